@@ -10,6 +10,8 @@
 
 #include "driver/gpio.h"
 #include "hal/gpio_hal.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "soc/gpio_sig_map.h"
@@ -18,6 +20,9 @@
 #include "esp_system.h"
 #include "esp_intr_alloc.h"
 
+#include "pulse_capture.h"
+#include "board_profile.h"
+
 #if CONFIG_IDF_TARGET_ESP32  
 
 #elif CONFIG_IDF_TARGET_ESP32S2
@@ -54,17 +59,21 @@
 #define MATRIX_DETACH_OUT_SIG       (0x100)
 #define MATRIX_DETACH_IN_LOW_PIN    (0x30)
 
+#define PIN_MODE_UNSET              (0xFF)
+
 
 // create a new ESP-IDF hardware abstraction layer
 // the HAL must inherit from the base RadioLibHal class
 // and implement all of its virtual methods
 // this is pretty much just copied from Arduino ESP32 core
-class EspHal2 : public RadioLibHal {
+// Board is a board_profile.h profile, the SPI pins and the RF chip select come from it as constants
+template<typename Board>
+class EspHal2T : public RadioLibHal {
   public:
     // default constructor - initializes the base HAL and any needed private members
-    EspHal2(int8_t sck, int8_t miso, int8_t mosi)
-      : RadioLibHal(INPUT, OUTPUT, LOW, HIGH, RISING, FALLING),
-      spiSCK(sck), spiMISO(miso), spiMOSI(mosi)  {
+    EspHal2T()
+      : RadioLibHal(INPUT, OUTPUT, LOW, HIGH, RISING, FALLING)  {
+        memset(pinModes, PIN_MODE_UNSET, sizeof(pinModes));
         gpio_install_isr_service((int)ESP_INTR_FLAG_IRAM);
     }
 
@@ -83,30 +92,49 @@ class EspHal2 : public RadioLibHal {
     // GPIO-related methods (pinMode, digitalWrite etc.) should check
     // RADIOLIB_NC as an alias for non-connected pins
     void pinMode(uint32_t pin, uint32_t mode) override {
-      if(pin == RADIOLIB_NC) {
+      if(pin == RADIOLIB_NC || pin >= GPIO_NUM_MAX) {
         return;
       }
 
-      gpio_hal_context_t gpiohal;
-      gpiohal.dev = GPIO_LL_GET_HW(GPIO_PORT_0);
+      // pulseIn() and RadioLib set modes again and again, only touch the hardware on a change
+      // (the cache assumes nothing outside this HAL reconfigures the radio pins)
+      if(pinModes[pin] == mode) {
+        return;
+      }
 
-      gpio_config_t conf = {
-        .pin_bit_mask = (1ULL<<pin),
-        .mode = (gpio_mode_t)mode,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = (gpio_int_type_t)gpiohal.dev->pin[pin].int_type,
-      };
-      gpio_config(&conf);
+      if(pinModes[pin] == PIN_MODE_UNSET) {
+        // first use, gpio_config() also routes the pad to the GPIO matrix
+        gpio_hal_context_t gpiohal;
+        gpiohal.dev = GPIO_LL_GET_HW(GPIO_PORT_0);
+
+        gpio_config_t conf = {
+          .pin_bit_mask = (1ULL<<pin),
+          .mode = (gpio_mode_t)mode,
+          .pull_up_en = GPIO_PULLUP_DISABLE,
+          .pull_down_en = GPIO_PULLDOWN_DISABLE,
+          .intr_type = (gpio_int_type_t)gpiohal.dev->pin[pin].int_type,
+        };
+        gpio_config(&conf);
+      } else {
+        gpio_set_direction((gpio_num_t)pin, (gpio_mode_t)mode);
+      }
+      pinModes[pin] = (uint8_t)mode;
       return;
     }
 
+    // straight to the output / input registers, gpio_set_level() and gpio_get_level() only add
+    // argument checks and a call on top of the same gpio_ll functions
     void digitalWrite(uint32_t pin, uint32_t value) override {
+      // RadioLib drops and raises CS around every register access, give it the constant pin path
+      if(pin == (uint32_t)Board::rfCs) {
+        writePin<(uint32_t)Board::rfCs>(value);
+        return;
+      }
       if(pin == RADIOLIB_NC) {
         return;
       }
 
-      gpio_set_level((gpio_num_t)pin, value);
+      gpio_ll_set_level(&GPIO, (gpio_num_t)pin, value);
     }
 
     uint32_t digitalRead(uint32_t pin) override {
@@ -114,7 +142,25 @@ class EspHal2 : public RadioLibHal {
         return(0);
       }
 
-      return(gpio_get_level((gpio_num_t)pin));
+      return(gpio_ll_get_level(&GPIO, (gpio_num_t)pin));
+    }
+
+    // compile time pin binding for code that knows its pins up front, the RADIOLIB_NC
+    // check and the low / high register bank choice fold away and the call inlines
+    template<uint32_t PIN> inline void writePin(uint32_t value) {
+      if constexpr (PIN != RADIOLIB_NC) {
+        static_assert(PIN < GPIO_NUM_MAX, "pin is not a GPIO on this chip");
+        gpio_ll_set_level(&GPIO, (gpio_num_t)PIN, value);
+      }
+    }
+
+    template<uint32_t PIN> inline uint32_t readPin() {
+      if constexpr (PIN != RADIOLIB_NC) {
+        static_assert(PIN < GPIO_NUM_MAX, "pin is not a GPIO on this chip");
+        return(gpio_ll_get_level(&GPIO, (gpio_num_t)PIN));
+      } else {
+        return(0);
+      }
     }
 
     void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override {
@@ -123,9 +169,9 @@ class EspHal2 : public RadioLibHal {
       }
       gpio_set_intr_type((gpio_num_t)interruptNum, (gpio_int_type_t)(mode & 0x7));
 
-      // this uses function typecasting, which is not defined when the functions have different signatures
-      // untested and might not work
-      gpio_isr_handler_add((gpio_num_t)interruptNum, (void (*)(void*))interruptCb, NULL);
+      // RadioLib callbacks are void(void) and the isr service calls void(void*), calling through
+      // a cast pointer is undefined, so the callback rides along as the argument instead
+      gpio_isr_handler_add((gpio_num_t)interruptNum, isrTrampoline, (void*)interruptCb);
       return;
     }
 
@@ -158,29 +204,27 @@ class EspHal2 : public RadioLibHal {
       return((unsigned long)(esp_timer_get_time()));
     }
 
+    // edges are timestamped by an interrupt while this task blocks, see pulse_capture.h
+    // Arduino contract: 0 on timeout, otherwise the next full pulse at state in us
     long pulseIn(uint32_t pin, uint32_t state, unsigned long timeout) override {
       if(pin == RADIOLIB_NC) {
         return(0);
       }
 
       this->pinMode(pin, INPUT);
-      uint32_t start = this->micros();
-      uint32_t curtick = this->micros();
 
-      while(this->digitalRead(pin) == state) {
-        if((this->micros() - curtick) > timeout) {
-          return(0);
-        }
+      uint32_t widthNs;
+      if(pulse_capture(pin, state, timeout, &widthNs) != 0) {
+        return(0);
       }
-
-      return(this->micros() - start);
+      return((long)((widthNs + 500) / 1000));
     }
 
     void spiBegin() {
         spi_bus_config_t buscfg = {};
-        buscfg.miso_io_num = spiMISO;
-        buscfg.mosi_io_num = spiMOSI;
-        buscfg.sclk_io_num = spiSCK;
+        buscfg.miso_io_num = Board::spiMiso;
+        buscfg.mosi_io_num = Board::spiMosi;
+        buscfg.sclk_io_num = Board::spiSck;
         buscfg.quadwp_io_num = -1;
         buscfg.quadhd_io_num = -1;
         buscfg.data4_io_num = -1;
@@ -200,7 +244,7 @@ class EspHal2 : public RadioLibHal {
         devcfg.mode = 0;
         devcfg.spics_io_num = -1; //ISSUE HERE???
         devcfg.queue_size = 1;
-        esp_err_t ret = spi_bus_add_device(SPI3_HOST, &devcfg, &spi);
+        esp_err_t ret = spi_bus_add_device(BOARD_SPI_HOST, &devcfg, &spi);
         if (ret != ESP_OK) {
             ESP_LOGE("SPI", "Failed to add SPI device: %s", esp_err_to_name(ret));
         }
@@ -240,18 +284,24 @@ class EspHal2 : public RadioLibHal {
 
     void spiEnd() {
       // detach pins
-      //spi_bus_free(SPI3_HOST);
+      //spi_bus_free(BOARD_SPI_HOST);
       return;
     }
 
   private:
+    // in IRAM like the isr service dispatching to it (ESP_INTR_FLAG_IRAM)
+    static void IRAM_ATTR isrTrampoline(void* arg) {
+      ((void (*)(void))arg)();
+    }
+
     // the HAL can contain any additional private members
-    int8_t spiSCK;
-    int8_t spiMISO;
-    int8_t spiMOSI;
     spi_device_handle_t spi;
+    uint8_t pinModes[GPIO_NUM_MAX];   // last mode set per pin, PIN_MODE_UNSET before the first
 };
 
+// the HAL for this board
+using EspHal2 = EspHal2T<board::Profile>;
+
 
 
 /*
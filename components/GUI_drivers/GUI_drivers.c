@@ -2,42 +2,61 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "sdkconfig.h"
+
 // including the FreeRTOS task libraries
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 // includes for adc drivers
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#endif
 #include "esp_log.h"
+#include "driver/gpio.h"
 
 
 // including custom driver code
+#include "board_profile.h"
 #include "rf_comms.h"
 #include "GUI_drivers.h"
 #include "sync_objects.h"
+#include "latency_stats.h"
+#include "dlog.h"
+#include "mem_budget.h"
+#include "msg_store.h"
+#include "msg_log.h"
 
 //including the u8g2 and u8g2_hal libs
 #include "u8g2.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "host_display.h"     // host build, frame buffer goes to a PBM file
+#else
 #include "u8g2_esp32_hal.h"
+#endif
 
-// Defines needed for u8g2 SPI communication
-#define SPI_MOSI_PIN    36 // was 35 // was 23
-#define SPI_MISO_PIN    -1
-#define SPI_SCK_PIN     35 // was 37 // was 18
-#define SPI_CS_PIN      42  // this if for DISPLAY only
-#define SPI_RESET_PIN   1  // this is for DISPLAY only 
+// Defines needed for u8g2 SPI communication, assigned in board_profile.h
+#define SPI_MOSI_PIN    BOARD_SPI_MOSI
+#define SPI_SCK_PIN     BOARD_SPI_SCK
+#define SPI_CS_PIN      BOARD_DISP_CS       // this if for DISPLAY only
+#define SPI_RESET_PIN   BOARD_DISP_RESET    // this is for DISPLAY only
 
-#define PIN_NUM_DC      2 // used to be 21
+#define PIN_NUM_DC      BOARD_DISP_DC
 
-#define DISP_BUTTON     48   // GPIO display button is connected to
+#define DISP_BUTTON     BOARD_DISP_BUTTON   // GPIO display button is connected to
 #define DEBOUNCE_DELAY  50  // delay in ms for debouncing check
 
 #define RADIOLIB_ERR_NONE 0 // define used to know if we got error from radio functions
 
 #define MSG_CHAR_LEN 256
+#define DISPLAY_QUEUE_LEN 10
+#define LINE_CHAR_LEN 20    // characters per display line in the 5x8 font
+#define HISTORY_TIMEOUT_MS 10000    // scrollback drops back to idle after this long without a press
+#define LOG_RETRY_MS 5000           // wait after a failed SD log write before the next try
 
+#if !CONFIG_IDF_TARGET_LINUX
 // Defines for battery capacity meaurment circuits
 #define ADC_UNIT        ADC_UNIT_1
 #define ADC_CHANNEL     ADC_CHANNEL_6
@@ -48,6 +67,8 @@ static adc_oneshot_unit_handle_t    adc_handle;
 static adc_cali_handle_t            adc_cali_handle;
 static bool cali_enabled = false;
 
+#endif
+
 #define BATTERY_MIN 3.0
 #define BATTERY_MAX 4.3
 
@@ -58,15 +79,24 @@ static bool cali_enabled = false;
 // making a u8g2 object for our main display
 static u8g2_t mainDisp;
 
-// define the queue from GUI_drivers.h
+// define the queue from GUI_drivers.h, storage is static so it can not fail at runtime
 QueueHandle_t displayQueue;
+static StaticQueue_t displayQueueBuf;
+static uint8_t displayQueueStorage[DISPLAY_QUEUE_LEN * sizeof(display_msg_package_t)];
 
 // variable for holding and update the measured battery capacity
 static float capacity;
 
+// last msg_store seq copied into the SD message log
+static uint32_t lastLogged = MSG_STORE_NO_SEQ;
+// the last write to the log failed at logFailTick, the next try waits LOG_RETRY_MS
+static bool logFailing = false;
+static TickType_t logFailTick;
+
 
 // ==== List of main wrapper functions editing display ========== //
 
+#if !CONFIG_IDF_TARGET_LINUX
 // init the ADC for measuring the battery voltag - TODO: IMPLEMENT BATTERY READING
 void init_adc()
 {
@@ -83,11 +113,27 @@ void init_adc()
     };
     ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, ADC_CHANNEL, &adc_channel_config));
 }
+#endif
+
+
+// push the frame buffer out to the panel, every draw ends up going through here
+static void disp_send_buffer(void)
+{
+    u8g2_SendBuffer(&mainDisp);
+
+#if CONFIG_IDF_TARGET_LINUX
+    host_display_flush(&mainDisp);
+#endif
+}
 
 
 // init the display - to be called on startup and used indefinitely
 esp_err_t init_display()
 {
+#if CONFIG_IDF_TARGET_LINUX
+    // no panel on the host, u8g2 still draws into the same frame buffer
+    u8g2_Setup_ssd1309_128x64_noname0_f(&mainDisp, U8G2_R2, u8g2_host_byte_cb, u8g2_host_gpio_and_delay_cb);
+#else
     //calling default hardware abstaction layer for esp32
     u8g2_esp32_hal_t u8g2_esp32_hal = U8G2_ESP32_HAL_DEFAULT;
 
@@ -103,9 +149,12 @@ esp_err_t init_display()
 
     // using noname0_f -> gives a full frame buffer with 10124 bytes
     u8g2_Setup_ssd1309_128x64_noname0_f(&mainDisp, U8G2_R2, u8g2_esp32_spi_byte_cb, u8g2_esp32_gpio_and_delay_cb);
+#endif
 
     // initing the queue and giving it a size of 10
-    displayQueue = xQueueCreate(10, sizeof(display_msg_package_t));
+    displayQueue = xQueueCreateStatic(DISPLAY_QUEUE_LEN, sizeof(display_msg_package_t), displayQueueStorage, &displayQueueBuf);
+    MEM_BUDGET_ADD(GUI_DRIVERS, mainDisp, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(GUI_DRIVERS, displayQueueStorage, MEM_REGION_DRAM);
 
     // calling init commands to turn on and clear display
     u8g2_InitDisplay(&mainDisp);
@@ -123,7 +172,7 @@ esp_err_t init_display()
 void clear_disp()
 {
     u8g2_ClearBuffer(&mainDisp);
-    u8g2_SendBuffer(&mainDisp);
+    disp_send_buffer();
 }
 
 
@@ -141,7 +190,7 @@ void display_main_hud(void)
     // draw small notification dot
     //u8g2_DrawDisc(&mainDisp, 124, 59, 2, U8G2_DRAW_ALL);
 
-    u8g2_SendBuffer(&mainDisp);
+    disp_send_buffer();
 }
 
 
@@ -152,7 +201,7 @@ void display_clear_msg_text()
     u8g2_SetDrawColor(&mainDisp, 0);
     u8g2_DrawBox(&mainDisp, 14, 10, 100, 80);
     // send editted buffer to display
-    u8g2_SendBuffer(&mainDisp);
+    disp_send_buffer();
 }
 
 
@@ -169,14 +218,14 @@ void display_update_notif()
         // code to add-in notif symbol from display
         u8g2_SetDrawColor(&mainDisp, 1);
         u8g2_DrawDisc(&mainDisp, 124, 59, 2, U8G2_DRAW_ALL);
-        u8g2_SendBuffer(&mainDisp);
+        disp_send_buffer();
         //u8g2_DrawStr(&mainDisp, 119, 59, (char)msgs );
     }
     else {
         // code to remove notif symbol from display
         u8g2_SetDrawColor(&mainDisp, 0);
         u8g2_DrawDisc(&mainDisp, 124, 59, 2, U8G2_DRAW_ALL);
-        u8g2_SendBuffer(&mainDisp);
+        disp_send_buffer();
         //u8g2_DrawStr(&mainDisp, 119, 59, "0" );
     }
 
@@ -218,7 +267,7 @@ void test_pixels()
         u8g2_DrawPixel(&mainDisp, 10, y);  // Draw a vertical line at x=10
     }
 
-    u8g2_SendBuffer(&mainDisp);  // Send the buffer to the display
+    disp_send_buffer();  // Send the buffer to the display
 }
 
 
@@ -240,7 +289,7 @@ void write_patient_info(display_msg_package_t* patientInfo)
     u8g2_DrawStr(&mainDisp, 14, 20+(1*10), patientInfo->l_name);
     u8g2_DrawStr(&mainDisp, 14, 20+(2*10), patientInfo->last_checkup_date);
     u8g2_DrawStr(&mainDisp, 14, 20+(3*10), patientInfo->last_checkup_time);
-    u8g2_SendBuffer(&mainDisp);
+    disp_send_buffer();
 
     // small delay before cleaing the information
     vTaskDelay(pdMS_TO_TICKS(5000));
@@ -262,7 +311,7 @@ void write_to_disp(const char* str)
         u8g2_SetFont(&mainDisp, u8g2_font_5x8_tr);
         u8g2_SetDrawColor(&mainDisp, 1);
 
-        const int line_char_len = 20;
+        const int line_char_len = LINE_CHAR_LEN;
         int currMsgLen = strlen(str);
         //printf("msg length: %d\n", currMsgLen);   // debug
 
@@ -273,23 +322,21 @@ void write_to_disp(const char* str)
 
             for (int i=0; i < splitLines; i++)
             {
-                char *substring = (char*)malloc( (line_char_len+1) * sizeof(char) );
-                if (substring == NULL) { printf("malloc failed here...\n"); return; }
+                char substring[LINE_CHAR_LEN + 1];
 
                 strncpy(substring, &str[i * line_char_len], line_char_len);
                 substring[line_char_len] = '\0';
 
-                printf("%s\n", substring);  // debug
+                DLOG(DISP_LINE, i, strlen(substring));  // debug
 
                 u8g2_DrawStr(&mainDisp, 14, (i*10) + 20 , substring);
-                free(substring);
             }
             // sending buffer after addding al lines to it
-            u8g2_SendBuffer(&mainDisp);
+            disp_send_buffer();
         }
         else {  //case of only one line needed
             u8g2_DrawStr(&mainDisp, 14, 20, str);
-            u8g2_SendBuffer(&mainDisp);
+            disp_send_buffer();
         }
 
         xSemaphoreGive(xMsgDisplaySem);
@@ -301,17 +348,90 @@ void write_to_disp(const char* str)
 
 
 
+// ==== Message history ========== //
+
+// copy pages that reached msg_store since the last call into the SD log, done from the display
+// task so the card writes never hold up the radio task
+static void history_log_new()
+{
+    if (!msg_log_is_open()) {
+        return;
+    }
+    // a card that is gone or full fails every write, not every 100 ms display pass
+    if (logFailing && (xTaskGetTickCount() - logFailTick) < pdMS_TO_TICKS(LOG_RETRY_MS)) {
+        return;
+    }
+
+    msg_store_hdr_t hdr;
+    char text[MSG_TEXT_LEN + 1];
+    uint32_t oldest = msg_store_oldest();
+    uint32_t newest = msg_store_newest();
+    uint32_t seq = lastLogged + 1;
+
+    // pages the store evicted before we got to them are gone
+    if ((int32_t)(seq - oldest) < 0) {
+        seq = oldest;
+    }
+    for (; (int32_t)(newest - seq) >= 0; seq++)
+    {
+        // a failed write is tried again from this page after LOG_RETRY_MS, if the store still has it
+        if (msg_store_get(seq, &hdr, text, sizeof(text)) == 0 && msg_log_append(&hdr, text) == MSG_STORE_NO_SEQ) {
+            logFailing = true;
+            logFailTick = xTaskGetTickCount();
+            return;
+        }
+        lastLogged = seq;
+    }
+    logFailing = false;
+}
+
+
+// history comes from the SD log when there is one, otherwise from what msg_store still holds
+static uint32_t history_oldest()
+{
+    return msg_log_is_open() ? msg_log_oldest() : msg_store_oldest();
+}
+
+static uint32_t history_newest()
+{
+    return msg_log_is_open() ? msg_log_newest() : msg_store_newest();
+}
+
+static bool history_has(uint32_t seq)
+{
+    uint32_t oldest = history_oldest();
+    return (seq - oldest) < (history_newest() + 1 - oldest);
+}
+
+static void history_show(uint32_t seq, char* text, size_t textCap)
+{
+    int ret = msg_log_is_open() ? msg_log_read(seq, NULL, text, textCap)
+                                : msg_store_get(seq, NULL, text, textCap);
+    if (ret != 0) {
+        snprintf(text, textCap, "(page %lu unreadable)", (unsigned long)seq);
+    }
+
+    display_clear_msg_text();
+    write_to_disp(text);
+}
+
+
 
 // Main display control loop to run in the task
 void displayLoop(void *params)
 {
-    char message[MSG_CHAR_LEN];    // buffer to take in the packets from RF module
+    rf_msg_t message;    // seq of the next page from the RF module, the text is in msg_store
+    char text[MSG_TEXT_LEN + 1];
     bool last_state = gpio_get_level(DISP_BUTTON);
+    uint32_t historySeq = MSG_STORE_NO_SEQ;     // page shown while scrolling back
+    TickType_t historyTick = 0;                 // when it was shown
 
     int processState = 0; 
     /* display loop state machine
         0 - idle,       - wait for message on queue     - go to 1
+                        - button with nothing queued    - go to 2
         1 - displaying, - look for button press         - go to 0
+        2 - history,    - button shows the page before  - go to 0 past the oldest page or on timeout
     */
 
     gpio_config_t io_config = {
@@ -327,6 +447,7 @@ void displayLoop(void *params)
     for(;;)
     {
         display_update_notif();     // check and update notif
+        history_log_new();          // new pages out to the SD log
         //display_update_battery();   // check and update battery
 
         bool current_state = gpio_get_level(DISP_BUTTON);
@@ -341,16 +462,37 @@ void displayLoop(void *params)
                 // get message from buffer and put it into message[] by reference
                 if ( xQueueReceive( xMsgBufferQueue, &message, portMAX_DELAY) == pdPASS)
                 {
-                    printf("pulled out the message from buffer: %s\n", message);
+                    uint32_t t_dequeued = latency_now();
+
+                    // only fails if the store wrapped past a page still on the queue
+                    if ( msg_store_get(message.seq, NULL, text, sizeof(text)) != 0 ) {
+                        snprintf(text, sizeof(text), "(page %lu lost)", (unsigned long)message.seq);
+                    }
+                    DLOG(DISP_MSG_PULLED, strlen(text));
+
                     // write the message to the display then clean the buffer after
-                    write_to_disp( message );
-                    memset(message, 0, sizeof(message));
+                    write_to_disp( text );
+                    uint32_t t_drawn = latency_now();
+
+                    latency_record(LAT_STAGE_QUEUED, message.lat.t_queued, t_dequeued);
+                    latency_record(LAT_STAGE_DRAW, t_dequeued, t_drawn);
+                    latency_record(LAT_STAGE_TOTAL, message.lat.t_read, t_drawn);
+
+                    memset(&message, 0, sizeof(message));
                 }
                 else {
                     printf("Could not get message from xMsgBufferQueue for some reason...\n");
                 }
                 processState = 1;   //change to next state
             }
+            // nothing new, scroll back from the newest page instead
+            else if ( (current_state == 0) && (last_state == 1) && history_has(history_newest()) )
+            {
+                historySeq = history_newest();
+                history_show(historySeq, text, sizeof(text));
+                historyTick = xTaskGetTickCount();
+                processState = 2;
+            }
         }
         else if (processState == 1)    // displaying message, waiting for next button input
         {
@@ -361,6 +503,21 @@ void displayLoop(void *params)
                 processState = 0;   // switching state back to idle
             }
         }
+        else if (processState == 2)    // scrolling back through history, one page per press
+        {
+            if ( (current_state == 0) && (last_state == 1) && history_has(historySeq - 1) )
+            {
+                historySeq--;
+                history_show(historySeq, text, sizeof(text));
+                historyTick = xTaskGetTickCount();
+            }
+            else if ( ((current_state == 0) && (last_state == 1)) ||
+                      (xTaskGetTickCount() - historyTick) >= pdMS_TO_TICKS(HISTORY_TIMEOUT_MS) )
+            {
+                display_clear_msg_text();
+                processState = 0;   // past the oldest page or left alone, back to idle
+            }
+        }
         
         last_state = current_state;     // for button state
 
@@ -7,18 +7,20 @@
 #include <string.h>
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
+#include "board_profile.h"
 
 
 // ==== Defines needed for SPI as well as other handles ===============
 #define RF_HOST    SPI2_HOST
 
-#define PIN_NUM_MISO 25
-#define PIN_NUM_MOSI 23
-#define PIN_NUM_CLK  19
-#define PIN_NUM_CS   22
-#define PIN_NUM_DC   21
-#define PIN_NUM_RST  18
-#define PIN_NUM_BCKL 5
+// the display pins from board_profile.h, the old ESP32 devkit numbers (25, 23, 22) do not exist on the S3
+#define PIN_NUM_MISO -1
+#define PIN_NUM_MOSI BOARD_SPI_MOSI
+#define PIN_NUM_CLK  BOARD_SPI_SCK
+#define PIN_NUM_CS   BOARD_DISP_CS
+#define PIN_NUM_DC   BOARD_DISP_DC
+#define PIN_NUM_RST  BOARD_DISP_RESET
+#define PIN_NUM_BCKL BOARD_DISP_BCKL
 
 spi_device_handle_t spi;
 
@@ -0,0 +1,243 @@
+#ifndef BOARD_PROFILE_H
+#define BOARD_PROFILE_H
+
+/*
+    - The one place pin and bus assignments live, everything else takes them from here
+    - C files use the BOARD_* macros, C++ gets the same numbers as constexpr members of
+      board::Profile, which the templated HAL classes are built on (EspHal2T<Board>)
+    - Including this from any C++ file runs the compile time checks at the bottom: every pin
+      exists on the ESP32-S3 and no two users claim the same pin unless they share a bus
+    - -1 means not connected
+*/
+
+
+// ==== SPI bus (SPI3), shared by the display and the RF69 ==== //
+#define BOARD_SPI_HOST          SPI3_HOST
+#define BOARD_SPI_SCK           35
+#define BOARD_SPI_MOSI          36
+#define BOARD_SPI_MISO          37      // only the RF69 drives it, the panel is write only
+
+// ==== Display (SSD1309 on u8g2) ==== //
+#define BOARD_DISP_CS           42
+#define BOARD_DISP_DC           2
+#define BOARD_DISP_RESET        1
+#define BOARD_DISP_BUTTON       48
+#define BOARD_DISP_BCKL         -1      // no backlight control on this panel
+
+// ==== RF69 in direct receive mode ==== //
+#define BOARD_RF_CS             21
+#define BOARD_RF_RESET          47
+#define BOARD_RF_DIO0           39
+#define BOARD_RF_DIO1           40      // DCLK, one rising edge per demodulated bit
+#define BOARD_RF_DIO2           41      // DATA
+
+// ==== Camera (DVP) ==== //
+#define BOARD_CAM_BUTTON        38
+#define BOARD_CAM_PWDN          -1
+#define BOARD_CAM_RESET         -1
+#define BOARD_CAM_XCLK          15
+#define BOARD_CAM_SIOD          4
+#define BOARD_CAM_SIOC          5
+#define BOARD_CAM_VSYNC         6
+#define BOARD_CAM_HREF          7
+#define BOARD_CAM_PCLK          13
+#define BOARD_CAM_Y9            16
+#define BOARD_CAM_Y8            17
+#define BOARD_CAM_Y7            18
+#define BOARD_CAM_Y6            12
+#define BOARD_CAM_Y5            10
+#define BOARD_CAM_Y4            8
+#define BOARD_CAM_Y3            9
+#define BOARD_CAM_Y2            11
+
+// ==== SD card (SDMMC) ==== //
+// what SDMMC_SLOT_CONFIG_DEFAULT() hands out on the S3, now spelled out
+#define BOARD_SD_CLK            14
+#define BOARD_SD_CMD            15
+#define BOARD_SD_D0             2
+// 4 bit bus once D1..D3 are wired, the S3 routes SDMMC through the GPIO matrix so any free pins do
+#define BOARD_SD_WIDTH          1
+#define BOARD_SD_D1             -1
+#define BOARD_SD_D2             -1
+#define BOARD_SD_D3             -1
+
+// ==== WiFi ==== //
+#define BOARD_WIFI_BUTTON       33      // reserved, nothing reads it yet
+
+// ==== Free ==== //
+#define BOARD_SPARE_GPIO        34      // nothing attached (no PSRAM on this module), benches drive it
+
+
+#if BOARD_SD_WIDTH != 1 && BOARD_SD_WIDTH != 4
+#error "board profile: BOARD_SD_WIDTH is 1 or 4"
+#endif
+#if BOARD_SD_WIDTH == 4 && (BOARD_SD_D1 < 0 || BOARD_SD_D2 < 0 || BOARD_SD_D3 < 0)
+#error "board profile: a 4 bit SD bus needs BOARD_SD_D1..D3"
+#endif
+
+
+#ifdef __cplusplus
+
+#include <stddef.h>
+
+// C++ even when a .cpp includes this inside its extern "C" block, templates can not have C linkage
+extern "C++" {
+
+namespace board {
+
+// who claims a pin, pins on the same shared bus may repeat
+enum Bus : int {
+    BUS_NONE = 0,
+    BUS_SPI3 = 1,
+};
+
+struct PinClaim {
+    int pin;
+    Bus bus;
+};
+
+struct S3Pager {
+    // spi bus
+    static constexpr int spiSck     = BOARD_SPI_SCK;
+    static constexpr int spiMosi    = BOARD_SPI_MOSI;
+    static constexpr int spiMiso    = BOARD_SPI_MISO;
+
+    // display
+    static constexpr int dispCs     = BOARD_DISP_CS;
+    static constexpr int dispDc     = BOARD_DISP_DC;
+    static constexpr int dispReset  = BOARD_DISP_RESET;
+    static constexpr int dispButton = BOARD_DISP_BUTTON;
+
+    // radio
+    static constexpr int rfCs       = BOARD_RF_CS;
+    static constexpr int rfReset    = BOARD_RF_RESET;
+    static constexpr int rfDio0     = BOARD_RF_DIO0;
+    static constexpr int rfDio1     = BOARD_RF_DIO1;
+    static constexpr int rfDio2     = BOARD_RF_DIO2;
+
+    // camera
+    static constexpr int camButton  = BOARD_CAM_BUTTON;
+    static constexpr int camXclk    = BOARD_CAM_XCLK;
+
+    // sd card
+    static constexpr int sdClk      = BOARD_SD_CLK;
+    static constexpr int sdCmd      = BOARD_SD_CMD;
+    static constexpr int sdD0       = BOARD_SD_D0;
+    static constexpr int sdWidth    = BOARD_SD_WIDTH;
+    static constexpr int sdD1       = BOARD_SD_D1;
+    static constexpr int sdD2       = BOARD_SD_D2;
+    static constexpr int sdD3       = BOARD_SD_D3;
+
+    static constexpr PinClaim claims[] = {
+        { BOARD_SPI_SCK, BUS_SPI3 }, { BOARD_SPI_MOSI, BUS_SPI3 }, { BOARD_SPI_MISO, BUS_SPI3 },
+
+        { BOARD_DISP_CS, BUS_NONE }, { BOARD_DISP_DC, BUS_NONE }, { BOARD_DISP_RESET, BUS_NONE },
+        { BOARD_DISP_BUTTON, BUS_NONE }, { BOARD_DISP_BCKL, BUS_NONE },
+
+        { BOARD_RF_CS, BUS_NONE }, { BOARD_RF_RESET, BUS_NONE }, { BOARD_RF_DIO0, BUS_NONE },
+        { BOARD_RF_DIO1, BUS_NONE }, { BOARD_RF_DIO2, BUS_NONE },
+
+        { BOARD_CAM_BUTTON, BUS_NONE }, { BOARD_CAM_PWDN, BUS_NONE }, { BOARD_CAM_RESET, BUS_NONE },
+        { BOARD_CAM_XCLK, BUS_NONE }, { BOARD_CAM_SIOD, BUS_NONE }, { BOARD_CAM_SIOC, BUS_NONE },
+        { BOARD_CAM_VSYNC, BUS_NONE }, { BOARD_CAM_HREF, BUS_NONE }, { BOARD_CAM_PCLK, BUS_NONE },
+        { BOARD_CAM_Y9, BUS_NONE }, { BOARD_CAM_Y8, BUS_NONE }, { BOARD_CAM_Y7, BUS_NONE },
+        { BOARD_CAM_Y6, BUS_NONE }, { BOARD_CAM_Y5, BUS_NONE }, { BOARD_CAM_Y4, BUS_NONE },
+        { BOARD_CAM_Y3, BUS_NONE }, { BOARD_CAM_Y2, BUS_NONE },
+
+        { BOARD_SD_CLK, BUS_NONE }, { BOARD_SD_CMD, BUS_NONE }, { BOARD_SD_D0, BUS_NONE },
+        { BOARD_SD_D1, BUS_NONE }, { BOARD_SD_D2, BUS_NONE }, { BOARD_SD_D3, BUS_NONE },
+
+        { BOARD_WIFI_BUTTON, BUS_NONE }, { BOARD_SPARE_GPIO, BUS_NONE },
+    };
+
+    // clashes that exist on the current wiring and are tolerated until the hardware is respun,
+    // a new clash anywhere else fails the build, and so does a fixed one left on this list
+    //  - 15: SD CMD vs camera XCLK
+    //  - 2:  SD D0 vs display DC
+    static constexpr int knownClashes[] = { BOARD_SD_CMD, BOARD_SD_D0 };
+};
+
+using Profile = S3Pager;
+
+
+// ==== Compile time checks ==== //
+
+// GPIO 22..25 are not bonded out on the S3
+constexpr bool gpio_exists(int pin)
+{
+    return pin == -1 || (pin >= 0 && pin <= 21) || (pin >= 26 && pin <= 48);
+}
+
+template<size_t N>
+constexpr bool all_exist(const PinClaim (&claims)[N])
+{
+    for (size_t i = 0; i < N; i++) {
+        if (!gpio_exists(claims[i].pin)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<size_t N>
+constexpr bool clashes_at(const PinClaim (&claims)[N], int pin)
+{
+    int users = 0;
+    Bus bus = BUS_NONE;
+    for (size_t i = 0; i < N; i++)
+    {
+        if (claims[i].pin != pin) {
+            continue;
+        }
+        if (users > 0 && (bus == BUS_NONE || claims[i].bus != bus)) {
+            return true;
+        }
+        bus = claims[i].bus;
+        users++;
+    }
+    return false;
+}
+
+template<size_t N, size_t K>
+constexpr bool only_known_clashes(const PinClaim (&claims)[N], const int (&known)[K])
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        if (claims[i].pin == -1 || !clashes_at(claims, claims[i].pin)) {
+            continue;
+        }
+        bool listed = false;
+        for (size_t k = 0; k < K; k++) {
+            listed = listed || (known[k] == claims[i].pin);
+        }
+        if (!listed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<size_t N, size_t K>
+constexpr bool known_still_clash(const PinClaim (&claims)[N], const int (&known)[K])
+{
+    for (size_t k = 0; k < K; k++) {
+        if (!clashes_at(claims, known[k])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(all_exist(Profile::claims), "board profile: a pin is not a GPIO on the ESP32-S3");
+static_assert(only_known_clashes(Profile::claims, Profile::knownClashes),
+              "board profile: two users claim the same pin");
+static_assert(known_still_clash(Profile::claims, Profile::knownClashes),
+              "board profile: a clash on knownClashes is gone, take it off the list");
+
+} // namespace board
+
+} // extern "C++"
+
+#endif // __cplusplus
+
+#endif // BOARD_PROFILE_H
@@ -7,39 +7,52 @@
 // gpio and driver includes
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "sdkconfig.h"
 #include "driver/gpio.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "driver/spi_master.h"
+#endif
 
 //esp camera libraries
 #include "camera.h"
 #include "esp_camera.h"
 
+#include "board_profile.h"
 #include "GUI_drivers.h"
 #include "wifi_comms.h"
+#include "dlog.h"
+#include "cap_archive.h"
+#include "patient_cache.h"
+#include "esp_timer.h"
+#include "qr_decode.h"
+#include "mem_budget.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_jpg_decode.h"
+#endif
 
 
 // ==== Defines For Camera ================================
 
-#define CAM_BUTTON   38
+#define CAM_BUTTON       BOARD_CAM_BUTTON
 
-// defines for esp32s3 specifically
-#define PWDN_GPIO_NUM    -1
-#define RESET_GPIO_NUM   -1
-#define XCLK_GPIO_NUM    15
-#define SIOD_GPIO_NUM    4
-#define SIOC_GPIO_NUM    5
-#define VSYNC_GPIO_NUM   6
-#define HREF_GPIO_NUM    7
-#define PCLK_GPIO_NUM    13
+// pins are assigned in board_profile.h
+#define PWDN_GPIO_NUM    BOARD_CAM_PWDN
+#define RESET_GPIO_NUM   BOARD_CAM_RESET
+#define XCLK_GPIO_NUM    BOARD_CAM_XCLK
+#define SIOD_GPIO_NUM    BOARD_CAM_SIOD
+#define SIOC_GPIO_NUM    BOARD_CAM_SIOC
+#define VSYNC_GPIO_NUM   BOARD_CAM_VSYNC
+#define HREF_GPIO_NUM    BOARD_CAM_HREF
+#define PCLK_GPIO_NUM    BOARD_CAM_PCLK
 
-#define Y9_GPIO_NUM      16
-#define Y8_GPIO_NUM      17
-#define Y7_GPIO_NUM      18
-#define Y6_GPIO_NUM      12
-#define Y5_GPIO_NUM      10
-#define Y4_GPIO_NUM      8
-#define Y3_GPIO_NUM      9
-#define Y2_GPIO_NUM      11
+#define Y9_GPIO_NUM      BOARD_CAM_Y9
+#define Y8_GPIO_NUM      BOARD_CAM_Y8
+#define Y7_GPIO_NUM      BOARD_CAM_Y7
+#define Y6_GPIO_NUM      BOARD_CAM_Y6
+#define Y5_GPIO_NUM      BOARD_CAM_Y5
+#define Y4_GPIO_NUM      BOARD_CAM_Y4
+#define Y3_GPIO_NUM      BOARD_CAM_Y3
+#define Y2_GPIO_NUM      BOARD_CAM_Y2
 
 
 
@@ -49,6 +62,22 @@
 // static frame buffer for us work with and reuse
 static camera_fb_t *pic;
 
+#if !CONFIG_IDF_TARGET_LINUX
+// the frame in gray at a quarter of VGA, and the decoder state; 19 KiB of internal RAM next to the
+// two DRAM frame buffers and the WiFi heap (half size would be 75 KiB). A band has to fill about
+// half the frame to get 3 pixels per module
+#define QR_IMAGE_W      (QR_DECODE_MAX_W / 2)
+#define QR_IMAGE_H      (QR_DECODE_MAX_H / 2)
+static MEM_BULK_ATTR uint8_t s_qrImage[QR_IMAGE_W * QR_IMAGE_H];
+static qr_decoder_t s_qr;
+
+typedef struct {
+    const camera_fb_t* fb;
+    int width;      // of s_qrImage as filled, multiples of 8
+    int height;
+} qr_jpeg_t;
+#endif
+
 // pre-defined settings for our camera
 static camera_config_t camera_config = {
 
@@ -136,6 +165,11 @@ static camera_config_t camera_config = {
 esp_err_t init_camera()
 {   
 
+#if !CONFIG_IDF_TARGET_LINUX
+    MEM_BUDGET_ADD(CAMERA, s_qrImage, MEM_BULK_REGION);
+    MEM_BUDGET_ADD(CAMERA, s_qr, MEM_REGION_DRAM);
+#endif
+
     // initing camera hardware with our config
     esp_err_t err = esp_camera_init(&camera_config);
 
@@ -175,7 +209,7 @@ esp_err_t take_picture()
     }
 
     // debug prompt
-    printf("get_picture(): taking picture now\n");
+    DLOG(CAM_CAPTURE_START);
 
     // attemping to capture a photo in the fb
     pic = esp_camera_fb_get();
@@ -186,7 +220,7 @@ esp_err_t take_picture()
         printf("get_picture(): Capture failed!\n");
         return ESP_FAIL;
     }
-    printf("picture taken!, lenght of %zu bytes!\n", pic->len);
+    DLOG(CAM_CAPTURE_DONE, pic->len);
 
     vTaskDelay(1000 / portTICK_PERIOD_MS);
     return ESP_OK;
@@ -194,6 +228,72 @@ esp_err_t take_picture()
 
 
 
+#if !CONFIG_IDF_TARGET_LINUX
+// JPEG decoder input straight out of the frame buffer, a NULL buf only skips
+static size_t qr_jpeg_read(void* arg, size_t index, uint8_t* buf, size_t len)
+{
+    const qr_jpeg_t* j = arg;
+    if (buf) {
+        memcpy(buf, j->fb->buf + index, len);
+    }
+    return len;
+}
+
+
+// each decoded block (RGB888, already scaled) to gray; a NULL block marks the start and the end
+static bool qr_jpeg_write(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data)
+{
+    const qr_jpeg_t* j = arg;
+    if (!data) {
+        return true;
+    }
+    for (int row = 0; row < h && y + row < j->height; row++)
+    {
+        const uint8_t* rgb = data + (size_t)row * w * 3;
+        uint8_t* gray = &s_qrImage[(y + row) * j->width + x];
+        for (int col = 0; col < w && x + col < j->width; col++, rgb += 3) {
+            gray[col] = (uint8_t)((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8);
+        }
+    }
+    return true;
+}
+#endif
+
+
+// read the wristband's QR code off the frame: decoded to gray at quarter size (160 x 120 from VGA)
+// and searched there, the id goes to the patient cache and the upload; the host
+// build reads the payload from a .qr file per frame
+bool camera_read_qr(const camera_fb_t* fb, char* out, size_t cap)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    (void)fb;
+    return host_camera_qr_payload(out, cap);
+#else
+    // the smallest scale down that fits, the decoder wants both sides in whole 8 pixel blocks
+    int scale = JPG_SCALE_NONE;
+    while (scale < JPG_SCALE_MAX && ((fb->width >> scale) > QR_IMAGE_W || (fb->height >> scale) > QR_IMAGE_H)) {
+        scale++;
+    }
+    qr_jpeg_t j = { .fb = fb, .width = (fb->width >> scale) & ~7, .height = (fb->height >> scale) & ~7 };
+    if (fb->format != PIXFORMAT_JPEG || j.width > QR_IMAGE_W || j.height > QR_IMAGE_H) {
+        return false;
+    }
+
+    int64_t startUs = esp_timer_get_time();
+    if (esp_jpg_decode(fb->len, (jpg_scale_t)scale, qr_jpeg_read, qr_jpeg_write, &j) != ESP_OK)
+    {
+        printf("camera_read_qr(): Could not decode the frame\n");
+        return false;
+    }
+    qr_decode_status_t st = qr_decode(&s_qr, s_qrImage, j.width, j.height, out, cap, NULL);
+    printf("camera_read_qr(): %s in %lld ms (status %d)\n", (st == QR_DECODE_OK) ? "read" : "no code",
+           (long long)((esp_timer_get_time() - startUs) / 1000), (int)st);
+    return st == QR_DECODE_OK;
+#endif
+}
+
+
+
 // Task to be used for polling the wifi button press and starting camera operations
 void camera_button_poll(void* params)
 {
@@ -215,6 +315,9 @@ void camera_button_poll(void* params)
 
         if ( currentState == 0 && lastState == 1 )
         {
+            // scan to display latency counts from the press
+            int64_t scanStartUs = esp_timer_get_time();
+
             // prmpt user for image capture
             write_to_disp_temp("Capturing photo...", 1);
 
@@ -222,9 +325,16 @@ void camera_button_poll(void* params)
             if (take_picture() == ESP_OK) {
 
                 camera_fb_t *pic = get_fb();    // getting frame buffer after successful image capture
+
+                // keep a copy on the card when there is one, before the buffer goes back to the driver
+                if (cap_archive_is_open() && cap_archive_append(pic->buf, pic->len) == CAP_ARCHIVE_NO_SEQ) {
+                    printf("Could not archive the capture...\n");
+                }
                 
-                // attempting to send image to server for response
-                esp_err_t state = send_image_to_server(pic);
+                // a band seen recently is shown from the patient cache, anything else goes to the server
+                char qrId[PATIENT_ID_LEN];
+                bool haveId = camera_read_qr(pic, qrId, sizeof(qrId));
+                esp_err_t state = lookup_patient(pic, haveId ? qrId : NULL, scanStartUs);
                 if (state == ESP_OK) {
                     printf("HTTP transmission success!\n");
                 }
@@ -1,9 +1,13 @@
+#include <stdbool.h>
 #include "esp_camera.h"
 
 esp_err_t init_camera();
 camera_fb_t* get_fb();
 esp_err_t take_picture();
 
+// payload of the QR code in the frame (the patient id on the band), false when none was read
+bool camera_read_qr(const camera_fb_t* fb, char* out, size_t cap);
+
 // main task function
 void camera_task( void *param );
 void camera_button_poll(void* params);
\ No newline at end of file
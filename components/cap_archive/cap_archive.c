@@ -0,0 +1,842 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+
+#include "cap_archive.h"
+#include "sd_card.h"
+#include "sd_writer.h"
+#include "sd_async.h"
+#include "mem_budget.h"
+
+
+#define SEG_SECTORS         (CAP_ARCHIVE_SEGMENT_BYTES / SD_SECTOR)
+#define INDEX_SECTORS       ((CAP_ARCHIVE_MAX_RECORDS * 4 + SD_SECTOR - 1) / SD_SECTOR)
+#define FOOTER_SECTOR       (SEG_SECTORS - 1)
+#define INDEX_SECTOR        (FOOTER_SECTOR - INDEX_SECTORS)
+#define DATA_END            INDEX_SECTOR        // first sector records may not use
+#define REC_HDR_BYTES       32
+#define REC_FIRST_BYTES     (SD_SECTOR - REC_HDR_BYTES)     // data that shares the header's sector
+#define SEG_VERSION         1
+#define ARCHIVE_DIR_LEN     64
+#define ARCHIVE_PATH_LEN    (ARCHIVE_DIR_LEN + 24)
+
+#if CAP_ARCHIVE_SEGMENT_BYTES % SD_SECTOR != 0
+#error CAP_ARCHIVE_SEGMENT_BYTES must be a whole number of sectors
+#endif
+#if SEG_SECTORS > 65536
+#error record sectors are kept as 16 bit numbers
+#endif
+
+/*
+    on the card, little endian
+    segment header, sector 0:   "CAPS", version, 3 x 0, segment id, first seq, CRC32 of bytes 0-15
+    record header:              "CREC", seq, length, time ms, CRC32 of the data, 8 x 0, CRC32 of bytes 0-27
+    index, INDEX_SECTORS:       first sector of each record, 4 bytes each
+    footer, last sector:        "CIDX", record count, index sector, CRC32 of the index, CRC32 of bytes 0-15
+*/
+
+typedef struct {
+    uint32_t id;
+    uint32_t firstSeq;
+    uint32_t count;
+} seg_t;
+
+typedef struct {
+    char        dir[ARCHIVE_DIR_LEN];
+    bool        open;
+    int         fd;                                     // segment being appended to, -1 if none
+    bool        prealloc;                               // it has its full size, writes into it leave the FAT alone
+    bool        async;                                  // records go through the background writer
+    int         stream;                                 // writer stream into the open segment, -1 if none
+    volatile uint32_t failedSeq;                        // first record the writer could not get onto the card
+    seg_t       segs[CAP_ARCHIVE_MAX_SEGMENTS];         // oldest first
+    uint32_t    segCount;
+    uint16_t    recSector[CAP_ARCHIVE_MAX_RECORDS];     // first sector of each record in the open segment
+    uint32_t    nextSector;
+    uint32_t    nextSeq;
+    uint8_t     sector[SD_SECTOR] __attribute__((aligned(4)));  // DMA capable scratch
+    cap_archive_stats_t stats;
+} archive_t;
+
+static const char* TAG = "CAP_ARCHIVE";
+
+static archive_t s_archive = { .fd = -1, .stream = -1 };
+
+// the writer has let go of the archive's stream
+static SemaphoreHandle_t s_drained;
+static StaticSemaphore_t s_drainedBuf;
+
+
+// ==== Helpers ============================================================== //
+
+static inline uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t crc32(const void* data, size_t len)
+{
+    return esp_rom_crc32_le(0, data, len);
+}
+
+static inline uint32_t rec_sectors(size_t len)
+{
+    return (uint32_t)((REC_HDR_BYTES + len + SD_SECTOR - 1) / SD_SECTOR);
+}
+
+static void seg_path(const archive_t* ar, uint32_t id, char* path)
+{
+    snprintf(path, ARCHIVE_PATH_LEN, "%s/cap%05lu.bin", ar->dir, (unsigned long)id);  // 8.3 names only
+}
+
+
+static esp_err_t sector_write(archive_t* ar, int fd, const void* buf, size_t sectors, uint32_t at)
+{
+    size_t n = sectors * SD_SECTOR;
+    if (pwrite(fd, buf, n, (off_t)at * SD_SECTOR) != (ssize_t)n) {
+        return ESP_FAIL;
+    }
+    ar->stats.written_bytes += n;
+    return ESP_OK;
+}
+
+
+static bool sector_read(int fd, void* buf, size_t n, uint32_t at, size_t skip)
+{
+    return pread(fd, buf, n, (off_t)at * SD_SECTOR + (off_t)skip) == (ssize_t)n;
+}
+
+
+// a record header in s is good and is record seq
+static bool rec_hdr_valid(const uint8_t* s, uint32_t seq)
+{
+    return memcmp(s, "CREC", 4) == 0 && get_u32(&s[28]) == crc32(s, 28) && get_u32(&s[4]) == seq &&
+           rec_sectors(get_u32(&s[8])) <= DATA_END - 1;
+}
+
+
+// ==== Background writer ==================================================== //
+
+// both run on the writer task, only the live archive writes through it
+static void rec_durable(void* ctx, esp_err_t err)
+{
+    if (err != ESP_OK && s_archive.failedSeq == CAP_ARCHIVE_NO_SEQ) {
+        s_archive.failedSeq = (uint32_t)(uintptr_t)ctx;
+    }
+}
+
+
+static void stream_closed(void* ctx, esp_err_t err)
+{
+    xSemaphoreGive(s_drained);
+}
+
+
+// ==== Segments ============================================================= //
+
+static void seg_seal(archive_t* ar, int fd, uint32_t count)
+{
+    // index: the record table, one sector at a time through the DMA scratch
+    uint32_t indexCrc = 0;
+    for (uint32_t i = 0; i < INDEX_SECTORS; i++)
+    {
+        memset(ar->sector, 0, SD_SECTOR);
+        for (uint32_t k = 0; k < SD_SECTOR / 4; k++)
+        {
+            uint32_t r = i * (SD_SECTOR / 4) + k;
+            if (r < count) {
+                put_u32(&ar->sector[k * 4], ar->recSector[r]);
+            }
+        }
+        indexCrc = esp_rom_crc32_le(indexCrc, ar->sector, SD_SECTOR);
+        sector_write(ar, fd, ar->sector, 1, INDEX_SECTOR + i);
+    }
+
+    memset(ar->sector, 0, SD_SECTOR);
+    memcpy(ar->sector, "CIDX", 4);
+    put_u32(&ar->sector[4], count);
+    put_u32(&ar->sector[8], INDEX_SECTOR);
+    put_u32(&ar->sector[12], indexCrc);
+    put_u32(&ar->sector[16], crc32(ar->sector, 16));
+    sector_write(ar, fd, ar->sector, 1, FOOTER_SECTOR);
+    fsync(fd);
+
+    ar->stats.sealed++;
+}
+
+
+// record count from a valid footer, -1 if the segment was never sealed
+static int seg_footer_count(archive_t* ar, int fd)
+{
+    uint8_t* s = ar->sector;
+    if (!sector_read(fd, s, SD_SECTOR, FOOTER_SECTOR, 0) || memcmp(s, "CIDX", 4) != 0 ||
+        get_u32(&s[16]) != crc32(s, 16) || get_u32(&s[4]) > CAP_ARCHIVE_MAX_RECORDS) {
+        return -1;
+    }
+    return (int)get_u32(&s[4]);
+}
+
+
+// walk the records of an unsealed segment into recSector, stopping at the first bad one
+static uint32_t seg_recover(archive_t* ar, int fd, uint32_t firstSeq)
+{
+    uint32_t count = 0;
+    uint32_t at = 1;
+
+    while (count < CAP_ARCHIVE_MAX_RECORDS && at < DATA_END)
+    {
+        uint8_t* s = ar->sector;
+        if (!sector_read(fd, s, SD_SECTOR, at, 0) || !rec_hdr_valid(s, firstSeq + count)) {
+            break;
+        }
+
+        uint32_t len = get_u32(&s[8]);
+        uint32_t want = get_u32(&s[16]);
+        uint32_t need = rec_sectors(len);
+        if (at + need > DATA_END) {
+            break;
+        }
+
+        // the data CRC, reading the rest of the record a sector at a time
+        uint32_t first = (len < REC_FIRST_BYTES) ? len : REC_FIRST_BYTES;
+        uint32_t crc = esp_rom_crc32_le(0, &s[REC_HDR_BYTES], first);
+        bool ok = true;
+        for (uint32_t done = first, k = 1; ok && done < len; k++)
+        {
+            uint32_t n = (len - done < SD_SECTOR) ? len - done : SD_SECTOR;
+            ok = sector_read(fd, s, n, at + k, 0);
+            crc = esp_rom_crc32_le(crc, s, n);
+            done += n;
+        }
+        if (!ok || crc != want) {
+            break;
+        }
+
+        ar->recSector[count++] = (uint16_t)at;
+        at += need;
+    }
+
+    ar->nextSector = at;
+    return count;
+}
+
+
+static esp_err_t seg_begin(archive_t* ar)
+{
+    char path[ARCHIVE_PATH_LEN];
+
+    // the oldest segment makes room
+    if (ar->segCount == CAP_ARCHIVE_MAX_SEGMENTS)
+    {
+        seg_path(ar, ar->segs[0].id, path);
+        unlink(path);
+        memmove(&ar->segs[0], &ar->segs[1], (CAP_ARCHIVE_MAX_SEGMENTS - 1) * sizeof(seg_t));
+        ar->segCount--;
+    }
+
+    uint32_t id = (ar->segCount > 0) ? ar->segs[ar->segCount - 1].id + 1 : 0;
+    seg_path(ar, id, path);
+
+    // all clusters up front, appends never touch the FAT again
+    ar->prealloc = (sd_writer_preallocate(path, CAP_ARCHIVE_SEGMENT_BYTES) == ESP_OK);
+    if (!ar->prealloc) {
+        ESP_LOGW(TAG, "%s not preallocated", path);
+    }
+    ar->fd = open(path, O_RDWR | O_CREAT | (ar->prealloc ? 0 : O_TRUNC), 0644);
+    if (ar->fd < 0)
+    {
+        ESP_LOGE(TAG, "could not create %s", path);
+        return ESP_FAIL;
+    }
+
+    memset(ar->sector, 0, SD_SECTOR);
+    memcpy(ar->sector, "CAPS", 4);
+    ar->sector[4] = SEG_VERSION;
+    put_u32(&ar->sector[8], id);
+    put_u32(&ar->sector[12], ar->nextSeq);
+    put_u32(&ar->sector[16], crc32(ar->sector, 16));
+    if (sector_write(ar, ar->fd, ar->sector, 1, 0) != ESP_OK)
+    {
+        close(ar->fd);
+        ar->fd = -1;
+        return ESP_FAIL;
+    }
+
+    ar->segs[ar->segCount++] = (seg_t){ .id = id, .firstSeq = ar->nextSeq, .count = 0 };
+    ar->nextSector = 1;
+    return ESP_OK;
+}
+
+
+// ==== Archive internals, no locking ======================================== //
+
+// wait until the writer has every queued record on the card and has closed its stream; from the
+// first record that did not make it on, the segment is cut off and sealed, the next append starts
+// a new one
+static void archive_drain(archive_t* ar)
+{
+    if (ar->stream < 0) {
+        return;
+    }
+    if (sd_async_close(ar->stream, stream_closed, NULL) == ESP_OK) {
+        xSemaphoreTake(s_drained, portMAX_DELAY);
+    }
+    ar->stream = -1;
+
+    // the stream grew a segment that was not preallocated, our fd still has the old size and
+    // cluster chain and would write the FAT from them
+    if (!ar->prealloc && ar->fd >= 0)
+    {
+        char path[ARCHIVE_PATH_LEN];
+        seg_path(ar, ar->segs[ar->segCount - 1].id, path);
+        close(ar->fd);
+        ar->fd = open(path, O_RDWR);
+        if (ar->fd < 0) {
+            // the next append starts a new segment, this one is sealed when the archive is next opened
+            ESP_LOGE(TAG, "could not reopen %s", path);
+        }
+    }
+
+    uint32_t failed = ar->failedSeq;
+    if (failed == CAP_ARCHIVE_NO_SEQ) {
+        return;
+    }
+    seg_t* seg = &ar->segs[ar->segCount - 1];
+    ESP_LOGE(TAG, "seq %lu..%lu did not reach the card", (unsigned long)failed, (unsigned long)(ar->nextSeq - 1));
+    ar->stats.lost += ar->nextSeq - failed;
+    seg->count = failed - seg->firstSeq;
+    if (ar->fd >= 0)
+    {
+        seg_seal(ar, ar->fd, seg->count);
+        close(ar->fd);
+    }
+    ar->fd = -1;
+    ar->failedSeq = CAP_ARCHIVE_NO_SEQ;
+}
+
+
+static void archive_close(archive_t* ar)
+{
+    archive_drain(ar);
+    if (ar->fd >= 0) {
+        close(ar->fd);
+    }
+    ar->fd = -1;
+    ar->open = false;
+}
+
+
+// keep the CAP_ARCHIVE_MAX_SEGMENTS newest ids, sorted oldest first
+static void archive_add_id(archive_t* ar, uint32_t id)
+{
+    if (ar->segCount == CAP_ARCHIVE_MAX_SEGMENTS)
+    {
+        if (id < ar->segs[0].id) {
+            return;
+        }
+        memmove(&ar->segs[0], &ar->segs[1], (CAP_ARCHIVE_MAX_SEGMENTS - 1) * sizeof(seg_t));
+        ar->segCount--;
+    }
+
+    uint32_t i = ar->segCount++;
+    while (i > 0 && ar->segs[i - 1].id > id)
+    {
+        ar->segs[i] = ar->segs[i - 1];
+        i--;
+    }
+    ar->segs[i] = (seg_t){ .id = id };
+}
+
+
+static esp_err_t archive_open(archive_t* ar, const char* dir)
+{
+    memset(ar, 0, sizeof(*ar));
+    ar->fd = -1;
+    ar->stream = -1;
+    ar->nextSeq = 1;
+    snprintf(ar->dir, sizeof(ar->dir), "%s", dir);
+
+    DIR* d = opendir(dir);
+    if (d == NULL)
+    {
+        ESP_LOGE(TAG, "could not open %s", dir);
+        return ESP_FAIL;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL)
+    {
+        // FAT without long names hands them back in upper case
+        if (strlen(e->d_name) == 12 && strncasecmp(e->d_name, "cap", 3) == 0 &&
+            strcasecmp(&e->d_name[8], ".bin") == 0) {
+            archive_add_id(ar, (uint32_t)strtoul(&e->d_name[3], NULL, 10));
+        }
+    }
+    closedir(d);
+
+    int64_t t0 = esp_timer_get_time();
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < ar->segCount; i++)
+    {
+        seg_t seg = ar->segs[i];
+        bool last = (i == ar->segCount - 1);
+        char path[ARCHIVE_PATH_LEN];
+        seg_path(ar, seg.id, path);
+
+        int fd = open(path, O_RDWR);
+        uint8_t* s = ar->sector;
+        if (fd < 0 || !sector_read(fd, s, SD_SECTOR, 0, 0) || memcmp(s, "CAPS", 4) != 0 ||
+            get_u32(&s[16]) != crc32(s, 16))
+        {
+            // created but never written, nothing in it
+            ESP_LOGW(TAG, "%s has no header, skipped", path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        seg.firstSeq = get_u32(&s[12]);
+
+        int count = seg_footer_count(ar, fd);
+        if (count >= 0) {
+            seg.count = (uint32_t)count;
+            close(fd);
+        }
+        else
+        {
+            seg.count = seg_recover(ar, fd, seg.firstSeq);
+            ar->stats.recovered = seg.count;
+            if (last)
+            {
+                struct stat st;
+                ar->fd = fd;            // carry on appending behind the last good record
+                ar->prealloc = (fstat(fd, &st) == 0 && st.st_size >= CAP_ARCHIVE_SEGMENT_BYTES);
+            }
+            else
+            {
+                seg_seal(ar, fd, seg.count);    // cut short by a crash before it was sealed
+                close(fd);
+            }
+        }
+
+        ar->segs[kept++] = seg;
+        ar->nextSeq = seg.firstSeq + seg.count;
+    }
+    ar->segCount = kept;
+    ar->stats.recover_us = (uint32_t)(esp_timer_get_time() - t0);
+    ar->open = true;
+    return ESP_OK;
+}
+
+
+// record sectors into the open segment at at, queued when the writer has a stream into it
+static esp_err_t rec_write(archive_t* ar, const void* buf, size_t sectors, uint32_t at)
+{
+    if (ar->stream < 0) {
+        return sector_write(ar, ar->fd, buf, sectors, at);
+    }
+    ar->stats.written_bytes += sectors * SD_SECTOR;
+    return sd_async_write(ar->stream, buf, sectors * SD_SECTOR, NULL, NULL);
+}
+
+
+static uint32_t archive_append(archive_t* ar, const uint8_t* data, size_t len, uint32_t timeMs)
+{
+    uint32_t need = rec_sectors(len);
+    if (!ar->open || need > DATA_END - 1) {
+        return CAP_ARCHIVE_NO_SEQ;
+    }
+    int64_t t0 = esp_timer_get_time();
+
+    // a record the writer lost ends its segment
+    if (ar->failedSeq != CAP_ARCHIVE_NO_SEQ) {
+        archive_drain(ar);
+    }
+
+    seg_t* seg = (ar->fd >= 0) ? &ar->segs[ar->segCount - 1] : NULL;
+    if (seg != NULL && (seg->count == CAP_ARCHIVE_MAX_RECORDS || ar->nextSector + need > DATA_END))
+    {
+        archive_drain(ar);
+        if (ar->fd >= 0)
+        {
+            seg_seal(ar, ar->fd, seg->count);
+            close(ar->fd);
+            ar->fd = -1;
+        }
+    }
+    if (ar->fd < 0)
+    {
+        if (seg_begin(ar) != ESP_OK) {
+            return CAP_ARCHIVE_NO_SEQ;
+        }
+    }
+    seg = &ar->segs[ar->segCount - 1];
+
+    // the camera task only waits for a free writer buffer, the record is copied into them
+    if (ar->async && ar->stream < 0)
+    {
+        // the header and directory entry settled on the card before a second fd writes into it
+        char path[ARCHIVE_PATH_LEN];
+        seg_path(ar, seg->id, path);
+        fsync(ar->fd);
+        ar->stream = sd_async_open_at(path, (uint64_t)ar->nextSector * SD_SECTOR);
+    }
+
+    // header sector, with as much data as fits behind the header
+    uint32_t first = (len < REC_FIRST_BYTES) ? len : REC_FIRST_BYTES;
+    memset(ar->sector, 0, SD_SECTOR);
+    memcpy(ar->sector, "CREC", 4);
+    put_u32(&ar->sector[4], ar->nextSeq);
+    put_u32(&ar->sector[8], len);
+    put_u32(&ar->sector[12], timeMs);
+    put_u32(&ar->sector[16], crc32(data, len));
+    put_u32(&ar->sector[28], crc32(ar->sector, 28));
+    memcpy(&ar->sector[REC_HDR_BYTES], data, first);
+
+    esp_err_t err = rec_write(ar, ar->sector, 1, ar->nextSector);
+
+    // whole sectors straight from the caller's buffer, the short tail padded through the scratch
+    size_t rest = len - first;
+    size_t whole = rest / SD_SECTOR;
+    if (err == ESP_OK && whole > 0) {
+        err = rec_write(ar, &data[first], whole, ar->nextSector + 1);
+    }
+    if (err == ESP_OK && rest % SD_SECTOR != 0)
+    {
+        memset(ar->sector, 0, SD_SECTOR);
+        memcpy(ar->sector, &data[first + whole * SD_SECTOR], rest % SD_SECTOR);
+        err = rec_write(ar, ar->sector, 1, ar->nextSector + 1 + whole);
+    }
+
+    if (ar->stream >= 0)
+    {
+        // durable once the writer has fsynced it, rec_durable hears when it is not
+        if (err == ESP_OK) {
+            err = sd_async_flush(ar->stream, rec_durable, (void*)(uintptr_t)ar->nextSeq);
+        }
+        if (err != ESP_OK)
+        {
+            // part of it may be queued, the segment ends before it
+            ESP_LOGE(TAG, "append of %u bytes failed", (unsigned)len);
+            ar->failedSeq = ar->nextSeq;
+            return CAP_ARCHIVE_NO_SEQ;
+        }
+    }
+    else if (err != ESP_OK || fsync(ar->fd) != 0)
+    {
+        // nothing is indexed, the next append writes over it
+        ESP_LOGE(TAG, "append of %u bytes failed", (unsigned)len);
+        return CAP_ARCHIVE_NO_SEQ;
+    }
+
+    ar->recSector[seg->count++] = (uint16_t)ar->nextSector;
+    ar->nextSector += need;
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    ar->stats.appends++;
+    ar->stats.payload_bytes += len;
+    if (us > ar->stats.append_us_max) {
+        ar->stats.append_us_max = us;
+    }
+    return ar->nextSeq++;
+}
+
+
+static int archive_read(archive_t* ar, uint32_t seq, uint8_t* buf, size_t cap, size_t* lenOut)
+{
+    if (!ar->open || ar->segCount == 0 || seq < ar->segs[0].firstSeq) {
+        return -1;
+    }
+
+    // last segment starting at or before seq
+    uint32_t lo = 0;
+    uint32_t hi = ar->segCount - 1;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (ar->segs[mid].firstSeq <= seq) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    // records of the open segment may still be queued on the writer
+    if (lo == ar->segCount - 1) {
+        archive_drain(ar);
+    }
+    const seg_t* seg = &ar->segs[lo];
+    uint32_t idx = seq - seg->firstSeq;
+    if (idx >= seg->count) {
+        return -1;
+    }
+
+    // the open segment is indexed in RAM, a sealed one through its index on the card
+    bool active = (lo == ar->segCount - 1) && ar->fd >= 0;
+    int fd = ar->fd;
+    uint32_t at;
+    if (active) {
+        at = ar->recSector[idx];
+    }
+    else
+    {
+        // a third file next to the open segment and its stream, one of the SD_MAX_FILES slots
+        char path[ARCHIVE_PATH_LEN];
+        seg_path(ar, seg->id, path);
+        fd = open(path, O_RDONLY);
+        uint8_t entry[4];
+        if (fd < 0 || !sector_read(fd, entry, sizeof(entry), INDEX_SECTOR, idx * 4))
+        {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        at = get_u32(entry);
+    }
+
+    int ret = -1;
+    uint8_t* s = ar->sector;
+    if (sector_read(fd, s, SD_SECTOR, at, 0) && rec_hdr_valid(s, seq) && get_u32(&s[8]) <= cap)
+    {
+        uint32_t len = get_u32(&s[8]);
+        uint32_t want = get_u32(&s[16]);
+        uint32_t first = (len < REC_FIRST_BYTES) ? len : REC_FIRST_BYTES;
+        memcpy(buf, &s[REC_HDR_BYTES], first);
+
+        if (len == first || sector_read(fd, &buf[first], len - first, at + 1, 0))
+        {
+            ret = (crc32(buf, len) == want) ? 0 : -2;
+            if (lenOut != NULL) {
+                *lenOut = len;
+            }
+        }
+    }
+
+    if (!active) {
+        close(fd);
+    }
+    ar->stats.reads++;
+    ar->stats.crc_errors += (ret == -2);
+    return ret;
+}
+
+
+static uint32_t archive_oldest(const archive_t* ar)
+{
+    return (ar->segCount > 0) ? ar->segs[0].firstSeq : ar->nextSeq;
+}
+
+
+// ==== Public functions ===================================================== //
+
+esp_err_t cap_archive_open(const char* dir)
+{
+    archive_close(&s_archive);
+    esp_err_t err = archive_open(&s_archive, dir);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // appends go through the background writer whenever it runs
+    if (s_drained == NULL) {
+        s_drained = xSemaphoreCreateBinaryStatic(&s_drainedBuf);
+    }
+    s_archive.async = (s_drained != NULL && sd_async_is_running());
+
+    MEM_BUDGET_ADD(CAP_ARCHIVE, s_archive, MEM_REGION_DRAM);
+    ESP_LOGI(TAG, "%s: %lu segments, seq %lu..%lu, %lu records recovered in %lu us",
+             dir, (unsigned long)s_archive.segCount, (unsigned long)cap_archive_oldest(),
+             (unsigned long)cap_archive_newest(), (unsigned long)s_archive.stats.recovered,
+             (unsigned long)s_archive.stats.recover_us);
+    return ESP_OK;
+}
+
+
+void cap_archive_close(void)
+{
+    archive_close(&s_archive);
+}
+
+
+bool cap_archive_is_open(void)
+{
+    return s_archive.open;
+}
+
+
+uint32_t cap_archive_append(const uint8_t* data, size_t len)
+{
+    return archive_append(&s_archive, data, len, (uint32_t)(esp_timer_get_time() / 1000));
+}
+
+
+int cap_archive_read(uint32_t seq, uint8_t* buf, size_t cap, size_t* len)
+{
+    return archive_read(&s_archive, seq, buf, cap, len);
+}
+
+
+uint32_t cap_archive_oldest(void)
+{
+    return archive_oldest(&s_archive);
+}
+
+
+uint32_t cap_archive_newest(void)
+{
+    return s_archive.nextSeq - 1;
+}
+
+
+void cap_archive_get_stats(cap_archive_stats_t* out)
+{
+    *out = s_archive.stats;
+}
+
+
+// ==== Benchmark ============================================================== //
+
+#define BENCH_MIN_LEN   (12 * 1024)     // VGA JPEGs at quality 10 land around here
+#define BENCH_MAX_LEN   (28 * 1024)
+#define BENCH_READS     100
+#define BENCH_FAT_SECTORS   3           // per file: directory entry, FAT and its mirror
+
+static uint32_t bench_rng(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+static void bench_fill(uint8_t* buf, size_t len, uint32_t seq)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)(seq * 131 + i * 7);
+    }
+}
+
+
+void cap_archive_bench(const char* dir, uint32_t images)
+{
+    char sub[ARCHIVE_DIR_LEN];
+    char path[ARCHIVE_PATH_LEN];
+    snprintf(sub, sizeof(sub), "%s/capbench", dir);
+    mkdir(sub, 0755);
+
+    // private archive on the heap so the live one is untouched
+    archive_t* ar = malloc(sizeof(archive_t));
+    uint8_t* img = malloc(BENCH_MAX_LEN);
+    uint32_t* lens = malloc(images * sizeof(uint32_t));
+    if (ar == NULL || img == NULL || lens == NULL || images == 0 || archive_open(ar, sub) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        free(ar);
+        free(img);
+        free(lens);
+        return;
+    }
+
+    uint32_t rng = 0xBB67AE85;
+    for (uint32_t i = 0; i < images; i++) {
+        lens[i] = BENCH_MIN_LEN + bench_rng(&rng) % (BENCH_MAX_LEN - BENCH_MIN_LEN + 1);
+    }
+
+    // ---- appended to the archive ---- //
+    uint32_t failed = 0;
+    int64_t archUs = 0;
+    for (uint32_t i = 0; i < images; i++)
+    {
+        bench_fill(img, lens[i], i + 1);
+        int64_t t0 = esp_timer_get_time();
+        failed += (archive_append(ar, img, lens[i], i) != i + 1);
+        archUs += esp_timer_get_time() - t0;
+    }
+    cap_archive_stats_t arch = ar->stats;
+
+    // ---- one file each, the save_picture() way, written before it returns ---- //
+    uint64_t fileBytes = 0;
+    int64_t fileUs = 0;
+    for (uint32_t i = 0; i < images; i++)
+    {
+        bench_fill(img, lens[i], i + 1);
+        snprintf(path, sizeof(path), "%s/i%07lu.jpg", sub, (unsigned long)i);
+        int64_t t0 = esp_timer_get_time();
+        save_picture_inline(path, img, lens[i]);
+        fileUs += esp_timer_get_time() - t0;
+
+        // data in whole sectors, plus the metadata every new file costs on FAT
+        fileBytes += ((lens[i] + SD_SECTOR - 1) / SD_SECTOR + BENCH_FAT_SECTORS) * SD_SECTOR;
+        unlink(path);
+    }
+
+    // ---- random reads, CRC checked ---- //
+    uint32_t bad = 0;
+    uint32_t reads = (images < BENCH_READS) ? images : BENCH_READS;
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < reads; i++)
+    {
+        uint32_t seq = 1 + bench_rng(&rng) % images;
+        size_t len = 0;
+        int ret = archive_read(ar, seq, img, BENCH_MAX_LEN, &len);
+        uint8_t expect = (uint8_t)(seq * 131 + (len - 1) * 7);
+        bad += (ret != 0 || len != lens[seq - 1] || img[0] != (uint8_t)(seq * 131) || img[len - 1] != expect);
+    }
+    int64_t readUs = esp_timer_get_time() - t0;
+
+    // ---- crash: the last record loses its last sector, reopen recovers up to the one before ---- //
+    seg_t last = ar->segs[ar->segCount - 1];
+    uint32_t lastEnd = ar->nextSector;
+    archive_close(ar);
+
+    seg_path(ar, last.id, path);
+    int fd = open(path, O_RDWR);
+    if (fd >= 0)
+    {
+        memset(img, 0, SD_SECTOR);
+        pwrite(fd, img, SD_SECTOR, (off_t)(lastEnd - 1) * SD_SECTOR);
+        close(fd);
+    }
+    archive_open(ar, sub);
+    bool recovered = (ar->nextSeq - 1 == images - 1);
+
+    double seconds = (double)archUs / 1e6;
+    ESP_LOGI(TAG, "bench: %lu images of %d-%d KiB, archive %.1f images/s (%lu us max), one file each %.1f images/s, "
+             "%lu failed", (unsigned long)images, BENCH_MIN_LEN / 1024, BENCH_MAX_LEN / 1024,
+             seconds > 0 ? images / seconds : 0.0, (unsigned long)arch.append_us_max,
+             fileUs > 0 ? images / ((double)fileUs / 1e6) : 0.0, (unsigned long)failed);
+    ESP_LOGI(TAG, "bench: write amplification archive %.3f (%lu segments sealed), one file each %.3f (FAT modelled)",
+             (double)arch.written_bytes / (double)arch.payload_bytes, (unsigned long)arch.sealed,
+             (double)fileBytes / (double)arch.payload_bytes);
+    ESP_LOGI(TAG, "bench: random read %.0f us per image, %lu mismatches; torn last record %s, recovery %lu us "
+             "over %lu records", (double)readUs / reads, (unsigned long)bad,
+             recovered ? "dropped" : "NOT RECOVERED", (unsigned long)ar->stats.recover_us,
+             (unsigned long)ar->stats.recovered);
+
+    for (uint32_t i = 0; i < ar->segCount; i++)
+    {
+        seg_path(ar, ar->segs[i].id, path);
+        unlink(path);
+    }
+    archive_close(ar);
+    rmdir(sub);
+    free(ar);
+    free(img);
+    free(lens);
+}
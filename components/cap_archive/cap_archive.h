@@ -0,0 +1,82 @@
+#ifndef CAP_ARCHIVE_H
+#define CAP_ARCHIVE_H
+
+/*
+    - Captures packed into a few large segment files instead of one FAT file each, so saving an
+      image does not allocate clusters, grow the FAT or touch the directory
+    - A segment is preallocated to CAP_ARCHIVE_SEGMENT_BYTES. Sector 0 is its header, records start
+      on sector boundaries: a 32 byte header (seq, length, time, CRC32 of the data, CRC32 of the
+      header) followed by the JPEG, padded out to the next sector
+    - A full segment is sealed with an index of its records and a footer in its last sector, so
+      opening it later costs two sector reads. The open segment has no index on the card; it is
+      rebuilt by walking the records and stops at the first one whose CRCs do not hold, which is
+      where appending carries on after a crash
+    - Seq numbers run on across segments and boots; once CAP_ARCHIVE_MAX_SEGMENTS exist the oldest
+      segment is deleted
+    - When the background SD writer runs (sd_async) the record sectors are queued on it and
+      cap_archive_append returns once they are copied into its buffers; each record is fsynced on
+      the writer task. Reading the open segment, sealing it and closing wait for the queue first.
+      A record the writer fails to store cuts its segment off there: it is sealed without that
+      record and the ones queued behind it (counted as lost), and the next append starts a new
+      segment, so seqs can skip. Without the writer appends are written and fsynced inline
+    - Up to three files open on the card at once: the open segment, the writer stream into it and
+      a sealed segment while cap_archive_read() reads from it; SD_MAX_FILES counts them
+    - Not thread safe, only the camera task appends
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAP_ARCHIVE_SEGMENT_BYTES   (4 * 1024 * 1024)
+#define CAP_ARCHIVE_MAX_RECORDS     256     // per segment, ~16 KiB average at 4 MiB
+#define CAP_ARCHIVE_MAX_SEGMENTS    64      // 256 MiB of captures on the card
+#define CAP_ARCHIVE_NO_SEQ          0
+
+typedef struct {
+    uint32_t appends;
+    uint32_t append_us_max;
+    uint64_t payload_bytes;     // JPEG bytes appended
+    uint64_t written_bytes;     // bytes handed to the file system for them, headers / padding / index included
+    uint32_t sealed;            // segments sealed with an index
+    uint32_t reads;
+    uint32_t crc_errors;        // reads that failed the data CRC
+    uint32_t recover_us;        // rebuilding the open segment on the last open
+    uint32_t recovered;         // records found in it
+    uint32_t lost;              // appended, then failed on the background writer
+} cap_archive_stats_t;
+
+
+// find the segments in dir and recover the open one
+esp_err_t cap_archive_open(const char* dir);
+void cap_archive_close(void);
+bool cap_archive_is_open(void);
+
+// append one capture, returns its seq (CAP_ARCHIVE_NO_SEQ on failure); durable once it returns
+// when written inline, once the writer gets to it otherwise
+uint32_t cap_archive_append(const uint8_t* data, size_t len);
+
+// capture by seq into buf; 0 ok, -1 not in the archive or larger than cap, -2 CRC mismatch
+int cap_archive_read(uint32_t seq, uint8_t* buf, size_t cap, size_t* len);
+
+// range of seq in the archive, oldest > newest when it is empty
+uint32_t cap_archive_oldest(void);
+uint32_t cap_archive_newest(void);
+
+void cap_archive_get_stats(cap_archive_stats_t* out);
+
+// images/s and write amplification against one file per image (save_picture), random reads and
+// crash recovery, on scratch files in dir which are removed afterwards
+void cap_archive_bench(const char* dir, uint32_t images);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAP_ARCHIVE_H
@@ -0,0 +1,294 @@
+#include <string.h>
+
+#include "cbor_lite.h"
+
+
+#define AI_1BYTE        24      // additional info: the argument follows in 1 / 2 / 4 / 8 bytes
+#define AI_2BYTES       25
+#define AI_4BYTES       26
+#define AI_8BYTES       27
+#define AI_INDEFINITE   31
+
+
+// ==== Reader ================================================================= //
+
+void cbor_reader_init(cbor_reader_t* r, const uint8_t* buf, size_t len)
+{
+    r->p = buf;
+    r->end = buf + len;
+    r->err = false;
+}
+
+
+int cbor_peek(const cbor_reader_t* r)
+{
+    return (r->err || r->p >= r->end) ? CBOR_NONE : (r->p[0] >> 5);
+}
+
+
+// the initial byte and its argument, the cursor moves past both
+static bool read_head(cbor_reader_t* r, int* major, uint64_t* arg)
+{
+    if (r->err || r->p >= r->end) {
+        r->err = true;
+        return false;
+    }
+
+    uint8_t ib = *r->p++;
+    uint8_t ai = ib & 0x1F;
+    *major = ib >> 5;
+
+    if (ai < AI_1BYTE)
+    {
+        *arg = ai;
+        return true;
+    }
+    if (ai > AI_8BYTES)
+    {
+        r->err = true;      // indefinite lengths and reserved values, the server never sends them
+        return false;
+    }
+
+    size_t n = (size_t)1 << (ai - AI_1BYTE);
+    if ((size_t)(r->end - r->p) < n)
+    {
+        r->err = true;
+        return false;
+    }
+
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v = (v << 8) | r->p[i];     // network order
+    }
+    r->p += n;
+    *arg = v;
+    return true;
+}
+
+
+// head of the given major type
+static bool read_typed(cbor_reader_t* r, int want, uint64_t* arg)
+{
+    const uint8_t* at = r->p;
+    int major;
+
+    if (!read_head(r, &major, arg)) {
+        return false;
+    }
+    if (major != want)
+    {
+        r->p = at;
+        r->err = true;
+        return false;
+    }
+    return true;
+}
+
+
+bool cbor_read_uint(cbor_reader_t* r, uint64_t* value)
+{
+    return read_typed(r, CBOR_UINT, value);
+}
+
+
+bool cbor_read_map(cbor_reader_t* r, uint32_t* pairs)
+{
+    uint64_t n;
+    if (!read_typed(r, CBOR_MAP, &n)) {
+        return false;
+    }
+    // every pair takes two bytes at least, a bigger count is a lie
+    if (n > (uint64_t)(r->end - r->p) / 2)
+    {
+        r->err = true;
+        return false;
+    }
+    *pairs = (uint32_t)n;
+    return true;
+}
+
+
+bool cbor_read_array(cbor_reader_t* r, uint32_t* items)
+{
+    uint64_t n;
+    if (!read_typed(r, CBOR_ARRAY, &n)) {
+        return false;
+    }
+    if (n > (uint64_t)(r->end - r->p))
+    {
+        r->err = true;
+        return false;
+    }
+    *items = (uint32_t)n;
+    return true;
+}
+
+
+bool cbor_read_text(cbor_reader_t* r, const char** text, size_t* len)
+{
+    uint64_t n;
+    if (!read_typed(r, CBOR_TEXT, &n)) {
+        return false;
+    }
+    if (n > (uint64_t)(r->end - r->p))
+    {
+        r->err = true;
+        return false;
+    }
+    *text = (const char*)r->p;
+    *len = (size_t)n;
+    r->p += n;
+    return true;
+}
+
+
+static bool skip_depth(cbor_reader_t* r, int depth)
+{
+    int major;
+    uint64_t arg;
+
+    if (depth > CBOR_MAX_DEPTH || !read_head(r, &major, &arg))
+    {
+        r->err = true;
+        return false;
+    }
+
+    switch (major)
+    {
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+        if (arg > (uint64_t)(r->end - r->p))
+        {
+            r->err = true;
+            return false;
+        }
+        r->p += arg;
+        return true;
+
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+    {
+        uint64_t items = (major == CBOR_MAP) ? arg * 2 : arg;
+        if (items > (uint64_t)(r->end - r->p))
+        {
+            r->err = true;
+            return false;
+        }
+        for (uint64_t i = 0; i < items; i++)
+        {
+            if (!skip_depth(r, depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    case CBOR_TAG:
+        return skip_depth(r, depth + 1);    // the tagged item
+
+    default:
+        return true;    // integers, simple values and floats are all in the head
+    }
+}
+
+
+bool cbor_skip(cbor_reader_t* r)
+{
+    return skip_depth(r, 0);
+}
+
+
+bool cbor_reader_done(const cbor_reader_t* r)
+{
+    return !r->err && r->p == r->end;
+}
+
+
+// ==== Writer ================================================================= //
+
+void cbor_writer_init(cbor_writer_t* w, uint8_t* buf, size_t cap)
+{
+    w->start = buf;
+    w->p = buf;
+    w->end = buf + cap;
+    w->err = false;
+}
+
+
+// shortest head for the argument, as RFC 8949 deterministic encoding asks
+static void write_head(cbor_writer_t* w, int major, uint64_t arg)
+{
+    uint8_t head[9];
+    size_t n;
+
+    if (arg < AI_1BYTE) {
+        head[0] = (uint8_t)arg;
+        n = 0;
+    }
+    else if (arg <= 0xFF) {
+        head[0] = AI_1BYTE;
+        n = 1;
+    }
+    else if (arg <= 0xFFFF) {
+        head[0] = AI_2BYTES;
+        n = 2;
+    }
+    else if (arg <= 0xFFFFFFFFULL) {
+        head[0] = AI_4BYTES;
+        n = 4;
+    }
+    else {
+        head[0] = AI_8BYTES;
+        n = 8;
+    }
+
+    head[0] |= (uint8_t)(major << 5);
+    for (size_t i = 0; i < n; i++) {
+        head[1 + i] = (uint8_t)(arg >> (8 * (n - 1 - i)));
+    }
+
+    if (w->err || (size_t)(w->end - w->p) < n + 1)
+    {
+        w->err = true;
+        return;
+    }
+    memcpy(w->p, head, n + 1);
+    w->p += n + 1;
+}
+
+
+void cbor_write_uint(cbor_writer_t* w, uint64_t value)
+{
+    write_head(w, CBOR_UINT, value);
+}
+
+
+void cbor_write_map(cbor_writer_t* w, uint32_t pairs)
+{
+    write_head(w, CBOR_MAP, pairs);
+}
+
+
+void cbor_write_array(cbor_writer_t* w, uint32_t items)
+{
+    write_head(w, CBOR_ARRAY, items);
+}
+
+
+void cbor_write_text(cbor_writer_t* w, const char* text, size_t len)
+{
+    write_head(w, CBOR_TEXT, len);
+    if (w->err || (size_t)(w->end - w->p) < len)
+    {
+        w->err = true;
+        return;
+    }
+    memcpy(w->p, text, len);
+    w->p += len;
+}
+
+
+size_t cbor_writer_len(const cbor_writer_t* w)
+{
+    return w->err ? 0 : (size_t)(w->p - w->start);
+}
@@ -0,0 +1,81 @@
+#ifndef CBOR_LITE_H
+#define CBOR_LITE_H
+
+/*
+    - The part of CBOR (RFC 8949) the server's answers use: unsigned / negative integers, byte
+      and text strings, arrays, maps, tags and simple values, definite lengths only
+    - The reader is a cursor over the received buffer, nothing is allocated or copied: a string
+      comes back as a pointer into the buffer and its length (not NUL terminated)
+    - Every read checks the bounds and the type; the first failure sticks in r->err so a decoder
+      can read a whole record and check once at the end
+    - The writer is the mirror image into a caller's buffer, for the bench and the host tools
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CBOR_MAX_DEPTH      8       // nesting cbor_skip() follows
+
+// major types
+#define CBOR_UINT           0
+#define CBOR_NEGINT         1
+#define CBOR_BYTES          2
+#define CBOR_TEXT           3
+#define CBOR_ARRAY          4
+#define CBOR_MAP            5
+#define CBOR_TAG            6
+#define CBOR_SIMPLE         7
+
+#define CBOR_NONE           (-1)    // cbor_peek() at the end or after an error
+
+typedef struct {
+    const uint8_t*  p;
+    const uint8_t*  end;
+    bool            err;
+} cbor_reader_t;
+
+typedef struct {
+    uint8_t*    start;
+    uint8_t*    p;
+    uint8_t*    end;
+    bool        err;        // ran out of room, the output is cut
+} cbor_writer_t;
+
+
+void cbor_reader_init(cbor_reader_t* r, const uint8_t* buf, size_t len);
+
+// major type of the next item
+int cbor_peek(const cbor_reader_t* r);
+
+bool cbor_read_uint(cbor_reader_t* r, uint64_t* value);
+bool cbor_read_map(cbor_reader_t* r, uint32_t* pairs);
+bool cbor_read_array(cbor_reader_t* r, uint32_t* items);
+bool cbor_read_text(cbor_reader_t* r, const char** text, size_t* len);
+
+// step over the next item, whatever it is, nested ones included
+bool cbor_skip(cbor_reader_t* r);
+
+// everything read, nothing left over and no error
+bool cbor_reader_done(const cbor_reader_t* r);
+
+
+void cbor_writer_init(cbor_writer_t* w, uint8_t* buf, size_t cap);
+void cbor_write_uint(cbor_writer_t* w, uint64_t value);
+void cbor_write_map(cbor_writer_t* w, uint32_t pairs);
+void cbor_write_array(cbor_writer_t* w, uint32_t items);
+void cbor_write_text(cbor_writer_t* w, const char* text, size_t len);
+
+// bytes written, 0 when they did not fit
+size_t cbor_writer_len(const cbor_writer_t* w);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CBOR_LITE_H
@@ -0,0 +1,284 @@
+// standard includes
+#include <stdio.h>
+#include <string.h>
+
+// FreeRTOS and esp includes
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "dlog.h"
+#include "mem_budget.h"
+
+
+// ==== Defines and types ==================================================== //
+
+#define DLOG_DRAIN_PERIOD_MS    20
+#define DLOG_DRAIN_PRIORITY     1       // just above idle, never competes with the radio / display
+#define DLOG_DRAIN_STACK        3072
+#define DLOG_RING_MASK          (DLOG_RING_LEN - 1)
+
+#if (DLOG_RING_LEN & DLOG_RING_MASK) != 0
+#error DLOG_RING_LEN must be a power of two
+#endif
+
+// one record in the ring, seq is used to hand the slot between producers and the drain task
+typedef struct {
+    uint32_t seq;
+    uint32_t timestamp;
+    uint16_t id;
+    uint8_t  nargs;
+    uint8_t  core;
+    uint32_t args[DLOG_MAX_ARGS];
+} dlog_slot_t;
+
+// bounded multi-producer / single-consumer ring, one per core so tasks on different
+// cores never touch the same cache lines or fight over the head index
+typedef struct {
+    dlog_slot_t slots[DLOG_RING_LEN];
+    uint32_t    head;       // next slot a producer will claim
+    uint32_t    tail;       // next slot the drain task will read (drain task only)
+} dlog_ring_t;
+
+typedef struct {
+    uint8_t     level;
+    const char* tag;
+    const char* fmt;
+} dlog_fmt_entry_t;
+
+
+// ==== Static variables ===================================================== //
+
+static const char* TAG = "DLOG";
+
+static dlog_ring_t      s_rings[portNUM_PROCESSORS];
+MEM_STATIC_TASK(s_drainTask, DLOG_DRAIN_STACK);
+static dlog_output_t    s_output = DLOG_OUTPUT_TEXT;
+static volatile uint8_t s_level = ESP_LOG_INFO;
+static volatile bool    s_ready = false;
+
+static uint32_t s_written;
+static uint32_t s_dropped;
+static uint32_t s_filtered;
+static uint32_t s_highWater;
+
+static const dlog_fmt_entry_t s_formats[DLOG_ID_COUNT] = {
+#define DLOG_TABLE_ENTRY(id, lvl, tag, fmt) { lvl, tag, fmt },
+    DLOG_FORMATS(DLOG_TABLE_ENTRY)
+#undef DLOG_TABLE_ENTRY
+};
+
+static const char s_levelChars[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+
+// ==== Producer side - called from the hot paths ============================ //
+
+void dlog_write(dlog_id_t id, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    if (!s_ready || id >= DLOG_ID_COUNT) {
+        return;
+    }
+
+    // runtime level check is a single table lookup
+    if (s_formats[id].level > s_level) {
+        __atomic_fetch_add(&s_filtered, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t core = xPortGetCoreID();
+    dlog_ring_t *ring = &s_rings[core];
+    dlog_slot_t *slot;
+
+    // claim a slot - a task being preempted (or migrated) between the load and the
+    // CAS just retries, nobody ever waits on a lock
+    uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = &ring->slots[pos & DLOG_RING_MASK];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // ring is full, the drain task is behind
+            __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->timestamp = (uint32_t)esp_timer_get_time();
+    slot->id        = (uint16_t)id;
+    slot->nargs     = (uint8_t)(nargs > DLOG_MAX_ARGS ? DLOG_MAX_ARGS : nargs);
+    slot->core      = (uint8_t)core;
+    slot->args[0]   = a0;
+    slot->args[1]   = a1;
+    slot->args[2]   = a2;
+    slot->args[3]   = a3;
+
+    // publish the record to the drain task
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&s_written, 1, __ATOMIC_RELAXED);
+}
+
+
+// ==== Consumer side - drain task =========================================== //
+
+// pop the oldest record of a ring, returns false when it is empty
+static bool ring_pop(dlog_ring_t *ring, dlog_slot_t *out)
+{
+    uint32_t pos = ring->tail;
+    dlog_slot_t *slot = &ring->slots[pos & DLOG_RING_MASK];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+        return false;
+    }
+
+    *out = *slot;
+
+    // hand the slot back to the producers for the next lap around the ring
+    __atomic_store_n(&slot->seq, pos + DLOG_RING_LEN, __ATOMIC_RELEASE);
+    ring->tail = pos + 1;
+    return true;
+}
+
+
+static void emit_text(const dlog_slot_t *rec)
+{
+    const dlog_fmt_entry_t *entry = &s_formats[rec->id];
+
+    printf("%c (%lu) %s: ", s_levelChars[entry->level], (unsigned long)(rec->timestamp / 1000), entry->tag);
+    printf(entry->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+    printf("\n");
+}
+
+
+static void emit_binary(const dlog_slot_t *rec)
+{
+    uint8_t frame[5 + 4 + (4 * DLOG_MAX_ARGS) + 1];
+    size_t len = 0;
+
+    frame[len++] = DLOG_FRAME_SYNC0;
+    frame[len++] = DLOG_FRAME_SYNC1;
+    frame[len++] = (uint8_t)((rec->core << 4) | rec->nargs);
+    frame[len++] = (uint8_t)(rec->id & 0xFF);
+    frame[len++] = (uint8_t)(rec->id >> 8);
+
+    for (int b = 0; b < 4; b++) {
+        frame[len++] = (uint8_t)(rec->timestamp >> (8 * b));
+    }
+    for (int a = 0; a < rec->nargs; a++) {
+        for (int b = 0; b < 4; b++) {
+            frame[len++] = (uint8_t)(rec->args[a] >> (8 * b));
+        }
+    }
+
+    uint8_t check = 0;
+    for (size_t i = 0; i < len; i++) {
+        check ^= frame[i];
+    }
+    frame[len++] = check;
+
+    fwrite(frame, 1, len, stdout);
+}
+
+
+static void dlog_drain_task(void *param)
+{
+    dlog_slot_t rec;
+    uint32_t reportedDrops = 0;
+
+    for (;;)
+    {
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            dlog_ring_t *ring = &s_rings[core];
+
+            // track how far behind we got since the last wake-up
+            uint32_t waiting = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - ring->tail;
+            if (waiting > s_highWater) {
+                s_highWater = waiting;
+            }
+
+            while (ring_pop(ring, &rec))
+            {
+                if (s_output == DLOG_OUTPUT_BINARY) {
+                    emit_binary(&rec);
+                }
+                else {
+                    emit_text(&rec);
+                }
+            }
+        }
+        fflush(stdout);
+
+        uint32_t dropped = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+        if (dropped != reportedDrops)
+        {
+            ESP_LOGW(TAG, "%lu records dropped, ring full", (unsigned long)(dropped - reportedDrops));
+            reportedDrops = dropped;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_PERIOD_MS));
+    }
+}
+
+
+// ==== Public functions ===================================================== //
+
+// init the rings and start the drain task, call once before the other tasks start
+esp_err_t dlog_init(dlog_output_t output)
+{
+    if (s_ready) {
+        return ESP_OK;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        memset(&s_rings[core], 0, sizeof(dlog_ring_t));
+        for (uint32_t i = 0; i < DLOG_RING_LEN; i++) {
+            s_rings[core].slots[i].seq = i;
+        }
+    }
+    s_output = output;
+
+    TaskHandle_t drain = xTaskCreateStatic(dlog_drain_task, "DlogDrain", MEM_STACK_DEPTH(DLOG_DRAIN_STACK), NULL,
+                                           DLOG_DRAIN_PRIORITY, s_drainTask_stack, &s_drainTask_tcb);
+    if (drain == NULL)
+    {
+        ESP_LOGE(TAG, "Could not create the drain task...");
+        return ESP_FAIL;
+    }
+    MEM_BUDGET_ADD(DLOG, s_rings, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD_TASK(DLOG, s_drainTask, drain);
+
+    s_ready = true;
+    return ESP_OK;
+}
+
+
+// same meaning as esp_log_level_set(), applies to every deferred record
+void dlog_set_level(esp_log_level_t level)
+{
+    s_level = (uint8_t)level;
+}
+
+
+void dlog_get_stats(dlog_stats_t *out)
+{
+    out->written    = __atomic_load_n(&s_written, __ATOMIC_RELAXED);
+    out->dropped    = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+    out->filtered   = __atomic_load_n(&s_filtered, __ATOMIC_RELAXED);
+    out->high_water = s_highWater;
+}
@@ -0,0 +1,80 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "dlog_fmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// ==== Deferred binary logger ================================================ //
+/*
+    DLOG(RF_RX_BYTES, len, addr);
+
+    - records the format id + raw args into a lock-free ring for the current core,
+      no formatting and no UART access happens in the caller
+    - a low priority drain task empties the rings and either prints the text or
+      emits binary frames to be decoded on the host by tools/dlog_decode.py
+    - when the ring is full the record is dropped and counted, the caller never blocks
+*/
+
+#define DLOG_MAX_ARGS       4
+#define DLOG_RING_LEN       256     // records per core, must be a power of two
+
+// binary frame layout (little endian):
+//  [0xD1][0x06][core << 4 | nargs][id lo][id hi][timestamp us x4][args x4 each][xor of all previous]
+#define DLOG_FRAME_SYNC0    0xD1
+#define DLOG_FRAME_SYNC1    0x06
+
+typedef enum {
+    DLOG_OUTPUT_TEXT = 0,   // drain task formats the records itself (still off the hot path)
+    DLOG_OUTPUT_BINARY,     // drain task writes raw frames, decode on the host
+} dlog_output_t;
+
+// ids for every entry of dlog_fmt.h
+typedef enum {
+#define DLOG_ENUM_ENTRY(id, level, tag, fmt) DLOG_ID_##id,
+    DLOG_FORMATS(DLOG_ENUM_ENTRY)
+#undef DLOG_ENUM_ENTRY
+    DLOG_ID_COUNT
+} dlog_id_t;
+
+typedef struct {
+    uint32_t written;       // records that made it into a ring
+    uint32_t dropped;       // records lost because a ring was full
+    uint32_t filtered;      // records skipped because of the runtime level
+    uint32_t high_water;    // most records ever waiting in one ring
+} dlog_stats_t;
+
+
+esp_err_t dlog_init(dlog_output_t output);
+void dlog_set_level(esp_log_level_t level);
+void dlog_get_stats(dlog_stats_t *out);
+
+// use the DLOG() macro instead of calling this directly
+void dlog_write(dlog_id_t id, uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+
+// ==== Argument counting helpers for DLOG() ==== //
+#define DLOG_CAST(x)                ((uint32_t)(uintptr_t)(x))
+#define DLOG_0(id)                  dlog_write(id, 0, 0, 0, 0, 0)
+#define DLOG_1(id, a)               dlog_write(id, 1, DLOG_CAST(a), 0, 0, 0)
+#define DLOG_2(id, a, b)            dlog_write(id, 2, DLOG_CAST(a), DLOG_CAST(b), 0, 0)
+#define DLOG_3(id, a, b, c)         dlog_write(id, 3, DLOG_CAST(a), DLOG_CAST(b), DLOG_CAST(c), 0)
+#define DLOG_4(id, a, b, c, d)      dlog_write(id, 4, DLOG_CAST(a), DLOG_CAST(b), DLOG_CAST(c), DLOG_CAST(d))
+#define DLOG_PICK(_0, _1, _2, _3, _4, NAME, ...) NAME
+
+#define DLOG(id, ...) \
+    DLOG_PICK(_, ##__VA_ARGS__, DLOG_4, DLOG_3, DLOG_2, DLOG_1, DLOG_0)(DLOG_ID_##id, ##__VA_ARGS__)
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DLOG_H
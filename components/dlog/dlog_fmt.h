@@ -0,0 +1,30 @@
+#ifndef DLOG_FMT_H
+#define DLOG_FMT_H
+
+/*
+    - Table of every deferred log message in the firmware
+    - The ring only stores the index into this table plus up to 4 raw 32-bit arguments,
+      the string is looked up when the drain task (or tools/dlog_decode.py) prints it
+    - Arguments are always 32-bit integers, so only use %d / %u / %x / %c style conversions
+      (no %s - the pointer will be stale by the time the record is printed)
+    - tools/dlog_decode.py parses this file, so keep one X(...) entry per line and
+      ONLY APPEND new entries to the end, the ids are part of the binary format
+
+    X( ID, level, tag, format )
+*/
+#define DLOG_FORMATS(X) \
+    X( RF_RX_BYTES,         ESP_LOG_DEBUG,   "RF_COMMS",   "Received %u bytes from address %u" ) \
+    X( RF_MSG_QUEUED,       ESP_LOG_DEBUG,   "RF_COMMS",   "message received: %u chars queued" ) \
+    X( RF_MSG_EVICTED,      ESP_LOG_INFO,    "RF_COMMS",   "removing oldest message..." ) \
+    X( DISP_MSG_PULLED,     ESP_LOG_DEBUG,   "GUI",        "pulled out the message from buffer: %u chars" ) \
+    X( DISP_LINE,           ESP_LOG_VERBOSE, "GUI",        "line %d: %u chars" ) \
+    X( CAM_CAPTURE_START,   ESP_LOG_DEBUG,   "CAMERA",     "get_picture(): taking picture now" ) \
+    X( CAM_CAPTURE_DONE,    ESP_LOG_DEBUG,   "CAMERA",     "picture taken!, length of %u bytes!" ) \
+    X( U8G2_SPI_CB,         ESP_LOG_DEBUG,   "u8g2_hal",   "spi_byte_cb: Received a msg: %d, arg_int: %d, arg_ptr: 0x%08x" ) \
+    X( U8G2_GPIO_CB,        ESP_LOG_DEBUG,   "u8g2_hal",   "gpio_and_delay_cb: Received a msg: %d, arg_int: %d, arg_ptr: 0x%08x" ) \
+    X( RF_BCH_FIXED,        ESP_LOG_DEBUG,   "RF_COMMS",   "BCH: %u codewords corrected, %u uncorrectable" ) \
+    X( RF_MSG_DUPLICATE,    ESP_LOG_DEBUG,   "RF_COMMS",   "dropping repeat of a page to %u" ) \
+    X( RF_RESYNC,           ESP_LOG_WARN,    "RF_COMMS",   "resync (reason %u), %u unread bytes dropped" ) \
+
+
+#endif // DLOG_FMT_H
@@ -0,0 +1,611 @@
+#include <string.h>
+
+#include "gunzip.h"
+
+
+// gzip header, RFC 1952
+#define GZIP_ID1        0x1F
+#define GZIP_ID2        0x8B
+#define GZIP_DEFLATE    8
+#define GZIP_FHCRC      0x02
+#define GZIP_FEXTRA     0x04
+#define GZIP_FNAME      0x08
+#define GZIP_FCOMMENT   0x10
+
+enum {
+    ST_HEADER = 0,      // ID1 ID2 CM FLG
+    ST_SKIP,            // MTIME XFL OS, FEXTRA's data, FHCRC
+    ST_XLEN,
+    ST_STRING,          // FNAME / FCOMMENT up to their NUL
+    ST_BLOCK,           // BFINAL BTYPE
+    ST_STORED_LEN,
+    ST_STORED,
+    ST_TABLE_COUNTS,    // HLIT HDIST HCLEN
+    ST_TABLE_CODELENS,
+    ST_TABLE_LENS,
+    ST_CODES,
+    ST_TRAILER,
+    ST_DONE,
+};
+
+// one symbol's worth of bits, taken from a copy so a symbol cut off by the end of the input
+// leaves the stream where it was
+typedef struct {
+    uint64_t buf;
+    uint32_t cnt;
+} bits_t;
+
+// RFC 1951 3.2.5
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// order of the code length code lengths, 3.2.7
+static const uint8_t codelen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// CRC-32 a nibble at a time, 64 bytes of table instead of 1 KB
+static const uint32_t crc_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+
+// ==== Huffman codes ========================================================== //
+
+// canonical code from the code lengths, puff style: the count of each length and the symbols in
+// code order; < 0 when the lengths over-subscribe, > 0 when they leave codes unused
+static int build(uint16_t* count, uint16_t* symbol, const uint8_t* lengths, int n)
+{
+    uint16_t offs[GUNZIP_MAX_BITS + 1];
+    int left = 1;
+
+    memset(count, 0, sizeof(uint16_t) * (GUNZIP_MAX_BITS + 1));
+    for (int s = 0; s < n; s++) {
+        count[lengths[s]]++;
+    }
+    if (count[0] == n) {
+        return 0;       // no codes, complete but unusable
+    }
+
+    for (int len = 1; len <= GUNZIP_MAX_BITS; len++)
+    {
+        left <<= 1;
+        left -= count[len];
+        if (left < 0) {
+            return left;
+        }
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < GUNZIP_MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + count[len];
+    }
+    for (int s = 0; s < n; s++)
+    {
+        if (lengths[s] != 0) {
+            symbol[offs[lengths[s]]++] = (uint16_t)s;
+        }
+    }
+    return left;
+}
+
+
+// next symbol, a bit at a time: 1 with *sym set, 0 when the bits ran out, -1 for a code the
+// table does not have
+static int decode(bits_t* b, const uint16_t* count, const uint16_t* symbol, int* sym)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (int len = 1; len <= GUNZIP_MAX_BITS; len++)
+    {
+        if (b->cnt == 0) {
+            return 0;
+        }
+        code |= (int)(b->buf & 1);
+        b->buf >>= 1;
+        b->cnt--;
+
+        int n = count[len];
+        if (code - n < first)
+        {
+            *sym = symbol[index + (code - first)];
+            return 1;
+        }
+        index += n;
+        first += n;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+
+static bool take(bits_t* b, uint32_t n, uint32_t* value)
+{
+    if (b->cnt < n) {
+        return false;
+    }
+    *value = (uint32_t)(b->buf & ((1ULL << n) - 1));
+    b->buf >>= n;
+    b->cnt -= n;
+    return true;
+}
+
+
+static void fixed_tables(gunzip_t* g)
+{
+    uint8_t* lengths = g->lengths;
+    int s = 0;
+
+    for (; s < 144; s++) lengths[s] = 8;
+    for (; s < 256; s++) lengths[s] = 9;
+    for (; s < 280; s++) lengths[s] = 7;
+    for (; s < GUNZIP_MAX_LCODES; s++) lengths[s] = 8;
+    build(g->lencode.count, g->lencode.symbol, lengths, GUNZIP_MAX_LCODES);
+
+    memset(lengths, 5, GUNZIP_MAX_DCODES);
+    build(g->distcode.count, g->distcode.symbol, lengths, GUNZIP_MAX_DCODES);
+}
+
+
+// ==== Output ================================================================= //
+
+// the bytes since the last flush, always one piece: a flush happens whenever the window wraps
+static bool flush(gunzip_t* g)
+{
+    uint32_t n = g->pos - g->flushed;
+    if (n == 0) {
+        return true;
+    }
+
+    const uint8_t* data = g->window + (g->flushed & g->mask);
+    g->crc = crc32_update(g->crc, data, n);
+    g->flushed = g->pos;
+    return g->sink(g->ctx, data, n);
+}
+
+
+static inline bool put(gunzip_t* g, uint8_t byte)
+{
+    g->window[g->pos & g->mask] = byte;
+    g->pos++;
+    if ((g->pos & g->mask) == 0)
+    {
+        g->full = true;
+        return flush(g);
+    }
+    return true;
+}
+
+
+// ==== Decoder ================================================================ //
+
+void gunzip_init(gunzip_t* g, uint8_t* window, size_t windowSize, gunzip_sink_t sink, void* ctx)
+{
+    memset(g, 0, sizeof(*g));
+    g->window = window;
+    g->mask = (uint32_t)windowSize - 1;
+    g->sink = sink;
+    g->ctx = ctx;
+    g->state = ST_HEADER;
+    g->status = GUNZIP_MORE;
+}
+
+
+// the next optional header field, or the first block once they are all skipped
+static void header_next(gunzip_t* g)
+{
+    if (g->flags & GZIP_FEXTRA)
+    {
+        g->flags &= ~GZIP_FEXTRA;
+        g->state = ST_XLEN;
+    }
+    else if (g->flags & (GZIP_FNAME | GZIP_FCOMMENT))
+    {
+        g->flags &= (g->flags & GZIP_FNAME) ? ~GZIP_FNAME : ~GZIP_FCOMMENT;
+        g->state = ST_STRING;
+    }
+    else if (g->flags & GZIP_FHCRC)
+    {
+        g->flags &= ~GZIP_FHCRC;
+        g->remain = 2;
+        g->state = ST_SKIP;
+    }
+    else {
+        g->state = ST_BLOCK;
+    }
+}
+
+
+// read the dynamic code lengths, returns the status to stop with or GUNZIP_MORE to go on
+static int table_lens(gunzip_t* g, bits_t* b)
+{
+    const int total = g->nlen + g->ndist;
+
+    while (g->have < total)
+    {
+        bits_t t = *b;
+        int sym;
+        uint32_t rep;
+        uint8_t len = 0;
+
+        int r = decode(&t, g->lencode.count, g->lencode.symbol, &sym);
+        if (r <= 0) {
+            return (r == 0) ? GUNZIP_MORE : GUNZIP_ERR_DATA;
+        }
+
+        if (sym < 16)
+        {
+            g->lengths[g->have++] = (uint8_t)sym;
+            *b = t;
+            continue;
+        }
+        if (sym == 16)
+        {
+            if (g->have == 0) {
+                return GUNZIP_ERR_DATA;
+            }
+            len = g->lengths[g->have - 1];
+            if (!take(&t, 2, &rep)) {
+                return GUNZIP_MORE;
+            }
+            rep += 3;
+        }
+        else if (sym == 17)
+        {
+            if (!take(&t, 3, &rep)) {
+                return GUNZIP_MORE;
+            }
+            rep += 3;
+        }
+        else
+        {
+            if (!take(&t, 7, &rep)) {
+                return GUNZIP_MORE;
+            }
+            rep += 11;
+        }
+
+        if (g->have + rep > (uint32_t)total) {
+            return GUNZIP_ERR_DATA;
+        }
+        memset(&g->lengths[g->have], len, rep);
+        g->have += rep;
+        *b = t;
+    }
+
+    // an incomplete code is only allowed when it has a single symbol, 3.2.7
+    if (g->lengths[256] == 0) {
+        return GUNZIP_ERR_DATA;
+    }
+    int err = build(g->lencode.count, g->lencode.symbol, g->lengths, g->nlen);
+    if (err < 0 || (err > 0 && g->nlen - g->lencode.count[0] != 1)) {
+        return GUNZIP_ERR_DATA;
+    }
+    err = build(g->distcode.count, g->distcode.symbol, g->lengths + g->nlen, g->ndist);
+    if (err < 0 || (err > 0 && g->ndist - g->distcode.count[0] != 1)) {
+        return GUNZIP_ERR_DATA;
+    }
+
+    g->state = ST_CODES;
+    return GUNZIP_MORE;
+}
+
+
+// literals and matches until the end of the block or of the input
+static int codes(gunzip_t* g, bits_t* b, const uint8_t** in, const uint8_t* end)
+{
+    for (;;)
+    {
+        // the longest symbol with its distance is 48 bits, keep the buffer topped up
+        while (b->cnt <= 56 && *in < end)
+        {
+            b->buf |= (uint64_t)*(*in)++ << b->cnt;
+            b->cnt += 8;
+        }
+
+        bits_t t = *b;
+        int sym;
+        int r = decode(&t, g->lencode.count, g->lencode.symbol, &sym);
+        if (r <= 0) {
+            return (r == 0) ? GUNZIP_MORE : GUNZIP_ERR_DATA;
+        }
+
+        if (sym < 256)
+        {
+            *b = t;
+            if (!put(g, (uint8_t)sym)) {
+                return GUNZIP_ERR_SINK;
+            }
+            continue;
+        }
+        if (sym == 256)
+        {
+            *b = t;
+            g->state = g->last ? ST_TRAILER : ST_BLOCK;
+            return GUNZIP_MORE;
+        }
+
+        sym -= 257;
+        if (sym >= 29) {
+            return GUNZIP_ERR_DATA;
+        }
+        uint32_t extra;
+        if (!take(&t, len_extra[sym], &extra)) {
+            return GUNZIP_MORE;
+        }
+        uint32_t len = len_base[sym] + extra;
+
+        r = decode(&t, g->distcode.count, g->distcode.symbol, &sym);
+        if (r <= 0) {
+            return (r == 0) ? GUNZIP_MORE : GUNZIP_ERR_DATA;
+        }
+        if (sym >= 30) {
+            return GUNZIP_ERR_DATA;
+        }
+        if (!take(&t, dist_extra[sym], &extra)) {
+            return GUNZIP_MORE;
+        }
+        uint32_t dist = dist_base[sym] + extra;
+
+        if (dist > g->mask + 1) {
+            return GUNZIP_ERR_WINDOW;
+        }
+        if (!g->full && dist > g->pos) {
+            return GUNZIP_ERR_DATA;     // before the start of the output
+        }
+
+        *b = t;
+        while (len--)
+        {
+            if (!put(g, g->window[(g->pos - dist) & g->mask])) {
+                return GUNZIP_ERR_SINK;
+            }
+        }
+    }
+}
+
+
+gunzip_status_t gunzip_feed(gunzip_t* g, const uint8_t* in, size_t len)
+{
+    const uint8_t* end = in + len;
+    bits_t b = { g->bitbuf, g->bitcnt };
+    int status = GUNZIP_MORE;
+    uint32_t v;
+
+    if (g->status != GUNZIP_MORE) {
+        return (gunzip_status_t)g->status;
+    }
+
+    while (status == GUNZIP_MORE && g->state != ST_DONE)
+    {
+        while (b.cnt <= 56 && in < end)
+        {
+            b.buf |= (uint64_t)*in++ << b.cnt;
+            b.cnt += 8;
+        }
+        uint32_t before = b.cnt;
+        int state = g->state;
+
+        switch (g->state)
+        {
+        case ST_HEADER:
+            if (!take(&b, 32, &v)) {
+                break;
+            }
+            if ((v & 0xFF) != GZIP_ID1 || ((v >> 8) & 0xFF) != GZIP_ID2 || ((v >> 16) & 0xFF) != GZIP_DEFLATE)
+            {
+                status = GUNZIP_ERR_DATA;
+                break;
+            }
+            g->flags = (uint8_t)(v >> 24);
+            g->remain = 6;      // MTIME XFL OS
+            g->state = ST_SKIP;
+            break;
+
+        case ST_SKIP:
+            while (g->remain > 0 && take(&b, 8, &v)) {
+                g->remain--;
+            }
+            if (g->remain == 0) {
+                header_next(g);
+            }
+            break;
+
+        case ST_XLEN:
+            if (take(&b, 16, &v))
+            {
+                g->remain = v;
+                g->state = ST_SKIP;
+            }
+            break;
+
+        case ST_STRING:
+            while (take(&b, 8, &v))
+            {
+                if (v == 0)
+                {
+                    header_next(g);
+                    break;
+                }
+            }
+            break;
+
+        case ST_BLOCK:
+            if (!take(&b, 3, &v)) {
+                break;
+            }
+            g->last = v & 1;
+            if ((v >> 1) == 0)
+            {
+                // stored, from the next byte boundary
+                b.buf >>= b.cnt & 7;
+                b.cnt &= ~7u;
+                g->state = ST_STORED_LEN;
+            }
+            else if ((v >> 1) == 1)
+            {
+                fixed_tables(g);
+                g->state = ST_CODES;
+            }
+            else if ((v >> 1) == 2) {
+                g->state = ST_TABLE_COUNTS;
+            }
+            else {
+                status = GUNZIP_ERR_DATA;
+            }
+            break;
+
+        case ST_STORED_LEN:
+            if (!take(&b, 32, &v)) {
+                break;
+            }
+            if ((v & 0xFFFF) != (~v >> 16))
+            {
+                status = GUNZIP_ERR_DATA;
+                break;
+            }
+            g->remain = v & 0xFFFF;
+            g->state = ST_STORED;
+            break;
+
+        case ST_STORED:
+            // what is already in the bit buffer first, then straight from the input
+            while (g->remain > 0 && take(&b, 8, &v))
+            {
+                g->remain--;
+                if (!put(g, (uint8_t)v)) {
+                    status = GUNZIP_ERR_SINK;
+                    break;
+                }
+            }
+            while (status == GUNZIP_MORE && g->remain > 0 && in < end)
+            {
+                g->remain--;
+                if (!put(g, *in++)) {
+                    status = GUNZIP_ERR_SINK;
+                }
+            }
+            if (g->remain == 0 && status == GUNZIP_MORE) {
+                g->state = g->last ? ST_TRAILER : ST_BLOCK;
+            }
+            break;
+
+        case ST_TABLE_COUNTS:
+            if (!take(&b, 14, &v)) {
+                break;
+            }
+            g->nlen = 257 + (v & 0x1F);
+            g->ndist = 1 + ((v >> 5) & 0x1F);
+            g->ncode = 4 + (v >> 10);
+            if (g->nlen > 286 || g->ndist > GUNZIP_MAX_DCODES)
+            {
+                status = GUNZIP_ERR_DATA;
+                break;
+            }
+            memset(g->lengths, 0, 19);
+            g->have = 0;
+            g->state = ST_TABLE_CODELENS;
+            break;
+
+        case ST_TABLE_CODELENS:
+            while (g->have < g->ncode && take(&b, 3, &v)) {
+                g->lengths[codelen_order[g->have++]] = (uint8_t)v;
+            }
+            if (g->have == g->ncode)
+            {
+                // the code length code goes in lencode until the real one is read
+                if (build(g->lencode.count, g->lencode.symbol, g->lengths, 19) != 0)
+                {
+                    status = GUNZIP_ERR_DATA;
+                    break;
+                }
+                g->have = 0;
+                g->state = ST_TABLE_LENS;
+            }
+            break;
+
+        case ST_TABLE_LENS:
+            status = table_lens(g, &b);
+            break;
+
+        case ST_CODES:
+            status = codes(g, &b, &in, end);
+            break;
+
+        case ST_TRAILER:
+            b.buf >>= b.cnt & 7;
+            b.cnt &= ~7u;
+            if (b.cnt < 64) {
+                break;
+            }
+            if (!flush(g))
+            {
+                status = GUNZIP_ERR_SINK;
+                break;
+            }
+            take(&b, 32, &v);
+            if (v != g->crc) {
+                status = GUNZIP_ERR_CHECK;
+            }
+            take(&b, 32, &v);
+            if (v != g->pos) {
+                status = GUNZIP_ERR_CHECK;
+            }
+            if (status == GUNZIP_MORE) {
+                status = GUNZIP_DONE;
+            }
+            g->state = ST_DONE;
+            break;
+        }
+
+        // stuck for bits with none left to read: wait for the next feed
+        if (status == GUNZIP_MORE && g->state == state && b.cnt == before && in == end) {
+            break;
+        }
+    }
+
+    g->bitbuf = b.buf;
+    g->bitcnt = b.cnt;
+    if (status == GUNZIP_MORE && !flush(g)) {
+        status = GUNZIP_ERR_SINK;
+    }
+    g->status = status;
+    return (gunzip_status_t)status;
+}
+
+
+gunzip_status_t gunzip_finish(const gunzip_t* g)
+{
+    return (g->status == GUNZIP_MORE) ? GUNZIP_ERR_DATA : (gunzip_status_t)g->status;
+}
+
+
+uint32_t gunzip_total_out(const gunzip_t* g)
+{
+    return g->pos;
+}
@@ -0,0 +1,103 @@
+#ifndef GUNZIP_H
+#define GUNZIP_H
+
+/*
+    - Incremental decoder for a gzip body (RFC 1952 around RFC 1951 deflate): the body is fed in
+      whatever pieces the HTTP client reads, nothing of it is kept beyond the bits of one symbol,
+      so a download of any size needs the same RAM
+    - Output goes through the caller's window, a power of two that also serves as the history
+      back references copy from; every time it fills (and at the end of each gunzip_feed()) the
+      new bytes are handed to the sink, in place, before they are overwritten
+    - The window has to cover the distance the compressor used: the server compresses with a
+      window of at most that size (zlib wbits), a stream reaching further back stops with
+      GUNZIP_ERR_WINDOW instead of producing garbage. A window as large as the whole answer
+      works for any server
+    - The CRC-32 and length in the gzip trailer are checked, a cut or damaged body never ends in
+      GUNZIP_DONE
+    - Nothing is allocated, the tables live in gunzip_t (about 1.1 KB)
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GUNZIP_MAX_BITS     15      // longest Huffman code deflate allows
+#define GUNZIP_MAX_LCODES   288     // literal / length symbols, 286 used + 2 in the fixed code
+#define GUNZIP_MAX_DCODES   30
+
+typedef enum {
+    GUNZIP_MORE = 0,                // everything fed was used, the stream goes on
+    GUNZIP_DONE,                    // trailer checked, anything fed after it is ignored
+    GUNZIP_ERR_DATA = -1,           // not gzip, or not valid deflate
+    GUNZIP_ERR_WINDOW = -2,         // a back reference further than the window
+    GUNZIP_ERR_CHECK = -3,          // trailer CRC or length does not match the output
+    GUNZIP_ERR_SINK = -4,           // the sink refused the output
+} gunzip_status_t;
+
+// take len new bytes, returns false to stop the stream
+typedef bool (*gunzip_sink_t)(void* ctx, const uint8_t* data, size_t len);
+
+typedef struct {
+    uint16_t count[GUNZIP_MAX_BITS + 1];    // codes of each length
+    uint16_t symbol[GUNZIP_MAX_LCODES];     // symbols in canonical order
+} gunzip_huff_t;
+
+typedef struct {
+    // input bits not used yet, lowest first
+    uint64_t        bitbuf;
+    uint32_t        bitcnt;
+
+    // output
+    uint8_t*        window;
+    uint32_t        mask;
+    uint32_t        pos;            // bytes out so far, mod 2^32 like the trailer length
+    uint32_t        flushed;        // bytes handed to the sink so far
+    bool            full;           // pos has been past the window size
+    uint32_t        crc;
+    gunzip_sink_t   sink;
+    void*           ctx;
+
+    // where the decoder stopped
+    int             state;
+    int             status;
+    bool            last;           // this block is the final one
+    uint8_t         flags;          // gzip header fields still to skip
+    uint32_t        remain;         // header bytes to skip, stored block bytes to copy
+
+    // dynamic block tables, read over as many feeds as the header takes
+    uint16_t        nlen;
+    uint16_t        ndist;
+    uint16_t        ncode;
+    uint16_t        have;
+    uint8_t         lengths[GUNZIP_MAX_LCODES + GUNZIP_MAX_DCODES];
+    gunzip_huff_t   lencode;
+    struct {
+        uint16_t count[GUNZIP_MAX_BITS + 1];
+        uint16_t symbol[GUNZIP_MAX_DCODES];
+    } distcode;
+} gunzip_t;
+
+
+// window is windowSize bytes, a power of two; the sink gets every output byte once, in order
+void gunzip_init(gunzip_t* g, uint8_t* window, size_t windowSize, gunzip_sink_t sink, void* ctx);
+
+// decode the next len bytes of the body
+gunzip_status_t gunzip_feed(gunzip_t* g, const uint8_t* in, size_t len);
+
+// at the end of the body: GUNZIP_DONE, the error that stopped it, or GUNZIP_ERR_DATA when the
+// body was cut short
+gunzip_status_t gunzip_finish(const gunzip_t* g);
+
+// bytes out so far, mod 2^32
+uint32_t gunzip_total_out(const gunzip_t* g);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GUNZIP_H
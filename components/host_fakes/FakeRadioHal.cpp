@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "FakeRadioHal.h"
+
+extern "C" {
+    #include "freertos/FreeRTOS.h"
+    #include "freertos/task.h"
+    #include "driver/gpio.h"
+    #include "esp_timer.h"
+    #include "esp_log.h"
+    #include "host_fakes.h"
+}
+
+
+// ==== Defines for the emulated RF69 ========================================= //
+
+#define RF69_REG_BITRATE_MSB    0x03
+#define RF69_REG_BITRATE_LSB    0x04
+#define RF69_REG_VERSION        0x10
+#define RF69_CHIP_VERSION       0x24
+#define RF69_FXOSC              32000000UL
+#define RF69_SPI_WRITE          0x80
+
+#define FAKE_DEFAULT_BIT_RATE   1200
+#define FAKE_BIT_QUEUE_LEN      (1 << 16)
+#define FAKE_BIT_QUEUE_MASK     (FAKE_BIT_QUEUE_LEN - 1)
+#define FAKE_CLOCK_STACK        4096
+#define FAKE_CLOCK_PRIORITY     20      // above every firmware task, like the real radio
+#define FAKE_PIN_MODE_UNSET     0xFF
+
+static const char* TAG = "FAKE_RADIO";
+
+// the scripted bits waiting to be clocked out, shared with the feeding task
+static uint8_t          s_bits[FAKE_BIT_QUEUE_LEN];
+static size_t           s_bitHead;
+static size_t           s_bitTail;
+static pthread_mutex_t  s_bitLock = PTHREAD_MUTEX_INITIALIZER;
+
+static FakeRadioHal*    s_instance = NULL;
+
+
+// RadioLib callbacks are void(void), the gpio isr service wants void(void*)
+static void isr_trampoline(void* arg)
+{
+    void (*cb)(void) = (void (*)(void))arg;
+    cb();
+}
+
+
+// ==== Construction and lifetime ============================================= //
+
+FakeRadioHal::FakeRadioHal(uint32_t clkPin, uint32_t dataPin)
+    : RadioLibHal(GPIO_MODE_INPUT, GPIO_MODE_OUTPUT, 0, 1, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE),
+      clkPin(clkPin), dataPin(dataPin), running(false)
+{
+    memset(regs, 0, sizeof(regs));
+    memset(pinModes, FAKE_PIN_MODE_UNSET, sizeof(pinModes));
+    regs[RF69_REG_VERSION] = RF69_CHIP_VERSION;
+    s_instance = this;
+}
+
+
+void FakeRadioHal::init()
+{
+    spiBegin();
+
+    const char* script = host_env("HOST_RF_SCRIPT", NULL);
+    if (script != NULL)
+    {
+        int loaded = loadScript(script);
+        ESP_LOGI(TAG, "loaded %d bits from %s", loaded, script);
+    }
+
+    if (!running)
+    {
+        running = true;
+        xTaskCreate(clockTask, "FakeRadioClk", FAKE_CLOCK_STACK, this, FAKE_CLOCK_PRIORITY, NULL);
+    }
+}
+
+
+void FakeRadioHal::term()
+{
+    spiEnd();
+}
+
+
+// ==== GPIO, routed to the fake driver/gpio.h ================================ //
+
+// only a change of mode reaches the driver, like EspHal2
+void FakeRadioHal::pinMode(uint32_t pin, uint32_t mode)
+{
+    if (pin == RADIOLIB_NC || pin >= HOST_GPIO_COUNT || pinModes[pin] == mode) {
+        return;
+    }
+    gpio_set_direction((gpio_num_t)pin, (gpio_mode_t)mode);
+    pinModes[pin] = (uint8_t)mode;
+}
+
+void FakeRadioHal::digitalWrite(uint32_t pin, uint32_t value)
+{
+    if (pin == RADIOLIB_NC) {
+        return;
+    }
+    gpio_set_level((gpio_num_t)pin, value);
+}
+
+uint32_t FakeRadioHal::digitalRead(uint32_t pin)
+{
+    if (pin == RADIOLIB_NC) {
+        return 0;
+    }
+    return gpio_get_level((gpio_num_t)pin);
+}
+
+void FakeRadioHal::attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode)
+{
+    if (interruptNum == RADIOLIB_NC) {
+        return;
+    }
+    gpio_set_intr_type((gpio_num_t)interruptNum, (gpio_int_type_t)(mode & 0x7));
+    gpio_isr_handler_add((gpio_num_t)interruptNum, isr_trampoline, (void*)interruptCb);
+}
+
+void FakeRadioHal::detachInterrupt(uint32_t interruptNum)
+{
+    if (interruptNum == RADIOLIB_NC) {
+        return;
+    }
+    gpio_isr_handler_remove((gpio_num_t)interruptNum);
+    gpio_set_intr_type((gpio_num_t)interruptNum, GPIO_INTR_DISABLE);
+}
+
+
+// ==== Timing ================================================================ //
+
+void FakeRadioHal::delay(unsigned long ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void FakeRadioHal::delayMicroseconds(unsigned long us)
+{
+    usleep(us);
+}
+
+unsigned long FakeRadioHal::millis()
+{
+    return (unsigned long)(esp_timer_get_time() / 1000ULL);
+}
+
+unsigned long FakeRadioHal::micros()
+{
+    return (unsigned long)esp_timer_get_time();
+}
+
+long FakeRadioHal::pulseIn(uint32_t pin, uint32_t state, unsigned long timeout)
+{
+    if (pin == RADIOLIB_NC) {
+        return 0;
+    }
+
+    // same contract as EspHal2: let a pulse in progress finish, wait for the next one, time it
+    unsigned long begin = micros();
+    unsigned long start;
+    state = state ? 1 : 0;
+
+    while (digitalRead(pin) == state) {
+        if ((micros() - begin) > timeout) {
+            return 0;
+        }
+    }
+    while (digitalRead(pin) != state) {
+        if ((micros() - begin) > timeout) {
+            return 0;
+        }
+    }
+    start = micros();
+    while (digitalRead(pin) == state) {
+        if ((micros() - begin) > timeout) {
+            return 0;
+        }
+    }
+    return (long)(micros() - start);
+}
+
+
+// ==== SPI, an RF69 register file ============================================ //
+
+void FakeRadioHal::spiBegin() {}
+void FakeRadioHal::spiBeginTransaction() {}
+void FakeRadioHal::spiEndTransaction() {}
+void FakeRadioHal::spiEnd() {}
+
+// first byte is the register address (bit 7 set for writes), the rest is a burst
+void FakeRadioHal::spiTransfer(uint8_t* out, size_t len, uint8_t* in)
+{
+    if (len == 0) {
+        return;
+    }
+
+    uint8_t addr = out[0] & 0x7F;
+    bool write = (out[0] & RF69_SPI_WRITE) != 0;
+
+    if (in != NULL) {
+        in[0] = 0;
+    }
+
+    for (size_t i = 1; i < len; i++)
+    {
+        uint8_t reg = (uint8_t)((addr + i - 1) & 0x7F);
+
+        if (write)
+        {
+            // the version register is read-only on the real chip
+            if (reg != RF69_REG_VERSION) {
+                regs[reg] = out[i];
+            }
+        }
+        else if (in != NULL) {
+            in[i] = regs[reg];
+        }
+    }
+}
+
+
+// ==== Scripted bitstream ==================================================== //
+
+uint32_t FakeRadioHal::bitRate()
+{
+    uint32_t div = ((uint32_t)regs[RF69_REG_BITRATE_MSB] << 8) | regs[RF69_REG_BITRATE_LSB];
+    if (div == 0) {
+        return FAKE_DEFAULT_BIT_RATE;
+    }
+    return RF69_FXOSC / div;
+}
+
+
+size_t FakeRadioHal::feedBits(const uint8_t* bits, size_t count)
+{
+    size_t accepted = 0;
+
+    pthread_mutex_lock(&s_bitLock);
+    while (accepted < count && (s_bitHead - s_bitTail) < FAKE_BIT_QUEUE_LEN)
+    {
+        s_bits[s_bitHead & FAKE_BIT_QUEUE_MASK] = bits[accepted] ? 1 : 0;
+        s_bitHead++;
+        accepted++;
+    }
+    pthread_mutex_unlock(&s_bitLock);
+
+    return accepted;
+}
+
+
+size_t FakeRadioHal::pendingBits()
+{
+    pthread_mutex_lock(&s_bitLock);
+    size_t pending = s_bitHead - s_bitTail;
+    pthread_mutex_unlock(&s_bitLock);
+    return pending;
+}
+
+
+// script files are '0' / '1' characters, whitespace is ignored and '#' starts a comment
+int FakeRadioHal::loadScript(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "could not open RF script %s", path);
+        return -1;
+    }
+
+    uint8_t chunk[256];
+    size_t used = 0;
+    int total = 0;
+    int c;
+    bool comment = false;
+
+    while ((c = fgetc(f)) != EOF)
+    {
+        if (comment)
+        {
+            comment = (c != '\n');
+            continue;
+        }
+        if (c == '#') {
+            comment = true;
+        }
+        else if (c == '0' || c == '1')
+        {
+            chunk[used++] = (uint8_t)(c - '0');
+            if (used == sizeof(chunk))
+            {
+                total += (int)feedBits(chunk, used);
+                used = 0;
+            }
+        }
+    }
+    total += (int)feedBits(chunk, used);
+
+    fclose(f);
+    return total;
+}
+
+
+// put the next bit on DIO2 and pulse DCLK, exactly what the module does in direct mode
+void FakeRadioHal::clockOut(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint8_t bit;
+
+        pthread_mutex_lock(&s_bitLock);
+        if (s_bitHead == s_bitTail)
+        {
+            pthread_mutex_unlock(&s_bitLock);
+            return;     // nothing on air, the clock stays quiet
+        }
+        bit = s_bits[s_bitTail & FAKE_BIT_QUEUE_MASK];
+        s_bitTail++;
+        pthread_mutex_unlock(&s_bitLock);
+
+        host_gpio_drive((gpio_num_t)dataPin, bit);
+        host_gpio_drive((gpio_num_t)clkPin, 1);
+        host_gpio_drive((gpio_num_t)clkPin, 0);
+    }
+}
+
+
+// releases bits in real time at the programmed bit rate, catching up after scheduling gaps
+void FakeRadioHal::clockTask(void* param)
+{
+    FakeRadioHal* self = (FakeRadioHal*)param;
+    int64_t last = esp_timer_get_time();
+    uint64_t owed = 0;      // bits owed, in units of 1 / 1e6 bit
+    uint32_t speedup = fake_radio_speedup();
+
+    for (;;)
+    {
+        vTaskDelay(1);
+
+        int64_t now = esp_timer_get_time();
+        owed += (uint64_t)(now - last) * self->bitRate() * speedup;
+        last = now;
+
+        uint32_t due = (uint32_t)(owed / 1000000ULL);
+        owed -= (uint64_t)due * 1000000ULL;
+
+        // an idle queue should not bank up a burst for when bits arrive
+        if (self->pendingBits() == 0) {
+            owed = 0;
+            continue;
+        }
+
+        self->clockOut(due);
+    }
+}
+
+
+// ==== C wrappers ============================================================ //
+
+size_t fake_radio_feed_bits(const uint8_t* bits, size_t count)
+{
+    return (s_instance != NULL) ? s_instance->feedBits(bits, count) : 0;
+}
+
+size_t fake_radio_pending_bits(void)
+{
+    return (s_instance != NULL) ? s_instance->pendingBits() : 0;
+}
+
+// HOST_RF_SPEEDUP plays the air N times faster than real time, for compressing long soak runs
+uint32_t fake_radio_speedup(void)
+{
+    int speedup = atoi(host_env("HOST_RF_SPEEDUP", "1"));
+    return (speedup > 0) ? (uint32_t)speedup : 1;
+}
+
+uint32_t fake_radio_bit_rate(void)
+{
+    return (s_instance != NULL) ? s_instance->bitRate() : FAKE_DEFAULT_BIT_RATE;
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+
+#include "esp_log.h"
+#include "esp_camera.h"
+#include "host_fakes.h"
+
+
+#define HOST_CAMERA_MAX_FILES   64
+#define HOST_CAMERA_NAME_LEN    256
+
+static const char* TAG = "HOST_CAMERA";
+
+static char         s_files[HOST_CAMERA_MAX_FILES][HOST_CAMERA_NAME_LEN];
+static int          s_fileCount;
+static int          s_nextFile;
+static int          s_lastFile = -1;
+static camera_config_t s_config;
+
+
+static int name_cmp(const void* a, const void* b)
+{
+    return strcmp((const char*)a, (const char*)b);
+}
+
+static int has_jpeg_ext(const char* name)
+{
+    const char* dot = strrchr(name, '.');
+    return dot != NULL && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
+
+static void frame_dimensions(framesize_t size, size_t* w, size_t* h)
+{
+    switch (size)
+    {
+        case FRAMESIZE_QVGA:    *w = 320;  *h = 240;  break;
+        case FRAMESIZE_VGA:     *w = 640;  *h = 480;  break;
+        case FRAMESIZE_SVGA:    *w = 800;  *h = 600;  break;
+        case FRAMESIZE_XGA:     *w = 1024; *h = 768;  break;
+        case FRAMESIZE_UXGA:    *w = 1600; *h = 1200; break;
+        default:                *w = 0;    *h = 0;    break;
+    }
+}
+
+
+// scan the camera folder once, files are served in name order
+esp_err_t esp_camera_init(const camera_config_t* config)
+{
+    const char* dirPath = host_env("HOST_CAMERA_DIR", "host_data/camera");
+    s_config = *config;
+    s_fileCount = 0;
+    s_nextFile = 0;
+
+    DIR* dir = opendir(dirPath);
+    if (dir == NULL)
+    {
+        ESP_LOGE(TAG, "camera folder %s does not exist", dirPath);
+        return ESP_FAIL;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && s_fileCount < HOST_CAMERA_MAX_FILES)
+    {
+        if (!has_jpeg_ext(entry->d_name)) {
+            continue;
+        }
+        snprintf(s_files[s_fileCount], HOST_CAMERA_NAME_LEN, "%s/%s", dirPath, entry->d_name);
+        s_fileCount++;
+    }
+    closedir(dir);
+
+    if (s_fileCount == 0)
+    {
+        ESP_LOGE(TAG, "no .jpg files in %s", dirPath);
+        return ESP_FAIL;
+    }
+
+    qsort(s_files, s_fileCount, HOST_CAMERA_NAME_LEN, name_cmp);
+    ESP_LOGI(TAG, "serving %d frames from %s", s_fileCount, dirPath);
+    return ESP_OK;
+}
+
+
+esp_err_t esp_camera_deinit(void)
+{
+    s_fileCount = 0;
+    return ESP_OK;
+}
+
+
+camera_fb_t* esp_camera_fb_get(void)
+{
+    if (s_fileCount == 0) {
+        return NULL;
+    }
+
+    const char* path = s_files[s_nextFile];
+    s_lastFile = s_nextFile;
+    s_nextFile = (s_nextFile + 1) % s_fileCount;
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "could not open %s", path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    camera_fb_t* fb = (camera_fb_t*)calloc(1, sizeof(camera_fb_t));
+    uint8_t* buf = (size > 0) ? (uint8_t*)malloc(size) : NULL;
+    if (fb == NULL || buf == NULL || fread(buf, 1, size, f) != (size_t)size)
+    {
+        fclose(f);
+        free(buf);
+        free(fb);
+        return NULL;
+    }
+    fclose(f);
+
+    fb->buf = buf;
+    fb->len = (size_t)size;
+    fb->format = PIXFORMAT_JPEG;
+    frame_dimensions(s_config.frame_size, &fb->width, &fb->height);
+    gettimeofday(&fb->timestamp, NULL);
+    return fb;
+}
+
+
+void esp_camera_fb_return(camera_fb_t* fb)
+{
+    if (fb != NULL)
+    {
+        free(fb->buf);
+        free(fb);
+    }
+}
+
+
+bool host_camera_qr_payload(char* out, size_t cap)
+{
+    char path[HOST_CAMERA_NAME_LEN];
+
+    if (s_lastFile < 0 || s_lastFile >= s_fileCount || cap == 0) {
+        return false;
+    }
+
+    // same name with .qr in place of .jpg / .jpeg
+    snprintf(path, sizeof(path), "%s", s_files[s_lastFile]);
+    char* dot = strrchr(path, '.');
+    if (dot == NULL || (size_t)(dot - path) + 4 > sizeof(path)) {
+        return false;
+    }
+    strcpy(dot, ".qr");
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fgets(out, (int)cap, f) != NULL;
+    fclose(f);
+
+    if (ok) {
+        out[strcspn(out, "\r\n")] = '\0';
+    }
+    return ok && out[0] != '\0';
+}
+
+
+static int sensor_nop(sensor_t* sensor, int value)
+{
+    (void)sensor;
+    (void)value;
+    return 0;
+}
+
+sensor_t* esp_camera_sensor_get(void)
+{
+    static sensor_t s_sensor = {
+        .set_gain_ctrl = sensor_nop,
+        .set_exposure_ctrl = sensor_nop,
+        .set_agc_gain = sensor_nop,
+        .set_aec_value = sensor_nop,
+    };
+    return &s_sensor;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "u8g2.h"
+#include "host_display.h"
+#include "host_fakes.h"
+
+
+static uint32_t s_frameCount;
+
+
+// the panel has nothing to talk to on the host, accept and drop every byte
+uint8_t u8g2_host_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+    (void)u8x8;
+    (void)msg;
+    (void)arg_int;
+    (void)arg_ptr;
+    return 1;
+}
+
+
+uint8_t u8g2_host_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+    (void)u8x8;
+    (void)msg;
+    (void)arg_int;
+    (void)arg_ptr;
+    return 1;
+}
+
+
+// dump the u8g2 frame buffer (vertical tiles, lsb on top) as a binary PBM
+void host_display_flush(u8g2_t *u8g2)
+{
+    const char* path = host_env("HOST_DISPLAY_PBM", "host_out/display.pbm");
+    char tmpPath[256];
+
+    uint8_t* buf = u8g2_GetBufferPtr(u8g2);
+    int width  = u8g2_GetBufferTileWidth(u8g2) * 8;
+    int height = u8g2_GetBufferTileHeight(u8g2) * 8;
+
+    // the panel is mounted upside down (U8G2_R2), flip it back so the image matches what staff see
+    int flip = (u8g2->cb == U8G2_R2);
+
+    s_frameCount++;
+
+    // write next to the target and rename so a viewer never reads half a frame
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    host_mkdirs_for_file(path);
+
+    FILE* f = fopen(tmpPath, "wb");
+    if (f == NULL) {
+        return;
+    }
+
+    fprintf(f, "P4\n# frame %lu\n%d %d\n", (unsigned long)s_frameCount, width, height);
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t packed = 0;
+        for (int x = 0; x < width; x++)
+        {
+            int sx = flip ? (width - 1 - x) : x;
+            int sy = flip ? (height - 1 - y) : y;
+            int bit = (buf[(sy / 8) * width + sx] >> (sy % 8)) & 0x01;
+
+            packed = (uint8_t)((packed << 1) | bit);
+            if ((x % 8) == 7)
+            {
+                fputc(packed, f);
+                packed = 0;
+            }
+        }
+    }
+    fclose(f);
+    rename(tmpPath, path);
+}
+
+
+uint32_t host_display_frame_count(void)
+{
+    return s_frameCount;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "host_fakes.h"
+
+
+const char* host_env(const char* name, const char* fallback)
+{
+    const char* value = getenv(name);
+    if (value == NULL || value[0] == '\0') {
+        return fallback;
+    }
+    return value;
+}
+
+
+int host_mkdirs(const char* path)
+{
+    char tmp[256];
+
+    if (path == NULL || strlen(path) >= sizeof(tmp)) {
+        return -1;
+    }
+    strcpy(tmp, path);
+
+    // create every parent folder in turn, ignoring the ones that already exist
+    for (char* p = tmp + 1; *p; p++)
+    {
+        if (*p == '/')
+        {
+            *p = '\0';
+            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+
+    if (mkdir(tmp, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+
+int host_mkdirs_for_file(const char* filePath)
+{
+    char dir[256];
+
+    const char* slash = strrchr(filePath, '/');
+    if (slash == NULL) {
+        return 0;   // file in the current folder
+    }
+
+    size_t len = (size_t)(slash - filePath);
+    if (len == 0 || len >= sizeof(dir)) {
+        return (len == 0) ? 0 : -1;
+    }
+
+    memcpy(dir, filePath, len);
+    dir[len] = '\0';
+    return host_mkdirs(dir);
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "driver/gpio.h"
+
+
+// ==== Fake pin state ======================================================= //
+
+typedef struct {
+    gpio_mode_t     mode;
+    gpio_int_type_t intr;
+    uint8_t         level;
+    gpio_isr_t      isr;
+    void*           isrArg;
+} host_pin_t;
+
+static host_pin_t       s_pins[HOST_GPIO_COUNT];
+static pthread_mutex_t  s_pinLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool pin_valid(gpio_num_t pin)
+{
+    return (pin >= 0 && pin < HOST_GPIO_COUNT);
+}
+
+
+// set a level and fire the ISR if the change matches the interrupt type
+static void update_level(gpio_num_t pin, uint32_t level)
+{
+    gpio_isr_t isr = NULL;
+    void* arg = NULL;
+
+    pthread_mutex_lock(&s_pinLock);
+    host_pin_t *p = &s_pins[pin];
+    uint8_t old = p->level;
+    p->level = level ? 1 : 0;
+
+    bool fire = false;
+    switch (p->intr)
+    {
+        case GPIO_INTR_POSEDGE:     fire = (old == 0 && p->level == 1); break;
+        case GPIO_INTR_NEGEDGE:     fire = (old == 1 && p->level == 0); break;
+        case GPIO_INTR_ANYEDGE:     fire = (old != p->level);           break;
+        case GPIO_INTR_LOW_LEVEL:   fire = (p->level == 0);             break;
+        case GPIO_INTR_HIGH_LEVEL:  fire = (p->level == 1);             break;
+        default:                                                        break;
+    }
+    if (fire) {
+        isr = p->isr;
+        arg = p->isrArg;
+    }
+    pthread_mutex_unlock(&s_pinLock);
+
+    // handler runs outside the lock so it can read / write pins itself
+    if (isr != NULL) {
+        isr(arg);
+    }
+}
+
+
+// ==== driver/gpio.h API ==================================================== //
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig)
+{
+    if (pGPIOConfig == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&s_pinLock);
+    for (int pin = 0; pin < HOST_GPIO_COUNT; pin++)
+    {
+        if ((pGPIOConfig->pin_bit_mask & (1ULL << pin)) == 0) {
+            continue;
+        }
+        s_pins[pin].mode = pGPIOConfig->mode;
+        s_pins[pin].intr = pGPIOConfig->intr_type;
+
+        // an undriven input settles on its pull resistor
+        if (pGPIOConfig->mode == GPIO_MODE_INPUT)
+        {
+            if (pGPIOConfig->pull_up_en) {
+                s_pins[pin].level = 1;
+            }
+            else if (pGPIOConfig->pull_down_en) {
+                s_pins[pin].level = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_pinLock);
+    return ESP_OK;
+}
+
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_pinLock);
+    s_pins[gpio_num].mode = mode;
+    pthread_mutex_unlock(&s_pinLock);
+    return ESP_OK;
+}
+
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    update_level(gpio_num, level);
+    return ESP_OK;
+}
+
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return 0;
+    }
+    pthread_mutex_lock(&s_pinLock);
+    int level = s_pins[gpio_num].level;
+    pthread_mutex_unlock(&s_pinLock);
+    return level;
+}
+
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_pinLock);
+    s_pins[gpio_num].intr = intr_type;
+    pthread_mutex_unlock(&s_pinLock);
+    return ESP_OK;
+}
+
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args)
+{
+    if (!pin_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_pinLock);
+    s_pins[gpio_num].isr = isr_handler;
+    s_pins[gpio_num].isrArg = args;
+    pthread_mutex_unlock(&s_pinLock);
+    return ESP_OK;
+}
+
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    return gpio_isr_handler_add(gpio_num, NULL, NULL);
+}
+
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num)
+{
+    return pin_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+// edges fire whenever an interrupt type and handler are set, there is no separate enable bit
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    return pin_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+// ==== Host only ============================================================ //
+
+void host_gpio_drive(gpio_num_t gpio_num, uint32_t level)
+{
+    if (pin_valid(gpio_num)) {
+        update_level(gpio_num, level);
+    }
+}
+
+
+gpio_mode_t host_gpio_get_mode(gpio_num_t gpio_num)
+{
+    if (!pin_valid(gpio_num)) {
+        return GPIO_MODE_DISABLE;
+    }
+    pthread_mutex_lock(&s_pinLock);
+    gpio_mode_t mode = s_pins[gpio_num].mode;
+    pthread_mutex_unlock(&s_pinLock);
+    return mode;
+}
@@ -0,0 +1,96 @@
+#ifndef FAKE_RADIO_HAL_H
+#define FAKE_RADIO_HAL_H
+
+/*
+    - Host build stand-in for EspHal2 + the RF69 module behind it
+    - SPI traffic goes to an emulated RF69 register file (enough for radio.begin() and
+      pager.startReceive() to succeed, reads return what was last written)
+    - In direct receive mode the real module clocks every demodulated bit out on DIO1 (DCLK)
+      with the bit on DIO2, the fake does the same from a queue of scripted bits at the
+      bit rate programmed into RegBitrate, driving the pins through the fake driver/gpio.h
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <RadioLib.h>
+#include "driver/gpio.h"
+
+class FakeRadioHal : public RadioLibHal {
+  public:
+    // clkPin is the DIO1 / DCLK line the pager interrupt is attached to, dataPin is DIO2
+    FakeRadioHal(uint32_t clkPin, uint32_t dataPin);
+
+    void init() override;
+    void term() override;
+
+    void pinMode(uint32_t pin, uint32_t mode) override;
+    void digitalWrite(uint32_t pin, uint32_t value) override;
+    uint32_t digitalRead(uint32_t pin) override;
+    void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(void), uint32_t mode) override;
+    void detachInterrupt(uint32_t interruptNum) override;
+
+    // same compile time pin binding as EspHal2, through the fake gpio driver
+    template<uint32_t PIN> inline void writePin(uint32_t value) {
+      if constexpr (PIN != RADIOLIB_NC) {
+        static_assert(PIN < HOST_GPIO_COUNT, "pin is not a GPIO on this chip");
+        gpio_set_level((gpio_num_t)PIN, value);
+      }
+    }
+
+    template<uint32_t PIN> inline uint32_t readPin() {
+      if constexpr (PIN != RADIOLIB_NC) {
+        static_assert(PIN < HOST_GPIO_COUNT, "pin is not a GPIO on this chip");
+        return (uint32_t)gpio_get_level((gpio_num_t)PIN);
+      } else {
+        return 0;
+      }
+    }
+
+    void delay(unsigned long ms) override;
+    void delayMicroseconds(unsigned long us) override;
+    unsigned long millis() override;
+    unsigned long micros() override;
+    long pulseIn(uint32_t pin, uint32_t state, unsigned long timeout) override;
+
+    void spiBegin() override;
+    void spiBeginTransaction() override;
+    void spiTransfer(uint8_t* out, size_t len, uint8_t* in) override;
+    void spiEndTransaction() override;
+    void spiEnd() override;
+
+    // ==== Host only ==== //
+    size_t feedBits(const uint8_t* bits, size_t count);     // one bit per byte, returns bits accepted
+    size_t pendingBits();
+    int loadScript(const char* path);                       // returns bits loaded or -1
+    uint32_t bitRate();
+
+  private:
+    static void clockTask(void* param);
+    void clockOut(uint32_t count);
+
+    uint32_t clkPin;
+    uint32_t dataPin;
+    uint8_t regs[0x80];
+    uint8_t pinModes[HOST_GPIO_COUNT];      // mirrors EspHal2's mode cache
+    bool running;
+};
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// C access to the radio fake rf_comms created, for traffic generators and benchmarks
+size_t fake_radio_feed_bits(const uint8_t* bits, size_t count);
+size_t fake_radio_pending_bits(void);
+uint32_t fake_radio_bit_rate(void);
+uint32_t fake_radio_speedup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAKE_RADIO_HAL_H
@@ -0,0 +1,85 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+/*
+    - Host build stand-in for the ESP-IDF driver/gpio.h
+    - Keeps a level per pin, outputs are set by the firmware and inputs by the "outside
+      world" through host_gpio_drive() (buttons, radio data lines, etc...)
+    - Registered ISR handlers are called straight from host_gpio_drive() / gpio_set_level()
+      when the configured edge happens, on the calling thread
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_GPIO_COUNT     64
+
+typedef int gpio_num_t;
+#define GPIO_NUM_NC         (-1)
+
+typedef enum {
+    GPIO_MODE_DISABLE       = 0,
+    GPIO_MODE_INPUT         = 1,
+    GPIO_MODE_OUTPUT        = 2,
+    GPIO_MODE_INPUT_OUTPUT  = 3,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0,
+    GPIO_PULLUP_ENABLE  = 1,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE = 0,
+    GPIO_PULLDOWN_ENABLE  = 1,
+} gpio_pulldown_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE       = 0,
+    GPIO_INTR_POSEDGE       = 1,
+    GPIO_INTR_NEGEDGE       = 2,
+    GPIO_INTR_ANYEDGE       = 3,
+    GPIO_INTR_LOW_LEVEL     = 4,
+    GPIO_INTR_HIGH_LEVEL    = 5,
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t        pin_bit_mask;
+    gpio_mode_t     mode;
+    gpio_pullup_t   pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig);
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args);
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num);
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num);
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num);
+
+// ==== Host only ==== //
+
+// drive an input pin from outside the firmware, fires the ISR on a matching edge
+void host_gpio_drive(gpio_num_t gpio_num, uint32_t level);
+
+// last mode given through gpio_config() / gpio_set_direction()
+gpio_mode_t host_gpio_get_mode(gpio_num_t gpio_num);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_DRIVER_GPIO_H
@@ -0,0 +1,120 @@
+#ifndef HOST_ESP_CAMERA_H
+#define HOST_ESP_CAMERA_H
+
+/*
+    - Host build stand-in for esp32-camera's esp_camera.h
+    - Frames are JPEG files served in name order from HOST_CAMERA_DIR (default host_data/camera),
+      wrapping around after the last one
+    - A frame may have a .qr file next to it (ward1.jpg -> ward1.qr) holding the payload of the QR
+      code in the picture, standing in for a decoder on the device
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ==== Types mirrored from esp32-camera / driver/ledc.h ==== //
+typedef enum { LEDC_CHANNEL_0 = 0, LEDC_CHANNEL_1 } ledc_channel_t;
+typedef enum { LEDC_TIMER_0 = 0, LEDC_TIMER_1 } ledc_timer_t;
+
+typedef enum {
+    PIXFORMAT_RGB565,
+    PIXFORMAT_YUV422,
+    PIXFORMAT_YUV420,
+    PIXFORMAT_GRAYSCALE,
+    PIXFORMAT_JPEG,
+    PIXFORMAT_RGB888,
+    PIXFORMAT_RAW,
+    PIXFORMAT_RGB444,
+    PIXFORMAT_RGB555,
+} pixformat_t;
+
+typedef enum {
+    FRAMESIZE_96X96,
+    FRAMESIZE_QQVGA,
+    FRAMESIZE_QCIF,
+    FRAMESIZE_HQVGA,
+    FRAMESIZE_240X240,
+    FRAMESIZE_QVGA,
+    FRAMESIZE_CIF,
+    FRAMESIZE_HVGA,
+    FRAMESIZE_VGA,
+    FRAMESIZE_SVGA,
+    FRAMESIZE_XGA,
+    FRAMESIZE_HD,
+    FRAMESIZE_SXGA,
+    FRAMESIZE_UXGA,
+} framesize_t;
+
+typedef enum { CAMERA_FB_IN_PSRAM, CAMERA_FB_IN_DRAM } camera_fb_location_t;
+typedef enum { CAMERA_GRAB_WHEN_EMPTY, CAMERA_GRAB_LATEST } camera_grab_mode_t;
+
+typedef struct {
+    int pin_pwdn;
+    int pin_reset;
+    int pin_xclk;
+    union { int pin_sccb_sda; int pin_sscb_sda; };
+    union { int pin_sccb_scl; int pin_sscb_scl; };
+    int pin_d7;
+    int pin_d6;
+    int pin_d5;
+    int pin_d4;
+    int pin_d3;
+    int pin_d2;
+    int pin_d1;
+    int pin_d0;
+    int pin_vsync;
+    int pin_href;
+    int pin_pclk;
+
+    int xclk_freq_hz;
+    ledc_timer_t ledc_timer;
+    ledc_channel_t ledc_channel;
+
+    pixformat_t pixel_format;
+    framesize_t frame_size;
+    int jpeg_quality;
+    size_t fb_count;
+    camera_fb_location_t fb_location;
+    camera_grab_mode_t grab_mode;
+} camera_config_t;
+
+typedef struct {
+    uint8_t* buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;
+} camera_fb_t;
+
+// only the sensor calls used by camera.c, they all do nothing on the host
+typedef struct _sensor sensor_t;
+struct _sensor {
+    int (*set_gain_ctrl)(sensor_t* sensor, int enable);
+    int (*set_exposure_ctrl)(sensor_t* sensor, int enable);
+    int (*set_agc_gain)(sensor_t* sensor, int gain);
+    int (*set_aec_value)(sensor_t* sensor, int gain);
+};
+
+esp_err_t esp_camera_init(const camera_config_t* config);
+esp_err_t esp_camera_deinit(void);
+camera_fb_t* esp_camera_fb_get(void);
+void esp_camera_fb_return(camera_fb_t* fb);
+sensor_t* esp_camera_sensor_get(void);
+
+// host only: QR payload of the last frame served, false when it has no .qr file
+bool host_camera_qr_payload(char* out, size_t cap);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_CAMERA_H
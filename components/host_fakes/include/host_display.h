@@ -0,0 +1,31 @@
+#ifndef HOST_DISPLAY_H
+#define HOST_DISPLAY_H
+
+/*
+    - Host build stand-in for the SSD1309 panel behind u8g2
+    - The byte / gpio callbacks swallow everything, the frame buffer is written out as a
+      PBM image (HOST_DISPLAY_PBM, default host_out/display.pbm) on every flush
+*/
+
+#include <stdint.h>
+#include "u8g2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint8_t u8g2_host_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+uint8_t u8g2_host_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+// write what the panel would be showing right now, call after u8g2_SendBuffer()
+void host_display_flush(u8g2_t *u8g2);
+
+// number of flushes since boot, handy for benchmarks that wait on the display
+uint32_t host_display_frame_count(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_DISPLAY_H
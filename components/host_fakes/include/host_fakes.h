@@ -0,0 +1,38 @@
+#ifndef HOST_FAKES_H
+#define HOST_FAKES_H
+
+/*
+    - Helpers shared by the hardware fakes of the linux host build
+    - Every fake reads its inputs from / writes its outputs to plain files relative to
+      the directory the host binary is started from, overridable with env variables:
+
+        HOST_RF_SCRIPT      bitstream played by the fake radio            (default: none)
+        HOST_RF_SPEEDUP     fake radio clocks bits N times real time      (default: 1)
+        HOST_CAMERA_DIR     folder of *.jpg served as camera frames       (default: host_data/camera)
+        HOST_DISPLAY_PBM    where the display frame buffer is written     (default: host_out/display.pbm)
+        HOST_SD_DIR         folder standing in for the SD card mount      (default: host_out/sdcard)
+        HOST_SERVER_URL     base url of tools/host_server.py              (default: http://127.0.0.1:5000)
+        HOST_LOOKUP_IP      address of its UDP lookups, port 5001         (default: 127.0.0.1)
+        HOST_MQTT_URI       tools/mqtt_broker.py                          (default: mqtt://127.0.0.1:1883)
+        HOST_MQTT_ID        MQTT client id, the broker keeps its session  (default: mdv-host)
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// value of an env variable, or the fallback when it is not set / empty
+const char* host_env(const char* name, const char* fallback);
+
+// mkdir -p for the folders the fakes write into, returns 0 on success
+int host_mkdirs(const char* path);
+
+// same as host_mkdirs() but for the folder a file path lives in
+int host_mkdirs_for_file(const char* filePath);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FAKES_H
@@ -0,0 +1,188 @@
+// standard includes
+#include <stdio.h>
+#include <string.h>
+
+// FreeRTOS and esp includes
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_app_desc.h"
+#include "esp_log.h"
+
+#include "latency_stats.h"
+
+
+static const char* TAG = "LATENCY";
+
+// one histogram per stage, shared between the radio and display tasks
+static lat_hist_t   s_stageHist[LAT_STAGE_COUNT];
+static portMUX_TYPE s_statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* s_stageNames[LAT_STAGE_COUNT] = {
+    "read",
+    "enqueue",
+    "queued",
+    "draw",
+    "total",
+};
+
+
+// ==== Histogram helpers ==================================================== //
+
+// map a value in us onto its log-linear bucket
+static inline uint32_t bucket_index(uint32_t us)
+{
+    if (us < LAT_HIST_SUB) {
+        return us;
+    }
+
+    uint32_t msb   = 31 - __builtin_clz(us);
+    uint32_t shift = msb - LAT_HIST_SUB_BITS;
+    return ((shift + 1) << LAT_HIST_SUB_BITS) + ((us >> shift) & (LAT_HIST_SUB - 1));
+}
+
+// largest value that still lands in the given bucket
+static uint32_t bucket_upper(uint32_t idx)
+{
+    if (idx < LAT_HIST_SUB) {
+        return idx;
+    }
+
+    uint32_t shift = (idx >> LAT_HIST_SUB_BITS) - 1;
+    uint64_t mant  = (idx & (LAT_HIST_SUB - 1)) | LAT_HIST_SUB;
+    return (uint32_t)(((mant + 1) << shift) - 1);
+}
+
+
+void lat_hist_reset(lat_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+
+void lat_hist_add(lat_hist_t *hist, uint32_t us)
+{
+    hist->buckets[bucket_index(us)]++;
+    hist->count++;
+    hist->sum += us;
+
+    if (us > hist->max) {
+        hist->max = us;
+    }
+}
+
+
+// permille = 500 for p50, 990 for p99 etc... returns 0 for an empty histogram
+uint32_t lat_hist_percentile(const lat_hist_t *hist, uint32_t permille)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    // rank of the sample we are looking for (rounded up, at least 1)
+    uint64_t rank = ((uint64_t)hist->count * permille + 999) / 1000;
+    if (rank == 0) { rank = 1; }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LAT_HIST_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= rank)
+        {
+            // never report more than what we actually saw
+            uint32_t upper = bucket_upper(i);
+            return (upper > hist->max) ? hist->max : upper;
+        }
+    }
+
+    return hist->max;
+}
+
+
+void lat_hist_summarize(const lat_hist_t *hist, lat_summary_t *out)
+{
+    out->count = hist->count;
+    out->mean  = hist->count ? (uint32_t)(hist->sum / hist->count) : 0;
+    out->p50   = lat_hist_percentile(hist, 500);
+    out->p95   = lat_hist_percentile(hist, 950);
+    out->p99   = lat_hist_percentile(hist, 990);
+    out->max   = hist->max;
+}
+
+
+// ==== Per-stage message latency ============================================ //
+
+const char* latency_stage_name(lat_stage_t stage)
+{
+    if (stage >= LAT_STAGE_COUNT) {
+        return "invalid";
+    }
+    return s_stageNames[stage];
+}
+
+
+// record one sample for a stage, start/end come from latency_now()
+void latency_record(lat_stage_t stage, uint32_t start, uint32_t end)
+{
+    if (stage >= LAT_STAGE_COUNT) {
+        return;
+    }
+
+    uint32_t delta = end - start;
+
+    portENTER_CRITICAL(&s_statsLock);
+    lat_hist_add(&s_stageHist[stage], delta);
+    portEXIT_CRITICAL(&s_statsLock);
+}
+
+
+void latency_stats_get(lat_stage_t stage, lat_summary_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (stage >= LAT_STAGE_COUNT) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_statsLock);
+    lat_hist_summarize(&s_stageHist[stage], out);
+    portEXIT_CRITICAL(&s_statsLock);
+}
+
+
+void latency_stats_reset(void)
+{
+    portENTER_CRITICAL(&s_statsLock);
+    for (int i = 0; i < LAT_STAGE_COUNT; i++) {
+        lat_hist_reset(&s_stageHist[i]);
+    }
+    portEXIT_CRITICAL(&s_statsLock);
+}
+
+
+// print one line per stage through the normal ESP_LOG path, tagged with the firmware
+// build so numbers from different builds can be told apart when collecting logs
+void latency_stats_dump(bool reset_after)
+{
+    const esp_app_desc_t *app = esp_app_get_description();
+    lat_summary_t summary[LAT_STAGE_COUNT];
+
+    // take a consistent snapshot of every stage before printing
+    portENTER_CRITICAL(&s_statsLock);
+    for (int i = 0; i < LAT_STAGE_COUNT; i++)
+    {
+        lat_hist_summarize(&s_stageHist[i], &summary[i]);
+        if (reset_after) {
+            lat_hist_reset(&s_stageHist[i]);
+        }
+    }
+    portEXIT_CRITICAL(&s_statsLock);
+
+    ESP_LOGI(TAG, "build=%s %s %s", app->version, app->date, app->time);
+    for (int i = 0; i < LAT_STAGE_COUNT; i++)
+    {
+        ESP_LOGI(TAG, "stage=%s n=%lu mean=%lu p50=%lu p95=%lu p99=%lu max=%lu (us)",
+                 s_stageNames[i],
+                 (unsigned long)summary[i].count, (unsigned long)summary[i].mean,
+                 (unsigned long)summary[i].p50,   (unsigned long)summary[i].p95,
+                 (unsigned long)summary[i].p99,   (unsigned long)summary[i].max);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Stages a page goes through on its way from the radio to the pixels on screen
+typedef enum {
+    LAT_STAGE_READ = 0,     // time spent inside pager.readData()
+    LAT_STAGE_ENQUEUE,      // readData() returned -> message placed on xMsgBufferQueue
+    LAT_STAGE_QUEUED,       // sitting in xMsgBufferQueue until displayLoop pulls it out
+    LAT_STAGE_DRAW,         // pulled from the queue -> u8g2_SendBuffer() returned
+    LAT_STAGE_TOTAL,        // readData() called -> message on screen
+
+    LAT_STAGE_COUNT
+} lat_stage_t;
+
+
+// Timestamps carried along with every message (low 32 bits of esp_timer, in us)
+// NOTE: unsigned subtraction keeps the deltas valid across the ~71 minute wrap
+typedef struct {
+    uint32_t t_read;        // pager.readData() called
+    uint32_t t_rx;          // pager.readData() returned
+    uint32_t t_queued;      // message placed on xMsgBufferQueue
+} latency_tag_t;
+
+
+// ==== Log-linear histogram (8 sub-buckets per power of two, <= 12.5% error) ==== //
+#define LAT_HIST_SUB_BITS   3
+#define LAT_HIST_SUB        (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_BUCKETS    ((32 - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB)
+
+typedef struct {
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[LAT_HIST_BUCKETS];
+} lat_hist_t;
+
+// summary of a histogram, all values in microseconds
+typedef struct {
+    uint32_t count;
+    uint32_t mean;
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+} lat_summary_t;
+
+
+// current time in the format used by latency_tag_t
+static inline uint32_t latency_now(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+// generic histogram helpers - not locked, the caller owns the histogram
+void lat_hist_reset(lat_hist_t *hist);
+void lat_hist_add(lat_hist_t *hist, uint32_t us);
+uint32_t lat_hist_percentile(const lat_hist_t *hist, uint32_t permille);
+void lat_hist_summarize(const lat_hist_t *hist, lat_summary_t *out);
+
+// per-stage message latency - safe to call from any task
+void latency_record(lat_stage_t stage, uint32_t start, uint32_t end);
+void latency_stats_get(lat_stage_t stage, lat_summary_t *out);
+void latency_stats_reset(void);
+void latency_stats_dump(bool reset_after);
+const char* latency_stage_name(lat_stage_t stage);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_STATS_H
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include "esp_heap_caps.h"
+#endif
+
+#include "mem_budget.h"
+
+
+typedef struct {
+    const char*     subsys;
+    const char*     object;
+    size_t          bytes;
+    size_t          budget;
+    mem_region_t    region;
+    TaskHandle_t    task;       // NULL unless registered with mem_budget_add_task()
+    size_t          stackBytes;
+} mem_entry_t;
+
+static const char* TAG = "MEM_BUDGET";
+
+static mem_entry_t  s_entries[MEM_BUDGET_MAX_OBJECTS];
+static int          s_count;
+static uint32_t     s_dropped;
+
+
+static mem_entry_t* add_entry(const char* subsys, const char* object)
+{
+    for (int i = 0; i < s_count; i++)
+    {
+        if (strcmp(s_entries[i].subsys, subsys) == 0 && strcmp(s_entries[i].object, object) == 0) {
+            return NULL;
+        }
+    }
+    if (s_count >= MEM_BUDGET_MAX_OBJECTS)
+    {
+        s_dropped++;
+        return NULL;
+    }
+
+    mem_entry_t* e = &s_entries[s_count++];
+    memset(e, 0, sizeof(*e));
+    e->subsys = subsys;
+    e->object = object;
+    return e;
+}
+
+
+void mem_budget_add(const char* subsys, const char* object, size_t bytes, mem_region_t region, size_t budget)
+{
+    mem_entry_t* e = add_entry(subsys, object);
+    if (e == NULL) {
+        return;
+    }
+    e->bytes = bytes;
+    e->budget = budget;
+    e->region = region;
+}
+
+
+void mem_budget_add_task(const char* subsys, TaskHandle_t task, size_t stackBytes, size_t tcbBytes, size_t budget)
+{
+    if (task == NULL) {
+        return;
+    }
+    mem_entry_t* e = add_entry(subsys, pcTaskGetName(task));
+    if (e == NULL) {
+        return;
+    }
+    e->bytes = stackBytes + tcbBytes;
+    e->budget = budget;
+    e->region = MEM_REGION_DRAM;
+    e->task = task;
+    e->stackBytes = stackBytes;
+}
+
+
+void mem_budget_heap(const char* when)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct mallinfo2 info = mallinfo2();
+    ESP_LOGI(TAG, "heap (host) %s: %lu in use, %lu free in the arena", when,
+             (unsigned long)info.uordblks, (unsigned long)info.fordblks);
+#else
+    ESP_LOGI(TAG, "heap (internal) %s: %lu free, %lu lowest ever, %lu largest block", when,
+             (unsigned long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+  #if CONFIG_SPIRAM
+    ESP_LOGI(TAG, "heap (psram) %s: %lu free, %lu lowest ever, %lu largest block", when,
+             (unsigned long)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+             (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+  #endif
+#endif
+}
+
+
+void mem_budget_report(void)
+{
+    static const char* regionNames[] = { "dram", "psram" };
+    size_t total[2] = { 0, 0 };
+
+    ESP_LOGI(TAG, "---- static memory by subsystem ----");
+
+    for (int i = 0; i < s_count; i++)
+    {
+        // print each subsystem once, at its first entry
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            seen = seen || (strcmp(s_entries[j].subsys, s_entries[i].subsys) == 0);
+        }
+        if (seen) {
+            continue;
+        }
+
+        size_t used = 0;
+        for (int j = i; j < s_count; j++)
+        {
+            const mem_entry_t* e = &s_entries[j];
+            if (strcmp(e->subsys, s_entries[i].subsys) != 0) {
+                continue;
+            }
+            used += e->bytes;
+            total[e->region] += e->bytes;
+
+            if (e->task != NULL)
+            {
+                ESP_LOGI(TAG, "    %-24s %6lu %-5s  stack %lu, %lu never used", e->object,
+                         (unsigned long)e->bytes, regionNames[e->region], (unsigned long)e->stackBytes,
+                         (unsigned long)(uxTaskGetStackHighWaterMark(e->task) * sizeof(StackType_t)));
+            }
+            else
+            {
+                ESP_LOGI(TAG, "    %-24s %6lu %-5s", e->object, (unsigned long)e->bytes, regionNames[e->region]);
+            }
+        }
+
+        size_t budget = s_entries[i].budget;
+        if (used > budget) {
+            ESP_LOGE(TAG, "  %-26s %6lu / %lu OVER BUDGET", s_entries[i].subsys, (unsigned long)used, (unsigned long)budget);
+        } else {
+            ESP_LOGI(TAG, "  %-26s %6lu / %lu (%lu%%)", s_entries[i].subsys, (unsigned long)used,
+                     (unsigned long)budget, (unsigned long)(budget ? (used * 100) / budget : 0));
+        }
+    }
+
+    ESP_LOGI(TAG, "registered: %lu dram, %lu psram", (unsigned long)total[MEM_REGION_DRAM],
+             (unsigned long)total[MEM_REGION_PSRAM]);
+    if (s_dropped > 0) {
+        ESP_LOGW(TAG, "%lu objects not listed, raise MEM_BUDGET_MAX_OBJECTS", (unsigned long)s_dropped);
+    }
+
+    mem_budget_heap("with every task up");
+}
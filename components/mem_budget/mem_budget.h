@@ -0,0 +1,109 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+/*
+    - Static RAM budget per subsystem, checked twice:
+        - build time: tools/mem_budget.py runs after every link, sums .bss / .data of each
+          component archive from the map file and fails the build when one is over its budget
+          (MEM_BUDGET_<NAME> is matched against lib<name>.a, case does not matter)
+        - boot: each subsystem registers its long-lived objects with MEM_BUDGET_ADD() /
+          mem_budget_add_task() and mem_budget_report() prints them with the heap state
+    - Long-lived objects are never on the heap: tasks, queues and semaphores use the *Static
+      FreeRTOS calls, the heap is left to IDF (wifi, http, camera driver) and short-lived benches
+    - MEM_BULK_ATTR puts a buffer in PSRAM when the build has it, only for buffers that are never
+      touched from an ISR or with the cache off, task stacks always stay in internal DRAM
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// ==== Budgets, static bytes per component ==== //
+#define MEM_BUDGET_MAIN             (18 * 1024)     // task stacks / TCBs, message queue
+#define MEM_BUDGET_RF_COMMS         (16 * 1024)     // RadioLib objects, bit ring, BCH and capcode tables
+#define MEM_BUDGET_DLOG             (20 * 1024)     // per-core rings, drain task
+#define MEM_BUDGET_GUI_DRIVERS      (2 * 1024)      // u8g2 state, display queue
+#define MEM_BUDGET_WIFI_COMMS       (12 * 1024)     // cJSON arena, response buffer, gunzip decoders and download window
+#define MEM_BUDGET_LATENCY_STATS    (6 * 1024)      // stage histograms
+#define MEM_BUDGET_MSG_DEDUP        (1 * 1024)
+#define MEM_BUDGET_MSG_STORE        (10 * 1024)     // page arena and its index
+#define MEM_BUDGET_MSG_LOG          (6 * 1024)      // SD log sector index, tail and read sectors
+#define MEM_BUDGET_CAP_ARCHIVE      (3 * 1024)      // segment table, open segment record table, sector scratch
+#define MEM_BUDGET_SD_CARD          (18 * 1024)     // async writer task and its 12 KiB buffer pool, stream carries
+#define MEM_BUDGET_PATIENT_CACHE    (3 * 1024)      // RAM tier records, NVS tier directory
+#define MEM_BUDGET_WARD_ROSTER      (2 * 1024)      // fence of the roster index, one entry sector
+#define MEM_BUDGET_UDP_LOOKUP       (1 * 1024)      // socket, request / answer datagrams
+#define MEM_BUDGET_MQTT_PAGER       (1 * 1024)      // counters, bench lock; esp-mqtt's task and buffers are on the heap
+#define MEM_BUDGET_PULSE_CAPTURE    (1 * 1024)
+#define MEM_BUDGET_CAMERA           (24 * 1024)     // the frame in gray for the QR decoder (19 KiB), decoder state
+
+
+// ==== Placement ==== //
+typedef enum {
+    MEM_REGION_DRAM = 0,
+    MEM_REGION_PSRAM,
+} mem_region_t;
+
+#if CONFIG_SPIRAM_ALLOW_BSS_EXT_MEM
+#include "esp_attr.h"
+#define MEM_BULK_ATTR       EXT_RAM_BSS_ATTR
+#define MEM_BULK_REGION     MEM_REGION_PSRAM
+#else
+#define MEM_BULK_ATTR
+#define MEM_BULK_REGION     MEM_REGION_DRAM
+#endif
+
+// IDF counts stack depth in bytes, other FreeRTOS ports in words, this works for both
+#define MEM_STACK_DEPTH(bytes)  ((bytes) / sizeof(StackType_t))
+
+// storage for one xTaskCreateStatic() task
+#define MEM_STATIC_TASK(var, bytes) \
+    static StackType_t  var##_stack[MEM_STACK_DEPTH(bytes)]; \
+    static StaticTask_t var##_tcb
+
+
+// ==== Boot report ==== //
+#define MEM_BUDGET_MAX_OBJECTS  48      // 38 MEM_BUDGET_ADD* sites in a full build, the report counts any dropped
+
+#ifdef __cplusplus
+#define MEM_STATIC_ASSERT(cond, msg)    static_assert(cond, msg)
+#else
+#define MEM_STATIC_ASSERT(cond, msg)    _Static_assert(cond, msg)
+#endif
+
+// register a static object, also refuses to build if the object alone is over the budget
+#define MEM_BUDGET_ADD(SUBSYS, object, region) do { \
+        MEM_STATIC_ASSERT(sizeof(object) <= MEM_BUDGET_##SUBSYS, #object " is over the " #SUBSYS " budget"); \
+        mem_budget_add(#SUBSYS, #object, sizeof(object), (region), MEM_BUDGET_##SUBSYS); \
+    } while (0)
+
+// register a static task (stack + TCB), the report adds its stack high water mark
+#define MEM_BUDGET_ADD_TASK(SUBSYS, var, handle) do { \
+        MEM_STATIC_ASSERT(sizeof(var##_stack) + sizeof(var##_tcb) <= MEM_BUDGET_##SUBSYS, \
+                          #var " is over the " #SUBSYS " budget"); \
+        mem_budget_add_task(#SUBSYS, (handle), sizeof(var##_stack), sizeof(var##_tcb), MEM_BUDGET_##SUBSYS); \
+    } while (0)
+
+// boot time only (app_main and the init functions it calls), registering twice is a no-op
+void mem_budget_add(const char* subsys, const char* object, size_t bytes, mem_region_t region, size_t budget);
+void mem_budget_add_task(const char* subsys, TaskHandle_t task, size_t stackBytes, size_t tcbBytes, size_t budget);
+
+// every registered object grouped by subsystem against its budget, then the heap state
+void mem_budget_report(void);
+
+// the heap state alone, labelled, for points in the boot where it matters (after WiFi is up)
+void mem_budget_heap(const char* when);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_BUDGET_H
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+
+#include "mqtt_pager.h"
+#include "sync_objects.h"
+#include "msg_store.h"
+#include "msg_dedup.h"
+#include "capcode_table.h"
+#include "latency_stats.h"
+#include "rf_comms.h"
+#include "GUI_drivers.h"
+#include "mem_budget.h"
+
+
+#define TOPIC_LEN           (sizeof(MQTT_PAGER_BENCH_TOPIC) + MQTT_PAGER_ID_LEN)
+#define RECONNECT_MS        2000
+#define BUFFER_BYTES        512     // one page with its topic in a single event
+
+// bench
+#define BENCH_WINDOW        8       // pages published but not back yet
+#define BENCH_MAX_PAGES     4096
+#define BENCH_WAIT_MS       5000    // for the connection, the subscription and the last page
+
+typedef struct {
+    uint32_t    pages;
+    uint32_t    subscribeId;
+    bool        subscribed;
+    uint32_t    received;
+    uint32_t    duplicates;
+    uint32_t    lastUs;             // last page back
+    lat_hist_t  hist;
+    uint8_t     seen[BENCH_MAX_PAGES / 8];
+} bench_state_t;
+
+static const char* TAG = "MQTT_PAGER";
+
+static esp_mqtt_client_handle_t s_client;
+static volatile bool            s_connected;
+static char                     s_clientId[MQTT_PAGER_ID_LEN];
+static char                     s_benchTopic[TOPIC_LEN];
+static mqtt_pager_stats_t       s_stats;
+
+// the bench state is freed by the bench while the MQTT task may still be delivering to it
+static bench_state_t*           s_bench;
+static StaticSemaphore_t        s_benchLockBuf;
+static SemaphoreHandle_t        s_benchLock;
+
+
+// ==== Delivery ============================================================== //
+
+// same steps as the radio's queue_message(), the first copy of a page goes to the display
+static void deliver_page(uint32_t address, const char* text, size_t len)
+{
+    rf_msg_t message;
+    uint32_t evicted;
+
+    memset(&message, 0, sizeof(message));
+    message.lat.t_read = latency_now();
+    message.lat.t_rx = message.lat.t_read;
+
+    if (capcode_table_match(address) == CAPCODE_NO_MATCH)
+    {
+        s_stats.filtered++;
+        return;
+    }
+    if (msg_dedup_check(address, text, len))
+    {
+        s_stats.duplicates++;
+        return;
+    }
+
+    message.seq = msg_store_append(address, BASIC_MSG, text, len);
+
+    // shares the queue with the radio task, rf_enqueue_message() never blocks on it
+    bool sent = rf_enqueue_message(&message, &evicted);
+    s_stats.evicted += evicted;
+    if ( !sent )
+    {
+        ESP_LOGE(TAG, "Could not add msg to the queue for some reason...\n");
+        return;
+    }
+    s_stats.delivered++;
+}
+
+
+// "pager/page/<capcode>", false for anything else
+static bool topic_capcode(const char* topic, int topicLen, uint32_t* address)
+{
+    char num[12];
+    size_t prefix = sizeof(MQTT_PAGER_TOPIC) - 1;
+
+    if (topicLen <= (int)prefix || topicLen - prefix >= sizeof(num) ||
+        memcmp(topic, MQTT_PAGER_TOPIC, prefix) != 0)
+    {
+        return false;
+    }
+
+    memcpy(num, &topic[prefix], topicLen - prefix);
+    num[topicLen - prefix] = '\0';
+    char* end;
+    unsigned long value = strtoul(num, &end, 10);
+    if (*end != '\0' || end == num || value > CAPCODE_ADDR_MASK) {
+        return false;
+    }
+    *address = (uint32_t)value;
+    return true;
+}
+
+
+static void on_page(const esp_mqtt_event_t* event)
+{
+    char text[MSG_TEXT_LEN + 1];
+    uint32_t address;
+
+    s_stats.received++;
+
+    // the buffer holds any page the store keeps, a longer one arrives in pieces and is not shown
+    if (event->current_data_offset != 0 || event->data_len != event->total_data_len ||
+        !topic_capcode(event->topic, event->topic_len, &address))
+    {
+        s_stats.dropped++;
+        return;
+    }
+
+    // hashed the way the radio path hashes its copy, the text without a terminator
+    size_t len = (event->data_len < (int)MSG_TEXT_LEN) ? (size_t)event->data_len : MSG_TEXT_LEN;
+    memcpy(text, event->data, len);
+    text[len] = '\0';
+    deliver_page(address, text, strlen(text));
+}
+
+
+// ==== Bench side of the event handler ======================================= //
+
+static void bench_on_page(const esp_mqtt_event_t* event)
+{
+    char payload[32];
+    uint32_t now = latency_now();
+    unsigned long seq;
+    unsigned long sentUs;
+
+    int n = (event->data_len < (int)sizeof(payload) - 1) ? event->data_len : (int)sizeof(payload) - 1;
+    memcpy(payload, event->data, n);
+    payload[n] = '\0';
+
+    xSemaphoreTake(s_benchLock, portMAX_DELAY);
+    bench_state_t* b = s_bench;
+    if (b != NULL && sscanf(payload, "%lu %lu", &seq, &sentUs) == 2 && seq < b->pages)
+    {
+        // QoS 1 is at least once, a page the broker sent again is only counted
+        if (b->seen[seq / 8] & (1u << (seq % 8))) {
+            b->duplicates++;
+        }
+        else
+        {
+            b->seen[seq / 8] |= (uint8_t)(1u << (seq % 8));
+            lat_hist_add(&b->hist, now - (uint32_t)sentUs);
+            b->received++;
+            b->lastUs = now;
+        }
+    }
+    xSemaphoreGive(s_benchLock);
+}
+
+
+static void bench_on_subscribed(int msgId)
+{
+    xSemaphoreTake(s_benchLock, portMAX_DELAY);
+    if (s_bench != NULL && (uint32_t)msgId == s_bench->subscribeId) {
+        s_bench->subscribed = true;
+    }
+    xSemaphoreGive(s_benchLock);
+}
+
+
+// ==== MQTT events ============================================================ //
+
+static void mqtt_event_handler(void* arg, esp_event_base_t base, int32_t eventId, void* eventData)
+{
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)eventData;
+
+    switch ((esp_mqtt_event_id_t)eventId)
+    {
+    case MQTT_EVENT_CONNECTED:
+        s_connected = true;
+        s_stats.connects++;
+        // a resumed persistent session still has its subscription
+        ESP_LOGI(TAG, "connected as %s, session %s", s_clientId, event->session_present ? "resumed" : "new");
+        if (!event->session_present) {
+            esp_mqtt_client_subscribe(s_client, MQTT_PAGER_TOPIC "+", 1);
+        }
+        break;
+
+    case MQTT_EVENT_DISCONNECTED:
+        if (s_connected) {
+            s_stats.disconnects++;
+            ESP_LOGW(TAG, "broker lost, pages come over the radio only until it is back");
+        }
+        s_connected = false;
+        break;
+
+    case MQTT_EVENT_SUBSCRIBED:
+        bench_on_subscribed(event->msg_id);
+        break;
+
+    case MQTT_EVENT_DATA:
+        if (event->topic_len == (int)strlen(s_benchTopic) &&
+            memcmp(event->topic, s_benchTopic, event->topic_len) == 0)
+        {
+            bench_on_page(event);
+        }
+        else {
+            on_page(event);
+        }
+        break;
+
+    case MQTT_EVENT_ERROR:
+        ESP_LOGW(TAG, "mqtt error, type %d", event->error_handle ? (int)event->error_handle->error_type : -1);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+// ==== API ==================================================================== //
+
+esp_err_t mqtt_pager_start(const char* uri, const char* clientId)
+{
+    if (s_client != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    snprintf(s_clientId, sizeof(s_clientId), "%s", clientId);
+    snprintf(s_benchTopic, sizeof(s_benchTopic), "%s%s", MQTT_PAGER_BENCH_TOPIC, s_clientId);
+    s_benchLock = xSemaphoreCreateMutexStatic(&s_benchLockBuf);
+
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = uri,
+        .credentials.client_id = s_clientId,
+        .session.disable_clean_session = true,
+        .session.keepalive = MQTT_PAGER_KEEPALIVE_S,
+        .network.reconnect_timeout_ms = RECONNECT_MS,
+        .buffer.size = BUFFER_BYTES,
+    };
+
+    s_client = esp_mqtt_client_init(&config);
+    if (s_client == NULL)
+    {
+        ESP_LOGE(TAG, "mqtt client init failed");
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    esp_err_t err = esp_mqtt_client_start(s_client);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "mqtt client start failed: %s", esp_err_to_name(err));
+        esp_mqtt_client_destroy(s_client);
+        s_client = NULL;
+        return err;
+    }
+
+    MEM_BUDGET_ADD(MQTT_PAGER, s_stats, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(MQTT_PAGER, s_benchLockBuf, MEM_REGION_DRAM);
+    ESP_LOGI(TAG, "pages from %s as %s", uri, s_clientId);
+    return ESP_OK;
+}
+
+
+bool mqtt_pager_is_connected(void)
+{
+    return s_connected;
+}
+
+
+void mqtt_pager_get_stats(mqtt_pager_stats_t* out)
+{
+    *out = s_stats;
+}
+
+
+void mqtt_pager_log_stats(void)
+{
+    ESP_LOGI(TAG, "mqtt pages: %lu in, %lu shown first, %lu already had, %lu not ours, %lu dropped, "
+             "%lu evicted; %lu connects, %lu disconnects%s",
+             (unsigned long)s_stats.received, (unsigned long)s_stats.delivered, (unsigned long)s_stats.duplicates,
+             (unsigned long)s_stats.filtered, (unsigned long)s_stats.dropped, (unsigned long)s_stats.evicted,
+             (unsigned long)s_stats.connects, (unsigned long)s_stats.disconnects,
+             s_connected ? "" : " (not connected)");
+}
+
+
+// ==== Benchmark ============================================================== //
+
+// what the MQTT task has counted so far
+static void bench_progress(bench_state_t* b, bool* subscribed, uint32_t* received)
+{
+    xSemaphoreTake(s_benchLock, portMAX_DELAY);
+    *subscribed = b->subscribed;
+    *received = b->received;
+    xSemaphoreGive(s_benchLock);
+}
+
+
+// wait until the SUBACK came and at least atLeast pages are back, false after BENCH_WAIT_MS
+static bool bench_wait(bench_state_t* b, uint32_t atLeast)
+{
+    int64_t until = esp_timer_get_time() + BENCH_WAIT_MS * 1000LL;
+    bool subscribed;
+    uint32_t received;
+
+    for (;;)
+    {
+        bench_progress(b, &subscribed, &received);
+        if (subscribed && received >= atLeast) {
+            return true;
+        }
+        if (esp_timer_get_time() >= until) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+
+void mqtt_pager_bench(uint32_t pages, uint32_t pageBytes)
+{
+    char payload[MSG_TEXT_LEN + 1];
+
+    if (s_client == NULL)
+    {
+        ESP_LOGW(TAG, "bench: mqtt_pager_start() first");
+        return;
+    }
+    if (pages > BENCH_MAX_PAGES) {
+        pages = BENCH_MAX_PAGES;
+    }
+    if (pageBytes > MSG_TEXT_LEN) {
+        pageBytes = MSG_TEXT_LEN;
+    }
+
+    for (int i = 0; i < BENCH_WAIT_MS && !s_connected; i++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    if (!s_connected)
+    {
+        ESP_LOGW(TAG, "bench: broker not connected");
+        return;
+    }
+
+    bench_state_t* b = calloc(1, sizeof(*b));
+    if (b == NULL)
+    {
+        ESP_LOGE(TAG, "bench: no memory");
+        return;
+    }
+    b->pages = pages;
+    lat_hist_reset(&b->hist);
+
+    xSemaphoreTake(s_benchLock, portMAX_DELAY);
+    s_bench = b;
+    b->subscribeId = (uint32_t)esp_mqtt_client_subscribe(s_client, s_benchTopic, 1);
+    xSemaphoreGive(s_benchLock);
+
+    uint32_t sent = 0;
+    int64_t start = esp_timer_get_time();
+    if (bench_wait(b, 0))
+    {
+        start = esp_timer_get_time();
+        for (; sent < pages; sent++)
+        {
+            // keep a window in flight, the outbox would otherwise take every page up front
+            if (sent >= BENCH_WINDOW && !bench_wait(b, sent - BENCH_WINDOW + 1)) {
+                break;
+            }
+
+            int n = snprintf(payload, sizeof(payload), "%lu %lu ", (unsigned long)sent, (unsigned long)latency_now());
+            while ((uint32_t)n < pageBytes) {
+                payload[n++] = 'x';
+            }
+            if (esp_mqtt_client_publish(s_client, s_benchTopic, payload, n, 1, 0) < 0) {
+                break;
+            }
+        }
+        bench_wait(b, sent);
+    }
+    else {
+        ESP_LOGW(TAG, "bench: no SUBACK for %s", s_benchTopic);
+    }
+
+    esp_mqtt_client_unsubscribe(s_client, s_benchTopic);
+    xSemaphoreTake(s_benchLock, portMAX_DELAY);
+    s_bench = NULL;
+    xSemaphoreGive(s_benchLock);
+
+    lat_summary_t sum;
+    lat_hist_summarize(&b->hist, &sum);
+    uint32_t took = b->lastUs - (uint32_t)start;
+    ESP_LOGI(TAG, "bench: %lu of %lu pages of %lu bytes back (%lu sent again), publish to delivery p50 %lu us, "
+             "p95 %lu, p99 %lu, max %lu", (unsigned long)b->received, (unsigned long)sent,
+             (unsigned long)pageBytes, (unsigned long)b->duplicates, (unsigned long)sum.p50,
+             (unsigned long)sum.p95, (unsigned long)sum.p99, (unsigned long)sum.max);
+    if (b->received > 0 && took > 0)
+    {
+        ESP_LOGI(TAG, "bench: %.0f pages/s, %.0f payload bytes/s with up to %u in flight",
+                 (double)b->received * 1e6 / took, (double)b->received * pageBytes * 1e6 / took, BENCH_WINDOW);
+    }
+    free(b);
+}
@@ -0,0 +1,67 @@
+#ifndef MQTT_PAGER_H
+#define MQTT_PAGER_H
+
+/*
+    - Pages over WiFi as a second way in next to the POCSAG receiver: an MQTT subscription whose
+      pages go through msg_store and xMsgBufferQueue to the display like the radio's, queued with
+      the radio's own rf_enqueue_message() so the two producers never block each other on it
+    - The paging server publishes every page to MQTT_PAGER_TOPIC "<capcode>" (decimal), the
+      payload is the page text. The device subscribes to all of them and keeps the capcodes its
+      table matches, the same filter as the radio
+    - QoS 1 on a persistent session (clean session off, a fixed client id per device), so the
+      broker keeps what arrives while the device is off the network and sends it on reconnect;
+      esp-mqtt reconnects on its own
+    - A page sent both ways shows once, msg_dedup drops whichever copy comes second. The radio
+      keeps running the whole time, so losing WiFi only loses the second copy. NOTE: a page held
+      by the broker for longer than the dedup window (or behind more than MSG_DEDUP_SLOTS newer
+      pages) is shown a second time on reconnect
+    - Pages from here count in the QUEUED / DRAW / TOTAL latency stages like radio pages, their
+      timestamps start when the MQTT event arrives
+    - tools/mqtt_broker.py is a stand-in broker for the host build
+    - Only built with CONFIG_MQTT_PAGER_ENABLE (menuconfig: MQTT pager), otherwise this header is
+      all there is and esp-mqtt is not linked in
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MQTT_PAGER_TOPIC        "pager/page/"
+#define MQTT_PAGER_BENCH_TOPIC  "pager/bench/"      // + client id, never reaches the display
+#define MQTT_PAGER_ID_LEN       24
+#define MQTT_PAGER_KEEPALIVE_S  30
+
+typedef struct {
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t received;          // pages in, before any filtering
+    uint32_t delivered;         // queued for the display, this copy was the first
+    uint32_t duplicates;        // the radio (or an earlier MQTT copy) had it already
+    uint32_t filtered;          // not one of our capcodes
+    uint32_t dropped;           // bad topic, or a page split over several MQTT events
+    uint32_t evicted;           // oldest queued message thrown out to make room
+} mqtt_pager_stats_t;
+
+
+// connect to the broker at uri as clientId and subscribe, needs the network up and the sync
+// objects created; the connection itself comes up in the background
+esp_err_t mqtt_pager_start(const char* uri, const char* clientId);
+bool mqtt_pager_is_connected(void);
+
+void mqtt_pager_get_stats(mqtt_pager_stats_t* out);
+void mqtt_pager_log_stats(void);
+
+// publish pages of pageBytes to a topic of our own and time each one back through the broker:
+// publish to delivery latency (two hops over the broker) and pages per second, at most 8 in flight
+void mqtt_pager_bench(uint32_t pages, uint32_t pageBytes);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MQTT_PAGER_H
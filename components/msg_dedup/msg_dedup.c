@@ -0,0 +1,94 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "msg_dedup.h"
+
+
+#define FNV_OFFSET  2166136261UL
+#define FNV_PRIME   16777619UL
+
+typedef struct {
+    uint32_t hash;
+    uint16_t len;
+    bool     used;
+    uint32_t seenMs;
+} dedup_slot_t;
+
+static dedup_slot_t         s_ring[MSG_DEDUP_SLOTS];
+static uint8_t              s_head;     // next slot to overwrite, the oldest entry
+static uint32_t             s_windowMs = MSG_DEDUP_DEFAULT_WINDOW_MS;
+static msg_dedup_stats_t    s_stats;
+static portMUX_TYPE         s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+bool msg_dedup_check(uint32_t address, const char* text, size_t len)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+
+    uint8_t addr[4] = { (uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24) };
+    uint32_t hash = fnv1a(FNV_OFFSET, addr, sizeof(addr));
+    hash = fnv1a(hash, (const uint8_t*)text, len);
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.checked++;
+
+    for (int i = 0; i < MSG_DEDUP_SLOTS; i++)
+    {
+        dedup_slot_t* slot = &s_ring[i];
+
+        // the window counts from the first copy, so a page repeated for ever still shows once per window
+        if (slot->used && slot->hash == hash && slot->len == (uint16_t)len &&
+            (uint32_t)(now - slot->seenMs) < s_windowMs)
+        {
+            s_stats.suppressed++;
+            portEXIT_CRITICAL(&s_lock);
+            return true;
+        }
+    }
+
+    s_ring[s_head].hash = hash;
+    s_ring[s_head].len = (uint16_t)len;
+    s_ring[s_head].used = true;
+    s_ring[s_head].seenMs = now;
+    s_head = (uint8_t)((s_head + 1) % MSG_DEDUP_SLOTS);
+    portEXIT_CRITICAL(&s_lock);
+
+    return false;
+}
+
+
+void msg_dedup_set_window(uint32_t windowMs)
+{
+    s_windowMs = windowMs;
+}
+
+
+void msg_dedup_reset(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_ring, 0, sizeof(s_ring));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_head = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+void msg_dedup_get_stats(msg_dedup_stats_t* out)
+{
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
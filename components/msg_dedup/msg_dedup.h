@@ -0,0 +1,44 @@
+#ifndef MSG_DEDUP_H
+#define MSG_DEDUP_H
+
+/*
+    - Suppresses pages the paging system retransmits, before the copies reach xMsgBufferQueue,
+      and the copy of a page that arrives both over the radio and over MQTT (mqtt_pager)
+    - A page is identified by a 32 bit FNV-1a hash over (capcode, text) plus its length
+    - The last MSG_DEDUP_SLOTS pages live in a fixed ring, a page is a duplicate when the same
+      identity was seen within the window; lookup is a scan of the ring, so the cost per page
+      is constant and nothing is allocated
+    - The radio task and the MQTT task both check, the ring is under a short spinlock
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSG_DEDUP_SLOTS             32
+#define MSG_DEDUP_DEFAULT_WINDOW_MS 60000
+
+typedef struct {
+    uint32_t checked;       // pages looked at
+    uint32_t suppressed;    // of which duplicates
+} msg_dedup_stats_t;
+
+
+// true if this page was already seen inside the window (and should be dropped),
+// otherwise it is remembered and false is returned
+bool msg_dedup_check(uint32_t address, const char* text, size_t len);
+
+void msg_dedup_set_window(uint32_t windowMs);
+void msg_dedup_reset(void);     // forget every page, counters included
+void msg_dedup_get_stats(msg_dedup_stats_t* out);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MSG_DEDUP_H
@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "msg_log.h"
+#include "mem_budget.h"
+
+
+#define SECTOR_MAGIC0       'M'
+#define SECTOR_MAGIC1       'L'
+#define SECTOR_VERSION      1
+#define SECTOR_HDR_BYTES    12
+#define SECTOR_PAYLOAD      (MSG_LOG_SECTOR - SECTOR_HDR_BYTES)
+#define LOG_PATH_LEN        128
+
+// sector header, little endian
+//   0-1 magic, 2-3 boot, 4-7 first seq, 8-9 payload bytes used, 10 record count, 11 version
+
+typedef struct {
+    int         fd;
+    uint32_t    firstSeq[MSG_LOG_SECTORS];  // seq of the first record in each slot
+    uint32_t    slots;          // sectors in the file, filled in order until the ring wraps
+    uint32_t    last;           // slot written most recently
+    uint32_t    nextSeq;
+    uint16_t    boot;
+
+    // the sector being filled, as it is on the card
+    bool        tailOpen;
+    uint16_t    tailUsed;
+    uint8_t     tailCount;
+    uint8_t     tail[MSG_LOG_SECTOR];
+
+    // last sector read for scrollback
+    int32_t     cacheSlot;
+    uint8_t     cache[MSG_LOG_SECTOR];
+
+    uint32_t    failStreak;     // failed appends in a row, only the first one is logged
+
+    msg_log_stats_t stats;
+} log_t;
+
+static const char* TAG = "MSG_LOG";
+
+static log_t s_log = { .fd = -1 };
+
+
+// ==== Sector helpers ======================================================= //
+
+static inline uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t get_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void put_u16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+
+// true if the header is one of ours and its fill fits the sector
+static bool sector_valid(const uint8_t* s)
+{
+    return s[0] == SECTOR_MAGIC0 && s[1] == SECTOR_MAGIC1 && s[11] == SECTOR_VERSION &&
+           get_u32(&s[4]) != MSG_STORE_NO_SEQ && get_u16(&s[8]) <= SECTOR_PAYLOAD;
+}
+
+
+static uint32_t oldest_slot(const log_t* lg)
+{
+    return (lg->slots < MSG_LOG_SECTORS) ? 0 : (lg->last + 1) % MSG_LOG_SECTORS;
+}
+
+
+static uint32_t oldest_seq(const log_t* lg)
+{
+    return (lg->slots > 0) ? lg->firstSeq[oldest_slot(lg)] : lg->nextSeq;
+}
+
+
+// ==== Log internals, no locking ============================================ //
+
+static void log_rebuild(log_t* lg)
+{
+    int64_t t0 = esp_timer_get_time();
+
+    off_t size = lseek(lg->fd, 0, SEEK_END);
+    uint32_t slots = (size > 0) ? (uint32_t)(size / MSG_LOG_SECTOR) : 0;
+    if (slots > MSG_LOG_SECTORS) {
+        slots = MSG_LOG_SECTORS;    // grown by a build with a bigger ring, the rest is ignored
+    }
+
+    uint32_t newest = 0;
+    uint8_t newestCount = 0;
+    bool any = false;
+    uint8_t hdr[SECTOR_HDR_BYTES];
+
+    for (uint32_t s = 0; s < slots; s++)
+    {
+        lg->firstSeq[s] = MSG_STORE_NO_SEQ;
+        if (pread(lg->fd, hdr, sizeof(hdr), (off_t)s * MSG_LOG_SECTOR) != (ssize_t)sizeof(hdr) || !sector_valid(hdr))
+        {
+            lg->stats.bad_sectors++;
+            continue;
+        }
+
+        uint32_t first = get_u32(&hdr[4]);
+        lg->firstSeq[s] = first;
+        if (get_u16(&hdr[2]) >= lg->boot) {
+            lg->boot = get_u16(&hdr[2]) + 1;
+        }
+        if (!any || first > lg->firstSeq[newest])
+        {
+            newest = s;
+            newestCount = hdr[10];
+            any = true;
+        }
+    }
+
+    if (!any)
+    {
+        // nothing usable, start over at the front of the file
+        lg->slots = 0;
+        lg->last = MSG_LOG_SECTORS - 1;
+        lg->nextSeq = 1;
+    }
+    else
+    {
+        lg->slots = slots;
+        lg->last = newest;
+        lg->nextSeq = lg->firstSeq[newest] + newestCount;
+
+        // a bad sector takes the first seq of the one after it, so the index stays sorted and
+        // lookups into it just miss
+        uint32_t next = lg->nextSeq;
+        uint32_t start = oldest_slot(lg);
+        for (uint32_t i = lg->slots; i-- > 0; )
+        {
+            uint32_t s = (start + i) % MSG_LOG_SECTORS;
+            if (lg->firstSeq[s] == MSG_STORE_NO_SEQ) {
+                lg->firstSeq[s] = next;
+            } else {
+                next = lg->firstSeq[s];
+            }
+        }
+    }
+
+    lg->stats.sectors = lg->slots;
+    lg->stats.rebuild_us = (uint32_t)(esp_timer_get_time() - t0);
+}
+
+
+static esp_err_t log_open(log_t* lg, const char* path)
+{
+    memset(lg, 0, sizeof(*lg));
+    lg->cacheSlot = -1;
+
+    lg->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (lg->fd < 0)
+    {
+        ESP_LOGE(TAG, "could not open %s", path);
+        return ESP_FAIL;
+    }
+
+    log_rebuild(lg);
+    return ESP_OK;
+}
+
+
+static void log_close(log_t* lg)
+{
+    if (lg->fd >= 0) {
+        close(lg->fd);
+    }
+    lg->fd = -1;
+}
+
+
+// every boot gets its own sectors, so the boot count in a header covers all of its records
+static void log_start_sector(log_t* lg)
+{
+    uint32_t slot = (lg->last + 1) % MSG_LOG_SECTORS;
+    if (slot == lg->slots && lg->slots < MSG_LOG_SECTORS) {
+        lg->slots++;            // file grows by one sector
+    }                           // otherwise the oldest sector is overwritten
+
+    memset(lg->tail, 0xFF, sizeof(lg->tail));
+    lg->tail[0] = SECTOR_MAGIC0;
+    lg->tail[1] = SECTOR_MAGIC1;
+    put_u16(&lg->tail[2], lg->boot);
+    put_u32(&lg->tail[4], lg->nextSeq);
+    lg->tail[11] = SECTOR_VERSION;
+
+    lg->tailUsed = 0;
+    lg->tailCount = 0;
+    lg->tailOpen = true;
+    lg->firstSeq[slot] = lg->nextSeq;
+    lg->last = slot;
+    lg->stats.sectors = lg->slots;
+
+    if (lg->cacheSlot == (int32_t)slot) {
+        lg->cacheSlot = -1;
+    }
+}
+
+
+static uint32_t log_append(log_t* lg, const msg_store_hdr_t* hdr, const char* text)
+{
+    if (lg->fd < 0) {
+        return MSG_STORE_NO_SEQ;
+    }
+    int64_t t0 = esp_timer_get_time();
+
+    uint32_t rec = MSG_STORE_HDR_BYTES + hdr->len;
+    if (!lg->tailOpen || lg->tailUsed + rec > SECTOR_PAYLOAD) {
+        log_start_sector(lg);
+    }
+
+    // same record layout as msg_store: time (4), capcode (3), type (1), length (1), text
+    uint8_t* p = &lg->tail[SECTOR_HDR_BYTES + lg->tailUsed];
+    put_u32(p, hdr->time_ms);
+    p[4] = (uint8_t)hdr->address;
+    p[5] = (uint8_t)(hdr->address >> 8);
+    p[6] = (uint8_t)(hdr->address >> 16);
+    p[7] = hdr->type;
+    p[8] = hdr->len;
+    memcpy(&p[MSG_STORE_HDR_BYTES], text, hdr->len);
+
+    lg->tailUsed += rec;
+    lg->tailCount++;
+    put_u16(&lg->tail[8], lg->tailUsed);
+    lg->tail[10] = lg->tailCount;
+
+    // the whole sector, at its own offset, then out of the FAT / card caches
+    off_t off = (off_t)lg->last * MSG_LOG_SECTOR;
+    if (pwrite(lg->fd, lg->tail, MSG_LOG_SECTOR, off) != MSG_LOG_SECTOR || fsync(lg->fd) != 0)
+    {
+        // the record is taken back out, so the next one gets its seq and its place in the sector;
+        // the next successful write puts the whole sector right on the card again
+        lg->tailUsed -= rec;
+        lg->tailCount--;
+        memset(p, 0xFF, rec);
+        put_u16(&lg->tail[8], lg->tailUsed);
+        lg->tail[10] = lg->tailCount;
+        if (lg->failStreak++ == 0) {
+            ESP_LOGE(TAG, "sector %lu write failed", (unsigned long)lg->last);
+        }
+        lg->stats.append_failures++;
+        return MSG_STORE_NO_SEQ;
+    }
+    if (lg->failStreak > 0)
+    {
+        ESP_LOGW(TAG, "sector %lu written again after %lu failed writes", (unsigned long)lg->last,
+                 (unsigned long)lg->failStreak);
+        lg->failStreak = 0;
+    }
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    lg->stats.appends++;
+    lg->stats.append_us_last = us;
+    lg->stats.append_us_sum += us;
+    if (us > lg->stats.append_us_max) {
+        lg->stats.append_us_max = us;
+    }
+    return lg->nextSeq++;
+}
+
+
+static int log_read(log_t* lg, uint32_t seq, msg_store_hdr_t* hdr, char* text, size_t textCap)
+{
+    uint32_t oldest = oldest_seq(lg);
+    if (lg->fd < 0 || seq - oldest >= lg->nextSeq - oldest) {
+        return -1;
+    }
+
+    // last sector (in ring order) whose first record is at or before seq
+    uint32_t start = oldest_slot(lg);
+    uint32_t lo = 0;
+    uint32_t hi = lg->slots - 1;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (lg->firstSeq[(start + mid) % MSG_LOG_SECTORS] <= seq) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    uint32_t slot = (start + lo) % MSG_LOG_SECTORS;
+
+    const uint8_t* s;
+    if (lg->tailOpen && slot == lg->last) {
+        s = lg->tail;
+    }
+    else
+    {
+        if (lg->cacheSlot != (int32_t)slot)
+        {
+            int64_t t0 = esp_timer_get_time();
+            lg->cacheSlot = -1;
+            if (pread(lg->fd, lg->cache, MSG_LOG_SECTOR, (off_t)slot * MSG_LOG_SECTOR) != MSG_LOG_SECTOR) {
+                return -1;
+            }
+            lg->cacheSlot = (int32_t)slot;
+
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+            lg->stats.sector_reads++;
+            if (us > lg->stats.read_us_max) {
+                lg->stats.read_us_max = us;
+            }
+        }
+        s = lg->cache;
+    }
+
+    if (!sector_valid(s) || get_u32(&s[4]) != lg->firstSeq[slot]) {
+        return -1;
+    }
+
+    // walk the records in front of it, bounded by the sector's own fill (sector_valid() keeps that
+    // inside the sector); a torn sector has no CRC, every length is checked before it is used
+    uint32_t skip = seq - lg->firstSeq[slot];
+    uint32_t used = get_u16(&s[8]);
+    uint32_t pos = 0;
+    if (skip >= s[10]) {
+        return -1;
+    }
+    for (uint32_t i = 0; i <= skip; i++)
+    {
+        if (pos + MSG_STORE_HDR_BYTES > used) {
+            return -1;
+        }
+        uint32_t next = pos + MSG_STORE_HDR_BYTES + s[SECTOR_HDR_BYTES + pos + 8];
+        if (next > used) {
+            return -1;
+        }
+        if (i < skip) {
+            pos = next;
+        }
+    }
+
+    const uint8_t* p = &s[SECTOR_HDR_BYTES + pos];
+
+    if (hdr != NULL)
+    {
+        hdr->seq = seq;
+        hdr->time_ms = get_u32(p);
+        hdr->address = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16);
+        hdr->type = p[7];
+        hdr->len = p[8];
+    }
+    if (text != NULL && textCap > 0)
+    {
+        size_t n = (p[8] < textCap - 1) ? p[8] : textCap - 1;
+        memcpy(text, &p[MSG_STORE_HDR_BYTES], n);
+        text[n] = '\0';
+    }
+    return 0;
+}
+
+
+// ==== Public functions ===================================================== //
+
+esp_err_t msg_log_open(const char* dir)
+{
+    char path[LOG_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", dir, MSG_LOG_FILE);
+
+    log_close(&s_log);
+    esp_err_t err = log_open(&s_log, path);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    MEM_BUDGET_ADD(MSG_LOG, s_log, MEM_REGION_DRAM);
+    ESP_LOGI(TAG, "%s: %lu sectors, seq %lu..%lu, boot %u, index rebuilt in %lu us (%lu bad sectors)",
+             path, (unsigned long)s_log.slots, (unsigned long)msg_log_oldest(), (unsigned long)msg_log_newest(),
+             (unsigned)s_log.boot, (unsigned long)s_log.stats.rebuild_us, (unsigned long)s_log.stats.bad_sectors);
+    return ESP_OK;
+}
+
+
+void msg_log_close(void)
+{
+    log_close(&s_log);
+}
+
+
+bool msg_log_is_open(void)
+{
+    return s_log.fd >= 0;
+}
+
+
+uint32_t msg_log_append(const msg_store_hdr_t* hdr, const char* text)
+{
+    return log_append(&s_log, hdr, text);
+}
+
+
+int msg_log_read(uint32_t seq, msg_store_hdr_t* hdr, char* text, size_t textCap)
+{
+    return log_read(&s_log, seq, hdr, text, textCap);
+}
+
+
+uint32_t msg_log_oldest(void)
+{
+    return oldest_seq(&s_log);
+}
+
+
+uint32_t msg_log_newest(void)
+{
+    return s_log.nextSeq - 1;
+}
+
+
+void msg_log_get_stats(msg_log_stats_t* out)
+{
+    *out = s_log.stats;
+}
+
+
+// ==== Benchmark ============================================================== //
+
+#define BENCH_MIN_LEN   20
+#define BENCH_MAX_LEN   60
+#define BENCH_READS     1000
+#define BENCH_SCROLL    200
+
+static uint32_t bench_rng(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+void msg_log_bench(const char* dir, uint32_t messages)
+{
+    static const char pool[] = "CODE BLUE RM 412 BED 2 - DR PATEL TO ICU STAT, CALL EXT 5521 RE LABS ";
+    char path[LOG_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/msglogb.bin", dir);
+    unlink(path);
+
+    // private log on the heap so the live one is untouched
+    log_t* lg = malloc(sizeof(log_t));
+    if (lg == NULL || messages == 0)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        free(lg);
+        return;
+    }
+    if (log_open(lg, path) != ESP_OK)
+    {
+        free(lg);
+        return;
+    }
+
+    // ---- append ---- //
+    uint32_t rng = 0x6A09E667;
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < messages; i++)
+    {
+        msg_store_hdr_t hdr = {
+            .time_ms = i,
+            .address = 1000000 + i,
+            .type = 0,
+            .len = (uint8_t)(BENCH_MIN_LEN + bench_rng(&rng) % (BENCH_MAX_LEN - BENCH_MIN_LEN + 1)),
+        };
+        failed += (log_append(lg, &hdr, &pool[i % 8]) == MSG_STORE_NO_SEQ);
+    }
+    msg_log_stats_t app = lg->stats;
+    uint32_t held = lg->nextSeq - oldest_seq(lg);
+
+    // ---- reopen, the index comes back from the sector headers ---- //
+    log_close(lg);
+    log_open(lg, path);
+    uint32_t rebuildUs = lg->stats.rebuild_us;
+    uint32_t slots = lg->slots;
+    bool same = (lg->nextSeq - oldest_seq(lg) == held);
+
+    // ---- one page anywhere in the log, nothing cached ---- //
+    msg_store_hdr_t hdr;
+    char text[MSG_STORE_TEXT_MAX + 1];
+    uint32_t bad = 0;
+    uint32_t oldest = oldest_seq(lg);
+    int64_t coldUs = 0;
+    if (held == 0)
+    {
+        ESP_LOGE(TAG, "bench: nothing held after %lu failed writes, no reads", (unsigned long)failed);
+        log_close(lg);
+        unlink(path);
+        free(lg);
+        return;
+    }
+    for (uint32_t i = 0; i < BENCH_READS; i++)
+    {
+        uint32_t seq = oldest + bench_rng(&rng) % held;
+        lg->cacheSlot = -1;
+        int64_t t0 = esp_timer_get_time();
+        int ret = log_read(lg, seq, &hdr, text, sizeof(text));
+        coldUs += esp_timer_get_time() - t0;
+        bad += (ret != 0 || hdr.address != 1000000 + (seq - 1) || memcmp(text, &pool[(seq - 1) % 8], hdr.len) != 0);
+    }
+
+    // ---- scrolling back from the newest page, the way the display does ---- //
+    uint32_t readsBefore = lg->stats.sector_reads;
+    uint32_t scroll = (held < BENCH_SCROLL) ? held : BENCH_SCROLL;
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < scroll; i++) {
+        bad += (log_read(lg, lg->nextSeq - 1 - i, NULL, text, sizeof(text)) != 0);
+    }
+    int64_t scrollUs = esp_timer_get_time() - t0;
+    uint32_t scrollReads = lg->stats.sector_reads - readsBefore;
+
+    ESP_LOGI(TAG, "bench: %lu pages of %d-%d chars, %lu held in %lu sectors (%lu KiB on the card), %lu failed writes",
+             (unsigned long)messages, BENCH_MIN_LEN, BENCH_MAX_LEN, (unsigned long)held, (unsigned long)slots,
+             (unsigned long)(slots * MSG_LOG_SECTOR / 1024), (unsigned long)failed);
+    ESP_LOGI(TAG, "bench: append %.0f us avg, %lu us max (sector write + fsync)",
+             (double)app.append_us_sum / (app.appends ? app.appends : 1), (unsigned long)app.append_us_max);
+    ESP_LOGI(TAG, "bench: index rebuild %lu us for %lu sectors (%.1f us each), %s",
+             (unsigned long)rebuildUs, (unsigned long)slots, (double)rebuildUs / (slots ? slots : 1),
+             same ? "same range as before" : "RANGE CHANGED");
+    ESP_LOGI(TAG, "bench: page read %.1f us cold (one sector), scroll of %lu pages %.1f us each with %lu sector reads, "
+             "%lu mismatches", (double)coldUs / BENCH_READS, (unsigned long)scroll,
+             (double)scrollUs / (scroll ? scroll : 1), (unsigned long)scrollReads, (unsigned long)bad);
+
+    log_close(lg);
+    unlink(path);
+    free(lg);
+}
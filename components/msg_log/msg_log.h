@@ -0,0 +1,73 @@
+#ifndef MSG_LOG_H
+#define MSG_LOG_H
+
+/*
+    - Every page ever received, in one append-only file on the SD card, so the display can scroll
+      back past what msg_store still holds in RAM
+    - The file is a ring of MSG_LOG_SECTORS 512 byte sectors. A sector has a 12 byte header
+      (magic, boot count, seq of its first record, fill) and whole records, same 9 byte header +
+      text layout as msg_store, a record never straddles two sectors
+    - Appending rewrites the one sector being filled at its aligned offset, so a power cut loses at
+      most the record being written; each boot starts a fresh sector
+    - RAM index: the first seq of every sector (4 bytes each), built from the sector headers when
+      the log is opened; finding a record is a binary search over it and one sector read, and the
+      last sector read is cached so scrolling inside it costs nothing
+    - Not thread safe, only the display task uses the live log
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "msg_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSG_LOG_SECTOR          512
+#define MSG_LOG_SECTORS         1024    // 512 KiB file, ~10000 pages of 40 characters
+#define MSG_LOG_FILE            "msglog.bin"    // 8.3, the card is mounted without long names
+
+typedef struct {
+    uint32_t appends;
+    uint32_t append_failures;   // writes the card refused, the page was not logged
+    uint32_t append_us_last;
+    uint32_t append_us_max;
+    uint64_t append_us_sum;
+    uint32_t sector_reads;      // reads that missed the one sector cache
+    uint32_t read_us_max;
+    uint32_t rebuild_us;        // index rebuild on the last open
+    uint32_t bad_sectors;       // sectors skipped at rebuild (torn write, not a log)
+    uint32_t sectors;           // sectors in use
+} msg_log_stats_t;
+
+
+// open (or create) dir/MSG_LOG_FILE and rebuild the index from it
+esp_err_t msg_log_open(const char* dir);
+void msg_log_close(void);
+bool msg_log_is_open(void);
+
+// append one page, returns its log seq (MSG_STORE_NO_SEQ if the log is not open or the write failed)
+// hdr->seq is ignored, the log numbers its records on its own and keeps counting across boots
+uint32_t msg_log_append(const msg_store_hdr_t* hdr, const char* text);
+
+// one record by log seq, hdr->seq is the log seq, -1 if it is not in the log
+int msg_log_read(uint32_t seq, msg_store_hdr_t* hdr, char* text, size_t textCap);
+
+// range of log seq in the file, oldest > newest when it is empty
+uint32_t msg_log_oldest(void);
+uint32_t msg_log_newest(void);
+
+void msg_log_get_stats(msg_log_stats_t* out);
+
+// append / rebuild / page read timing on a scratch log in dir, which is removed afterwards
+void msg_log_bench(const char* dir, uint32_t messages);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MSG_LOG_H
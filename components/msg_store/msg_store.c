@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "msg_store.h"
+#include "mem_budget.h"
+
+
+#define INDEX_MASK  (MSG_STORE_INDEX_LEN - 1)
+
+#if (MSG_STORE_INDEX_LEN & INDEX_MASK) != 0
+#error MSG_STORE_INDEX_LEN must be a power of two
+#endif
+#if MSG_STORE_ARENA_BYTES > 65536
+#error MSG_STORE_ARENA_BYTES must fit a 16 bit offset
+#endif
+
+// records sit back to back and may wrap around the end of the arena, the oldest one starts at
+// index[oldest], so only the write position and the fill level are kept
+typedef struct {
+    uint8_t     arena[MSG_STORE_ARENA_BYTES];
+    uint16_t    index[MSG_STORE_INDEX_LEN];     // arena offset of record seq, at seq & INDEX_MASK
+    uint32_t    head;       // where the next record goes
+    uint32_t    used;       // bytes held
+    uint32_t    oldest;     // seq of the oldest record held
+    uint32_t    next;       // seq the next record gets, oldest == next when empty
+    msg_store_stats_t stats;
+} store_t;
+
+static const char* TAG = "MSG_STORE";
+
+static store_t      s_store;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+// ==== Store internals, no locking ========================================== //
+
+static void arena_write(store_t* st, uint32_t off, const void* data, size_t n)
+{
+    size_t first = MSG_STORE_ARENA_BYTES - off;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(&st->arena[off], data, first);
+    memcpy(&st->arena[0], (const uint8_t*)data + first, n - first);
+}
+
+
+static void arena_read(const store_t* st, uint32_t off, void* data, size_t n)
+{
+    size_t first = MSG_STORE_ARENA_BYTES - off;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(data, &st->arena[off], first);
+    memcpy((uint8_t*)data + first, &st->arena[0], n - first);
+}
+
+
+static void store_clear(store_t* st)
+{
+    memset(st, 0, sizeof(*st));
+    st->oldest = 1;     // seq 0 is MSG_STORE_NO_SEQ
+    st->next = 1;
+}
+
+
+static void store_evict_oldest(store_t* st)
+{
+    uint32_t off = st->index[st->oldest & INDEX_MASK];
+    uint8_t len = st->arena[(off + MSG_STORE_HDR_BYTES - 1) % MSG_STORE_ARENA_BYTES];
+
+    st->used -= MSG_STORE_HDR_BYTES + len;
+    st->oldest++;
+    st->stats.evicted++;
+}
+
+
+static uint32_t store_append(store_t* st, uint32_t address, uint8_t type, const char* text, size_t len,
+                             uint32_t timeMs)
+{
+    if (len > MSG_STORE_TEXT_MAX)
+    {
+        len = MSG_STORE_TEXT_MAX;
+        st->stats.truncated++;
+    }
+    uint32_t rec = MSG_STORE_HDR_BYTES + (uint32_t)len;
+
+    // every record is evicted at most once, so this stays O(1) per append on average
+    while (st->used + rec > MSG_STORE_ARENA_BYTES || (st->next - st->oldest) >= MSG_STORE_INDEX_LEN) {
+        store_evict_oldest(st);
+    }
+
+    // little endian: time (4), capcode (3), type (1), length (1)
+    uint8_t hdr[MSG_STORE_HDR_BYTES] = {
+        (uint8_t)timeMs, (uint8_t)(timeMs >> 8), (uint8_t)(timeMs >> 16), (uint8_t)(timeMs >> 24),
+        (uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16),
+        type, (uint8_t)len,
+    };
+    arena_write(st, st->head, hdr, sizeof(hdr));
+    arena_write(st, (st->head + MSG_STORE_HDR_BYTES) % MSG_STORE_ARENA_BYTES, text, len);
+
+    uint32_t seq = st->next++;
+    st->index[seq & INDEX_MASK] = (uint16_t)st->head;
+    st->head = (st->head + rec) % MSG_STORE_ARENA_BYTES;
+    st->used += rec;
+
+    st->stats.appended++;
+    if (st->used > st->stats.arena_high_water) {
+        st->stats.arena_high_water = st->used;
+    }
+    return seq;
+}
+
+
+static int store_get(store_t* st, uint32_t seq, msg_store_hdr_t* hdr, char* text, size_t textCap)
+{
+    // unsigned distance, also right once seq wraps (after 4 billion pages)
+    if (seq - st->oldest >= st->next - st->oldest)
+    {
+        st->stats.lookups_missed++;
+        return -1;
+    }
+
+    uint32_t off = st->index[seq & INDEX_MASK];
+    uint8_t raw[MSG_STORE_HDR_BYTES];
+    arena_read(st, off, raw, sizeof(raw));
+
+    uint8_t len = raw[8];
+    if (hdr != NULL)
+    {
+        hdr->seq = seq;
+        hdr->time_ms = (uint32_t)raw[0] | ((uint32_t)raw[1] << 8) | ((uint32_t)raw[2] << 16) | ((uint32_t)raw[3] << 24);
+        hdr->address = (uint32_t)raw[4] | ((uint32_t)raw[5] << 8) | ((uint32_t)raw[6] << 16);
+        hdr->type = raw[7];
+        hdr->len = len;
+    }
+
+    if (text != NULL && textCap > 0)
+    {
+        size_t n = (len < textCap - 1) ? len : textCap - 1;
+        arena_read(st, (off + MSG_STORE_HDR_BYTES) % MSG_STORE_ARENA_BYTES, text, n);
+        text[n] = '\0';
+    }
+    return 0;
+}
+
+
+// ==== Public functions ===================================================== //
+
+void msg_store_init(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    store_clear(&s_store);
+    portEXIT_CRITICAL(&s_lock);
+
+    MEM_BUDGET_ADD(MSG_STORE, s_store, MEM_REGION_DRAM);
+}
+
+
+uint32_t msg_store_append(uint32_t address, uint8_t type, const char* text, size_t len)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+
+    portENTER_CRITICAL(&s_lock);
+    uint32_t seq = store_append(&s_store, address, type, text, len, now);
+    portEXIT_CRITICAL(&s_lock);
+    return seq;
+}
+
+
+int msg_store_get(uint32_t seq, msg_store_hdr_t* hdr, char* text, size_t textCap)
+{
+    portENTER_CRITICAL(&s_lock);
+    int ret = store_get(&s_store, seq, hdr, text, textCap);
+    portEXIT_CRITICAL(&s_lock);
+    return ret;
+}
+
+
+uint32_t msg_store_oldest(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t seq = s_store.oldest;
+    portEXIT_CRITICAL(&s_lock);
+    return seq;
+}
+
+
+uint32_t msg_store_newest(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t seq = s_store.next - 1;
+    portEXIT_CRITICAL(&s_lock);
+    return seq;
+}
+
+
+void msg_store_get_stats(msg_store_stats_t* out)
+{
+    portENTER_CRITICAL(&s_lock);
+    *out = s_store.stats;
+    out->count = s_store.next - s_store.oldest;
+    out->arena_used = s_store.used;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+// ==== Benchmark ============================================================== //
+
+#define BENCH_FIXED_SLOT    256     // what one xMsgBufferQueue slot used to cost per page
+#define BENCH_FIXED_SLOTS   10
+#define BENCH_MIN_LEN       20
+#define BENCH_MAX_LEN       60
+
+static uint32_t bench_rng(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+void msg_store_bench(uint32_t messages)
+{
+    static const char pool[] = "CODE BLUE RM 412 BED 2 - DR PATEL TO ICU STAT, CALL EXT 5521 RE LABS ";
+
+    // private store on the heap so the live one is untouched
+    store_t* st = malloc(sizeof(store_t));
+    uint8_t* lens = malloc(messages);
+    uint32_t* probes = malloc(messages * sizeof(uint32_t));
+    if (st == NULL || lens == NULL || probes == NULL || messages == 0)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        free(st);
+        free(lens);
+        free(probes);
+        return;
+    }
+    store_clear(st);
+
+    uint32_t rng = 0x3C6EF372;
+    uint64_t textBytes = 0;
+    for (uint32_t i = 0; i < messages; i++)
+    {
+        lens[i] = (uint8_t)(BENCH_MIN_LEN + bench_rng(&rng) % (BENCH_MAX_LEN - BENCH_MIN_LEN + 1));
+        textBytes += lens[i];
+    }
+
+    // ---- append, evicting once the arena is full ---- //
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < messages; i++) {
+        store_append(st, 1000000 + i, 0, &pool[i % 8], lens[i], i);
+    }
+    int64_t t1 = esp_timer_get_time();
+
+    // ---- random lookups over what is held, plus a few that were evicted ---- //
+    uint32_t held = st->next - st->oldest;
+    for (uint32_t i = 0; i < messages; i++) {
+        probes[i] = (i % 16 == 0) ? st->oldest - 1 : st->oldest + bench_rng(&rng) % held;
+    }
+
+    char text[MSG_STORE_TEXT_MAX + 1];
+    msg_store_hdr_t hdr;
+    uint32_t bad = 0;
+    int64_t t2 = esp_timer_get_time();
+    for (uint32_t i = 0; i < messages; i++)
+    {
+        if (store_get(st, probes[i], &hdr, text, sizeof(text)) == 0) {
+            bad += (hdr.address != 1000000 + (probes[i] - 1));
+        }
+    }
+    int64_t t3 = esp_timer_get_time();
+
+    // round trip: what comes out is what went in
+    for (uint32_t seq = st->oldest; seq != st->next; seq++)
+    {
+        uint32_t i = seq - 1;
+        store_get(st, seq, &hdr, text, sizeof(text));
+        bad += (hdr.len != lens[i] || memcmp(text, &pool[i % 8], lens[i]) != 0 || hdr.time_ms != i);
+    }
+
+    size_t storeBytes = sizeof(st->arena) + sizeof(st->index);
+    double perPage = (double)st->used / held + (double)sizeof(st->index) / MSG_STORE_INDEX_LEN;
+    double avgLen = (double)textBytes / messages;
+
+    ESP_LOGI(TAG, "bench: %lu pages of %d-%d chars (avg %.1f), %lu held in %u bytes (arena + index)",
+             (unsigned long)messages, BENCH_MIN_LEN, BENCH_MAX_LEN, avgLen, (unsigned long)held, (unsigned)storeBytes);
+    ESP_LOGI(TAG, "bench: %.1f bytes per page vs %d in a fixed slot, %u bytes (%d slots) hold %.0f pages packed",
+             perPage, BENCH_FIXED_SLOT, (unsigned)(BENCH_FIXED_SLOT * BENCH_FIXED_SLOTS), BENCH_FIXED_SLOTS,
+             (double)(BENCH_FIXED_SLOT * BENCH_FIXED_SLOTS) / perPage);
+    ESP_LOGI(TAG, "bench: append %.0f ns, lookup %.0f ns per page, %lu evicted, %lu lookups missed, %lu mismatches",
+             (double)(t1 - t0) * 1000.0 / messages, (double)(t3 - t2) * 1000.0 / messages,
+             (unsigned long)st->stats.evicted, (unsigned long)st->stats.lookups_missed, (unsigned long)bad);
+
+    free(st);
+    free(lens);
+    free(probes);
+}
@@ -0,0 +1,72 @@
+#ifndef MSG_STORE_H
+#define MSG_STORE_H
+
+/*
+    - Every page the radio accepts, packed back to back in one byte arena instead of a 256 byte
+      slot each: a record is a 9 byte header (time, capcode, type, length) and the text with no
+      terminator, so a typical 20-60 character page costs 29-69 bytes
+    - Records are numbered by an ever increasing seq, a small ring index maps seq -> arena offset,
+      so append, lookup by seq and dropping the oldest record are all O(1)
+    - When the arena or the index is full the oldest records go first, a seq that was dropped
+      just fails to look up; xMsgBufferQueue only carries seq numbers into here
+    - The radio task appends and the display task reads, both under a short spinlock
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSG_STORE_ARENA_BYTES   8192    // < 64 KiB, offsets are 16 bit
+#define MSG_STORE_INDEX_LEN     256     // most records held at once, power of two
+#define MSG_STORE_TEXT_MAX      255     // longest text kept, longer pages are cut
+#define MSG_STORE_HDR_BYTES     9
+
+#define MSG_STORE_NO_SEQ        0       // never handed out
+
+// unpacked record header
+typedef struct {
+    uint32_t seq;
+    uint32_t time_ms;       // esp_timer time the page was stored
+    uint32_t address;       // capcode, 21 bits
+    uint8_t  type;          // a display_msg_type_t
+    uint8_t  len;           // text length, without a terminator
+} msg_store_hdr_t;
+
+typedef struct {
+    uint32_t appended;
+    uint32_t evicted;           // dropped to make room, oldest first
+    uint32_t truncated;         // pages longer than MSG_STORE_TEXT_MAX
+    uint32_t lookups_missed;    // get() for a seq no longer (or not yet) held
+    uint32_t count;             // records held now
+    uint32_t arena_used;        // bytes held now
+    uint32_t arena_high_water;
+} msg_store_stats_t;
+
+
+// empty the store (counters included) and register it with mem_budget, boot time
+void msg_store_init(void);
+
+// copy the page in, dropping the oldest records as needed, returns its seq
+uint32_t msg_store_append(uint32_t address, uint8_t type, const char* text, size_t len);
+
+// header and text (null terminated, cut to textCap - 1) of one record, -1 if it is not held
+int msg_store_get(uint32_t seq, msg_store_hdr_t* hdr, char* text, size_t textCap);
+
+// range of seq held right now, oldest > newest when the store is empty
+uint32_t msg_store_oldest(void);
+uint32_t msg_store_newest(void);
+
+void msg_store_get_stats(msg_store_stats_t* out);
+
+// memory per page and append / lookup cost on a private store, against fixed 256 byte slots
+void msg_store_bench(uint32_t messages);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MSG_STORE_H
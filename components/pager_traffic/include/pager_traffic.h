@@ -0,0 +1,108 @@
+#ifndef PAGER_TRAFFIC_H
+#define PAGER_TRAFFIC_H
+
+/*
+    - Synthetic hospital paging traffic for the host build
+    - Pages are POCSAG encoded and clocked into the firmware through the fake RF69 in host_fakes,
+      so they take exactly the path real pages take: DIO1/DIO2 -> PagerClient -> poll_radio
+    - Arrival times follow a Poisson process with optional storms (a code called hospital wide),
+      in simulated time so HOST_RF_SPEEDUP compresses hours of traffic into minutes
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PAGER_TRAFFIC_TEXT_MAX  200
+#define PAGER_TRAFFIC_PRIOS     4       // one per POCSAG function code
+
+typedef struct {
+    uint32_t seed;              // same seed, same traffic
+
+    // ---- rate ---- //
+    uint32_t msgs_per_min;      // mean background rate
+    uint32_t storm_every_s;     // 0 = no storms
+    uint32_t storm_msgs;        // pages sent back to back in a storm
+
+    // ---- length distribution, uniform in [len_min, len_max] characters ---- //
+    uint16_t len_min;
+    uint16_t len_max;
+
+    // ---- priority mix, relative weight of each function code (0 = numeric) ---- //
+    uint8_t  prio_weight[PAGER_TRAFFIC_PRIOS];
+
+    // ---- address mix ---- //
+    uint32_t own_address;       // the capcode rf_comms listens to
+    uint32_t own_mask;          // mask given to pager.startReceive()
+    uint8_t  own_pct;           // share of pages for us, the rest go to other_addresses
+    uint16_t other_addresses;   // distinct foreign capcodes in rotation
+
+    // ---- channel ---- //
+    uint32_t ber_ppm;           // bit errors per million bits on air
+    uint8_t  repeat_pct;        // share of pages the paging system sends a second time
+} pager_traffic_profile_t;
+
+// ordinary day on the ward, matches the capcode rf_comms starts with
+#define PAGER_TRAFFIC_PROFILE_DEFAULT() {   \
+    .seed = 1,                              \
+    .msgs_per_min = 6,                      \
+    .storm_every_s = 0,                     \
+    .storm_msgs = 0,                        \
+    .len_min = 8,                           \
+    .len_max = 80,                          \
+    .prio_weight = { 1, 6, 2, 1 },          \
+    .own_address = 12345,                   \
+    .own_mask = 12345,                      \
+    .own_pct = 50,                          \
+    .other_addresses = 32,                  \
+    .ber_ppm = 0,                           \
+    .repeat_pct = 0,                        \
+}
+
+typedef struct {
+    uint32_t pages;             // pages put on air
+    uint32_t pages_own;         // of which addressed to us
+    uint32_t repeats;           // retransmissions, not counted in pages / pages_own
+    uint32_t bits;              // bits put on air
+    uint32_t bit_errors;        // bits flipped by the channel
+    uint32_t storms;
+    uint32_t backlog_waits;     // times the fake radio's bit queue was full
+} pager_traffic_stats_t;
+
+
+// start the generator task, returns false if it is already running
+bool pager_traffic_start(const pager_traffic_profile_t* profile);
+void pager_traffic_stop(void);
+void pager_traffic_get_stats(pager_traffic_stats_t* out);
+
+// simulated seconds since the generator started (wall time x HOST_RF_SPEEDUP)
+double pager_traffic_sim_time(void);
+
+
+// ==== Soak benchmark ==== //
+
+// runs the generator for duration_s of simulated time, logging drops, evictions, latency
+// percentiles and heap drift every report_s, then a final summary; call from its own task
+void pager_soak_run(const pager_traffic_profile_t* profile, uint32_t duration_s, uint32_t report_s);
+
+// task wrapper reading duration / report period from HOST_SOAK_SECONDS / HOST_SOAK_REPORT_S
+void pager_soak_task(void* param);
+
+
+// ==== Receiver recovery check ==== //
+
+// stalls the radio task until the bit buffer overruns, then feeds noise mid stream, and checks
+// that after each fault rf_comms resyncs and the next page gets through, logging how long it took
+// the generator must not be running at the same time
+bool pager_recovery_run(void);
+void pager_recovery_task(void* param);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PAGER_TRAFFIC_H
@@ -0,0 +1,44 @@
+#ifndef POCSAG_ENCODE_H
+#define POCSAG_ENCODE_H
+
+/*
+    - POCSAG transmitter side, the inverse of what RadioLib's PagerClient decodes
+    - A transmission is 576 bits of preamble followed by batches of
+      one frame sync codeword + 8 frames of 2 codewords
+    - Output is one bit per byte (0 / 1), the format fake_radio_feed_bits() takes
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POCSAG_PREAMBLE_BITS    576
+#define POCSAG_FRAME_SYNC       0x7CD215D8UL
+#define POCSAG_IDLE             0x7A89C197UL
+#define POCSAG_BATCH_CODEWORDS  16
+#define POCSAG_BATCH_BITS       ((1 + POCSAG_BATCH_CODEWORDS) * 32)
+
+// function bits of the address codeword, RadioLib treats 0 as numeric and the rest as alphanumeric
+#define POCSAG_FUNC_NUMERIC     0
+#define POCSAG_FUNC_ALPHA       3
+
+// 21 data bits (msb aligned at bit 30..10 of the result) + BCH(31,21) check bits + even parity
+uint32_t pocsag_codeword(uint32_t data21);
+
+// bits needed for a message, so callers can size their buffer
+size_t pocsag_message_bits(uint8_t function, size_t textLen);
+
+// encode one page to a 21 bit capcode, returns bits written or 0 if it does not fit in maxBits
+// function 0 encodes text as numeric (digits, space, '-', 'U', '(', ')'), anything else as 7 bit ascii
+size_t pocsag_encode_message(uint32_t address, uint8_t function, const char* text,
+                             uint8_t* bits, size_t maxBits);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POCSAG_ENCODE_H
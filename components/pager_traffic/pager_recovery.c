@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "pager_traffic.h"
+#include "pocsag_encode.h"
+#include "FakeRadioHal.h"
+#include "rf_comms.h"
+
+
+#define RECOVERY_ADDRESS        12345       // default capcode rf_comms listens to
+#define RECOVERY_OVERRUN_PAGES  8           // back to back pages while the radio task is stalled, > the DCLK ring
+#define RECOVERY_NOISE_BITS     4096
+#define RECOVERY_TIMEOUT_MS     20000
+#define RECOVERY_MAX_BITS       (POCSAG_PREAMBLE_BITS + 4 * POCSAG_BATCH_BITS)
+
+static const char* TAG = "PAGER_RECOVERY";
+
+static uint8_t  s_bits[RECOVERY_MAX_BITS];
+static uint32_t s_marker;
+
+
+// ==== Helpers ================================================================ //
+
+static size_t put_page(const char* text)
+{
+    size_t count = pocsag_encode_message(RECOVERY_ADDRESS, POCSAG_FUNC_ALPHA, text, s_bits, sizeof(s_bits));
+    size_t done = 0;
+    while (done < count)
+    {
+        done += fake_radio_feed_bits(s_bits + done, count - done);
+        if (done < count) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+    }
+    return count;
+}
+
+
+static void wait_air_empty(void)
+{
+    while (fake_radio_pending_bits() > 0) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+}
+
+
+// ==== Faults ================================================================= //
+
+// the radio task stalls (think a long display flush) while pages keep arriving
+static void inject_overrun(void)
+{
+    char text[32];
+    TaskHandle_t radioTask = xTaskGetHandle("RadioTask");
+
+    if (radioTask != NULL) {
+        vTaskSuspend(radioTask);
+    }
+    for (int i = 0; i < RECOVERY_OVERRUN_PAGES; i++)
+    {
+        snprintf(text, sizeof(text), "STALLED PAGE %d OF A LONGER BURST", i);
+        put_page(text);
+    }
+    wait_air_empty();
+    if (radioTask != NULL) {
+        vTaskResume(radioTask);
+    }
+}
+
+
+// the transmitter drops out mid stream and the receiver is left clocking in noise
+static void inject_noise(void)
+{
+    uint32_t rng = 0xACE1;
+
+    put_page("LAST GOOD PAGE BEFORE THE NOISE");
+    for (size_t i = 0; i < RECOVERY_NOISE_BITS; i += sizeof(s_bits))
+    {
+        size_t n = (RECOVERY_NOISE_BITS - i < sizeof(s_bits)) ? RECOVERY_NOISE_BITS - i : sizeof(s_bits);
+        for (size_t b = 0; b < n; b++)
+        {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            s_bits[b] = rng & 1;
+        }
+        fake_radio_feed_bits(s_bits, n);
+    }
+    wait_air_empty();
+}
+
+
+// inject the fault, then time a fresh page from the moment it goes on air until it is queued
+static bool run_case(const char* name, void (*inject)(void))
+{
+    rf_stats_t before, after;
+    char text[32];
+
+    rf_get_stats(&before);
+    inject();
+    vTaskDelay(pdMS_TO_TICKS(200));     // give the radio task a wake-up to notice
+
+    rf_stats_t mid;
+    rf_get_stats(&mid);
+
+    snprintf(text, sizeof(text), "RECOVERY MARKER %lu", (unsigned long)s_marker++);
+    int64_t t0 = esp_timer_get_time();
+    size_t bits = put_page(text);
+
+    bool recovered = false;
+    int64_t waited = 0;
+    while (waited < (int64_t)RECOVERY_TIMEOUT_MS * 1000)
+    {
+        rf_get_stats(&after);
+        if (after.queued > mid.queued)
+        {
+            recovered = true;
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+        waited = esp_timer_get_time() - t0;
+    }
+    rf_get_stats(&after);
+
+    double airMs = (double)bits * 1000.0 / ((double)fake_radio_bit_rate() * fake_radio_speedup());
+    double tookMs = (double)(esp_timer_get_time() - t0) / 1000.0;
+    bool resynced = after.resyncs > before.resyncs;
+
+    ESP_LOGI(TAG, "%s: overruns +%lu, resyncs +%lu, %lu bits discarded, sync back in %lu us",
+             name, (unsigned long)(after.buf_overflows - before.buf_overflows),
+             (unsigned long)(after.resyncs - before.resyncs),
+             (unsigned long)(after.bits_discarded - before.bits_discarded), (unsigned long)after.resync_us_last);
+    ESP_LOGI(TAG, "%s: %s, next page queued %.1f ms after going on air (%.1f ms of air time)",
+             name, (recovered && resynced) ? "PASS" : "FAIL", tookMs, airMs);
+
+    return recovered && resynced;
+}
+
+
+// ==== Entry points =========================================================== //
+
+bool pager_recovery_run(void)
+{
+    bool ok = true;
+
+    // a clean page first so the receiver is locked on before the faults
+    put_page("RECOVERY CHECK START");
+    wait_air_empty();
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    ok &= run_case("overrun", inject_overrun);
+    ok &= run_case("desync", inject_noise);
+
+    ESP_LOGI(TAG, "recovery check %s", ok ? "PASSED" : "FAILED");
+    return ok;
+}
+
+
+void pager_recovery_task(void* param)
+{
+    pager_recovery_run();
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "pager_traffic.h"
+#include "FakeRadioHal.h"
+#include "host_fakes.h"
+#include "latency_stats.h"
+#include "rf_comms.h"
+#include "pocsag_bch.h"
+#include "msg_dedup.h"
+
+
+#define SOAK_DRAIN_TIMEOUT_MS   30000   // how long to wait for the air and the queue to empty at the end
+#define SOAK_SETTLE_MS          1000
+
+static const char* TAG = "PAGER_SOAK";
+
+
+// bytes the host heap has handed out, the closest thing to esp_get_free_heap_size() drift here
+static long heap_in_use(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return (long)info.uordblks;
+}
+
+
+static void soak_report(const char* label, long heapStart)
+{
+    pager_traffic_stats_t tx;
+    rf_stats_t rx;
+    pocsag_bch_stats_t bch;
+    msg_dedup_stats_t dup;
+    lat_summary_t total;
+
+    pager_traffic_get_stats(&tx);
+    rf_get_stats(&rx);
+    pocsag_bch_get_stats(&bch);
+    msg_dedup_get_stats(&dup);
+    latency_stats_get(LAT_STAGE_TOTAL, &total);
+
+    // anything addressed to us that never came out of readData() is a drop, repeats we suppressed are not
+    uint32_t readOwn = rx.read_ok - dup.suppressed;
+    uint32_t missed = (tx.pages_own > readOwn) ? tx.pages_own - readOwn : 0;
+    double dropPct = (tx.pages_own > 0) ? 100.0 * missed / tx.pages_own : 0.0;
+
+    ESP_LOGI(TAG, "[%s] t=%.0fs sent %lu (ours %lu, %lu storms, %lu bit errors, %lu backlog waits)",
+             label, pager_traffic_sim_time(), (unsigned long)tx.pages, (unsigned long)tx.pages_own,
+             (unsigned long)tx.storms, (unsigned long)tx.bit_errors, (unsigned long)tx.backlog_waits);
+    ESP_LOGI(TAG, "[%s] read %lu (%lu not ours), read errors %lu, queued %lu, evicted %lu, shown %lu, dropped %lu (%.2f%%)",
+             label, (unsigned long)rx.read_ok, (unsigned long)rx.filtered, (unsigned long)rx.read_err,
+             (unsigned long)rx.queued, (unsigned long)rx.evicted, (unsigned long)total.count, (unsigned long)missed, dropPct);
+    ESP_LOGI(TAG, "[%s] rx->display us: p50 %lu p95 %lu p99 %lu max %lu | heap drift %+ld bytes",
+             label, (unsigned long)total.p50, (unsigned long)total.p95, (unsigned long)total.p99,
+             (unsigned long)total.max, heap_in_use() - heapStart);
+    ESP_LOGI(TAG, "[%s] rx buffer high water %lu / %u bytes, overflows %lu, most pages per wake-up %lu",
+             label, (unsigned long)rx.buf_high_water, (unsigned)rf_buffer_size(),
+             (unsigned long)rx.buf_overflows, (unsigned long)rx.drain_max);
+    ESP_LOGI(TAG, "[%s] repeats sent %lu, suppressed %lu", label, (unsigned long)tx.repeats,
+             (unsigned long)dup.suppressed);
+    ESP_LOGI(TAG, "[%s] codewords clean %lu, 1 bit fixed %lu, 2 bits fixed %lu, uncorrectable %lu",
+             label, (unsigned long)bch.clean, (unsigned long)bch.corrected_1,
+             (unsigned long)bch.corrected_2, (unsigned long)bch.uncorrectable);
+}
+
+
+void pager_soak_run(const pager_traffic_profile_t* profile, uint32_t duration_s, uint32_t report_s)
+{
+    uint32_t speedup = fake_radio_speedup();
+    uint32_t reportMs = (report_s * 1000) / speedup;
+    if (reportMs == 0) {
+        reportMs = 1;
+    }
+
+    latency_stats_reset();
+    long heapStart = heap_in_use();
+
+    if (!pager_traffic_start(profile))
+    {
+        ESP_LOGE(TAG, "traffic generator already running");
+        return;
+    }
+    ESP_LOGI(TAG, "soak for %lus of simulated traffic (x%lu), report every %lus",
+             (unsigned long)duration_s, (unsigned long)speedup, (unsigned long)report_s);
+
+    while (pager_traffic_sim_time() < duration_s)
+    {
+        vTaskDelay(pdMS_TO_TICKS(reportMs));
+        soak_report("soak", heapStart);
+    }
+
+    // let the last pages clear the air and the display queue before the final numbers
+    pager_traffic_stop();
+    for (uint32_t waited = 0; fake_radio_pending_bits() > 0 && waited < SOAK_DRAIN_TIMEOUT_MS; waited += 100) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    vTaskDelay(pdMS_TO_TICKS(SOAK_SETTLE_MS));
+
+    soak_report("final", heapStart);
+    latency_stats_dump(false);
+}
+
+
+void pager_soak_task(void* param)
+{
+    const pager_traffic_profile_t* profile = (const pager_traffic_profile_t*)param;
+    pager_traffic_profile_t fallback = PAGER_TRAFFIC_PROFILE_DEFAULT();
+
+    uint32_t duration = (uint32_t)atoi(host_env("HOST_SOAK_SECONDS", "3600"));
+    uint32_t report = (uint32_t)atoi(host_env("HOST_SOAK_REPORT_S", "300"));
+
+    pager_soak_run((profile != NULL) ? profile : &fallback, duration, report);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "pager_traffic.h"
+#include "pocsag_encode.h"
+#include "FakeRadioHal.h"
+
+
+#define TRAFFIC_TASK_STACK      4096
+#define TRAFFIC_TASK_PRIORITY   3
+#define TRAFFIC_TICK_MS         10
+#define TRAFFIC_BACKLOG_WAIT_MS 5
+#define TRAFFIC_MAX_OTHERS      256
+#define TRAFFIC_MAX_BITS        (POCSAG_PREAMBLE_BITS + 8 * POCSAG_BATCH_BITS)
+
+static const char* TAG = "PAGER_TRAFFIC";
+
+static const char* s_words[] = {
+    "CODE", "BLUE", "RM", "ICU", "ER", "STAT", "CALL", "DR", "NURSE", "BED",
+    "WARD", "3B", "PT", "LAB", "XRAY", "PHARM", "PLEASE", "ASAP", "OR", "CONSULT",
+};
+
+static pager_traffic_profile_t  s_profile;
+static pager_traffic_stats_t    s_stats;
+static uint32_t                 s_rng;
+static uint32_t                 s_others[TRAFFIC_MAX_OTHERS];
+static uint16_t                 s_otherCount;
+static int64_t                  s_startUs;
+static uint32_t                 s_speedup;
+static volatile bool            s_running;
+static volatile bool            s_stop;
+
+// one page worth of bits, only the generator task touches it
+static uint8_t s_bits[TRAFFIC_MAX_BITS];
+
+
+// ==== Helpers ================================================================ //
+
+// xorshift32, deterministic for a given seed
+static uint32_t rng_next(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi)
+{
+    return lo + (rng_next() % (hi - lo + 1));
+}
+
+// uniform in (0, 1]
+static double rng_unit(void)
+{
+    return ((double)(rng_next() >> 8) + 1.0) / (double)(1 << 24);
+}
+
+
+// seconds of simulated time until the next page of a Poisson process
+static double next_gap(void)
+{
+    double perSecond = s_profile.msgs_per_min / 60.0;
+    return (perSecond > 0.0) ? -log(rng_unit()) / perSecond : 1e30;
+}
+
+
+static uint8_t pick_function(void)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < PAGER_TRAFFIC_PRIOS; i++) {
+        total += s_profile.prio_weight[i];
+    }
+    if (total == 0) {
+        return POCSAG_FUNC_ALPHA;
+    }
+
+    uint32_t pick = rng_next() % total;
+    for (int i = 0; i < PAGER_TRAFFIC_PRIOS; i++)
+    {
+        if (pick < s_profile.prio_weight[i]) {
+            return (uint8_t)i;
+        }
+        pick -= s_profile.prio_weight[i];
+    }
+    return POCSAG_FUNC_ALPHA;
+}
+
+
+// foreign capcodes are picked so they never pass our receive filter
+static void build_other_addresses(void)
+{
+    s_otherCount = s_profile.other_addresses;
+    if (s_otherCount > TRAFFIC_MAX_OTHERS) {
+        s_otherCount = TRAFFIC_MAX_OTHERS;
+    }
+
+    for (uint16_t i = 0; i < s_otherCount; i++)
+    {
+        uint32_t addr;
+        do {
+            addr = rng_next() & 0x1FFFFF;
+        } while ((addr & s_profile.own_mask) == (s_profile.own_address & s_profile.own_mask));
+        s_others[i] = addr;
+    }
+}
+
+
+static void build_text(char* text, uint8_t function, size_t len)
+{
+    size_t pos;
+
+    if (function == POCSAG_FUNC_NUMERIC)
+    {
+        // call-back numbers, sequence first so pages can be told apart
+        pos = (size_t)snprintf(text, len + 1, "%05lu-", (unsigned long)(s_stats.pages % 100000));
+        while (pos < len) {
+            text[pos++] = (char)('0' + rng_next() % 10);
+        }
+    }
+    else
+    {
+        pos = (size_t)snprintf(text, len + 1, "P%u #%05lu", function, (unsigned long)(s_stats.pages % 100000));
+        while (pos < len)
+        {
+            const char* word = s_words[rng_next() % (sizeof(s_words) / sizeof(s_words[0]))];
+            text[pos++] = ' ';
+            for (const char* c = word; *c != '\0' && pos < len; c++) {
+                text[pos++] = *c;
+            }
+        }
+    }
+    text[(pos < len) ? pos : len] = '\0';
+}
+
+
+// push bits into the fake radio, waiting while its queue is full
+static void feed_bits(const uint8_t* bits, size_t count)
+{
+    size_t done = 0;
+    while (done < count && !s_stop)
+    {
+        done += fake_radio_feed_bits(bits + done, count - done);
+        if (done < count)
+        {
+            s_stats.backlog_waits++;
+            vTaskDelay(pdMS_TO_TICKS(TRAFFIC_BACKLOG_WAIT_MS));
+        }
+    }
+}
+
+
+// the channel flips bits independently at the configured rate
+static void apply_channel(size_t count)
+{
+    if (s_profile.ber_ppm == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((rng_next() % 1000000) < s_profile.ber_ppm)
+        {
+            s_bits[i] ^= 1;
+            s_stats.bit_errors++;
+        }
+    }
+}
+
+
+static void send_page(void)
+{
+    char text[PAGER_TRAFFIC_TEXT_MAX + 1];
+
+    uint8_t function = pick_function();
+    bool own = (s_otherCount == 0) || (rng_next() % 100) < s_profile.own_pct;
+    uint32_t address = own ? s_profile.own_address : s_others[rng_next() % s_otherCount];
+
+    uint16_t lenMax = (s_profile.len_max > PAGER_TRAFFIC_TEXT_MAX) ? PAGER_TRAFFIC_TEXT_MAX : s_profile.len_max;
+    uint16_t lenMin = (s_profile.len_min > lenMax) ? lenMax : s_profile.len_min;
+    build_text(text, function, rng_range(lenMin, lenMax));
+
+    size_t count = pocsag_encode_message(address, function, text, s_bits, sizeof(s_bits));
+    if (count == 0)
+    {
+        ESP_LOGE(TAG, "page of %u chars does not fit the bit buffer", (unsigned)strlen(text));
+        return;
+    }
+
+    // the paging system sometimes sends the same page twice in a row
+    int copies = ((rng_next() % 100) < s_profile.repeat_pct) ? 2 : 1;
+    s_stats.repeats += copies - 1;
+
+    for (int copy = 0; copy < copies; copy++)
+    {
+        if (copy > 0) {
+            pocsag_encode_message(address, function, text, s_bits, sizeof(s_bits));
+        }
+        apply_channel(count);
+        feed_bits(s_bits, count);
+    }
+
+    s_stats.pages++;
+    s_stats.bits += count;
+    if (own) {
+        s_stats.pages_own++;
+    }
+}
+
+
+// ==== Generator task ========================================================= //
+
+static void traffic_task(void* param)
+{
+    double nextPage = next_gap();
+    double nextStorm = (s_profile.storm_every_s > 0) ? s_profile.storm_every_s : 1e30;
+
+    while (!s_stop)
+    {
+        double now = pager_traffic_sim_time();
+
+        if (now >= nextStorm)
+        {
+            s_stats.storms++;
+            for (uint32_t i = 0; i < s_profile.storm_msgs && !s_stop; i++) {
+                send_page();
+            }
+            nextStorm += s_profile.storm_every_s;
+        }
+
+        while (now >= nextPage && !s_stop)
+        {
+            send_page();
+            nextPage += next_gap();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(TRAFFIC_TICK_MS));
+    }
+
+    s_running = false;
+    vTaskDelete(NULL);
+}
+
+
+bool pager_traffic_start(const pager_traffic_profile_t* profile)
+{
+    if (s_running) {
+        return false;
+    }
+
+    s_profile = *profile;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_rng = (profile->seed != 0) ? profile->seed : 1;
+    build_other_addresses();
+
+    s_speedup = fake_radio_speedup();
+    s_startUs = esp_timer_get_time();
+    s_stop = false;
+    s_running = true;
+
+    ESP_LOGI(TAG, "traffic: %lu msg/min, len %u..%u, %u%% ours, ber %lu ppm, x%lu speed",
+             (unsigned long)s_profile.msgs_per_min, s_profile.len_min, s_profile.len_max,
+             s_profile.own_pct, (unsigned long)s_profile.ber_ppm, (unsigned long)s_speedup);
+
+    xTaskCreate(traffic_task, "PagerTraffic", TRAFFIC_TASK_STACK, NULL, TRAFFIC_TASK_PRIORITY, NULL);
+    return true;
+}
+
+
+void pager_traffic_stop(void)
+{
+    s_stop = true;
+}
+
+
+void pager_traffic_get_stats(pager_traffic_stats_t* out)
+{
+    *out = s_stats;
+}
+
+
+double pager_traffic_sim_time(void)
+{
+    return (double)(esp_timer_get_time() - s_startUs) / 1e6 * s_speedup;
+}
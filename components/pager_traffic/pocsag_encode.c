@@ -0,0 +1,166 @@
+#include <string.h>
+
+#include "pocsag_encode.h"
+
+
+#define POCSAG_BCH_POLY         0x769       // x^10 + x^9 + x^8 + x^6 + x^5 + x^3 + 1
+#define POCSAG_MSG_FLAG         (1UL << 20) // top data bit, 0 = address codeword, 1 = message
+#define POCSAG_MSG_BITS         20
+#define POCSAG_NUMERIC_SYMBOL   4
+#define POCSAG_ALPHA_SYMBOL     7
+#define POCSAG_NUMERIC_PAD      0xC         // numeric space
+
+
+// ==== Codeword construction ================================================== //
+
+uint32_t pocsag_codeword(uint32_t data21)
+{
+    // 31 bit BCH word: data in bits 30..10, remainder of the division in bits 9..0
+    uint32_t word = (data21 & 0x1FFFFFUL) << 10;
+    uint32_t rem = word;
+
+    for (int bit = 30; bit >= 10; bit--)
+    {
+        if (rem & (1UL << bit)) {
+            rem ^= (uint32_t)POCSAG_BCH_POLY << (bit - 10);
+        }
+    }
+    word |= rem & 0x3FF;
+
+    // last bit makes the parity of the whole 32 bit codeword even
+    uint32_t cw = word << 1;
+    cw |= (uint32_t)(__builtin_popcount(cw) & 1);
+    return cw;
+}
+
+
+// numeric pages carry BCD, with a handful of punctuation codes above 9
+static uint8_t numeric_symbol(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return (uint8_t)(c - '0');
+    }
+    switch (c)
+    {
+        case 'U':   return 0xB;
+        case '-':   return 0xD;
+        case ')':   return 0xE;
+        case '(':   return 0xF;
+        default:    return POCSAG_NUMERIC_PAD;
+    }
+}
+
+
+// ==== Bit output ============================================================= //
+
+typedef struct {
+    uint8_t* bits;
+    size_t   pos;
+} bit_writer_t;
+
+static void put_word(bit_writer_t* w, uint32_t cw)
+{
+    for (int i = 31; i >= 0; i--) {
+        w->bits[w->pos++] = (uint8_t)((cw >> i) & 1);
+    }
+}
+
+// codewords go out in batches, a frame sync word in front of every 16
+static void put_codeword(bit_writer_t* w, uint32_t cw, size_t* slot)
+{
+    if ((*slot % POCSAG_BATCH_CODEWORDS) == 0) {
+        put_word(w, POCSAG_FRAME_SYNC);
+    }
+    put_word(w, cw);
+    (*slot)++;
+}
+
+
+static size_t message_codewords(uint8_t function, size_t textLen)
+{
+    size_t symbolBits = (function == POCSAG_FUNC_NUMERIC) ? POCSAG_NUMERIC_SYMBOL : POCSAG_ALPHA_SYMBOL;
+    return (textLen * symbolBits + POCSAG_MSG_BITS - 1) / POCSAG_MSG_BITS;
+}
+
+
+static size_t total_slots(uint32_t address, uint8_t function, size_t textLen)
+{
+    // idle up to our frame, address, message, and at least one idle so the pager sees the end
+    size_t used = 2 * (address & 0x7) + 1 + message_codewords(function, textLen) + 1;
+    return ((used + POCSAG_BATCH_CODEWORDS - 1) / POCSAG_BATCH_CODEWORDS) * POCSAG_BATCH_CODEWORDS;
+}
+
+
+size_t pocsag_message_bits(uint8_t function, size_t textLen)
+{
+    // worst case frame position, so the answer does not depend on the address
+    size_t batches = total_slots(0x7, function, textLen) / POCSAG_BATCH_CODEWORDS;
+    return POCSAG_PREAMBLE_BITS + batches * POCSAG_BATCH_BITS;
+}
+
+
+size_t pocsag_encode_message(uint32_t address, uint8_t function, const char* text,
+                             uint8_t* bits, size_t maxBits)
+{
+    size_t textLen = strlen(text);
+    size_t slots = total_slots(address, function, textLen);
+    size_t needed = POCSAG_PREAMBLE_BITS + (slots / POCSAG_BATCH_CODEWORDS) * POCSAG_BATCH_BITS;
+
+    if (needed > maxBits) {
+        return 0;
+    }
+
+    bit_writer_t w = { .bits = bits, .pos = 0 };
+    size_t slot = 0;
+
+    // 1010... preamble for the receiver to lock on to
+    for (int i = 0; i < POCSAG_PREAMBLE_BITS; i++) {
+        bits[w.pos++] = (uint8_t)((i & 1) == 0);
+    }
+
+    // a pager only listens in the frame its address falls in
+    while (slot < 2 * (address & 0x7)) {
+        put_codeword(&w, POCSAG_IDLE, &slot);
+    }
+
+    // address codeword carries the top 18 bits of the capcode, the frame carries the rest
+    uint32_t addrData = (((address >> 3) & 0x3FFFFUL) << 2) | (function & 0x3);
+    put_codeword(&w, pocsag_codeword(addrData), &slot);
+
+    // pack the symbols lsb first into 20 bit message chunks
+    size_t symbolBits = (function == POCSAG_FUNC_NUMERIC) ? POCSAG_NUMERIC_SYMBOL : POCSAG_ALPHA_SYMBOL;
+    size_t msgWords = message_codewords(function, textLen);
+    uint32_t chunk = 0;
+    int chunkBits = 0;
+    size_t sent = 0;
+
+    for (size_t i = 0; sent < msgWords; i++)
+    {
+        uint8_t symbol;
+        if (i < textLen) {
+            symbol = (function == POCSAG_FUNC_NUMERIC) ? numeric_symbol(text[i]) : (uint8_t)(text[i] & 0x7F);
+        }
+        else {
+            symbol = (function == POCSAG_FUNC_NUMERIC) ? POCSAG_NUMERIC_PAD : 0;
+        }
+
+        for (size_t b = 0; b < symbolBits && sent < msgWords; b++)
+        {
+            chunk = (chunk << 1) | ((symbol >> b) & 1);
+            chunkBits++;
+            if (chunkBits == POCSAG_MSG_BITS)
+            {
+                put_codeword(&w, pocsag_codeword(POCSAG_MSG_FLAG | chunk), &slot);
+                chunk = 0;
+                chunkBits = 0;
+                sent++;
+            }
+        }
+    }
+
+    while (slot < slots) {
+        put_codeword(&w, POCSAG_IDLE, &slot);
+    }
+
+    return w.pos;
+}
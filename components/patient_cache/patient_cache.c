@@ -0,0 +1,681 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "patient_cache.h"
+#include "mem_budget.h"
+
+
+#define PATIENT_CACHE_NVS_NS    "pt_cache"
+#define PATIENT_BENCH_NVS_NS    "pt_bench"
+#define PATIENT_CLOCK_NVS_NS    "pt_clock"      // apart from the records, forget(NULL) erases theirs
+#define CLOCK_SAVE_S            600     // the clock is saved at least this often while the cache is used
+#define NVS_KEY_LEN             16      // NVS_KEY_NAME_MAX_SIZE
+
+#define FNV_OFFSET  2166136261UL
+#define FNV_PRIME   16777619UL
+
+static const char* TAG = "PATIENT_CACHE";
+
+typedef struct {
+    patient_record_t rec;
+    uint32_t hash;
+    uint32_t lastUse;       // tick of the last hit, the smallest one is evicted
+    bool     used;
+} ram_slot_t;
+
+// what is in an NVS blob without reading it
+typedef struct {
+    uint32_t hash;
+    uint32_t fetched;
+    bool     used;
+} nvs_slot_t;
+
+typedef struct {
+    ram_slot_t   ram[PATIENT_CACHE_RAM];
+    nvs_slot_t   nvs[PATIENT_CACHE_NVS];
+    uint32_t     tick;
+    nvs_handle_t handle;
+    bool         nvsOpen;   // false: RAM tier only
+    patient_cache_stats_t stats;
+} cache_state_t;
+
+static cache_state_t        s_cache;
+static uint32_t             s_clockBase;        // cache clock when this boot started
+static uint32_t             s_clockSaved;       // last value written to NVS
+static bool                 s_clockKept;        // false: the clock starts over each boot
+static StaticSemaphore_t    s_lockBuf;
+static SemaphoreHandle_t    s_lock;
+
+
+// ==== Helpers ================================================================ //
+
+static uint32_t id_hash(const char* id)
+{
+    uint32_t hash = FNV_OFFSET;
+    for (const char* p = id; *p != '\0'; p++)
+    {
+        hash ^= (uint8_t)*p;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+static bool is_expired(uint32_t fetched, uint32_t now)
+{
+    return now < fetched || now - fetched >= PATIENT_CACHE_TTL_S;
+}
+
+
+// the cache's clock: seconds the device has been on, carried over reboots from the value saved in
+// NVS. Time switched off is not counted, nor time on since the last save
+static uint32_t now_s(void)
+{
+    return s_clockBase + (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+
+// where the last boot's clock got to; false when it can not be read, records of earlier boots
+// can then not be aged
+static bool clock_load(void)
+{
+    nvs_handle_t handle;
+    uint32_t saved = 0;
+
+    if (nvs_open(PATIENT_CLOCK_NVS_NS, NVS_READWRITE, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_u32(handle, "clock", &saved);
+    nvs_close(handle);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return false;
+    }
+
+    s_clockBase = saved;
+    s_clockSaved = saved;
+    return true;
+}
+
+
+// with every put (the record's age must not go back after a reboot) and every CLOCK_SAVE_S
+static void clock_save(uint32_t now, bool put)
+{
+    nvs_handle_t handle;
+
+    if (!s_clockKept || (!put && now - s_clockSaved < CLOCK_SAVE_S)) {
+        return;
+    }
+    if (nvs_open(PATIENT_CLOCK_NVS_NS, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_u32(handle, "clock", now) == ESP_OK && nvs_commit(handle) == ESP_OK) {
+        s_clockSaved = now;
+    }
+    nvs_close(handle);
+}
+
+
+static void nvs_key(int slot, char key[NVS_KEY_LEN])
+{
+    snprintf(key, NVS_KEY_LEN, "r%02d", slot);
+}
+
+
+static void lock(void)
+{
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutexStatic(&s_lockBuf);
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+
+static void unlock(void)
+{
+    xSemaphoreGive(s_lock);
+}
+
+
+// ==== RAM tier =============================================================== //
+
+static ram_slot_t* ram_find(cache_state_t* st, uint32_t hash, const char* id)
+{
+    for (int i = 0; i < PATIENT_CACHE_RAM; i++)
+    {
+        ram_slot_t* slot = &st->ram[i];
+        if (slot->used && slot->hash == hash && strcmp(slot->rec.id, id) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+
+// the slot already holding this id, else a free one, else the least recently used
+static void ram_store(cache_state_t* st, const patient_record_t* rec, uint32_t hash)
+{
+    ram_slot_t* slot = ram_find(st, hash, rec->id);
+
+    for (int i = 0; slot == NULL && i < PATIENT_CACHE_RAM; i++)
+    {
+        if (!st->ram[i].used) {
+            slot = &st->ram[i];
+        }
+    }
+
+    if (slot == NULL)
+    {
+        slot = &st->ram[0];
+        for (int i = 1; i < PATIENT_CACHE_RAM; i++)
+        {
+            if (st->ram[i].lastUse < slot->lastUse) {
+                slot = &st->ram[i];
+            }
+        }
+    }
+
+    slot->rec = *rec;
+    slot->hash = hash;
+    slot->lastUse = ++st->tick;
+    slot->used = true;
+}
+
+
+// ==== NVS tier =============================================================== //
+
+// only blobs whose hash matches are read, a read that fails just makes the slot a miss
+static int nvs_find(cache_state_t* st, uint32_t hash, const char* id, patient_record_t* out)
+{
+    for (int i = 0; st->nvsOpen && i < PATIENT_CACHE_NVS; i++)
+    {
+        if (!st->nvs[i].used || st->nvs[i].hash != hash) {
+            continue;
+        }
+
+        char key[NVS_KEY_LEN];
+        size_t len = sizeof(*out);
+        nvs_key(i, key);
+        if (nvs_get_blob(st->handle, key, out, &len) != ESP_OK || len != sizeof(*out))
+        {
+            st->stats.nvs_errors++;
+            continue;
+        }
+        out->id[PATIENT_ID_LEN - 1] = '\0';
+        if (strcmp(out->id, id) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// the slot with this hash, else a free or expired one, else the one fetched longest ago
+static int nvs_victim(cache_state_t* st, uint32_t hash, uint32_t now)
+{
+    int victim = 0;
+
+    for (int i = 0; i < PATIENT_CACHE_NVS; i++)
+    {
+        if (st->nvs[i].used && st->nvs[i].hash == hash) {
+            return i;
+        }
+    }
+
+    for (int i = 0; i < PATIENT_CACHE_NVS; i++)
+    {
+        if (!st->nvs[i].used || is_expired(st->nvs[i].fetched, now)) {
+            return i;
+        }
+        if (st->nvs[i].fetched < st->nvs[victim].fetched) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+
+static void nvs_store(cache_state_t* st, const patient_record_t* rec, uint32_t hash, uint32_t now)
+{
+    if (!st->nvsOpen) {
+        return;
+    }
+
+    int slot = nvs_victim(st, hash, now);
+    char key[NVS_KEY_LEN];
+    nvs_key(slot, key);
+
+    esp_err_t err = nvs_set_blob(st->handle, key, rec, sizeof(*rec));
+    if (err == ESP_OK) {
+        err = nvs_commit(st->handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        st->nvs[slot].used = false;
+        st->stats.nvs_errors++;
+        ESP_LOGW(TAG, "could not save %s: %s", rec->id, esp_err_to_name(err));
+        return;
+    }
+
+    st->nvs[slot].hash = hash;
+    st->nvs[slot].fetched = rec->fetched;
+    st->nvs[slot].used = true;
+}
+
+
+static void nvs_forget(cache_state_t* st, int slot)
+{
+    char key[NVS_KEY_LEN];
+
+    st->nvs[slot].used = false;
+    if (st->nvsOpen)
+    {
+        nvs_key(slot, key);
+        nvs_erase_key(st->handle, key);
+        nvs_commit(st->handle);
+    }
+}
+
+
+// the directory comes from the blobs themselves, there is no separate index to keep in step; an
+// expired blob is left as a free slot. No namespace: RAM tier only
+static void state_open(cache_state_t* st, const char* ns, uint32_t now)
+{
+    patient_record_t rec;
+
+    memset(st, 0, sizeof(*st));
+    if (ns == NULL || nvs_open(ns, NVS_READWRITE, &st->handle) != ESP_OK) {
+        return;
+    }
+    st->nvsOpen = true;
+
+    for (int i = 0; i < PATIENT_CACHE_NVS; i++)
+    {
+        char key[NVS_KEY_LEN];
+        size_t len = sizeof(rec);
+        nvs_key(i, key);
+
+        if (nvs_get_blob(st->handle, key, &rec, &len) == ESP_OK && len == sizeof(rec) &&
+            !is_expired(rec.fetched, now))
+        {
+            rec.id[PATIENT_ID_LEN - 1] = '\0';
+            st->nvs[i].hash = id_hash(rec.id);
+            st->nvs[i].fetched = rec.fetched;
+            st->nvs[i].used = true;
+        }
+    }
+}
+
+
+// ==== Cache ================================================================== //
+
+static bool state_get(cache_state_t* st, const char* id, patient_record_t* out, uint32_t now)
+{
+    uint32_t hash = id_hash(id);
+    st->stats.lookups++;
+
+    ram_slot_t* slot = ram_find(st, hash, id);
+    if (slot != NULL)
+    {
+        // the NVS copy was fetched at the same time, it is no younger
+        if (is_expired(slot->rec.fetched, now))
+        {
+            slot->used = false;
+            st->stats.expired++;
+            st->stats.misses++;
+            return false;
+        }
+
+        slot->lastUse = ++st->tick;
+        *out = slot->rec;
+        st->stats.ram_hits++;
+        return true;
+    }
+
+    int i = nvs_find(st, hash, id, out);
+    if (i >= 0)
+    {
+        if (is_expired(out->fetched, now))
+        {
+            // free for the next put, the blob is written over then
+            st->nvs[i].used = false;
+            st->stats.expired++;
+            st->stats.misses++;
+            return false;
+        }
+
+        ram_store(st, out, hash);
+        st->stats.nvs_hits++;
+        return true;
+    }
+
+    st->stats.misses++;
+    return false;
+}
+
+
+static esp_err_t state_put(cache_state_t* st, const patient_record_t* rec, uint32_t now)
+{
+    if (rec->id[0] == '\0' || memchr(rec->id, '\0', PATIENT_ID_LEN) == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    patient_record_t copy = *rec;
+    copy.fetched = now;
+    uint32_t hash = id_hash(copy.id);
+
+    ram_store(st, &copy, hash);
+    nvs_store(st, &copy, hash, now);
+    st->stats.puts++;
+    return ESP_OK;
+}
+
+
+static void state_forget(cache_state_t* st, const char* id)
+{
+    if (id == NULL)
+    {
+        for (int i = 0; i < PATIENT_CACHE_RAM; i++) {
+            st->ram[i].used = false;
+        }
+        for (int i = 0; i < PATIENT_CACHE_NVS; i++) {
+            st->nvs[i].used = false;
+        }
+        if (st->nvsOpen)
+        {
+            nvs_erase_all(st->handle);
+            nvs_commit(st->handle);
+        }
+        return;
+    }
+
+    patient_record_t rec;
+    uint32_t hash = id_hash(id);
+
+    ram_slot_t* slot = ram_find(st, hash, id);
+    if (slot != NULL) {
+        slot->used = false;
+    }
+
+    int i = nvs_find(st, hash, id, &rec);
+    if (i >= 0) {
+        nvs_forget(st, i);
+    }
+}
+
+
+esp_err_t patient_cache_init(void)
+{
+    s_clockKept = clock_load();
+
+    lock();
+    state_open(&s_cache, s_clockKept ? PATIENT_CACHE_NVS_NS : NULL, now_s());
+    uint32_t kept = 0;
+    for (int i = 0; i < PATIENT_CACHE_NVS; i++) {
+        kept += s_cache.nvs[i].used;
+    }
+    unlock();
+
+    MEM_BUDGET_ADD(PATIENT_CACHE, s_cache, MEM_REGION_DRAM);
+
+    if (!s_cache.nvsOpen)
+    {
+        ESP_LOGW(TAG, "NVS namespace %s unavailable, caching in RAM only",
+                 s_clockKept ? PATIENT_CACHE_NVS_NS : PATIENT_CLOCK_NVS_NS);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "clock at %lu s, %lu records kept from earlier boots", (unsigned long)s_clockBase,
+             (unsigned long)kept);
+    return ESP_OK;
+}
+
+
+bool patient_cache_get(const char* id, patient_record_t* out)
+{
+    if (id == NULL || id[0] == '\0') {
+        return false;
+    }
+
+    lock();
+    uint32_t now = now_s();
+    bool hit = state_get(&s_cache, id, out, now);
+    clock_save(now, false);
+    unlock();
+    return hit;
+}
+
+
+esp_err_t patient_cache_put(const patient_record_t* rec)
+{
+    lock();
+    uint32_t now = now_s();
+    esp_err_t err = state_put(&s_cache, rec, now);
+    if (err == ESP_OK && s_cache.nvsOpen) {
+        clock_save(now, true);
+    }
+    unlock();
+    return err;
+}
+
+
+void patient_cache_forget(const char* id)
+{
+    lock();
+    state_forget(&s_cache, id);
+    unlock();
+}
+
+
+void patient_cache_note_scan(bool hit, uint32_t us)
+{
+    lock();
+    patient_cache_stats_t* stats = &s_cache.stats;
+    if (hit)
+    {
+        stats->hit_scans++;
+        stats->hit_us_sum += us;
+        if (us > stats->hit_us_max) {
+            stats->hit_us_max = us;
+        }
+    }
+    else
+    {
+        stats->miss_scans++;
+        stats->miss_us_sum += us;
+        if (us > stats->miss_us_max) {
+            stats->miss_us_max = us;
+        }
+    }
+    unlock();
+}
+
+
+void patient_cache_get_stats(patient_cache_stats_t* out)
+{
+    lock();
+    *out = s_cache.stats;
+    unlock();
+}
+
+
+void patient_cache_log_stats(void)
+{
+    patient_cache_stats_t st;
+    patient_cache_get_stats(&st);
+
+    uint32_t hits = st.ram_hits + st.nvs_hits;
+    ESP_LOGI(TAG, "%lu lookups, hit rate %lu%% (%lu RAM, %lu NVS), %lu misses of which %lu expired, %lu NVS errors",
+             (unsigned long)st.lookups, (unsigned long)(st.lookups ? hits * 100 / st.lookups : 0),
+             (unsigned long)st.ram_hits, (unsigned long)st.nvs_hits, (unsigned long)st.misses,
+             (unsigned long)st.expired, (unsigned long)st.nvs_errors);
+    ESP_LOGI(TAG, "scan to display: hit avg %lu us max %lu (%lu scans), miss avg %lu us max %lu (%lu scans)",
+             (unsigned long)(st.hit_scans ? st.hit_us_sum / st.hit_scans : 0), (unsigned long)st.hit_us_max,
+             (unsigned long)st.hit_scans,
+             (unsigned long)(st.miss_scans ? st.miss_us_sum / st.miss_scans : 0), (unsigned long)st.miss_us_max,
+             (unsigned long)st.miss_scans);
+}
+
+
+// ==== Packed records ========================================================= //
+
+size_t patient_record_pack(const patient_record_t* rec, uint8_t* buf, size_t cap)
+{
+    const char* fields[] = { rec->id, rec->f_name, rec->l_name, rec->last_checkup_date, rec->last_checkup_time };
+    size_t n = 0;
+
+    for (int i = 0; i < 5; i++)
+    {
+        size_t len = strlen(fields[i]) + 1;
+        if (n + len > cap) {
+            return 0;
+        }
+        memcpy(&buf[n], fields[i], len);
+        n += len;
+    }
+    return n;
+}
+
+
+bool patient_record_unpack(const uint8_t* buf, size_t len, patient_record_t* out)
+{
+    static const size_t caps[] = { PATIENT_ID_LEN, PATIENT_NAME_LEN, PATIENT_NAME_LEN, PATIENT_DATE_LEN,
+                                   PATIENT_TIME_LEN };
+    char* fields[] = { out->id, out->f_name, out->l_name, out->last_checkup_date, out->last_checkup_time };
+
+    memset(out, 0, sizeof(*out));
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + len;
+    for (int i = 0; i < 5; i++)
+    {
+        const uint8_t* nul = (p < end) ? memchr(p, '\0', (size_t)(end - p)) : NULL;
+        if (nul == NULL) {
+            return false;
+        }
+        snprintf(fields[i], caps[i], "%s", (const char*)p);
+        p = nul + 1;
+    }
+    return true;
+}
+
+
+// ==== Benchmark ============================================================== //
+
+static uint32_t bench_rng(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+static void bench_record(patient_record_t* rec, uint32_t patient)
+{
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->id, sizeof(rec->id), "MRN%06lu", (unsigned long)patient);
+    snprintf(rec->f_name, sizeof(rec->f_name), "First%lu", (unsigned long)patient);
+    snprintf(rec->l_name, sizeof(rec->l_name), "Last%lu", (unsigned long)patient);
+    strcpy(rec->last_checkup_date, "2025-01-01");
+    strcpy(rec->last_checkup_time, "14:30:00");
+}
+
+
+// average us per call of get over ids [first, first + count) in turn
+static uint32_t bench_gets(cache_state_t* st, uint32_t first, uint32_t count, uint32_t lookups, uint32_t now)
+{
+    patient_record_t rec;
+    char id[PATIENT_ID_LEN];
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < lookups; i++)
+    {
+        snprintf(id, sizeof(id), "MRN%06lu", (unsigned long)(first + i % count));
+        state_get(st, id, &rec, now);
+    }
+    return (uint32_t)((esp_timer_get_time() - start) / lookups);
+}
+
+
+void patient_cache_bench(uint32_t patients, uint32_t scans)
+{
+    const uint32_t lookups = 2000;
+    const uint32_t now = 1735689600;    // 2025-01-01, the bench runs on its own clock
+    patient_record_t rec;
+    uint32_t rng = 0x2545F491;
+
+    cache_state_t* st = malloc(sizeof(cache_state_t));
+    if (st == NULL || patients == 0)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        free(st);
+        return;
+    }
+    state_open(st, PATIENT_BENCH_NVS_NS, now);
+    state_forget(st, NULL);
+
+    // writes go through to NVS, one blob and a commit per put
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < PATIENT_CACHE_NVS; i++)
+    {
+        bench_record(&rec, i);
+        state_put(st, &rec, now);
+    }
+    uint32_t putUs = (uint32_t)((esp_timer_get_time() - start) / PATIENT_CACHE_NVS);
+
+    // the last PATIENT_CACHE_RAM puts are in RAM; cycling through every saved id in order evicts
+    // each one just before it comes round again, so every lookup is served from NVS
+    uint32_t ramUs = bench_gets(st, PATIENT_CACHE_NVS - PATIENT_CACHE_RAM, PATIENT_CACHE_RAM, lookups, now);
+    uint32_t nvsUs = bench_gets(st, 0, PATIENT_CACHE_NVS, lookups, now);
+    uint32_t missUs = bench_gets(st, PATIENT_CACHE_NVS, 1000000, lookups, now);
+    ESP_LOGI(TAG, "bench: put %lu us (NVS write), get: RAM hit %lu us, NVS hit %lu us, miss %lu us",
+             (unsigned long)putUs, (unsigned long)ramUs, (unsigned long)nvsUs, (unsigned long)missUs);
+
+    // medication rounds every 4 hours over the ward in bed order, a quarter of the bands scanned
+    // twice (nurse re-checks), a miss fetches the record from the server and puts it
+    state_forget(st, NULL);
+    memset(&st->stats, 0, sizeof(st->stats));
+
+    uint32_t t = now;
+    uint32_t done = 0;
+    uint32_t rounds = 0;
+    while (done < scans)
+    {
+        for (uint32_t p = 0; p < patients && done < scans; p++)
+        {
+            int repeats = (bench_rng(&rng) & 3) == 0 ? 2 : 1;
+            for (int r = 0; r < repeats && done < scans; r++, done++)
+            {
+                char id[PATIENT_ID_LEN];
+                snprintf(id, sizeof(id), "MRN%06lu", (unsigned long)p);
+                if (!state_get(st, id, &rec, t))
+                {
+                    bench_record(&rec, p);
+                    state_put(st, &rec, t);
+                }
+                t += 30;
+            }
+        }
+        t += 4 * 3600;
+        rounds++;
+    }
+
+    patient_cache_stats_t* s = &st->stats;
+    ESP_LOGI(TAG, "bench: ward of %lu, %lu scans over %lu rounds: hit rate %lu%% (%lu RAM, %lu NVS), "
+             "%lu uploads (%lu after expiry)", (unsigned long)patients, (unsigned long)done,
+             (unsigned long)rounds, (unsigned long)((s->ram_hits + s->nvs_hits) * 100 / s->lookups),
+             (unsigned long)s->ram_hits, (unsigned long)s->nvs_hits, (unsigned long)s->misses,
+             (unsigned long)s->expired);
+
+    state_forget(st, NULL);
+    if (st->nvsOpen) {
+        nvs_close(st->handle);
+    }
+    free(st);
+}
@@ -0,0 +1,104 @@
+#ifndef PATIENT_CACHE_H
+#define PATIENT_CACHE_H
+
+/*
+    - Patient records the server sent back for recent scans, keyed by the QR payload (the patient
+      id on the wristband), so scanning the same band again on a medication round is shown from
+      here instead of uploading the image again
+    - Two tiers:
+        - RAM: the last PATIENT_CACHE_RAM records, looked up by a scan over FNV-1a hashes,
+          evicted least recently used
+        - NVS: PATIENT_CACHE_NVS records, one blob each (namespace "pt_cache", keys "r00".."r31"),
+          written through on every put; only their hash and time are kept in RAM, a blob is read
+          when its hash matches and the record goes back into RAM
+    - A record expires PATIENT_CACHE_TTL_S after the server sent it, in either tier. Nothing sets
+      the wall clock (nothing starts SNTP), so ages run on the cache's own clock: seconds the device
+      was on, saved in NVS (namespace "pt_clock") with every put and every 10 minutes of use, and
+      carried on from there after a reboot, so the NVS tier survives one. Time switched off is not
+      counted. When the clock cannot be kept the cache runs in RAM only
+    - Lookup stats plus scan to display latency for hits and misses, the scan path reports the
+      latter through patient_cache_note_scan()
+    - Thread safe, the camera task and parse_json callers may overlap
+    - Off the device a record is five NUL terminated strings (id, first / last name, date, time),
+      the ward roster blob and the UDP lookup answer both carry it that way
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PATIENT_CACHE_RAM       16
+#define PATIENT_CACHE_NVS       32
+#define PATIENT_CACHE_TTL_S     (8 * 3600)      // one shift
+
+#define PATIENT_ID_LEN          24      // QR payload, NUL included
+#define PATIENT_NAME_LEN        24
+#define PATIENT_DATE_LEN        12      // "2025-01-01"
+#define PATIENT_TIME_LEN        10      // "14:30:00"
+
+// one record, also the layout of its NVS blob
+typedef struct {
+    char     id[PATIENT_ID_LEN];
+    char     f_name[PATIENT_NAME_LEN];
+    char     l_name[PATIENT_NAME_LEN];
+    char     last_checkup_date[PATIENT_DATE_LEN];
+    char     last_checkup_time[PATIENT_TIME_LEN];
+    uint32_t fetched;       // cache clock then, seconds
+} patient_record_t;
+
+typedef struct {
+    uint32_t lookups;
+    uint32_t ram_hits;
+    uint32_t nvs_hits;
+    uint32_t misses;
+    uint32_t expired;           // found, but past the TTL (counted in misses too)
+    uint32_t puts;
+    uint32_t nvs_errors;
+    uint32_t hit_scans;         // scan to display, shown from the cache
+    uint32_t hit_us_max;
+    uint64_t hit_us_sum;
+    uint32_t miss_scans;        // scan to display, through the server
+    uint32_t miss_us_max;
+    uint64_t miss_us_sum;
+} patient_cache_stats_t;
+
+
+// carry on the cache clock and read the NVS tier's directory, NVS has to be initialized
+esp_err_t patient_cache_init(void);
+
+// copy of the record for id, false on a miss or when it expired
+bool patient_cache_get(const char* id, patient_record_t* out);
+
+// remember a record the server sent, rec->fetched is set here
+esp_err_t patient_cache_put(const patient_record_t* rec);
+
+// drop one id from both tiers, or everything when id is NULL
+void patient_cache_forget(const char* id);
+
+// one scan from button press to the record going to the display
+void patient_cache_note_scan(bool hit, uint32_t us);
+
+void patient_cache_get_stats(patient_cache_stats_t* out);
+
+void patient_cache_log_stats(void);
+
+// record <-> its packed form; pack returns the bytes used (0 when cap is too small), unpack fails
+// unless all five strings are there, each is cut to its field
+size_t patient_record_pack(const patient_record_t* rec, uint8_t* buf, size_t cap);
+bool patient_record_unpack(const uint8_t* buf, size_t len, patient_record_t* out);
+
+// RAM hit / NVS hit / miss lookup cost and the hit rate of a simulated ward round, on a scratch
+// cache in its own NVS namespace which is erased afterwards, the live cache is kept
+void patient_cache_bench(uint32_t patients, uint32_t scans);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PATIENT_CACHE_H
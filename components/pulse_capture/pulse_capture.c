@@ -0,0 +1,430 @@
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+#endif
+
+#include "pulse_capture.h"
+
+
+#if CONFIG_IDF_TARGET_LINUX
+// the fake gpio driver runs handlers on the driving task, plain critical sections and gives
+#define CAPTURE_ATTR
+#define CAPTURE_ENTER_ISR(lock)     portENTER_CRITICAL(lock)
+#define CAPTURE_EXIT_ISR(lock)      portEXIT_CRITICAL(lock)
+#else
+#define CAPTURE_ATTR                IRAM_ATTR
+#define CAPTURE_ENTER_ISR(lock)     portENTER_CRITICAL_ISR(lock)
+#define CAPTURE_EXIT_ISR(lock)      portEXIT_CRITICAL_ISR(lock)
+#endif
+
+#define BENCH_REPEATS       8
+#define BENCH_LEAD_US       2000    // generator waits this long after the go, so the measurer is armed
+#define BENCH_STACK         3072
+
+static const char* TAG = "PULSE_CAPTURE";
+
+typedef enum {
+    CAP_IDLE = 0,       // nothing armed, edges are ignored
+    CAP_WAIT_IDLE,      // pin was already at state when armed, let that pulse finish first
+    CAP_WAIT_START,
+    CAP_IN_PULSE,
+    CAP_DONE,
+} cap_phase_t;
+
+static struct {
+    uint32_t            pin;
+    uint32_t            state;
+    volatile cap_phase_t phase;
+    uint32_t            start;      // ticks, see cap_ticks()
+    uint32_t            end;
+} s_cap;
+
+static portMUX_TYPE         s_capLock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t    s_capDone = NULL;
+static StaticSemaphore_t    s_capDoneBuf;
+
+
+// ==== Per-target primitives ==== //
+
+#if CONFIG_IDF_TARGET_LINUX
+static inline uint32_t cap_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+static inline uint32_t cap_ticks_per_us(void)
+{
+    return 1000;
+}
+
+static inline uint32_t cap_sample(uint32_t pin)
+{
+    return (uint32_t)gpio_get_level((gpio_num_t)pin);
+}
+#else
+static inline uint32_t cap_ticks(void)
+{
+    return (uint32_t)esp_cpu_get_cycle_count();
+}
+
+static inline uint32_t cap_ticks_per_us(void)
+{
+    return esp_rom_get_cpu_ticks_per_us();
+}
+
+static inline uint32_t cap_sample(uint32_t pin)
+{
+    return (uint32_t)gpio_ll_get_level(&GPIO, (gpio_num_t)pin);
+}
+#endif
+
+
+// both edges land here, the timestamp is taken first so the lock and the read do not skew it
+static void CAPTURE_ATTR capture_isr(void* arg)
+{
+    (void)arg;
+    uint32_t now = cap_ticks();
+    uint32_t level = cap_sample(s_cap.pin);
+    bool done = false;
+
+    CAPTURE_ENTER_ISR(&s_capLock);
+    switch (s_cap.phase)
+    {
+        case CAP_WAIT_IDLE:
+            if (level != s_cap.state) {
+                s_cap.phase = CAP_WAIT_START;
+            }
+            break;
+
+        case CAP_WAIT_START:
+            if (level == s_cap.state)
+            {
+                s_cap.start = now;
+                s_cap.phase = CAP_IN_PULSE;
+            }
+            break;
+
+        case CAP_IN_PULSE:
+            if (level != s_cap.state)
+            {
+                s_cap.end = now;
+                s_cap.phase = CAP_DONE;
+                done = true;
+            }
+            break;
+
+        default:
+            break;
+    }
+    CAPTURE_EXIT_ISR(&s_capLock);
+
+    if (done)
+    {
+#if CONFIG_IDF_TARGET_LINUX
+        xSemaphoreGive(s_capDone);
+#else
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(s_capDone, &woken);
+        portYIELD_FROM_ISR(woken);
+#endif
+    }
+}
+
+
+int pulse_capture(uint32_t pin, uint32_t state, uint32_t timeoutUs, uint32_t* widthNs)
+{
+    if (s_capDone == NULL)
+    {
+        s_capDone = xSemaphoreCreateBinaryStatic(&s_capDoneBuf);
+        if (s_capDone == NULL) {
+            return -1;
+        }
+    }
+
+    portENTER_CRITICAL(&s_capLock);
+    bool busy = (s_cap.phase != CAP_IDLE);
+    if (!busy)
+    {
+        s_cap.pin = pin;
+        s_cap.state = state ? 1 : 0;
+        s_cap.phase = CAP_WAIT_START;   // placeholder until the level is read below
+    }
+    portEXIT_CRITICAL(&s_capLock);
+
+    if (busy)
+    {
+        ESP_LOGE(TAG, "capture already running");
+        return -1;
+    }
+    xSemaphoreTake(s_capDone, 0);   // a give left over from a capture that timed out at the last moment
+
+    gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_ANYEDGE);
+    gpio_isr_handler_add((gpio_num_t)pin, capture_isr, NULL);
+    gpio_intr_enable((gpio_num_t)pin);
+
+    // the starting level decides the first phase, read under the lock so an edge racing
+    // the read is either seen here or handled by the ISR after it
+    portENTER_CRITICAL(&s_capLock);
+    s_cap.phase = (cap_sample(pin) == s_cap.state) ? CAP_WAIT_IDLE : CAP_WAIT_START;
+    portEXIT_CRITICAL(&s_capLock);
+
+    // the semaphore wait is tick granular, round up so a pulse is never cut short
+    TickType_t ticks = (TickType_t)((timeoutUs + (portTICK_PERIOD_MS * 1000) - 1) / (portTICK_PERIOD_MS * 1000)) + 1;
+    bool ok = (xSemaphoreTake(s_capDone, ticks) == pdTRUE);
+
+    gpio_isr_handler_remove((gpio_num_t)pin);
+    gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_DISABLE);
+
+    portENTER_CRITICAL(&s_capLock);
+    ok = ok && (s_cap.phase == CAP_DONE);
+    uint32_t ticksWide = s_cap.end - s_cap.start;
+    s_cap.phase = CAP_IDLE;
+    portEXIT_CRITICAL(&s_capLock);
+
+    if (!ok) {
+        return -1;
+    }
+
+    *widthNs = (uint32_t)(((uint64_t)ticksWide * 1000ULL) / cap_ticks_per_us());
+    return 0;
+}
+
+
+int pulse_capture_busy_wait(uint32_t pin, uint32_t state, uint32_t timeoutUs, uint32_t* widthNs)
+{
+    int64_t begin = esp_timer_get_time();
+    int64_t start;
+
+    state = state ? 1 : 0;
+
+    while ((uint32_t)gpio_get_level((gpio_num_t)pin) == state) {
+        if (esp_timer_get_time() - begin > timeoutUs) {
+            return -1;
+        }
+    }
+    while ((uint32_t)gpio_get_level((gpio_num_t)pin) != state) {
+        if (esp_timer_get_time() - begin > timeoutUs) {
+            return -1;
+        }
+    }
+    start = esp_timer_get_time();
+    while ((uint32_t)gpio_get_level((gpio_num_t)pin) == state) {
+        if (esp_timer_get_time() - begin > timeoutUs) {
+            return -1;
+        }
+    }
+
+    *widthNs = (uint32_t)((esp_timer_get_time() - start) * 1000);
+    return 0;
+}
+
+
+// ==== Bench ================================================================== //
+
+typedef struct {
+    uint32_t        pin;
+    uint32_t        widthUs;
+    uint32_t        actualNs;   // the generator's own cycle count between its two writes
+    TaskHandle_t    genTask;
+    TaskHandle_t    measurer;
+    volatile bool   quit;
+} bench_gen_t;
+
+static volatile uint32_t s_spinCount;
+static volatile bool     s_spinQuit;
+
+
+// one high pulse per notification, timed on its own cycle counter so the reference is as exact
+// as the capture it is checking (a width is a difference, so it does not matter which core)
+static void bench_generator(void* param)
+{
+    bench_gen_t* gen = (bench_gen_t*)param;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (gen->quit) {
+            break;
+        }
+
+        int64_t lead = esp_timer_get_time();
+        while (esp_timer_get_time() - lead < BENCH_LEAD_US) {}
+
+        uint32_t widthTicks = gen->widthUs * cap_ticks_per_us();
+        gpio_set_level((gpio_num_t)gen->pin, 1);
+        uint32_t t0 = cap_ticks();
+        while (cap_ticks() - t0 < widthTicks) {}
+        gpio_set_level((gpio_num_t)gen->pin, 0);
+        uint32_t t1 = cap_ticks();
+
+        gen->actualNs = (uint32_t)(((uint64_t)(t1 - t0) * 1000ULL) / cap_ticks_per_us());
+        xTaskNotifyGive(gen->measurer);
+    }
+
+    xTaskNotifyGive(gen->measurer);
+    vTaskDelete(NULL);
+}
+
+
+// counts whenever nothing more important wants the core, its rate is the CPU left over
+static void bench_spinner(void* param)
+{
+    (void)param;
+    while (!s_spinQuit) {
+        s_spinCount++;
+    }
+    vTaskDelete(NULL);
+}
+
+
+static BaseType_t bench_task_create(TaskFunction_t fn, const char* name, void* param, UBaseType_t prio,
+                                    TaskHandle_t* handle, int core)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    (void)core;
+    return xTaskCreate(fn, name, BENCH_STACK, param, prio, handle);
+#else
+    return xTaskCreatePinnedToCore(fn, name, BENCH_STACK, param, prio, handle, core);
+#endif
+}
+
+
+typedef int (*measure_fn_t)(uint32_t, uint32_t, uint32_t, uint32_t*);
+
+typedef struct {
+    int32_t  errAvgNs;
+    int32_t  errMaxNs;      // largest error either way, sign kept
+    int      missed;
+    uint32_t spinsPerMs;    // spinner rate while the method was measuring
+} bench_result_t;
+
+static void bench_method(bench_gen_t* gen, measure_fn_t fn, bench_result_t* res)
+{
+    int64_t errSum = 0;
+    int got = 0;
+    uint64_t spins = 0;
+    int64_t busyUs = 0;
+
+    memset(res, 0, sizeof(*res));
+
+    for (int i = 0; i < BENCH_REPEATS; i++)
+    {
+        uint32_t widthNs = 0;
+        uint32_t spin0 = s_spinCount;
+        int64_t t0 = esp_timer_get_time();
+
+        xTaskNotifyGive(gen->genTask);
+        int rc = fn(gen->pin, 1, BENCH_LEAD_US + gen->widthUs + 20000, &widthNs);
+
+        busyUs += esp_timer_get_time() - t0;
+        spins += s_spinCount - spin0;
+
+        // wait for the generator to finish before the next round, it also posts a timed out pulse
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+        if (rc != 0)
+        {
+            res->missed++;
+            continue;
+        }
+
+        int32_t err = (int32_t)widthNs - (int32_t)gen->actualNs;
+        errSum += err;
+        got++;
+        if ((err < 0 ? -err : err) > (res->errMaxNs < 0 ? -res->errMaxNs : res->errMaxNs)) {
+            res->errMaxNs = err;
+        }
+    }
+
+    res->errAvgNs = (got > 0) ? (int32_t)(errSum / got) : 0;
+    res->spinsPerMs = (busyUs > 0) ? (uint32_t)(spins * 1000 / busyUs) : 0;
+}
+
+
+static uint32_t cpu_pct(uint32_t spinsPerMs, uint32_t baseline)
+{
+    if (baseline == 0 || spinsPerMs >= baseline) {
+        return 0;
+    }
+    return 100 - (uint32_t)((uint64_t)spinsPerMs * 100 / baseline);
+}
+
+
+void pulse_capture_bench(uint32_t pin)
+{
+    static const uint32_t widths[] = { 10, 100, 1000, 10000 };
+    static bench_gen_t gen;
+
+    UBaseType_t oldPrio = uxTaskPriorityGet(NULL);
+    int core = xPortGetCoreID();
+
+    memset(&gen, 0, sizeof(gen));
+    gen.pin = pin;
+    gen.measurer = xTaskGetCurrentTaskHandle();
+
+    // the pad reads back what it drives, so one pin is both the source and the input under test
+    gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT);
+    gpio_set_level((gpio_num_t)pin, 0);
+
+    // measurer above the spinner on this core, generator above everything on the other one
+    vTaskPrioritySet(NULL, 10);
+    s_spinQuit = false;
+    if (bench_task_create(bench_spinner, "PulseSpin", NULL, 1, NULL, core) != pdPASS ||
+        bench_task_create(bench_generator, "PulseGen", &gen, 20, &gen.genTask,
+                          (portNUM_PROCESSORS > 1) ? !core : core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "bench: could not start the helper tasks");
+        s_spinQuit = true;
+        vTaskPrioritySet(NULL, oldPrio);
+        return;
+    }
+
+    // what the spinner gets with the measurer asleep is 100 % of the core
+    uint32_t spin0 = s_spinCount;
+    int64_t t0 = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(100));
+    uint32_t baseline = (uint32_t)((uint64_t)(s_spinCount - spin0) * 1000 / (esp_timer_get_time() - t0));
+
+    ESP_LOGI(TAG, "bench on GPIO %lu, %d pulses per width, error = measured - generated", (unsigned long)pin,
+             BENCH_REPEATS);
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+        bench_result_t isr, poll;
+        gen.widthUs = widths[w];
+
+        bench_method(&gen, pulse_capture, &isr);
+        bench_method(&gen, pulse_capture_busy_wait, &poll);
+
+        ESP_LOGI(TAG, "%5lu us: edge isr err %ld ns (worst %ld) %d missed cpu %lu%% | "
+                 "busy wait err %ld ns (worst %ld) %d missed cpu %lu%%",
+                 (unsigned long)widths[w],
+                 (long)isr.errAvgNs, (long)isr.errMaxNs, isr.missed, (unsigned long)cpu_pct(isr.spinsPerMs, baseline),
+                 (long)poll.errAvgNs, (long)poll.errMaxNs, poll.missed, (unsigned long)cpu_pct(poll.spinsPerMs, baseline));
+    }
+
+    gen.quit = true;
+    xTaskNotifyGive(gen.genTask);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    s_spinQuit = true;
+
+    gpio_set_direction((gpio_num_t)pin, GPIO_MODE_DISABLE);
+    vTaskPrioritySet(NULL, oldPrio);
+}
@@ -0,0 +1,38 @@
+#ifndef PULSE_CAPTURE_H
+#define PULSE_CAPTURE_H
+
+/*
+    - Pulse width measurement from GPIO edge interrupts, backs EspHal2::pulseIn()
+    - Both edges are timestamped in an IRAM handler with the CPU cycle counter (6.25 ns at 160 MHz),
+      the caller blocks on a semaphore in the meantime so the CPU is free for other tasks
+    - Same contract as Arduino's pulseIn(): wait for any pulse already in progress to end, wait for
+      the pin to go to state, time how long it stays there; timeout covers the whole wait and is
+      rounded up to whole RTOS ticks
+    - One capture at a time, and the pin's edge interrupt is borrowed for the duration, so it must
+      not be a pin with its own handler attached (DCLK / DIOx while receiving)
+    - Pulses shorter than the interrupt latency (a few us) can be missed and end in a timeout
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returns 0 and the width in ns, or -1 on timeout / a capture already running
+int pulse_capture(uint32_t pin, uint32_t state, uint32_t timeoutUs, uint32_t* widthNs);
+
+// the old polling loop, same contract, kept so the bench has something to compare against
+int pulse_capture_busy_wait(uint32_t pin, uint32_t state, uint32_t timeoutUs, uint32_t* widthNs);
+
+// drive known pulses on a spare pin (read back through its own input path) and log the error
+// and the CPU share of both methods, the pin must have nothing attached
+void pulse_capture_bench(uint32_t pin);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PULSE_CAPTURE_H
@@ -0,0 +1,1226 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "qr_decode.h"
+
+
+#define BLOCK               8       // binarizer block, pixels
+#define MIN_RANGE           24      // a block with less contrast than this is one colour
+#define MIN_FINDER_HITS     2       // rows a finder pattern has to be seen on
+#define MAX_TRIPLES         3       // finder triples tried, best placed first
+#define MAX_TRIPLE_SCORE    0.5f    // how far from a right isosceles triangle three finders may be
+#define FORMAT_MAX_ERRORS   3       // bit errors a format word is read through
+#define ALIGN_MIN_MATCH     22      // of the 25 modules of an alignment pattern
+#define CORNER_STEPS        4       // fourth corner searched this many half modules each way
+#define RS_MAX_EC           30      // check bytes per block, version 9 L
+#define RS_MAX_BLOCK        146     // bytes per block, version 9 L
+
+// Reed-Solomon blocks of each version at each level, levels in format bit order (M, L, H, Q):
+// check bytes per block, blocks of the short kind and their data bytes, blocks one byte longer
+typedef struct {
+    uint8_t ec;
+    uint8_t n1;
+    uint8_t k1;
+    uint8_t n2;
+} rs_layout_t;
+
+static const rs_layout_t rs_layout[QR_DECODE_MAX_VERSION][4] = {
+    { { 10, 1,  16, 0 }, {  7, 1,  19, 0 }, { 17, 1,  9, 0 }, { 13, 1, 13, 0 } },
+    { { 16, 1,  28, 0 }, { 10, 1,  34, 0 }, { 28, 1, 16, 0 }, { 22, 1, 22, 0 } },
+    { { 26, 1,  44, 0 }, { 15, 1,  55, 0 }, { 22, 2, 13, 0 }, { 18, 2, 17, 0 } },
+    { { 18, 2,  32, 0 }, { 20, 1,  80, 0 }, { 16, 4,  9, 0 }, { 26, 2, 24, 0 } },
+    { { 24, 2,  43, 0 }, { 26, 1, 108, 0 }, { 22, 2, 11, 2 }, { 18, 2, 15, 2 } },
+    { { 16, 4,  27, 0 }, { 18, 2,  68, 0 }, { 28, 4, 15, 0 }, { 24, 4, 19, 0 } },
+    { { 18, 4,  31, 0 }, { 20, 2,  78, 0 }, { 26, 4, 13, 1 }, { 18, 2, 14, 4 } },
+    { { 22, 2,  38, 2 }, { 24, 2,  97, 0 }, { 26, 4, 14, 2 }, { 22, 4, 18, 2 } },
+    { { 22, 3,  36, 2 }, { 30, 2, 116, 0 }, { 24, 4, 12, 4 }, { 20, 4, 16, 4 } },
+    { { 26, 4,  43, 1 }, { 18, 2,  68, 2 }, { 28, 6, 15, 2 }, { 24, 6, 19, 2 } },
+};
+
+static const char level_name[4] = { 'M', 'L', 'H', 'Q' };
+
+// alignment pattern rows / columns, none in version 1
+static const uint8_t align_pos[QR_DECODE_MAX_VERSION][3] = {
+    { 0 }, { 6, 18 }, { 6, 22 }, { 6, 26 }, { 6, 30 }, { 6, 34 },
+    { 6, 22, 38 }, { 6, 24, 42 }, { 6, 26, 46 }, { 6, 28, 50 },
+};
+
+static const char alnum_chars[45] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+// GF(256) over x^8 + x^4 + x^3 + x^2 + 1
+static const uint8_t gf_exp[255] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26,
+    0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0,
+    0x9d, 0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+    0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1,
+    0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0,
+    0xfd, 0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+    0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce,
+    0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc,
+    0x85, 0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+    0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73,
+    0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff,
+    0xe3, 0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6,
+    0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09,
+    0x12, 0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+    0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e,
+};
+
+static const uint8_t gf_log[256] = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee, 0x1b, 0x68, 0xc7, 0x4b,
+    0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81, 0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71,
+    0x05, 0x8a, 0x65, 0x2f, 0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+    0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78, 0x4d, 0xe4, 0x72, 0xa6,
+    0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd, 0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88,
+    0x36, 0xd0, 0x94, 0xce, 0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+    0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54, 0xfa, 0x85, 0xba, 0x3d,
+    0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b, 0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57,
+    0x07, 0x70, 0xc0, 0xf7, 0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+    0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9, 0x23, 0x20, 0x89, 0x2e,
+    0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd, 0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61,
+    0xf2, 0x56, 0xd3, 0xab, 0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+    0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec, 0x7f, 0x0c, 0x6f, 0xf6,
+    0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa, 0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a,
+    0xcb, 0x59, 0x5f, 0xb0, 0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+    0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea, 0xa8, 0x50, 0x58, 0xaf,
+};
+
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    return (a == 0 || b == 0) ? 0 : gf_exp[(gf_log[a] + gf_log[b]) % 255];
+}
+
+static inline uint8_t gf_div(uint8_t a, uint8_t b)
+{
+    return (a == 0) ? 0 : gf_exp[(gf_log[a] + 255 - gf_log[b]) % 255];
+}
+
+static inline uint8_t gf_pow(uint8_t a, int e)
+{
+    return (a == 0) ? 0 : gf_exp[(gf_log[a] * e) % 255];
+}
+
+
+// ==== Binarizer ============================================================== //
+
+// ZXing's hybrid binarizer: a black point per block from its own pixels (a flat block borrows
+// its neighbours'), the threshold of a block the average of the 5 x 5 blocks around it
+static void binarize(qr_decoder_t* qr, uint8_t* image, int w, int h)
+{
+    int bw = w / BLOCK;
+    int bh = h / BLOCK;
+    uint8_t* bp = qr->threshold;
+
+    for (int by = 0; by < bh; by++)
+    {
+        for (int bx = 0; bx < bw; bx++)
+        {
+            const uint8_t* p = &image[by * BLOCK * w + bx * BLOCK];
+            int sum = 0;
+            int min = 255;
+            int max = 0;
+            for (int y = 0; y < BLOCK; y++, p += w)
+            {
+                for (int x = 0; x < BLOCK; x++)
+                {
+                    sum += p[x];
+                    min = (p[x] < min) ? p[x] : min;
+                    max = (p[x] > max) ? p[x] : max;
+                }
+            }
+
+            int black = sum / (BLOCK * BLOCK);
+            if (max - min <= MIN_RANGE)
+            {
+                // light unless the blocks above and to the left say it is dark
+                black = min / 2;
+                if (by > 0 && bx > 0)
+                {
+                    int around = (bp[(by - 1) * bw + bx] + 2 * bp[by * bw + bx - 1] + bp[(by - 1) * bw + bx - 1]) / 4;
+                    if (min < around) {
+                        black = around;
+                    }
+                }
+            }
+            bp[by * bw + bx] = (uint8_t)black;
+        }
+    }
+
+    // 1 for dark from here on
+    for (int by = 0; by < bh; by++)
+    {
+        int top = (by < 2) ? 2 : (by > bh - 3) ? bh - 3 : by;
+        for (int bx = 0; bx < bw; bx++)
+        {
+            int left = (bx < 2) ? 2 : (bx > bw - 3) ? bw - 3 : bx;
+            int sum = 0;
+            for (int y = -2; y <= 2; y++)
+            {
+                for (int x = -2; x <= 2; x++) {
+                    sum += bp[(top + y) * bw + left + x];
+                }
+            }
+            int threshold = sum / 25;
+
+            uint8_t* p = &image[by * BLOCK * w + bx * BLOCK];
+            for (int y = 0; y < BLOCK; y++, p += w)
+            {
+                for (int x = 0; x < BLOCK; x++) {
+                    p[x] = (p[x] <= threshold);
+                }
+            }
+        }
+    }
+}
+
+
+// ==== Finder patterns ======================================================== //
+
+// five runs dark, light, dark, light, dark in 1:1:3:1:1, within half a module each
+static bool finder_ratio(const int* c)
+{
+    int total = c[0] + c[1] + c[2] + c[3] + c[4];
+    if (c[0] == 0 || c[1] == 0 || c[2] == 0 || c[3] == 0 || c[4] == 0 || total < 7) {
+        return false;
+    }
+    float module = total / 7.0f;
+    float slack = module / 2.0f;
+    return fabsf(module - c[0]) < slack && fabsf(module - c[1]) < slack && fabsf(3.0f * module - c[2]) < 3.0f * slack &&
+           fabsf(module - c[3]) < slack && fabsf(module - c[4]) < slack;
+}
+
+
+static inline float run_centre(const int* c, int end)
+{
+    return (float)(end - c[4] - c[3]) - c[2] / 2.0f;
+}
+
+
+// the same five runs across the line at (x, y), walking by (dx, dy) from the centre; the centre
+// along that line, or -1. A run may not be much longer than the centre run of the first line, and
+// the total has to be close to the first line's (total 0 skips that, a diagonal step is longer)
+static float cross_check(const uint8_t* image, int w, int h, int x, int y, int dx, int dy, int maxRun, int total)
+{
+    int c[5] = { 0 };
+
+    // back from the centre: the rest of the centre run, the light run, the outer dark run
+    int px = x;
+    int py = y;
+    for (int state = 2; state >= 0; state--)
+    {
+        while (px >= 0 && py >= 0 && px < w && py < h && image[py * w + px] == (state != 1) && c[state] <= maxRun)
+        {
+            c[state]++;
+            px -= dx;
+            py -= dy;
+        }
+        if (c[state] > maxRun || (state > 0 && (px < 0 || py < 0 || px >= w || py >= h))) {
+            return -1.0f;
+        }
+    }
+
+    // and forward
+    px = x + dx;
+    py = y + dy;
+    for (int state = 2; state <= 4; state++)
+    {
+        while (px >= 0 && py >= 0 && px < w && py < h && image[py * w + px] == (state != 3) && c[state] <= maxRun)
+        {
+            c[state]++;
+            px += dx;
+            py += dy;
+        }
+        if (c[state] > maxRun || (state < 4 && (px < 0 || py < 0 || px >= w || py >= h))) {
+            return -1.0f;
+        }
+    }
+
+    int sum = c[0] + c[1] + c[2] + c[3] + c[4];
+    if ((total > 0 && 5 * abs(sum - total) >= 2 * total) || !finder_ratio(c)) {
+        return -1.0f;
+    }
+    return run_centre(c, (dx != 0) ? px : py);
+}
+
+
+// runs that passed on a row: check them down the column and back across the row through the
+// centre found there, then merge with a finder already seen close by
+static void finder_candidate(qr_decoder_t* qr, const uint8_t* image, int w, int h, const int* c, int y, int end)
+{
+    int total = c[0] + c[1] + c[2] + c[3] + c[4];
+    float cx = run_centre(c, end);
+    float cy = cross_check(image, w, h, (int)cx, y, 0, 1, c[2] * 2, total);
+    if (cy < 0.0f) {
+        return;
+    }
+    // turned near 45 degrees a blurred corner can thin the outer run on the centre row; a diagonal
+    // then crosses the pattern square on and stands in for the row, keeping the first row's centre
+    float across = cross_check(image, w, h, (int)cx, (int)cy, 1, 0, c[2] * 2, total);
+    if (across >= 0.0f) {
+        cx = across;
+    }
+    else if (cross_check(image, w, h, (int)cx, (int)cy, 1, 1, c[2] * 2, 0) < 0.0f &&
+             cross_check(image, w, h, (int)cx, (int)cy, -1, 1, c[2] * 2, 0) < 0.0f) {
+        return;
+    }
+    float module = total / 7.0f;
+
+    for (int i = 0; i < qr->finderCount; i++)
+    {
+        qr_finder_t* f = &qr->finders[i];
+        if (fabsf(cx - f->x) <= f->module && fabsf(cy - f->y) <= f->module && fabsf(module - f->module) <= f->module)
+        {
+            // running average over the rows it shows up on
+            float n = f->hits;
+            f->x = (f->x * n + cx) / (n + 1.0f);
+            f->y = (f->y * n + cy) / (n + 1.0f);
+            f->module = (f->module * n + module) / (n + 1.0f);
+            f->hits++;
+            return;
+        }
+    }
+    qr_finder_t* slot = (qr->finderCount < QR_DECODE_MAX_FINDERS) ? &qr->finders[qr->finderCount++] : NULL;
+    for (int i = 0; !slot && i < qr->finderCount; i++)
+    {
+        // full of speckle from a busy background: one seen on a single row the scan has already
+        // left behind will not be seen again
+        qr_finder_t* f = &qr->finders[i];
+        if (f->hits < MIN_FINDER_HITS && f->y + 2.0f * f->module < (float)y) {
+            slot = f;
+        }
+    }
+    if (slot) {
+        *slot = (qr_finder_t){ .x = cx, .y = cy, .module = module, .hits = 1 };
+    }
+}
+
+
+// every row, ZXing style: counts of the last five runs, checked at the end of each dark run
+static void find_finders(qr_decoder_t* qr, const uint8_t* image, int w, int h)
+{
+    qr->finderCount = 0;
+    for (int y = 0; y < h; y++)
+    {
+        const uint8_t* row = &image[y * w];
+        int c[5] = { 0 };
+        int state = 0;
+        for (int x = 0; x < w; x++)
+        {
+            if (row[x])
+            {
+                if (state & 1) {
+                    state++;
+                }
+                c[state]++;
+            }
+            else if (!(state & 1))
+            {
+                if (state < 4)
+                {
+                    c[++state]++;
+                    continue;
+                }
+                if (finder_ratio(c)) {
+                    finder_candidate(qr, image, w, h, c, y, x);
+                }
+                // slide on by two runs, the light pixel here starts the next one
+                c[0] = c[2];
+                c[1] = c[3];
+                c[2] = c[4];
+                c[3] = 1;
+                c[4] = 0;
+                state = 3;
+            }
+            else {
+                c[state]++;
+            }
+        }
+        if (state == 4 && finder_ratio(c)) {
+            finder_candidate(qr, image, w, h, c, y, w);
+        }
+    }
+
+    // a pattern seen on one row only is noise
+    int kept = 0;
+    for (int i = 0; i < qr->finderCount; i++)
+    {
+        if (qr->finders[i].hits >= MIN_FINDER_HITS) {
+            qr->finders[kept++] = qr->finders[i];
+        }
+    }
+    qr->finderCount = (uint8_t)kept;
+}
+
+
+// ==== Geometry =============================================================== //
+
+typedef struct {
+    uint8_t tl;
+    uint8_t tr;
+    uint8_t bl;
+    float   score;
+} triple_t;
+
+static inline float dist2(const qr_finder_t* a, const qr_finder_t* b)
+{
+    return (a->x - b->x) * (a->x - b->x) + (a->y - b->y) * (a->y - b->y);
+}
+
+
+// three finders as corners of a right isosceles triangle (0 is exact), in reading order: the
+// corner at the right angle is top left, top right follows it clockwise as the image is seen
+static bool triple_place(const qr_decoder_t* qr, int a, int b, int c, triple_t* t)
+{
+    const qr_finder_t* f = qr->finders;
+    float minModule = fminf(f[a].module, fminf(f[b].module, f[c].module));
+    float maxModule = fmaxf(f[a].module, fmaxf(f[b].module, f[c].module));
+    if (maxModule > 1.5f * minModule) {
+        return false;
+    }
+
+    // the corner opposite the longest side is the right angle
+    float dab = dist2(&f[a], &f[b]);
+    float dac = dist2(&f[a], &f[c]);
+    float dbc = dist2(&f[b], &f[c]);
+    int corner = c;
+    int p = a;
+    int q = b;
+    float hyp = dab;
+    float s1 = dac;
+    float s2 = dbc;
+    if (dac >= dab && dac >= dbc) {
+        corner = b; p = a; q = c; hyp = dac; s1 = dab; s2 = dbc;
+    }
+    else if (dbc >= dab && dbc >= dac) {
+        corner = a; p = b; q = c; hyp = dbc; s1 = dab; s2 = dac;
+    }
+
+    // finder centres of version 1 are 14 modules apart
+    float module = (f[a].module + f[b].module + f[c].module) / 3.0f;
+    float l1 = sqrtf(s1);
+    float l2 = sqrtf(s2);
+    if (fminf(l1, l2) < 10.0f * module) {
+        return false;
+    }
+    t->score = fabsf(hyp - (s1 + s2)) / hyp + fabsf(l1 - l2) / fmaxf(l1, l2);
+    if (t->score > MAX_TRIPLE_SCORE) {
+        return false;
+    }
+
+    // y grows down, so top left -> top right -> bottom left turns clockwise: positive cross product
+    float cross = (f[p].x - f[corner].x) * (f[q].y - f[corner].y) - (f[p].y - f[corner].y) * (f[q].x - f[corner].x);
+    t->tl = (uint8_t)corner;
+    t->tr = (uint8_t)((cross > 0.0f) ? p : q);
+    t->bl = (uint8_t)((cross > 0.0f) ? q : p);
+    return true;
+}
+
+
+// up to MAX_TRIPLES placements, best first
+static int best_triples(const qr_decoder_t* qr, triple_t* best)
+{
+    int n = 0;
+    for (int a = 0; a < qr->finderCount; a++)
+    {
+        for (int b = a + 1; b < qr->finderCount; b++)
+        {
+            for (int c = b + 1; c < qr->finderCount; c++)
+            {
+                triple_t t;
+                if (!triple_place(qr, a, b, c, &t)) {
+                    continue;
+                }
+                int at;
+                if (n < MAX_TRIPLES) {
+                    at = n++;
+                }
+                else if (t.score < best[MAX_TRIPLES - 1].score) {
+                    at = MAX_TRIPLES - 1;
+                }
+                else {
+                    continue;
+                }
+                while (at > 0 && best[at - 1].score > t.score)
+                {
+                    best[at] = best[at - 1];
+                    at--;
+                }
+                best[at] = t;
+            }
+        }
+    }
+    return n;
+}
+
+
+// module coordinates (u, v) to pixels through a perspective transform
+typedef struct {
+    float h[8];
+} persp_t;
+
+static bool persp_solve(persp_t* t, const float src[4][2], const float dst[4][2])
+{
+    // x = (h0 u + h1 v + h2) / (h6 u + h7 v + 1), y likewise with h3 h4 h5; Gauss-Jordan on the
+    // eight equations the four corners give
+    double a[8][9];
+    for (int i = 0; i < 4; i++)
+    {
+        double u = src[i][0];
+        double v = src[i][1];
+        double x = dst[i][0];
+        double y = dst[i][1];
+        double rx[9] = { u, v, 1.0, 0.0, 0.0, 0.0, -u * x, -v * x, x };
+        double ry[9] = { 0.0, 0.0, 0.0, u, v, 1.0, -u * y, -v * y, y };
+        memcpy(a[2 * i], rx, sizeof(rx));
+        memcpy(a[2 * i + 1], ry, sizeof(ry));
+    }
+
+    for (int col = 0; col < 8; col++)
+    {
+        int pivot = col;
+        for (int r = col + 1; r < 8; r++)
+        {
+            if (fabs(a[r][col]) > fabs(a[pivot][col])) {
+                pivot = r;
+            }
+        }
+        if (fabs(a[pivot][col]) < 1e-9) {
+            return false;
+        }
+        if (pivot != col)
+        {
+            double tmp[9];
+            memcpy(tmp, a[col], sizeof(tmp));
+            memcpy(a[col], a[pivot], sizeof(tmp));
+            memcpy(a[pivot], tmp, sizeof(tmp));
+        }
+        for (int r = 0; r < 8; r++)
+        {
+            if (r == col) {
+                continue;
+            }
+            double f = a[r][col] / a[col][col];
+            for (int k = col; k < 9; k++) {
+                a[r][k] -= f * a[col][k];
+            }
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        t->h[i] = (float)(a[i][8] / a[i][i]);
+    }
+    return true;
+}
+
+
+static inline void persp_map(const persp_t* t, float u, float v, float* x, float* y)
+{
+    float d = t->h[6] * u + t->h[7] * v + 1.0f;
+    *x = (t->h[0] * u + t->h[1] * v + t->h[2]) / d;
+    *y = (t->h[3] * u + t->h[4] * v + t->h[5]) / d;
+}
+
+
+// binarized pixel under (x, y), -1 off the image
+static inline int pixel(const uint8_t* image, int w, int h, float x, float y)
+{
+    int px = (int)floorf(x);
+    int py = (int)floorf(y);
+    if (px < 0 || py < 0 || px >= w || py >= h) {
+        return -1;
+    }
+    return image[py * w + px];
+}
+
+
+// centre of the alignment pattern around (ex, ey), where its 5 x 5 modules (dark ring, light ring,
+// dark centre) match best, one module being (mx, my) along a row and (nx, ny) down a column; the
+// positions that match equally well are averaged
+static bool find_alignment(const uint8_t* image, int w, int h, float ex, float ey, float mx, float my, float nx,
+                           float ny, int radius, float* ax, float* ay)
+{
+    int best = ALIGN_MIN_MATCH;
+    float sumX = 0.0f;
+    float sumY = 0.0f;
+    int count = 0;
+
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+        for (int dx = -radius; dx <= radius; dx++)
+        {
+            float cx = ex + dx;
+            float cy = ey + dy;
+            int match = 0;
+            for (int v = -2; v <= 2; v++)
+            {
+                for (int u = -2; u <= 2; u++)
+                {
+                    int ring = (abs(u) > abs(v)) ? abs(u) : abs(v);
+                    match += (pixel(image, w, h, cx + u * mx + v * nx, cy + u * my + v * ny) == (ring != 1));
+                }
+            }
+            if (match > best)
+            {
+                best = match;
+                sumX = sumY = 0.0f;
+                count = 0;
+            }
+            if (match == best)
+            {
+                sumX += cx;
+                sumY += cy;
+                count++;
+            }
+        }
+    }
+    if (count == 0) {
+        return false;
+    }
+    *ax = sumX / count;
+    *ay = sumY / count;
+    return true;
+}
+
+
+static inline bool grid_get(const qr_decoder_t* qr, int dim, int x, int y)
+{
+    int i = y * dim + x;
+    return (qr->grid[i >> 3] >> (i & 7)) & 1;
+}
+
+
+// modules that read the same at their centre and a third of a module to each side; a grid that is
+// off puts centres on edges. All of it is scored, a corner a whole module out still reads sharp
+// next to that corner. About 400 modules are looked at whatever the version
+static int grid_sharpness(const persp_t* p, const uint8_t* image, int w, int h, int dim)
+{
+    static const float off[4][2] = { { -0.33f, 0.0f }, { 0.33f, 0.0f }, { 0.0f, -0.33f }, { 0.0f, 0.33f } };
+    int stride = (dim + 20) / 21;
+    int sharp = 0;
+    for (int y = 0; y < dim; y += stride)
+    {
+        for (int x = 0; x < dim; x += stride)
+        {
+            float px;
+            float py;
+            persp_map(p, x + 0.5f, y + 0.5f, &px, &py);
+            int v = pixel(image, w, h, px, py);
+            bool same = (v >= 0);
+            for (int k = 0; same && k < 4; k++)
+            {
+                persp_map(p, x + 0.5f + off[k][0], y + 0.5f + off[k][1], &px, &py);
+                same = (pixel(image, w, h, px, py) == v);
+            }
+            sharp += same;
+        }
+    }
+    return sharp;
+}
+
+
+// with no alignment pattern to go by the parallelogram corner is off as soon as the code is seen
+// at an angle: move it around by half modules, then quarters, to where the grid reads sharpest
+static void refine_corner(const uint8_t* image, int w, int h, int dim, const float src[4][2], float dst[4][2],
+                          float mx, float my, float nx, float ny)
+{
+    persp_t p;
+    float cornerX = dst[3][0];
+    float cornerY = dst[3][1];
+    int best = -1;
+    float bestU = 0.0f;
+    float bestV = 0.0f;
+    float step = 0.5f;
+    for (int pass = 0; pass < 2; pass++, step /= 2.0f)
+    {
+        float fromU = bestU;
+        float fromV = bestV;
+        int reach = (pass == 0) ? CORNER_STEPS : 1;
+        for (int j = -reach; j <= reach; j++)
+        {
+            for (int i = -reach; i <= reach; i++)
+            {
+                float u = fromU + i * step;
+                float v = fromV + j * step;
+                dst[3][0] = cornerX + u * mx + v * nx;
+                dst[3][1] = cornerY + u * my + v * ny;
+                if (!persp_solve(&p, src, dst)) {
+                    continue;
+                }
+                int sharp = grid_sharpness(&p, image, w, h, dim);
+                if (sharp > best)
+                {
+                    best = sharp;
+                    bestU = u;
+                    bestV = v;
+                }
+            }
+        }
+    }
+    dst[3][0] = cornerX + bestU * mx + bestV * nx;
+    dst[3][1] = cornerY + bestU * my + bestV * ny;
+}
+
+
+// the modules of a code of this version, read through the finder triple into qr->grid
+static bool sample_grid(qr_decoder_t* qr, const uint8_t* image, int w, int h, const triple_t* t, int version)
+{
+    const qr_finder_t* tl = &qr->finders[t->tl];
+    const qr_finder_t* tr = &qr->finders[t->tr];
+    const qr_finder_t* bl = &qr->finders[t->bl];
+    int dim = 17 + 4 * version;
+
+    // finder centres are the middle of module 3; without an alignment pattern the fourth corner is
+    // where a parallelogram puts it
+    float span = (float)(dim - 7);
+    float mx = (tr->x - tl->x) / span;
+    float my = (tr->y - tl->y) / span;
+    float nx = (bl->x - tl->x) / span;
+    float ny = (bl->y - tl->y) / span;
+    float src[4][2] = { { 3.5f, 3.5f }, { dim - 3.5f, 3.5f }, { 3.5f, dim - 3.5f }, { dim - 3.5f, dim - 3.5f } };
+    float dst[4][2] = { { tl->x, tl->y }, { tr->x, tr->y }, { bl->x, bl->y },
+                        { tr->x + bl->x - tl->x, tr->y + bl->y - tl->y } };
+
+    bool aligned = false;
+    if (version >= 2)
+    {
+        float back = dim - 10.0f;       // modules from the top left finder to the alignment pattern
+        float module = (tl->module + tr->module + bl->module) / 3.0f;
+        float ax;
+        float ay;
+        if (find_alignment(image, w, h, tl->x + back * (mx + nx), tl->y + back * (my + ny), mx, my, nx, ny,
+                           (int)ceilf(4.0f * module), &ax, &ay))
+        {
+            src[3][0] = src[3][1] = dim - 6.5f;
+            dst[3][0] = ax;
+            dst[3][1] = ay;
+            aligned = true;
+        }
+    }
+    if (!aligned) {
+        refine_corner(image, w, h, dim, src, dst, mx, my, nx, ny);
+    }
+
+    persp_t p;
+    if (!persp_solve(&p, src, dst)) {
+        return false;
+    }
+    memset(qr->grid, 0, sizeof(qr->grid));
+    for (int y = 0; y < dim; y++)
+    {
+        for (int x = 0; x < dim; x++)
+        {
+            float px;
+            float py;
+            persp_map(&p, x + 0.5f, y + 0.5f, &px, &py);
+            int v = pixel(image, w, h, px, py);
+            if (v < 0) {
+                return false;
+            }
+            int i = y * dim + x;
+            qr->grid[i >> 3] |= (uint8_t)(v << (i & 7));
+        }
+    }
+    return true;
+}
+
+
+// ==== Grid =================================================================== //
+
+static uint16_t format_code(int data)
+{
+    int rem = data;
+    for (int i = 0; i < 10; i++) {
+        rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+    }
+    return (uint16_t)(((data << 10) | rem) ^ 0x5412);
+}
+
+
+// level and mask from whichever format copy is nearer a valid word
+static bool read_format(const qr_decoder_t* qr, int dim, int* level, int* mask)
+{
+    uint16_t a = 0;
+    uint16_t b = 0;
+    for (int i = 0; i < 15; i++)
+    {
+        // around the top left finder
+        int x = (i < 8) ? 8 : (i == 8) ? 7 : 14 - i;
+        int y = (i < 6) ? i : (i < 8) ? i + 1 : 8;
+        a |= (uint16_t)(grid_get(qr, dim, x, y) << i);
+
+        // split between the other two
+        x = (i < 8) ? dim - 1 - i : 8;
+        y = (i < 8) ? 8 : dim - 15 + i;
+        b |= (uint16_t)(grid_get(qr, dim, x, y) << i);
+    }
+
+    int bestErrors = FORMAT_MAX_ERRORS + 1;
+    for (int data = 0; data < 32; data++)
+    {
+        uint16_t code = format_code(data);
+        int errors = __builtin_popcount(a ^ code);
+        int errorsB = __builtin_popcount(b ^ code);
+        errors = (errorsB < errors) ? errorsB : errors;
+        if (errors < bestErrors)
+        {
+            bestErrors = errors;
+            *level = data >> 3;
+            *mask = data & 7;
+        }
+    }
+    return bestErrors <= FORMAT_MAX_ERRORS;
+}
+
+
+static bool mask_bit(int mask, int x, int y)
+{
+    switch (mask)
+    {
+        case 0:  return (x + y) % 2 == 0;
+        case 1:  return y % 2 == 0;
+        case 2:  return x % 3 == 0;
+        case 3:  return (x + y) % 3 == 0;
+        case 4:  return (x / 3 + y / 2) % 2 == 0;
+        case 5:  return x * y % 2 + x * y % 3 == 0;
+        case 6:  return (x * y % 2 + x * y % 3) % 2 == 0;
+        default: return ((x + y) % 2 + x * y % 3) % 2 == 0;
+    }
+}
+
+
+// finders with their separators and format bits, timing, alignment and version info
+static bool is_function(int version, int dim, int x, int y)
+{
+    if ((x < 9 && y < 9) || (x >= dim - 8 && y < 9) || (x < 9 && y >= dim - 8) || x == 6 || y == 6) {
+        return true;
+    }
+    if (version >= 7 && ((x >= dim - 11 && x < dim - 8 && y < 6) || (y >= dim - 11 && y < dim - 8 && x < 6))) {
+        return true;
+    }
+
+    int n = (version == 1) ? 0 : (version < 7) ? 2 : 3;
+    const uint8_t* pos = align_pos[version - 1];
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            // none where a finder is
+            if ((i == 0 && j == 0) || (i == 0 && j == n - 1) || (i == n - 1 && j == 0)) {
+                continue;
+            }
+            if (abs(x - pos[j]) <= 2 && abs(y - pos[i]) <= 2) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// the data modules, unmasked, in the two column zigzag from the bottom right
+static void read_codewords(qr_decoder_t* qr, int version, int mask, int total)
+{
+    int dim = 17 + 4 * version;
+    int bit = 0;
+    memset(qr->codewords, 0, (size_t)total);
+
+    for (int right = dim - 1; right >= 1; right -= 2)
+    {
+        if (right == 6) {
+            right = 5;      // the vertical timing pattern
+        }
+        bool upward = ((right + 1) & 2) == 0;
+        for (int vert = 0; vert < dim; vert++)
+        {
+            int y = upward ? dim - 1 - vert : vert;
+            for (int j = 0; j < 2; j++)
+            {
+                int x = right - j;
+                if (bit >= total * 8 || is_function(version, dim, x, y)) {
+                    continue;
+                }
+                if (grid_get(qr, dim, x, y) ^ mask_bit(mask, x, y)) {
+                    qr->codewords[bit >> 3] |= (uint8_t)(0x80 >> (bit & 7));
+                }
+                bit++;
+            }
+        }
+    }
+}
+
+
+// ==== Reed-Solomon =========================================================== //
+
+// check bytes the smallest codes keep back against decoding to the wrong word (ISO 18004 table 9)
+static int rs_reserve(int version, int level)
+{
+    static const uint8_t v1[4] = { 2, 3, 1, 1 };
+    if (version == 1) {
+        return v1[level];
+    }
+    return (level == 1 && version <= 3) ? 4 - version : 0;
+}
+
+
+static void rs_syndromes(const uint8_t* block, int n, int ec, uint8_t* s)
+{
+    for (int i = 0; i < ec; i++)
+    {
+        uint8_t v = 0;
+        for (int k = 0; k < n; k++) {
+            v = gf_mul(v, gf_exp[i]) ^ block[k];
+        }
+        s[i] = v;
+    }
+}
+
+
+// correct the n bytes of a block (the last ec are check bytes) in place: bytes put right, -1 when
+// there are more errors than maxErrors
+static int rs_correct(uint8_t* block, int n, int ec, int maxErrors)
+{
+    uint8_t s[RS_MAX_EC];
+    rs_syndromes(block, n, ec, s);
+    bool clean = true;
+    for (int i = 0; i < ec; i++) {
+        clean &= (s[i] == 0);
+    }
+    if (clean) {
+        return 0;
+    }
+
+    // Berlekamp-Massey for the error locator
+    uint8_t lambda[RS_MAX_EC + 1] = { 1 };
+    uint8_t prev[RS_MAX_EC + 1] = { 1 };
+    uint8_t tmp[RS_MAX_EC + 1];
+    int errors = 0;
+    int shift = 1;
+    uint8_t lastD = 1;
+    for (int r = 0; r < ec; r++)
+    {
+        uint8_t d = s[r];
+        for (int i = 1; i <= errors; i++) {
+            d ^= gf_mul(lambda[i], s[r - i]);
+        }
+        if (d == 0)
+        {
+            shift++;
+            continue;
+        }
+        uint8_t f = gf_div(d, lastD);
+        bool grow = (2 * errors <= r);
+        if (grow) {
+            memcpy(tmp, lambda, sizeof(tmp));
+        }
+        for (int i = shift; i <= ec; i++) {
+            lambda[i] ^= gf_mul(f, prev[i - shift]);
+        }
+        if (grow)
+        {
+            errors = r + 1 - errors;
+            memcpy(prev, tmp, sizeof(prev));
+            lastD = d;
+            shift = 1;
+        }
+        else {
+            shift++;
+        }
+    }
+    if (errors > maxErrors) {
+        return -1;
+    }
+
+    // error evaluator, S(x) lambda(x) mod x^ec
+    uint8_t omega[RS_MAX_EC];
+    for (int i = 0; i < ec; i++)
+    {
+        uint8_t v = 0;
+        for (int j = 0; j <= i && j <= errors; j++) {
+            v ^= gf_mul(lambda[j], s[i - j]);
+        }
+        omega[i] = v;
+    }
+
+    // Chien search for the positions, Forney for the values
+    int found = 0;
+    for (int p = 0; p < n; p++)
+    {
+        int power = n - 1 - p;
+        uint8_t xinv = gf_exp[(255 - power) % 255];
+        uint8_t v = 0;
+        for (int i = 0; i <= errors; i++) {
+            v ^= gf_mul(lambda[i], gf_pow(xinv, i));
+        }
+        if (v != 0) {
+            continue;
+        }
+
+        uint8_t num = 0;
+        for (int i = 0; i < ec; i++) {
+            num ^= gf_mul(omega[i], gf_pow(xinv, i));
+        }
+        uint8_t den = 0;
+        for (int i = 1; i <= errors; i += 2) {
+            den ^= gf_mul(lambda[i], gf_pow(xinv, i - 1));
+        }
+        if (den == 0) {
+            return -1;
+        }
+        block[p] ^= gf_mul(gf_exp[power], gf_div(num, den));
+        found++;
+    }
+    if (found != errors) {
+        return -1;
+    }
+
+    rs_syndromes(block, n, ec, s);
+    for (int i = 0; i < ec; i++)
+    {
+        if (s[i] != 0) {
+            return -1;
+        }
+    }
+    return found;
+}
+
+
+// undo the block interleaving and correct each block, the data bytes end up in qr->data
+static qr_decode_status_t correct_blocks(qr_decoder_t* qr, int version, int level, int* dataLen)
+{
+    const rs_layout_t* l = &rs_layout[version - 1][level];
+    int blocks = l->n1 + l->n2;
+    int dataTotal = l->n1 * l->k1 + l->n2 * (l->k1 + 1);
+    int maxErrors = (l->ec - rs_reserve(version, level)) / 2;
+    uint8_t block[RS_MAX_BLOCK];
+    int out = 0;
+
+    qr->corrected = 0;
+    for (int b = 0; b < blocks; b++)
+    {
+        int k = l->k1 + (b >= l->n1);
+        for (int i = 0; i < l->k1; i++) {
+            block[i] = qr->codewords[i * blocks + b];
+        }
+        if (k > l->k1) {
+            block[l->k1] = qr->codewords[l->k1 * blocks + b - l->n1];     // only the long blocks have it
+        }
+        for (int i = 0; i < l->ec; i++) {
+            block[k + i] = qr->codewords[dataTotal + i * blocks + b];
+        }
+
+        int fixed = rs_correct(block, k + l->ec, l->ec, maxErrors);
+        if (fixed < 0) {
+            return QR_DECODE_ERR_ECC;
+        }
+        qr->corrected += (uint16_t)fixed;
+        memcpy(&qr->data[out], block, (size_t)k);
+        out += k;
+    }
+    *dataLen = out;
+    return QR_DECODE_OK;
+}
+
+
+// ==== Segments =============================================================== //
+
+typedef struct {
+    const uint8_t* data;
+    int bits;
+    int pos;
+} bitreader_t;
+
+static int take(bitreader_t* r, int n)
+{
+    if (r->pos + n > r->bits) {
+        return -1;
+    }
+    int v = 0;
+    for (int i = 0; i < n; i++, r->pos++) {
+        v = (v << 1) | ((r->data[r->pos >> 3] >> (7 - (r->pos & 7))) & 1);
+    }
+    return v;
+}
+
+
+static inline bool put(char* out, size_t cap, size_t* n, char c)
+{
+    if (*n + 1 >= cap) {
+        return false;
+    }
+    out[(*n)++] = c;
+    return true;
+}
+
+
+static qr_decode_status_t read_segments(const uint8_t* data, int len, int version, char* out, size_t cap, size_t* outLen)
+{
+    bitreader_t r = { .data = data, .bits = len * 8, .pos = 0 };
+    bool large = (version >= 10);       // longer character counts from version 10 on
+    size_t n = 0;
+
+    while (r.bits - r.pos >= 4)
+    {
+        int mode = take(&r, 4);
+        if (mode == 0) {
+            break;          // terminator
+        }
+
+        int count;
+        switch (mode)
+        {
+            case 1:         // numeric, three digits in 10 bits
+                count = take(&r, large ? 12 : 10);
+                while (count > 0)
+                {
+                    int digits = (count >= 3) ? 3 : count;
+                    int v = take(&r, (digits == 3) ? 10 : (digits == 2) ? 7 : 4);
+                    if (v < 0 || v >= ((digits == 3) ? 1000 : (digits == 2) ? 100 : 10)) {
+                        return QR_DECODE_ERR_DATA;
+                    }
+                    for (int div = (digits == 3) ? 100 : (digits == 2) ? 10 : 1; div > 0; div /= 10)
+                    {
+                        if (!put(out, cap, &n, (char)('0' + v / div % 10))) {
+                            return QR_DECODE_ERR_SPACE;
+                        }
+                    }
+                    count -= digits;
+                }
+                break;
+
+            case 2:         // alphanumeric, two characters in 11 bits
+                count = take(&r, large ? 11 : 9);
+                while (count > 0)
+                {
+                    int pair = (count >= 2);
+                    int v = take(&r, pair ? 11 : 6);
+                    if (v < 0 || v >= (pair ? 45 * 45 : 45)) {
+                        return QR_DECODE_ERR_DATA;
+                    }
+                    if ((pair && !put(out, cap, &n, alnum_chars[v / 45])) ||
+                        !put(out, cap, &n, alnum_chars[v % 45])) {
+                        return QR_DECODE_ERR_SPACE;
+                    }
+                    count -= pair ? 2 : 1;
+                }
+                break;
+
+            case 4:         // bytes
+                count = take(&r, large ? 16 : 8);
+                for (int i = 0; i < count; i++)
+                {
+                    int v = take(&r, 8);
+                    if (v < 0) {
+                        return QR_DECODE_ERR_DATA;
+                    }
+                    if (!put(out, cap, &n, (char)v)) {
+                        return QR_DECODE_ERR_SPACE;
+                    }
+                }
+                break;
+
+            case 7:         // ECI designator, one to three bytes, the bytes that follow are passed on as they are
+                count = take(&r, 8);
+                if (count >= 0 && (count & 0x80)) {
+                    count = take(&r, (count & 0x40) ? 16 : 8);
+                }
+                break;
+
+            case 3:         // structured append: sequence and parity
+                count = take(&r, 16);
+                break;
+
+            case 5:         // FNC1 first position
+                count = 0;
+                break;
+
+            case 9:         // FNC1 second position, application indicator
+                count = take(&r, 8);
+                break;
+
+            default:        // kanji, hanzi
+                return QR_DECODE_ERR_DATA;
+        }
+        if (count < 0) {
+            return QR_DECODE_ERR_DATA;
+        }
+    }
+
+    out[n] = '\0';
+    if (outLen != NULL) {
+        *outLen = n;
+    }
+    return QR_DECODE_OK;
+}
+
+
+// ==== Decoder ================================================================ //
+
+static qr_decode_status_t decode_at(qr_decoder_t* qr, const uint8_t* image, int w, int h, const triple_t* t,
+                                    int version, char* out, size_t cap, size_t* len)
+{
+    int level = 0;
+    int mask = 0;
+    if (!sample_grid(qr, image, w, h, t, version) || !read_format(qr, 17 + 4 * version, &level, &mask)) {
+        return QR_DECODE_ERR_FORMAT;
+    }
+
+    const rs_layout_t* l = &rs_layout[version - 1][level];
+    int total = l->n1 * l->k1 + l->n2 * (l->k1 + 1) + (l->n1 + l->n2) * l->ec;
+    read_codewords(qr, version, mask, total);
+
+    int dataLen;
+    qr_decode_status_t status = correct_blocks(qr, version, level, &dataLen);
+    if (status == QR_DECODE_OK) {
+        status = read_segments(qr->data, dataLen, version, out, cap, len);
+    }
+    if (status == QR_DECODE_OK)
+    {
+        qr->version = (uint8_t)version;
+        qr->level = level_name[level];
+    }
+    return status;
+}
+
+
+qr_decode_status_t qr_decode(qr_decoder_t* qr, uint8_t* image, int w, int h, char* out, size_t cap, size_t* len)
+{
+    if (w % BLOCK != 0 || h % BLOCK != 0 || w > QR_DECODE_MAX_W || h > QR_DECODE_MAX_H || w < 5 * BLOCK ||
+        h < 5 * BLOCK || cap == 0) {
+        return QR_DECODE_ERR_SIZE;
+    }
+    out[0] = '\0';
+
+    binarize(qr, image, w, h);
+    find_finders(qr, image, w, h);
+    triple_t triples[MAX_TRIPLES];
+    int n = best_triples(qr, triples);
+
+    // the version from how many modules fit between the finders, its neighbours in case that is off
+    static const int8_t around[3] = { 0, 1, -1 };
+    qr_decode_status_t status = (n > 0) ? QR_DECODE_ERR_FORMAT : QR_DECODE_NONE;
+    for (int i = 0; i < n; i++)
+    {
+        const qr_finder_t* f = qr->finders;
+        const triple_t* t = &triples[i];
+        float module = (f[t->tl].module + f[t->tr].module + f[t->bl].module) / 3.0f;
+        float side = (sqrtf(dist2(&f[t->tl], &f[t->tr])) + sqrtf(dist2(&f[t->tl], &f[t->bl]))) / 2.0f;
+        int guess = (int)lroundf((side / module - 10.0f) / 4.0f);
+
+        for (int k = 0; k < 3; k++)
+        {
+            int version = guess + around[k];
+            if (version < 1 || version > QR_DECODE_MAX_VERSION) {
+                continue;
+            }
+            qr_decode_status_t st = decode_at(qr, image, w, h, t, version, out, cap, len);
+            if (st == QR_DECODE_OK) {
+                return QR_DECODE_OK;
+            }
+            status = (st < status) ? st : status;
+        }
+    }
+    out[0] = '\0';
+    return status;
+}
@@ -0,0 +1,78 @@
+#ifndef QR_DECODE_H
+#define QR_DECODE_H
+
+/*
+    - Reads a QR code (model 2, versions 1-10, any error correction level) out of an 8 bit
+      grayscale image, which is plenty for the id printed on a wristband; numeric, alphanumeric
+      and byte segments are read, ECI and structured append headers skipped, kanji refused
+    - The image is binarized in place against a threshold per 8x8 block taken from the blocks
+      around it, so a band half in shadow still reads
+    - The three finder patterns are found by their 1:1:3:1:1 runs and checked across (or along a
+      diagonal when turned near 45 degrees), the best placed three give the grid; from version 2
+      on the bottom right alignment pattern is looked for so a band seen at an angle samples
+      right, without one the fourth corner is moved to where the grid reads sharpest. A few
+      versions around the estimate are tried
+    - Each block goes through Reed-Solomon correction, a code reads with as many damaged bytes as
+      its level allows
+    - Nothing is allocated, qr_decoder_t (about 2.6 KB) holds the working state
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QR_DECODE_MAX_W         320     // image size the block thresholds are sized for
+#define QR_DECODE_MAX_H         240
+#define QR_DECODE_MAX_VERSION   10
+#define QR_DECODE_MAX_DIM       (17 + 4 * QR_DECODE_MAX_VERSION)
+#define QR_DECODE_MAX_CODEWORDS 346     // version 10
+#define QR_DECODE_MAX_FINDERS   16
+
+typedef enum {
+    QR_DECODE_OK = 0,
+    QR_DECODE_NONE = -1,            // no three finder patterns that line up
+    QR_DECODE_ERR_FORMAT = -2,      // a code was found, its format bits did not read
+    QR_DECODE_ERR_ECC = -3,         // more damaged bytes than its level corrects
+    QR_DECODE_ERR_DATA = -4,        // a segment that is cut short or not supported
+    QR_DECODE_ERR_SPACE = -5,       // the payload does not fit the caller's buffer
+    QR_DECODE_ERR_SIZE = -6,        // image larger than QR_DECODE_MAX_W x H, smaller than 40 x 40,
+                                    // or not a multiple of 8 either way
+} qr_decode_status_t;
+
+typedef struct {
+    float       x;                  // centre, pixels
+    float       y;
+    float       module;             // module size, pixels
+    uint16_t    hits;               // rows it was seen on
+} qr_finder_t;
+
+typedef struct {
+    uint8_t     threshold[(QR_DECODE_MAX_W / 8) * (QR_DECODE_MAX_H / 8)];
+    qr_finder_t finders[QR_DECODE_MAX_FINDERS];
+    uint8_t     finderCount;
+    uint8_t     grid[(QR_DECODE_MAX_DIM * QR_DECODE_MAX_DIM + 7) / 8];
+    uint8_t     codewords[QR_DECODE_MAX_CODEWORDS];
+    uint8_t     data[QR_DECODE_MAX_CODEWORDS];
+
+    // the code the last qr_decode() read
+    uint8_t     version;
+    char        level;              // 'L', 'M', 'Q' or 'H'
+    uint16_t    corrected;          // bytes Reed-Solomon put right
+} qr_decoder_t;
+
+
+// payload of the first readable code in the w x h image (row major, one byte per pixel, binarized
+// in place) into out, NUL terminated; len (may be NULL) gets its length. On failure the status
+// is the furthest any attempt got
+qr_decode_status_t qr_decode(qr_decoder_t* qr, uint8_t* image, int w, int h, char* out, size_t cap, size_t* len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QR_DECODE_H
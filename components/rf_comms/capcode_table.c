@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "capcode_table.h"
+#include "mem_budget.h"
+
+
+#define CAPCODE_HASH_BITS   9
+#define CAPCODE_HASH_SIZE   (1 << CAPCODE_HASH_BITS)    // 2x CAPCODE_MAX keeps probe chains short
+#define CAPCODE_HASH_MASK   (CAPCODE_HASH_SIZE - 1)
+#define CAPCODE_SLOT_EMPTY  0                           // slots hold entry index + 1
+
+#define CAPCODE_NVS_NS      "rf_comms"
+#define CAPCODE_NVS_KEY     "capcodes"
+
+static const char* TAG = "CAPCODE";
+
+typedef struct {
+    capcode_entry_t entries[CAPCODE_MAX];
+    uint8_t         group[CAPCODE_MAX];         // which mask group an entry belongs to
+    uint32_t        hits[CAPCODE_MAX];
+    uint16_t        count;
+
+    uint32_t        masks[CAPCODE_MAX_MASKS];   // distinct masks, in the order first added
+    uint8_t         maskCount;
+
+    uint16_t        slots[CAPCODE_HASH_SIZE];
+    uint32_t        misses;
+} capcode_state_t;
+
+static capcode_state_t s_table;
+
+
+// ==== Hashing ================================================================ //
+
+// key is the masked address plus the mask group, so groups can share one table
+static inline uint32_t slot_of(uint32_t key, uint8_t group)
+{
+    return (uint32_t)((key ^ ((uint32_t)group << 21)) * 0x9E3779B1UL) >> (32 - CAPCODE_HASH_BITS);
+}
+
+
+static int state_find(const capcode_state_t* st, uint32_t key, uint8_t group)
+{
+    uint32_t slot = slot_of(key, group);
+
+    for (;;)
+    {
+        uint16_t s = st->slots[slot];
+        if (s == CAPCODE_SLOT_EMPTY) {
+            return CAPCODE_NO_MATCH;
+        }
+
+        int idx = s - 1;
+        if (st->group[idx] == group && (st->entries[idx].address & st->masks[group]) == key) {
+            return idx;
+        }
+        slot = (slot + 1) & CAPCODE_HASH_MASK;
+    }
+}
+
+
+static void state_clear(capcode_state_t* st)
+{
+    memset(st, 0, sizeof(*st));
+}
+
+
+static esp_err_t state_add(capcode_state_t* st, uint32_t address, uint32_t mask)
+{
+    address &= CAPCODE_ADDR_MASK;
+    mask &= CAPCODE_ADDR_MASK;
+
+    if (st->count >= CAPCODE_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t group = 0;
+    while (group < st->maskCount && st->masks[group] != mask) {
+        group++;
+    }
+
+    // a duplicate can only be in an existing group, found before a new group is taken for it
+    uint32_t key = address & mask;
+    if (group < st->maskCount && state_find(st, key, group) != CAPCODE_NO_MATCH) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (group == st->maskCount)
+    {
+        if (st->maskCount >= CAPCODE_MAX_MASKS) {
+            return ESP_ERR_NO_MEM;
+        }
+        st->masks[st->maskCount++] = mask;
+    }
+
+    uint16_t idx = st->count++;
+    st->entries[idx].address = address;
+    st->entries[idx].mask = mask;
+    st->group[idx] = group;
+    st->hits[idx] = 0;
+
+    uint32_t slot = slot_of(key, group);
+    while (st->slots[slot] != CAPCODE_SLOT_EMPTY) {
+        slot = (slot + 1) & CAPCODE_HASH_MASK;
+    }
+    st->slots[slot] = idx + 1;
+
+    return ESP_OK;
+}
+
+
+// one probe per mask group, groups are checked in the order their first entry was added;
+// the radio task and the MQTT pager both match, so the counters are bumped atomically
+static int state_match(capcode_state_t* st, uint32_t address)
+{
+    address &= CAPCODE_ADDR_MASK;
+
+    for (uint8_t g = 0; g < st->maskCount; g++)
+    {
+        int idx = state_find(st, address & st->masks[g], g);
+        if (idx != CAPCODE_NO_MATCH)
+        {
+            __atomic_fetch_add(&st->hits[idx], 1, __ATOMIC_RELAXED);
+            return idx;
+        }
+    }
+
+    __atomic_fetch_add(&st->misses, 1, __ATOMIC_RELAXED);
+    return CAPCODE_NO_MATCH;
+}
+
+
+// ==== Live table ============================================================= //
+
+void capcode_table_clear(void)
+{
+    state_clear(&s_table);
+}
+
+
+esp_err_t capcode_table_add(uint32_t address, uint32_t mask)
+{
+    return state_add(&s_table, address, mask);
+}
+
+
+int capcode_table_match(uint32_t address)
+{
+    return state_match(&s_table, address);
+}
+
+
+int capcode_table_count(void)
+{
+    return s_table.count;
+}
+
+
+bool capcode_table_get(int index, capcode_entry_t* entry, uint32_t* hits)
+{
+    if (index < 0 || index >= s_table.count) {
+        return false;
+    }
+    if (entry != NULL) {
+        *entry = s_table.entries[index];
+    }
+    if (hits != NULL) {
+        *hits = __atomic_load_n(&s_table.hits[index], __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+
+uint32_t capcode_table_misses(void)
+{
+    return __atomic_load_n(&s_table.misses, __ATOMIC_RELAXED);
+}
+
+
+void capcode_table_log(void)
+{
+    ESP_LOGI(TAG, "%d capcodes in %d mask groups, %lu pages for nobody", s_table.count,
+             s_table.maskCount, (unsigned long)capcode_table_misses());
+    for (int i = 0; i < s_table.count; i++)
+    {
+        ESP_LOGI(TAG, "  %7lu / 0x%06lx : %lu hits", (unsigned long)s_table.entries[i].address,
+                 (unsigned long)s_table.entries[i].mask,
+                 (unsigned long)__atomic_load_n(&s_table.hits[i], __ATOMIC_RELAXED));
+    }
+}
+
+
+// ==== NVS ==================================================================== //
+
+esp_err_t capcode_table_load(uint32_t defaultAddress, uint32_t defaultMask)
+{
+    static capcode_entry_t blob[CAPCODE_MAX];
+    size_t len = sizeof(blob);
+    nvs_handle_t nvs;
+
+    capcode_table_clear();
+    MEM_BUDGET_ADD(RF_COMMS, s_table, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(RF_COMMS, blob, MEM_REGION_DRAM);
+
+    // the radio comes up before wifi, so NVS may not be initialized yet
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_OK) {
+        err = nvs_open(CAPCODE_NVS_NS, NVS_READONLY, &nvs);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(nvs, CAPCODE_NVS_KEY, blob, &len);
+        nvs_close(nvs);
+    }
+
+    if (err != ESP_OK || len == 0 || (len % sizeof(capcode_entry_t)) != 0)
+    {
+        ESP_LOGI(TAG, "no capcode table saved (%s), listening on %lu only",
+                 esp_err_to_name(err), (unsigned long)defaultAddress);
+        return capcode_table_add(defaultAddress, defaultMask);
+    }
+
+    for (size_t i = 0; i < len / sizeof(capcode_entry_t); i++)
+    {
+        if (capcode_table_add(blob[i].address, blob[i].mask) != ESP_OK) {
+            ESP_LOGE(TAG, "skipping capcode %lu / 0x%06lx", (unsigned long)blob[i].address,
+                     (unsigned long)blob[i].mask);
+        }
+    }
+
+    ESP_LOGI(TAG, "loaded %d capcodes from NVS", s_table.count);
+    return ESP_OK;
+}
+
+
+esp_err_t capcode_table_save(void)
+{
+    nvs_handle_t nvs;
+
+    esp_err_t err = nvs_open(CAPCODE_NVS_NS, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(nvs, CAPCODE_NVS_KEY, s_table.entries, s_table.count * sizeof(capcode_entry_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+
+// ==== Benchmark ============================================================== //
+
+void capcode_table_bench(uint32_t lookups)
+{
+    static const uint32_t masks[] = { 0x1FFFFF, 0x1FFFF8, 0x1FFF00 };   // exact, frame wide, block wide
+    uint32_t rng = 0x2545F491;
+    uint32_t matched = 0;
+
+    // a full table on the heap so the live one is untouched
+    capcode_state_t* st = malloc(sizeof(capcode_state_t));
+    uint32_t* probes = malloc(lookups * sizeof(uint32_t));
+    if (st == NULL || probes == NULL)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        free(st);
+        free(probes);
+        return;
+    }
+    state_clear(st);
+
+    while (st->count < CAPCODE_MAX)
+    {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        state_add(st, rng, masks[st->count % 3]);
+    }
+
+    // half the probes are subscribed addresses, half random ones that mostly miss
+    for (uint32_t i = 0; i < lookups; i++)
+    {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        probes[i] = (i & 1) ? st->entries[rng % st->count].address : rng;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < lookups; i++) {
+        matched += (state_match(st, probes[i]) != CAPCODE_NO_MATCH);
+    }
+    int64_t elapsed = esp_timer_get_time() - t0;
+
+    ESP_LOGI(TAG, "bench: %lu lookups over %u capcodes / %u masks in %lld us, %.1f ns per codeword, %lu matched",
+             (unsigned long)lookups, st->count, st->maskCount, (long long)elapsed,
+             (double)elapsed * 1000.0 / lookups, (unsigned long)matched);
+
+    free(probes);
+    free(st);
+}
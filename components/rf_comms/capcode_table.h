@@ -0,0 +1,62 @@
+#ifndef CAPCODE_TABLE_H
+#define CAPCODE_TABLE_H
+
+/*
+    - The set of capcodes (POCSAG addresses) this pager answers to: its own, plus group pages
+      for the ward, the code team, a role...
+    - Every entry is an address + mask, a page matches when (page & mask) == (address & mask),
+      the same rule RadioLib's startReceive() filter uses
+    - Entries are grouped by mask, each group is a lookup in one open addressing hash table,
+      so a match costs one probe per distinct mask no matter how many capcodes there are
+    - The table lives in NVS (namespace "rf_comms", blob "capcodes") so it can change without
+      reflashing, with a built in default when nothing was saved yet
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPCODE_MAX         256     // entries in the table
+#define CAPCODE_MAX_MASKS   8       // distinct masks across all entries
+#define CAPCODE_ADDR_MASK   0x1FFFFF
+
+#define CAPCODE_NO_MATCH    (-1)
+
+// one subscription, also the layout of the NVS blob (an array of these, without the counter)
+typedef struct {
+    uint32_t address;
+    uint32_t mask;
+} capcode_entry_t;
+
+
+// empty the table (counters included)
+void capcode_table_clear(void);
+
+// add a subscription, fails when full, out of mask groups, or already present
+esp_err_t capcode_table_add(uint32_t address, uint32_t mask);
+
+// index of the first entry the address matches, CAPCODE_NO_MATCH otherwise; counts the hit
+int capcode_table_match(uint32_t address);
+
+// read the table from NVS, the default entry is loaded when no table was saved
+esp_err_t capcode_table_load(uint32_t defaultAddress, uint32_t defaultMask);
+esp_err_t capcode_table_save(void);
+
+int capcode_table_count(void);
+bool capcode_table_get(int index, capcode_entry_t* entry, uint32_t* hits);
+uint32_t capcode_table_misses(void);
+void capcode_table_log(void);
+
+// time matches against a full random table (runs on a scratch copy, the live table is kept)
+void capcode_table_bench(uint32_t lookups);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPCODE_TABLE_H
@@ -0,0 +1,292 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "pocsag_bch.h"
+#include "mem_budget.h"
+
+
+#define BCH_POLY            0x769       // x^10 + x^9 + x^8 + x^6 + x^5 + x^3 + 1
+#define BCH_CHECK_BITS      10
+#define BCH_SYNDROMES       (1 << BCH_CHECK_BITS)
+#define BCH_POS_BITS        5           // error positions are bits 1..31 of the codeword
+#define BCH_POS_MASK        0x1F
+#define BCH_UNCORRECTABLE   0xFFFF
+#define BCH_AIR_RATE        2400        // fastest POCSAG rate we have to keep up with
+#define BENCH_BATCH         4096        // codewords built up front, 32 KiB of heap for the bench
+
+static const char* TAG = "POCSAG_BCH";
+
+// syndrome contribution of each byte of the codeword, msb byte first
+static uint16_t s_synTable[4][256];
+
+// syndrome -> (pos1 | pos2 << 5), 0 = no error in that slot
+static uint16_t s_errTable[BCH_SYNDROMES];
+
+static pocsag_bch_stats_t s_stats;
+static bool s_ready = false;
+
+
+// ==== Table construction ===================================================== //
+
+// remainder of the 31 BCH bits (parity bit dropped) divided by the generator
+static uint16_t syndrome_slow(uint32_t cw)
+{
+    uint32_t rem = cw >> 1;
+    for (int bit = 30; bit >= BCH_CHECK_BITS; bit--)
+    {
+        if (rem & (1UL << bit)) {
+            rem ^= (uint32_t)BCH_POLY << (bit - BCH_CHECK_BITS);
+        }
+    }
+    return (uint16_t)rem;
+}
+
+
+static inline uint16_t syndrome(uint32_t cw)
+{
+    return s_synTable[0][cw >> 24] ^ s_synTable[1][(cw >> 16) & 0xFF] ^
+           s_synTable[2][(cw >> 8) & 0xFF] ^ s_synTable[3][cw & 0xFF];
+}
+
+
+void pocsag_bch_init(void)
+{
+    if (s_ready) {
+        return;
+    }
+
+    // the syndrome is linear, so every byte can be looked up on its own and xor'd together
+    for (int byte = 0; byte < 4; byte++)
+    {
+        for (int value = 0; value < 256; value++) {
+            s_synTable[byte][value] = syndrome_slow((uint32_t)value << (24 - 8 * byte));
+        }
+    }
+
+    for (int i = 0; i < BCH_SYNDROMES; i++) {
+        s_errTable[i] = BCH_UNCORRECTABLE;
+    }
+    s_errTable[0] = 0;
+
+    // minimum distance of BCH(31,21) is 5, so every 1 and 2 bit pattern has its own syndrome
+    for (int i = 1; i < 32; i++)
+    {
+        s_errTable[syndrome(1UL << i)] = (uint16_t)i;
+        for (int j = i + 1; j < 32; j++) {
+            s_errTable[syndrome((1UL << i) | (1UL << j))] = (uint16_t)(i | (j << BCH_POS_BITS));
+        }
+    }
+
+    MEM_BUDGET_ADD(RF_COMMS, s_synTable, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(RF_COMMS, s_errTable, MEM_REGION_DRAM);
+
+    s_ready = true;
+}
+
+
+// ==== Correction ============================================================= //
+
+pocsag_bch_result_t pocsag_bch_correct(uint32_t* cw)
+{
+    uint32_t word = *cw;
+    int fixed = 0;
+
+    uint16_t syn = syndrome(word);
+    if (syn != 0)
+    {
+        uint16_t err = s_errTable[syn];
+        if (err == BCH_UNCORRECTABLE) {
+            return POCSAG_BCH_UNCORRECTABLE;
+        }
+
+        word ^= 1UL << (err & BCH_POS_MASK);
+        fixed = 1;
+        if (err >> BCH_POS_BITS)
+        {
+            word ^= 1UL << (err >> BCH_POS_BITS);
+            fixed = 2;
+        }
+    }
+
+    // odd parity left over is either the parity bit itself or a third error the BCH part missed
+    if (__builtin_popcount(word) & 1)
+    {
+        if (fixed == 2) {
+            return POCSAG_BCH_UNCORRECTABLE;
+        }
+        word ^= 1;
+        fixed++;
+    }
+
+    *cw = word;
+    return (pocsag_bch_result_t)fixed;
+}
+
+
+void pocsag_bch_correct_ring(uint8_t* ring, size_t ringLen, size_t readPos, size_t writePos,
+                             size_t* checkedPos)
+{
+    size_t pending = (writePos + ringLen - readPos) % ringLen;
+
+    // pick up where the last call stopped if that is still inside the unread data
+    size_t start = readPos;
+    size_t done = (*checkedPos + ringLen - readPos) % ringLen;
+    if (done <= pending && (done % 4) == 0) {
+        start = *checkedPos;
+    }
+    else {
+        done = 0;
+    }
+
+    // only whole codewords, the ISR may still be filling the last one
+    size_t words = (pending - done) / 4;
+
+    for (size_t w = 0; w < words; w++)
+    {
+        size_t p0 = start;
+        size_t p1 = (p0 + 1) % ringLen;
+        size_t p2 = (p0 + 2) % ringLen;
+        size_t p3 = (p0 + 3) % ringLen;
+
+        uint32_t cw = ((uint32_t)ring[p0] << 24) | ((uint32_t)ring[p1] << 16) |
+                      ((uint32_t)ring[p2] << 8) | ring[p3];
+
+        switch (pocsag_bch_correct(&cw))
+        {
+            case POCSAG_BCH_CLEAN:          s_stats.clean++;            s_stats.uncorrectable_run = 0;  break;
+            case POCSAG_BCH_CORRECTED_1:    s_stats.corrected_1++;      s_stats.uncorrectable_run = 0;  break;
+            case POCSAG_BCH_CORRECTED_2:    s_stats.corrected_2++;      s_stats.uncorrectable_run = 0;  break;
+            default:                        s_stats.uncorrectable++;    s_stats.uncorrectable_run++;    break;
+        }
+
+        ring[p0] = (uint8_t)(cw >> 24);
+        ring[p1] = (uint8_t)(cw >> 16);
+        ring[p2] = (uint8_t)(cw >> 8);
+        ring[p3] = (uint8_t)cw;
+
+        start = (p0 + 4) % ringLen;
+    }
+
+    *checkedPos = start;
+}
+
+
+void pocsag_bch_get_stats(pocsag_bch_stats_t* out)
+{
+    *out = s_stats;
+}
+
+
+void pocsag_bch_reset_stats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+
+// ==== Benchmark ============================================================== //
+
+static uint32_t bench_rng(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+// valid codeword for 21 data bits, built with the same tables the decoder uses
+static uint32_t bench_codeword(uint32_t data21)
+{
+    uint32_t cw = (data21 & 0x1FFFFFUL) << 11;
+    cw |= (uint32_t)syndrome(cw) << 1;
+    cw |= (uint32_t)(__builtin_popcount(cw) & 1);
+    return cw;
+}
+
+
+void pocsag_bch_bench(uint32_t codewords)
+{
+    // the words are built up front so only the decoder is inside the timed loop; the batch is
+    // decoded as many times as it takes to reach codewords, copied out so each pass sees the same
+    // errors
+    uint32_t batch = (codewords < BENCH_BATCH) ? codewords : BENCH_BATCH;
+    uint32_t* sent = malloc(batch * sizeof(uint32_t));
+    uint32_t* rx = malloc(batch * sizeof(uint32_t));
+    if (sent == NULL || rx == NULL || batch == 0)
+    {
+        ESP_LOGE(TAG, "bench: out of memory or no codewords");
+        free(sent);
+        free(rx);
+        return;
+    }
+
+    uint32_t rng = 0x12345678;
+    uint32_t wrong = 0;
+    uint32_t flagged = 0;
+
+    pocsag_bch_init();
+
+    for (uint32_t n = 0; n < batch; n++)
+    {
+        sent[n] = bench_codeword(bench_rng(&rng));
+        rx[n] = sent[n];
+
+        uint32_t errors = n % 4;                // even mix of 0, 1, 2 and 3 bit errors
+        for (uint32_t e = 0; e < errors; )
+        {
+            uint32_t bit = 1UL << (bench_rng(&rng) % 32);
+            if ((rx[n] ^ sent[n]) & bit) {
+                continue;                       // same bit twice would cancel out
+            }
+            rx[n] ^= bit;
+            e++;
+        }
+    }
+
+    // ---- timed: decode only ---- //
+    uint32_t passes = (codewords + batch - 1) / batch;
+    volatile uint32_t sink = 0;                 // keeps the corrected words live
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t p = 0; p < passes; p++)
+    {
+        for (uint32_t n = 0; n < batch; n++)
+        {
+            uint32_t cw = rx[n];
+            sink += (uint32_t)pocsag_bch_correct(&cw) + cw;
+        }
+    }
+    int64_t elapsed = esp_timer_get_time() - t0;
+    uint32_t decoded = passes * batch;
+
+    // ---- untimed: check one pass ---- //
+    for (uint32_t n = 0; n < batch; n++)
+    {
+        uint32_t errors = n % 4;
+        uint32_t cw = rx[n];
+        pocsag_bch_result_t res = pocsag_bch_correct(&cw);
+
+        if (errors <= 2 && cw != sent[n]) {
+            wrong++;
+        }
+        if (errors == 3 && res == POCSAG_BCH_UNCORRECTABLE) {
+            flagged++;
+        }
+    }
+    free(sent);
+    free(rx);
+
+    if (elapsed <= 0) {
+        elapsed = 1;
+    }
+    double perSecond = (double)decoded * 1e6 / (double)elapsed;
+
+    ESP_LOGI(TAG, "%lu codewords in %lld us: %.0f cw/s = %.0f bps, %.0fx the %d bps air rate",
+             (unsigned long)decoded, (long long)elapsed, perSecond, perSecond * 32.0,
+             perSecond * 32.0 / BCH_AIR_RATE, BCH_AIR_RATE);
+    ESP_LOGI(TAG, "0-2 bit errors miscorrected: %lu, 3 bit errors flagged: %lu of %lu",
+             (unsigned long)wrong, (unsigned long)flagged, (unsigned long)(batch / 4));
+}
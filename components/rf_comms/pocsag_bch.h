@@ -0,0 +1,59 @@
+#ifndef POCSAG_BCH_H
+#define POCSAG_BCH_H
+
+/*
+    - Software error correction for POCSAG codewords, run on the raw RadioLib buffer before
+      pager.readData() parses it
+    - Every codeword is BCH(31,21) + an even parity bit, so up to two flipped bits per codeword
+      can be located from the 10 bit syndrome, and the parity bit catches a third
+    - The syndrome -> error position table is built once by pocsag_bch_init() (2 KB),
+      correcting a codeword is then 4 table lookups + 1
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    POCSAG_BCH_CLEAN = 0,       // no bit errors
+    POCSAG_BCH_CORRECTED_1,     // one bit fixed
+    POCSAG_BCH_CORRECTED_2,     // two bits fixed
+    POCSAG_BCH_UNCORRECTABLE,   // three or more errors, codeword left as received
+} pocsag_bch_result_t;
+
+typedef struct {
+    uint32_t clean;
+    uint32_t corrected_1;
+    uint32_t corrected_2;
+    uint32_t uncorrectable;
+    uint32_t uncorrectable_run;     // uncorrectable codewords in a row right now, a sign of lost sync
+} pocsag_bch_stats_t;
+
+
+void pocsag_bch_init(void);
+
+// correct one codeword in place, does not touch the counters
+pocsag_bch_result_t pocsag_bch_correct(uint32_t* cw);
+
+// correct every complete codeword between readPos and writePos of a circular byte buffer
+// (codewords msb first, aligned to readPos), counting the results
+// checkedPos remembers how far a previous call got so words are only checked once
+void pocsag_bch_correct_ring(uint8_t* ring, size_t ringLen, size_t readPos, size_t writePos,
+                             size_t* checkedPos);
+
+void pocsag_bch_get_stats(pocsag_bch_stats_t* out);
+void pocsag_bch_reset_stats(void);
+
+// time the decoder on random codewords with 0..3 errors, built before the timed loop, and log
+// codewords/s vs the 2400 bps air rate
+void pocsag_bch_bench(uint32_t codewords);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POCSAG_BCH_H
@@ -0,0 +1,260 @@
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+#endif
+
+#include "rf_bit_isr.h"
+#include "mem_budget.h"
+
+
+#define RF_BIT_RING_WORDS   (RF_BIT_RING_BITS / 32)
+#define RF_BIT_WORD_MASK    (RF_BIT_RING_WORDS - 1)
+
+#if CONFIG_IDF_TARGET_LINUX
+// the fake radio calls the handler from its clock thread, there is no flash cache to miss
+#define RF_ISR_ATTR
+#else
+#define RF_ISR_ATTR         IRAM_ATTR
+#endif
+
+static const char* TAG = "RF_BIT_ISR";
+
+// single producer (the ISR) / single consumer (poll_radio), both counters only ever go up and
+// wrap together, head - tail is the fill level
+static uint32_t     s_ring[RF_BIT_RING_WORDS];
+static uint32_t     s_head;     // written by the ISR only
+static uint32_t     s_tail;     // written by the task only
+
+static uint32_t     s_dataPin;
+static uint32_t     s_ticksPerUs;
+static uint32_t     s_gapTicks;     // DCLK periods longer than this are carrier gaps, not jitter
+
+// raw counters in CPU cycles, only the ISR writes them
+static struct {
+    uint32_t count;
+    uint32_t ring_overflows;
+    uint32_t ring_high_water;
+    uint32_t dur_min;
+    uint32_t dur_max;
+    uint64_t dur_sum;
+    uint32_t period_min;
+    uint32_t period_max;
+    uint32_t last_edge;
+    bool     have_edge;
+} s_raw;
+
+// the task asks, the ISR clears on its next edge, so the counters keep a single writer
+static volatile bool s_resetRequest = true;
+
+
+// ==== Per-target primitives, all inline so nothing is fetched from flash ==== //
+
+#if CONFIG_IDF_TARGET_LINUX
+static inline uint32_t isr_ticks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+static inline uint32_t isr_sample(uint32_t pin)
+{
+    return (uint32_t)gpio_get_level((gpio_num_t)pin);
+}
+#else
+static inline uint32_t isr_ticks(void)
+{
+    return (uint32_t)esp_cpu_get_cycle_count();
+}
+
+// gpio_get_level() is in flash unless CONFIG_GPIO_CTRL_FUNC_IN_IRAM, read the register directly
+static inline uint32_t isr_sample(uint32_t pin)
+{
+    return (uint32_t)gpio_ll_get_level(&GPIO, (gpio_num_t)pin);
+}
+#endif
+
+
+static void RF_ISR_ATTR rf_bit_isr(void* arg)
+{
+    (void)arg;
+    uint32_t start = isr_ticks();
+    uint32_t bit = isr_sample(s_dataPin);
+
+    if (s_resetRequest)
+    {
+        s_raw.count = 0;
+        s_raw.ring_overflows = 0;
+        s_raw.ring_high_water = 0;
+        s_raw.dur_min = UINT32_MAX;
+        s_raw.dur_max = 0;
+        s_raw.dur_sum = 0;
+        s_raw.period_min = UINT32_MAX;
+        s_raw.period_max = 0;
+        s_raw.have_edge = false;
+        s_resetRequest = false;
+    }
+
+    // ---- append to the ring ---- //
+    uint32_t head = s_head;
+    uint32_t used = head - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE);
+
+    if (used >= RF_BIT_RING_BITS) {
+        s_raw.ring_overflows++;     // the task is behind, drop the new bit and keep the old ones
+    }
+    else
+    {
+        uint32_t mask = 1UL << (head & 31);
+        uint32_t* word = &s_ring[(head >> 5) & RF_BIT_WORD_MASK];
+        *word = bit ? (*word | mask) : (*word & ~mask);
+
+        __atomic_store_n(&s_head, head + 1, __ATOMIC_RELEASE);
+        if (used + 1 > s_raw.ring_high_water) {
+            s_raw.ring_high_water = used + 1;
+        }
+    }
+
+    // ---- DCLK jitter ---- //
+    if (s_raw.have_edge)
+    {
+        uint32_t period = start - s_raw.last_edge;
+        if (period <= s_gapTicks)
+        {
+            if (period < s_raw.period_min) {
+                s_raw.period_min = period;
+            }
+            if (period > s_raw.period_max) {
+                s_raw.period_max = period;
+            }
+        }
+    }
+    s_raw.last_edge = start;
+    s_raw.have_edge = true;
+    s_raw.count++;
+
+    uint32_t dur = isr_ticks() - start;
+    if (dur < s_raw.dur_min) {
+        s_raw.dur_min = dur;
+    }
+    if (dur > s_raw.dur_max) {
+        s_raw.dur_max = dur;
+    }
+    s_raw.dur_sum += dur;
+}
+
+
+int rf_bit_isr_start(uint32_t clkPin, uint32_t dataPin, uint32_t bitRate)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    s_ticksPerUs = 1000;
+#else
+    s_ticksPerUs = esp_rom_get_cpu_ticks_per_us();
+#endif
+    s_dataPin = dataPin;
+    s_gapTicks = (uint32_t)((2ULL * 1000000ULL * s_ticksPerUs) / (bitRate ? bitRate : 1));
+
+    rf_bit_ring_flush();
+    rf_bit_isr_reset_stats();
+    MEM_BUDGET_ADD(RF_COMMS, s_ring, MEM_REGION_DRAM);     // the ISR writes it, never PSRAM
+
+    gpio_set_intr_type((gpio_num_t)clkPin, GPIO_INTR_POSEDGE);
+    esp_err_t err = gpio_isr_handler_add((gpio_num_t)clkPin, rf_bit_isr, NULL);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "could not attach the DCLK handler: %s", esp_err_to_name(err));
+        return -1;
+    }
+    gpio_intr_enable((gpio_num_t)clkPin);
+
+    ESP_LOGI(TAG, "DCLK on %lu, data on %lu, %lu bps", (unsigned long)clkPin, (unsigned long)dataPin,
+             (unsigned long)bitRate);
+    return 0;
+}
+
+
+void rf_bit_isr_stop(uint32_t clkPin)
+{
+    gpio_isr_handler_remove((gpio_num_t)clkPin);
+    gpio_set_intr_type((gpio_num_t)clkPin, GPIO_INTR_DISABLE);
+}
+
+
+size_t rf_bit_ring_pop(uint8_t* bits, size_t max)
+{
+    uint32_t tail = s_tail;
+    uint32_t avail = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE) - tail;
+    size_t count = (avail < max) ? avail : max;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t pos = tail + (uint32_t)i;
+        bits[i] = (uint8_t)((s_ring[(pos >> 5) & RF_BIT_WORD_MASK] >> (pos & 31)) & 0x01);
+    }
+
+    // hand the slots back only after they have been read
+    __atomic_store_n(&s_tail, tail + (uint32_t)count, __ATOMIC_RELEASE);
+    return count;
+}
+
+
+size_t rf_bit_ring_flush(void)
+{
+    uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    size_t dropped = head - s_tail;
+    __atomic_store_n(&s_tail, head, __ATOMIC_RELEASE);
+    return dropped;
+}
+
+
+size_t rf_bit_ring_used(void)
+{
+    return __atomic_load_n(&s_head, __ATOMIC_ACQUIRE) - s_tail;
+}
+
+
+static uint32_t ticks_to_ns(uint64_t ticks)
+{
+    return (s_ticksPerUs > 0) ? (uint32_t)((ticks * 1000ULL) / s_ticksPerUs) : 0;
+}
+
+
+// snapshot for the stat dump, fields can be one edge apart from each other
+void rf_bit_isr_get_stats(rf_bit_isr_stats_t* out)
+{
+    memset(out, 0, sizeof(*out));
+    out->period_nominal_ns = ticks_to_ns(s_gapTicks) / 2;
+
+    if (s_resetRequest || s_raw.count == 0) {
+        return;
+    }
+
+    out->count = s_raw.count;
+    out->ring_overflows = s_raw.ring_overflows;
+    out->ring_high_water = s_raw.ring_high_water;
+    out->dur_min_ns = ticks_to_ns(s_raw.dur_min);
+    out->dur_max_ns = ticks_to_ns(s_raw.dur_max);
+    out->dur_avg_ns = ticks_to_ns(s_raw.dur_sum / s_raw.count);
+
+    if (s_raw.period_max > 0)
+    {
+        out->period_min_ns = ticks_to_ns(s_raw.period_min);
+        out->period_max_ns = ticks_to_ns(s_raw.period_max);
+    }
+}
+
+
+void rf_bit_isr_reset_stats(void)
+{
+    s_resetRequest = true;
+}
@@ -0,0 +1,61 @@
+#ifndef RF_BIT_ISR_H
+#define RF_BIT_ISR_H
+
+/*
+    - Dedicated DCLK interrupt for direct receive mode, replaces the void(void) callback
+      PagerClient registers through the HAL
+    - The handler lives in IRAM and only touches IRAM / DRAM: it samples DIO2 straight from the
+      GPIO input register, appends the bit to a lock-free ring and returns, so a flash cache miss
+      (SPI display flush, NVS write) can not stall a bit
+    - poll_radio() pops the ring and feeds RadioLib's buffer from task context
+    - Handler duration and DCLK period are timed with the CPU cycle counter (ns on the host build)
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RF_BIT_RING_BITS    4096    // 3.4 s of air at 1200 bps, power of two
+
+typedef struct {
+    uint32_t count;             // interrupts taken
+    uint32_t ring_overflows;    // bits dropped because the task had not emptied the ring
+    uint32_t ring_high_water;   // most unread bits seen by the ISR
+
+    // handler run time, entry to exit, in ns
+    uint32_t dur_min_ns;
+    uint32_t dur_max_ns;
+    uint32_t dur_avg_ns;
+
+    // time between consecutive DCLK edges, gaps over 2 bit periods (no carrier) are left out
+    uint32_t period_min_ns;
+    uint32_t period_max_ns;
+    uint32_t period_nominal_ns;
+} rf_bit_isr_stats_t;
+
+
+// hook the handler onto the rising edge of clkPin, sampling dataPin
+// the GPIO ISR service must already be installed (EspHal2 does it)
+int rf_bit_isr_start(uint32_t clkPin, uint32_t dataPin, uint32_t bitRate);
+void rf_bit_isr_stop(uint32_t clkPin);
+
+// copy up to max bits (one per byte, oldest first) out of the ring, returns the count
+size_t rf_bit_ring_pop(uint8_t* bits, size_t max);
+
+// throw away everything in the ring, returns the number of bits dropped
+size_t rf_bit_ring_flush(void);
+
+size_t rf_bit_ring_used(void);
+
+void rf_bit_isr_get_stats(rf_bit_isr_stats_t* out);
+void rf_bit_isr_reset_stats(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RF_BIT_ISR_H
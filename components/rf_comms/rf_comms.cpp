@@ -3,9 +3,24 @@
 #include <string>
 #include <RadioLib.h>
 
+#include "sdkconfig.h"
+#include "board_profile.h"
 #include "rf_comms.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include "FakeRadioHal.h"
+#else
 #include "EspHal.h"
+#endif
 #include "esp_err.h"
+#include "esp_timer.h"
+#include "dlog.h"
+#include "pocsag_bch.h"
+#include "capcode_table.h"
+#include "msg_dedup.h"
+#include "msg_store.h"
+#include "rf_bit_isr.h"
+#include "mem_budget.h"
 
 
 #ifdef __cplusplus
@@ -21,28 +36,75 @@ extern "C" {
 
 using namespace std;
 
-// Defines of pins needed for RadioLib SPI interface
-#define SPI_MOSI_PIN    36 // was 35 // was 23
-#define SPI_MISO_PIN    37 // was 36 // was 19
-#define SPI_SCK_PIN     35 // was 37 // was 18
-#define SPI_CS_PIN      21 // was 5  // this is for RF only
-#define RFM_RESET_PIN   47 // was 4  // this is for RF only
+// RF69 pins, assigned in board_profile.h (the SPI bus pins go to EspHal2 through the profile too)
+#define SPI_CS_PIN      BOARD_RF_CS
+#define RFM_RESET_PIN   BOARD_RF_RESET
 
-#define DIO0_PIN        39   // was 26 
-#define DIO1_PIN        40  // was 14  // might not be needed
-#define DIO2_PIN        41   // was 13  // IMPORTANT -> should pass data from module to RadioLib
+#define DIO0_PIN        BOARD_RF_DIO0
+#define DIO1_PIN        BOARD_RF_DIO1   // DCLK
+#define DIO2_PIN        BOARD_RF_DIO2   // IMPORTANT -> should pass data from module to RadioLib
 
 #define MSG_CHAR_LEN 256
 
+#define RF_BIT_RATE     1200    // POCSAG speed the transmitter uses, also sets the DCLK jitter window
+
+#define RF_DRAIN_MAX    16      // pages read per wake-up at most, so one pass can not starve the display
+#define RF_DESYNC_RUN   4       // uncorrectable codewords in a row before we call the stream lost
+#define RF_PUMP_CHUNK   64      // bits moved from the ISR ring per pop
+#define RF_ENQUEUE_TRIES 4      // evictions before a page is given up, only racing producers need more than one
+
+// why the receiver was put back into sync search
+#define RF_RESYNC_OVERRUN   0
+#define RF_RESYNC_DESYNC    1
+#define RF_RESYNC_MANUAL    2
+
+#define RF_ERR_DESYNC       (-1100)     // get_message(): stream lost, resync requested
+
 static const char* TAG = "RF_COMMS";
 
-uint32_t myAddress = 12345;
+uint32_t myAddress = 12345;     // default subscription when NVS holds no capcode table
+uint32_t myMask = 12345;
 
 // ==== Static items for controlling display ========== //
-static EspHal2* hal = new EspHal2(SPI_SCK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN);
-static RF69 radio = new Module(hal, SPI_CS_PIN, DIO0_PIN, RFM_RESET_PIN, DIO1_PIN);
+// all static, constructed in this order before app_main
+#if CONFIG_IDF_TARGET_LINUX
+static FakeRadioHal s_hal(DIO1_PIN, DIO2_PIN);     // host build, scripted bitstream
+static FakeRadioHal* hal = &s_hal;
+#else
+static EspHal2 s_hal;
+static EspHal2* hal = &s_hal;
+#endif
+static Module s_module(hal, SPI_CS_PIN, DIO0_PIN, RFM_RESET_PIN, DIO1_PIN);
+static RF69 radio(&s_module);
 static PagerClient pager(&radio);
 
+// only poll_radio writes these, readers take a snapshot through rf_get_stats()
+static rf_stats_t s_stats;
+
+// how far into the RadioLib buffer the BCH stage has already corrected
+static size_t s_bchCheckedPos = 0;
+
+// the RadioLib buffer is only written from poll_radio (see pump_bits()), the DCLK interrupt
+// just fills the ring in rf_bit_isr.c, so resyncs can reset the positions directly
+static bool         s_awaitSync = false;
+static uint32_t     s_resyncStartUs;
+static uint32_t     s_lastOverflows;
+
+
+// bytes pump_bits() has written that readData() has not consumed yet
+size_t rf_buffer_used(void)
+{
+    size_t readPos = pager.phyLayer->bufferReadPos;
+    size_t writePos = pager.phyLayer->bufferWritePos;
+    return (writePos + RADIOLIB_STATIC_ARRAY_SIZE - readPos) % RADIOLIB_STATIC_ARRAY_SIZE;
+}
+
+
+size_t rf_buffer_size(void)
+{
+    return RADIOLIB_STATIC_ARRAY_SIZE;
+}
+
 
 
 // init the module and put it into a pager mode that will LISTEN only
@@ -52,6 +114,14 @@ esp_err_t init_radio(void)
 
     //Module *myModule = radio.getMod();
 
+    MEM_BUDGET_ADD(RF_COMMS, s_hal, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(RF_COMMS, s_module, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(RF_COMMS, radio, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(RF_COMMS, pager, MEM_REGION_DRAM);
+
+    // syndrome tables for correcting codewords before readData() sees them
+    pocsag_bch_init();
+
     // turning on radio
     state = radio.begin();
     if (state == RADIOLIB_ERR_NONE)
@@ -64,7 +134,7 @@ esp_err_t init_radio(void)
     }
 
     // starting the radio as a PAGER
-    state = pager.begin(434.0, 1200, false, 4500);
+    state = pager.begin(434.0, RF_BIT_RATE, false, 4500);
     if (state == RADIOLIB_ERR_NONE)
     {
         ESP_LOGI(TAG, "radio started just fine!\n");
@@ -73,8 +143,12 @@ esp_err_t init_radio(void)
         return ESP_FAIL;
     }
 
+    // capcodes we answer to, RadioLib is told to accept every address and
+    // capcode_table_match() does the filtering once readData() has the address
+    capcode_table_load(myAddress, myMask);
+
     // putting the pager into RECEIVE mode
-    state = pager.startReceive(DIO2_PIN, myAddress, 12345);
+    state = pager.startReceive(DIO2_PIN, 0, 0);
     if (state == RADIOLIB_ERR_NONE)
     {
         ESP_LOGI(TAG, "radio started just fine!\n");
@@ -83,6 +157,16 @@ esp_err_t init_radio(void)
         return ESP_FAIL;
     }
 
+    // swap PagerClient's DCLK handler for the IRAM one, it only samples DIO2 into a ring
+    // and RadioLib gets the bits from poll_radio
+    hal->detachInterrupt(DIO1_PIN);
+    if (rf_bit_isr_start(DIO1_PIN, DIO2_PIN, RF_BIT_RATE) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to attach the DCLK interrupt\n");
+        return ESP_FAIL;
+    }
+    s_lastOverflows = 0;    // the start zeroed the ISR's counters
+
     // pager is ready to be read from using the readData() function when
     // a message is seen using the .available() function
     return ESP_OK;  // made it to end wihtout failure
@@ -101,82 +185,424 @@ int get_numMessages()
 }
 
 
+// throw away the unread bits and go back to looking for a frame sync word, without touching the radio
+// bits still in the ISR ring are kept, the sync search runs over them on the next pump
+static void request_resync(uint8_t reason)
+{
+    PhysicalLayer* phy = pager.phyLayer;
+
+    if (s_awaitSync) {
+        return;     // already hunting
+    }
+
+    s_stats.resyncs++;
+    if (reason == RF_RESYNC_DESYNC) {
+        s_stats.desyncs++;
+    }
+    DLOG(RF_RESYNC, reason, rf_buffer_used());
+
+    s_stats.bits_discarded += rf_buffer_used() * 8 + phy->bufferBitPos;
+
+    // RadioLib resets the positions itself when it finds the next sync word
+    phy->gotSync = false;
+    phy->syncBuffer = 0;
+    phy->bufferReadPos = phy->bufferWritePos;
+    phy->bufferBitPos = 0;
+
+    s_bchCheckedPos = 0;
+    s_resyncStartUs = latency_now();
+    s_awaitSync = true;
+}
+
+
 // simple call to the physical layer class to reset the circular buffer poitners
 void clearBuffer()
 {
-    pager.phyLayer->bufferReadPos = 0;
-    pager.phyLayer->bufferWritePos = 0;
-    pager.phyLayer->bufferBitPos = 0;
+    request_resync(RF_RESYNC_MANUAL);
+}
+
+
+// false while the receiver has not seen a frame sync word since the last resync,
+// nothing in the buffer can be trusted until then
+static bool rx_in_sync()
+{
+    if (s_awaitSync)
+    {
+        if (!pager.phyLayer->gotSync) {
+            return false;
+        }
+
+        // locked on again, remember how long it took
+        uint32_t took = latency_now() - s_resyncStartUs;
+        s_stats.resync_us_last = took;
+        if (took > s_stats.resync_us_max) {
+            s_stats.resync_us_max = took;
+        }
+        s_bchCheckedPos = pager.phyLayer->bufferReadPos;
+        s_awaitSync = false;
+    }
+
+    return true;
+}
+
+
+// move bits from the ISR ring into RadioLib's buffer, in task context
+// stops one byte short of the read position so the buffer can never be overrun, anything
+// that does not fit waits in the ring (the ring counts its own overflows)
+static size_t pump_bits()
+{
+    PhysicalLayer* phy = pager.phyLayer;
+    uint8_t bits[RF_PUMP_CHUNK];
+    size_t moved = 0;
+
+    for (;;)
+    {
+        size_t room = RF_PUMP_CHUNK;
+
+        // before sync the bits only go through the sync word search and take no space
+        if (phy->gotSync)
+        {
+            size_t freeBits = (RADIOLIB_STATIC_ARRAY_SIZE - 1 - rf_buffer_used()) * 8;
+            freeBits = (freeBits > phy->bufferBitPos) ? freeBits - phy->bufferBitPos : 0;
+            if (freeBits < room) {
+                room = freeBits;
+            }
+        }
+
+        size_t count = (room > 0) ? rf_bit_ring_pop(bits, room) : 0;
+        for (size_t i = 0; i < count; i++) {
+            phy->updateDirectBuffer(bits[i]);
+        }
+        moved += count;
+
+        if (count < RF_PUMP_CHUNK) {
+            return moved;   // ring empty or RadioLib buffer full
+        }
+    }
+}
+
+
+// fix up to two bit errors per codeword in whatever the ISR has put in the buffer so far,
+// readData() only copes with clean codewords
+// returns false when a run of uncorrectable codewords says we are no longer aligned to the stream
+static bool correct_rx_buffer()
+{
+    pocsag_bch_stats_t before, after;
+    pocsag_bch_get_stats(&before);
+
+    pocsag_bch_correct_ring(pager.phyLayer->buffer, RADIOLIB_STATIC_ARRAY_SIZE,
+                            pager.phyLayer->bufferReadPos, pager.phyLayer->bufferWritePos,
+                            &s_bchCheckedPos);
+
+    pocsag_bch_get_stats(&after);
+    uint32_t fixed = (after.corrected_1 - before.corrected_1) + (after.corrected_2 - before.corrected_2);
+    uint32_t lost = after.uncorrectable - before.uncorrectable;
+    if (fixed > 0 || lost > 0) {
+        DLOG(RF_BCH_FIXED, fixed, lost);
+    }
+
+    return after.uncorrectable_run < RF_DESYNC_RUN;
 }
 
 
 // function to read a message and return len of packet
-int get_message(uint8_t* byteBuffer, size_t bufferLen )
+// address and lat are optional, address gets the capcode the page was sent to and
+// lat the read / receive timestamps for latency tracking
+int get_message(uint8_t* byteBuffer, size_t bufferLen, uint32_t* address, latency_tag_t* lat )
 {
     size_t len = bufferLen;                 // len of packet received -> for error checking
     uint32_t rec_address;       // address that sent the packet
 
     // filling buffer from calling function using readData()
+    uint32_t t_read = latency_now();
+    if (!correct_rx_buffer())
+    {
+        request_resync(RF_RESYNC_DESYNC);
+        return RF_ERR_DESYNC;     // nothing readable until the next sync word
+    }
     int state = pager.readData(byteBuffer, &len, &rec_address);
+    uint32_t t_rx = latency_now();
+
+    if (lat != NULL)
+    {
+        lat->t_read = t_read;
+        lat->t_rx = t_rx;
+        latency_record(LAT_STAGE_READ, t_read, t_rx);
+    }
 
     if (state != RADIOLIB_ERR_NONE)
     {
+        s_stats.read_err++;
         ESP_LOGE(TAG, "could not read a message for some reason... : %d\n", state);
         return state;   // returning RadioLib error code for debug
     }
 
-    ESP_LOGD(TAG, "Received %d bytes from address %lu\n", len, rec_address);
+    DLOG(RF_RX_BYTES, len, rec_address);
+
+    // not one of our capcodes, drop it quietly
+    if (capcode_table_match(rec_address) == CAPCODE_NO_MATCH)
+    {
+        s_stats.filtered++;
+        return RADIOLIB_ERR_ADDRESS_NOT_MATCHED;
+    }
 
     if ( len == 0 || len > bufferLen )
     {
+        s_stats.read_err++;
         ESP_LOGE(TAG, "either no data received or len > bufferLen...\n");
         return -1;
     }
 
+    if (address != NULL) {
+        *address = rec_address;
+    }
+
+    s_stats.read_ok++;
     return RADIOLIB_ERR_NONE;
 }
 
 
+// copy out the receive counters
+void rf_get_stats(rf_stats_t* out)
+{
+    rf_bit_isr_stats_t isr;
+    rf_bit_isr_get_stats(&isr);
+
+    *out = s_stats;
+    out->bits = isr.count;
+}
 
-// main task for polling the RF module for data and passing it to the msg queue
-void poll_radio(void *param)
+
+// receiver health for the periodic stat dump in main
+void rf_stats_dump(void)
 {
-    uint8_t buffer[512];
-    size_t length = sizeof(buffer);
-    char oldMessage[512];
+    ESP_LOGI(TAG, "rx: %lu read, %lu errors, %lu not ours, %lu queued, %lu evicted",
+             (unsigned long)s_stats.read_ok, (unsigned long)s_stats.read_err, (unsigned long)s_stats.filtered,
+             (unsigned long)s_stats.queued, (unsigned long)s_stats.evicted);
+    ESP_LOGI(TAG, "rx buffer: high water %lu / %u, %lu overruns, %lu resyncs (%lu desync), %lu bits discarded, "
+             "sync back in %lu us (max %lu)",
+             (unsigned long)s_stats.buf_high_water, (unsigned)RADIOLIB_STATIC_ARRAY_SIZE,
+             (unsigned long)s_stats.buf_overflows, (unsigned long)s_stats.resyncs, (unsigned long)s_stats.desyncs,
+             (unsigned long)s_stats.bits_discarded, (unsigned long)s_stats.resync_us_last,
+             (unsigned long)s_stats.resync_us_max);
+
+    rf_bit_isr_stats_t isr;
+    rf_bit_isr_get_stats(&isr);
+    ESP_LOGI(TAG, "dclk isr: %lu bits, ring high water %lu / %u, %lu dropped, run %lu..%lu ns (avg %lu), "
+             "period %lu..%lu ns (nominal %lu)",
+             (unsigned long)isr.count, (unsigned long)isr.ring_high_water, (unsigned)RF_BIT_RING_BITS,
+             (unsigned long)isr.ring_overflows, (unsigned long)isr.dur_min_ns, (unsigned long)isr.dur_max_ns,
+             (unsigned long)isr.dur_avg_ns, (unsigned long)isr.period_min_ns, (unsigned long)isr.period_max_ns,
+             (unsigned long)isr.period_nominal_ns);
+}
 
-    for (;;)    // main task loop
-    {  
-        int num = get_numMessages();
-        //printf("numer of messages is: %d\n", num);
 
-        if (num > 0)   // message available in buffer
+
+// check the HAL's GPIO paths agree with each other, then time one pin write through each of them
+// runs on the CS line, so call it after init_radio() and before poll_radio starts, CS is left high
+void rf_gpio_bench(uint32_t toggles)
+{
+    RadioLibHal* base = hal;    // through the vtable, the way RadioLib calls it
+    int bad = 0;
+
+    // an output-only pad has its input buffer off and reads back 0 whatever it drives
+    hal->pinMode(SPI_CS_PIN, GPIO_MODE_INPUT_OUTPUT);
+
+    for (uint32_t level = 0; level < 2; level++)
+    {
+        base->digitalWrite(SPI_CS_PIN, level);
+        bad += (base->digitalRead(SPI_CS_PIN) != level);
+        bad += (hal->readPin<SPI_CS_PIN>() != level);
+
+        hal->writePin<SPI_CS_PIN>(!level);
+        bad += (base->digitalRead(SPI_CS_PIN) != !level);
+    }
+
+    // unconnected pins read low and writes to them go nowhere
+    hal->writePin<RADIOLIB_NC>(1);
+    base->digitalWrite(RADIOLIB_NC, 1);
+    bad += (base->digitalRead(RADIOLIB_NC) != 0);
+    bad += (hal->readPin<RADIOLIB_NC>() != 0);
+
+#if CONFIG_IDF_TARGET_LINUX
+    // a mode change has to get past the cache, a repeat must not
+    hal->pinMode(SPI_CS_PIN, hal->GpioModeInput);
+    bad += (host_gpio_get_mode((gpio_num_t)SPI_CS_PIN) != (gpio_mode_t)hal->GpioModeInput);
+    hal->pinMode(SPI_CS_PIN, hal->GpioModeOutput);
+    bad += (host_gpio_get_mode((gpio_num_t)SPI_CS_PIN) != (gpio_mode_t)hal->GpioModeOutput);
+#endif
+    hal->pinMode(SPI_CS_PIN, hal->GpioModeOutput);
+
+    if (bad > 0) {
+        ESP_LOGE(TAG, "gpio bench: %d mismatches between the GPIO paths", bad);
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < toggles; i++) {
+        gpio_set_level((gpio_num_t)SPI_CS_PIN, i & 1);
+    }
+    int64_t t1 = esp_timer_get_time();
+    for (uint32_t i = 0; i < toggles; i++) {
+        base->digitalWrite(SPI_CS_PIN, i & 1);
+    }
+    int64_t t2 = esp_timer_get_time();
+    for (uint32_t i = 0; i < toggles; i++) {
+        hal->writePin<SPI_CS_PIN>(i & 1);
+    }
+    int64_t t3 = esp_timer_get_time();
+
+    hal->writePin<SPI_CS_PIN>(1);
+
+    ESP_LOGI(TAG, "gpio bench: ns per write over %lu: gpio_set_level %.1f, digitalWrite %.1f, writePin<> %.1f",
+             (unsigned long)toggles, (double)(t1 - t0) * 1000.0 / toggles,
+             (double)(t2 - t1) * 1000.0 / toggles, (double)(t3 - t2) * 1000.0 / toggles);
+}
+
+
+
+// put a page's seq on xMsgBufferQueue without blocking; a send that finds the queue full throws
+// out the oldest seq and tries again, so another producer taking the freed slot costs one more
+// eviction instead of a wait
+bool rf_enqueue_message(rf_msg_t* message, uint32_t* evicted)
+{
+    rf_msg_t oldMessage;
+    uint32_t thrown = 0;
+    bool sent = false;
+
+    // stamped right before it goes in
+    message->lat.t_queued = latency_now();
+    for (int i = 0; !sent; i++)
+    {
+        sent = ( xQueueSend(xMsgBufferQueue, message, 0) == pdPASS );
+        if ( !sent && i == RF_ENQUEUE_TRIES ) {
+            break;
+        }
+        if ( !sent && xQueueReceive(xMsgBufferQueue, &oldMessage, 0) == pdPASS ) {
+            thrown++;
+        }
+    }
+
+    if ( evicted != NULL ) {
+        *evicted = thrown;
+    }
+    if ( sent ) {
+        latency_record(LAT_STAGE_ENQUEUE, message->lat.t_rx, message->lat.t_queued);
+    }
+    return sent;
+}
+
+
+// store one page and hand its seq to the display, throwing out the oldest queued seq when the
+// queue is full (that page stays in msg_store)
+static void queue_message(rf_msg_t* message, uint32_t address, const char* text, size_t len)
+{
+    uint32_t evicted;
+
+    message->seq = msg_store_append(address, BASIC_MSG, text, len);
+    DLOG(RF_MSG_QUEUED, len);   // debug prints:
+
+    bool sent = rf_enqueue_message(message, &evicted);
+    if ( evicted > 0 )
+    {
+        DLOG(RF_MSG_EVICTED);
+        s_stats.evicted += evicted;
+    }
+
+    if ( !sent )
+    {
+        ESP_LOGE(TAG, "Could not add msg to the queue for some reason...\n");
+    }
+    else {
+        s_stats.queued++;
+    }
+}
+
+
+// pull every complete page out of the RadioLib buffer in one go, returns pages queued
+int rf_drain_messages(void)
+{
+    rf_msg_t message;                   // seq + latency timestamps, one queue slot
+    char text[MSG_TEXT_LEN + 1];        // page as read, copied into msg_store
+    uint32_t address;
+    int queued = 0;
+    int read = 0;
+
+    // leave room for the null terminator at the end of the text
+    size_t length = sizeof(text) - 1;
+
+    // the ring filled up since the last pass and the ISR dropped bits, the stream has a hole in it
+    rf_bit_isr_stats_t isr;
+    rf_bit_isr_get_stats(&isr);
+    if (isr.ring_overflows < s_lastOverflows) {
+        s_lastOverflows = 0;    // the ISR's counters were reset since the last pass
+    }
+    if (isr.ring_overflows != s_lastOverflows)
+    {
+        s_stats.buf_overflows += isr.ring_overflows - s_lastOverflows;
+        s_lastOverflows = isr.ring_overflows;
+        request_resync(RF_RESYNC_OVERRUN);
+    }
+
+    pump_bits();
+
+    // how full the buffer got since the last pass, before we empty it
+    size_t used = rf_buffer_used();
+    if (used > s_stats.buf_high_water) {
+        s_stats.buf_high_water = used;
+    }
+
+    while ( read < RF_DRAIN_MAX && rx_in_sync() && get_numMessages() > 0 )
+    {
+        size_t readPos = pager.phyLayer->bufferReadPos;
+        memset(&message, 0, sizeof(message));
+        memset(text, 0, sizeof(text));
+
+        // getting data from the RadioLib software buffer
+        int state = get_message((uint8_t*)text, length, &address, &message.lat);
+        read++;
+
+        // the paging system retransmits, only the first copy goes to the display
+        if ( state == RADIOLIB_ERR_NONE &&
+             msg_dedup_check(address, text, strlen(text)) )
         {
-            // getting data from the RadioLib software buffer
-            if ( get_message(buffer, length) == RADIOLIB_ERR_NONE)
-            {
-                ESP_LOGD(TAG, "message received: %s\n", buffer);   // debug prints:
-
-                // check if there is currently space in the queue - if not, discard oldest
-                if ( uxQueueSpacesAvailable(xMsgBufferQueue) == 0 )
-                {
-                    ESP_LOGI(TAG, "removing oldest message...\n");
-                    xQueueReceive(xMsgBufferQueue, &oldMessage, 0);
-                }
-
-                // add in new message to queue
-                if ( xQueueSend(xMsgBufferQueue, buffer, portMAX_DELAY) != pdPASS )
-                {
-                    ESP_LOGE(TAG, "Could not add msg to the queue for some reason...\n");
-                }
-
-                // clear buffer to ensure no leftover data
-                memset(buffer, 0, sizeof(buffer));
-            }
-            else {
-                ESP_LOGE(TAG, "could not read message for some reason...\n");
-            }
+            DLOG(RF_MSG_DUPLICATE, address);
+        }
+        else if ( state == RADIOLIB_ERR_NONE )
+        {
+            queue_message(&message, address, text, strlen(text));
+            queued++;
+        }
+        else if ( state != RADIOLIB_ERR_ADDRESS_NOT_MATCHED && state != RF_ERR_DESYNC ) {
+            ESP_LOGE(TAG, "could not read message for some reason...\n");
+        }
+
+        // top the buffer up with whatever arrived while we were reading
+        pump_bits();
+
+        // readData() did not consume anything, the rest is not a complete page yet
+        if ( pager.phyLayer->bufferReadPos == readPos ) {
+            break;
         }
+    }
+
+    if (read > 0) {
+        s_stats.drains++;
+    }
+    if ((uint32_t)read > s_stats.drain_max) {
+        s_stats.drain_max = read;
+    }
+
+    return queued;
+}
+
+
+// main task for polling the RF module for data and passing it to the msg queue
+void poll_radio(void *param)
+{
+    for (;;)    // main task loop
+    {  
+        // everything that arrived since the last wake-up leaves the buffer now
+        rf_drain_messages();
 
         //printf("Minimum stack sapce is: %u\r\n", uxTaskGetStackHighWaterMark(NULL));
         vTaskDelay(pdMS_TO_TICKS(50));
@@ -205,7 +631,7 @@ void receive_transmission(void *param)
             printf("MESSAGE AVAILABLE:%d\n", num);
 
             // trying to read a message:
-            if ( get_message(buffer, length) == RADIOLIB_ERR_NONE) 
+            if ( get_message(buffer, length, NULL, NULL) == RADIOLIB_ERR_NONE) 
             {   
                 printf("Polled Msg: %s\n", buffer);   // debug printing
                 memset(buffer, 0, sizeof(buffer));
@@ -1,17 +1,59 @@
 // testing calling cpp fucntion from c files
 
+#include <stdbool.h>
 #include "esp_err.h"
+#include "latency_stats.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    #include "sync_objects.h"
+
+    // running counters of the receive path, for soak runs and the stat loop in main
+    typedef struct {
+        uint32_t read_ok;       // readData() gave us a message
+        uint32_t read_err;      // readData() failed (no address match, bad length...)
+        uint32_t filtered;      // read fine but for a capcode we are not subscribed to
+        uint32_t queued;        // placed on xMsgBufferQueue
+        uint32_t evicted;       // oldest queued message thrown out to make room
+
+        // RadioLib bit buffer, for sizing RADIOLIB_STATIC_ARRAY_SIZE
+        uint32_t bits;              // DCLK interrupts taken
+        uint32_t buf_high_water;    // most unread bytes seen at a wake-up
+        uint32_t buf_overflows;     // bits the DCLK ISR dropped because its ring was full
+        uint32_t drains;            // wake-ups that found something to read
+        uint32_t drain_max;         // most pages read in one wake-up
+
+        // recovery, see request_resync() in rf_comms.cpp
+        uint32_t resyncs;           // times the buffer was dropped to hunt for a sync word again
+        uint32_t desyncs;           // of which because codewords stopped decoding
+        uint32_t bits_discarded;    // unread bits thrown away by resyncs
+        uint32_t resync_us_last;    // resync requested -> next frame sync word seen
+        uint32_t resync_us_max;
+    } rf_stats_t;
+
     int testFunc(void);
 
     // making these functions callable from .c files
     esp_err_t init_radio(void);
     int get_numMessages();
-    int get_message( uint8_t* byteBuffer, size_t bufferLen );
+    int get_message( uint8_t* byteBuffer, size_t bufferLen, uint32_t* address, latency_tag_t* lat );
+
+    // hand a stored page's seq to the display through xMsgBufferQueue, never blocking: the oldest
+    // queued seq is thrown out while it is full (that page stays in msg_store). Stamps lat.t_queued,
+    // evicted (may be NULL) gets the seqs thrown out; the radio and mqtt_pager both queue through here
+    bool rf_enqueue_message(rf_msg_t* message, uint32_t* evicted);
+
+    void rf_get_stats(rf_stats_t* out);
+    void rf_stats_dump(void);
+    void rf_gpio_bench(uint32_t toggles);     // HAL pin write paths, checked against each other and timed
+    void clearBuffer(void);     // drop unread bits and resync on the next frame sync word
+
+    // read every complete page waiting in the RadioLib buffer and queue it, returns pages queued
+    int rf_drain_messages(void);
+    size_t rf_buffer_used(void);
+    size_t rf_buffer_size(void);
 
     void receive_transmission(void *param);     // debug task
     void poll_radio(void *param);               // main msg poll task
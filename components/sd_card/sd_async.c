@@ -0,0 +1,612 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_attr.h"
+#endif
+
+#include "sd_async.h"
+#include "sd_writer.h"
+#include "mem_budget.h"
+
+
+#define WRITER_TASK_STACK   (3072)
+#define WRITER_TASK_PRIO    (3)     // under the radio and display tasks, a card stall only delays itself
+
+#if SD_ASYNC_BUF % SD_SECTOR != 0
+#error SD_ASYNC_BUF must be a whole number of sectors
+#endif
+
+// internal and word aligned, so the SDMMC DMA reads the pool in place
+#if CONFIG_IDF_TARGET_LINUX
+#define POOL_ATTR           __attribute__((aligned(4)))
+#else
+#define POOL_ATTR           DMA_ATTR
+#endif
+
+typedef struct {
+    sd_async_cb_t cb;
+    void*       ctx;
+} async_cb_t;
+
+// one pool buffer, owned by a stream while it fills, then by the writer task
+typedef struct {
+    uint8_t*    data;
+    int         stream;
+    int         fd;
+    uint64_t    off;            // file offset of data[0], sector aligned
+    size_t      len;
+    bool        sync;
+    bool        close;
+    uint8_t     ncb;
+    async_cb_t  cbs[SD_ASYNC_CBS];
+} async_buf_t;
+
+typedef struct {
+    bool        used;
+    int         fd;
+    async_buf_t* cur;           // buffer being filled, NULL between buffers
+    uint64_t    pos;            // where the next buffer starts, sector aligned
+    size_t      carryLen;       // partial sector a flush left behind, goes first into the next buffer
+    uint8_t     carry[SD_SECTOR];
+} async_stream_t;
+
+static const char* TAG = "SD_ASYNC";
+
+static async_buf_t      s_bufs[SD_ASYNC_BUFS];
+static POOL_ATTR uint8_t s_pool[SD_ASYNC_BUFS][SD_ASYNC_BUF];
+static async_stream_t   s_streams[SD_ASYNC_STREAMS];
+static bool             s_streamFailed[SD_ASYNC_STREAMS];  // writer task only, until the stream closes
+
+// full buffers to the writer, empty ones back
+static QueueHandle_t    s_work;
+static QueueHandle_t    s_free;
+static StaticQueue_t    s_workBuf;
+static StaticQueue_t    s_freeBuf;
+static uint8_t          s_workStorage[SD_ASYNC_BUFS * sizeof(async_buf_t*)];
+static uint8_t          s_freeStorage[SD_ASYNC_BUFS * sizeof(async_buf_t*)];
+
+MEM_STATIC_TASK(s_writerTask, WRITER_TASK_STACK);
+
+static portMUX_TYPE     s_lock = portMUX_INITIALIZER_UNLOCKED;
+static sd_async_stats_t s_stats;
+static uint64_t         s_rateBytes;
+static int64_t          s_rateSince;
+
+
+// ==== Writer task ========================================================== //
+
+static void writer_task(void* params)
+{
+    for (;;)
+    {
+        async_buf_t* b;
+        if (xQueueReceive(s_work, &b, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t err = ESP_OK;
+        if (b->len > 0 && pwrite(b->fd, b->data, b->len, (off_t)b->off) != (ssize_t)b->len) {
+            err = ESP_FAIL;
+        }
+        if (err == ESP_OK && b->sync && fsync(b->fd) != 0) {
+            err = ESP_FAIL;
+        }
+        uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+
+        portENTER_CRITICAL(&s_lock);
+        s_stats.bytes += (err == ESP_OK) ? b->len : 0;
+        s_stats.writes++;
+        s_stats.errors += (err != ESP_OK);
+        if (us > s_stats.write_us_max) {
+            s_stats.write_us_max = us;
+        }
+        portEXIT_CRITICAL(&s_lock);
+
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "write of %u bytes at %llu failed", (unsigned)b->len, (unsigned long long)b->off);
+        }
+
+        // an earlier buffer of the stream that went out without a waiter failed, nothing after it
+        // is reported durable
+        if (err != ESP_OK) {
+            s_streamFailed[b->stream] = true;
+        }
+        else if (s_streamFailed[b->stream]) {
+            err = ESP_FAIL;
+        }
+
+        // closed before anyone hears about it, so the stream id can be reused from the callback on
+        if (b->close)
+        {
+            if (close(b->fd) != 0 && err == ESP_OK) {
+                err = ESP_FAIL;
+            }
+            s_streamFailed[b->stream] = false;
+            portENTER_CRITICAL(&s_lock);
+            s_streams[b->stream].used = false;
+            portEXIT_CRITICAL(&s_lock);
+        }
+        for (uint8_t i = 0; i < b->ncb; i++) {
+            b->cbs[i].cb(b->cbs[i].ctx, err);
+        }
+        xQueueSend(s_free, &b, portMAX_DELAY);
+    }
+}
+
+
+// ==== Stream internals ===================================================== //
+
+static async_stream_t* stream_get(int stream)
+{
+    if (stream < 0 || stream >= SD_ASYNC_STREAMS || !s_streams[stream].used) {
+        return NULL;
+    }
+    return &s_streams[stream];
+}
+
+
+// a free buffer for the stream, waits (and counts the stall) when the writer has them all
+static void stream_acquire(async_stream_t* st)
+{
+    async_buf_t* b;
+    if (xQueueReceive(s_free, &b, 0) != pdTRUE)
+    {
+        int64_t t0 = esp_timer_get_time();
+        xQueueReceive(s_free, &b, portMAX_DELAY);
+        uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+
+        portENTER_CRITICAL(&s_lock);
+        s_stats.stalls++;
+        if (us > s_stats.stall_us_max) {
+            s_stats.stall_us_max = us;
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    b->stream = (int)(st - s_streams);
+    b->fd = st->fd;
+    b->off = st->pos;
+    b->sync = false;
+    b->close = false;
+    b->ncb = 0;
+    memcpy(b->data, st->carry, st->carryLen);
+    b->len = st->carryLen;
+    st->carryLen = 0;
+    st->cur = b;
+}
+
+
+static void stream_submit(async_stream_t* st, bool sync, bool closing)
+{
+    async_buf_t* b = st->cur;
+    b->sync = sync || b->ncb > 0;
+    b->close = closing;
+
+    // a short buffer ends mid sector, that sector is written again whole from the next buffer
+    size_t carry = (b->len < SD_ASYNC_BUF && !closing) ? b->len % SD_SECTOR : 0;
+    memcpy(st->carry, &b->data[b->len - carry], carry);
+    st->carryLen = carry;
+    st->pos = b->off + b->len - carry;
+    st->cur = NULL;
+
+    xQueueSend(s_work, &b, portMAX_DELAY);
+
+    uint32_t depth = (uint32_t)uxQueueMessagesWaiting(s_work);
+    portENTER_CRITICAL(&s_lock);
+    if (depth > s_stats.queue_depth_max) {
+        s_stats.queue_depth_max = depth;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+static void stream_add_cb(async_stream_t* st, sd_async_cb_t cb, void* ctx)
+{
+    if (st->cur == NULL) {
+        stream_acquire(st);
+    }
+    st->cur->cbs[st->cur->ncb++] = (async_cb_t){ .cb = cb, .ctx = ctx };
+
+    // full of waiters, no point holding them back any longer
+    if (st->cur->ncb == SD_ASYNC_CBS) {
+        stream_submit(st, true, false);
+    }
+}
+
+
+// ==== Public functions ===================================================== //
+
+esp_err_t sd_async_init(void)
+{
+    if (s_work != NULL) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < SD_ASYNC_BUFS; i++) {
+        s_bufs[i].data = s_pool[i];
+    }
+
+    s_work = xQueueCreateStatic(SD_ASYNC_BUFS, sizeof(async_buf_t*), s_workStorage, &s_workBuf);
+    s_free = xQueueCreateStatic(SD_ASYNC_BUFS, sizeof(async_buf_t*), s_freeStorage, &s_freeBuf);
+    for (int i = 0; i < SD_ASYNC_BUFS; i++)
+    {
+        async_buf_t* b = &s_bufs[i];
+        xQueueSend(s_free, &b, 0);
+    }
+    s_rateSince = esp_timer_get_time();
+
+    TaskHandle_t task = xTaskCreateStatic(writer_task, "SdWriter", MEM_STACK_DEPTH(WRITER_TASK_STACK), NULL,
+                                          WRITER_TASK_PRIO, s_writerTask_stack, &s_writerTask_tcb);
+    MEM_BUDGET_ADD_TASK(SD_CARD, s_writerTask, task);
+    MEM_BUDGET_ADD(SD_CARD, s_streams, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(SD_CARD, s_bufs, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(SD_CARD, s_pool, MEM_REGION_DRAM);
+    return ESP_OK;
+}
+
+
+bool sd_async_is_running(void)
+{
+    return s_work != NULL;
+}
+
+
+static int stream_claim(void)
+{
+    int id = -1;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < SD_ASYNC_STREAMS && id < 0; i++)
+    {
+        if (!s_streams[i].used)
+        {
+            s_streams[i].used = true;
+            id = i;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (id < 0) {
+        return -1;
+    }
+
+    async_stream_t* st = &s_streams[id];
+    st->cur = NULL;
+    st->pos = 0;
+    st->carryLen = 0;
+    return id;
+}
+
+
+int sd_async_open(const char* path, bool append)
+{
+    int id = stream_claim();
+    if (id < 0) {
+        return -1;
+    }
+
+    async_stream_t* st = &s_streams[id];
+    st->fd = open(path, O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+    if (st->fd < 0)
+    {
+        ESP_LOGE(TAG, "could not open %s", path);
+        st->used = false;
+        return -1;
+    }
+
+    // appending starts at the last sector boundary with that sector's bytes carried
+    if (append)
+    {
+        off_t end = lseek(st->fd, 0, SEEK_END);
+        st->pos = (uint64_t)end & ~(uint64_t)(SD_SECTOR - 1);
+        st->carryLen = (size_t)((uint64_t)end - st->pos);
+        if (st->carryLen > 0 && pread(st->fd, st->carry, st->carryLen, (off_t)st->pos) != (ssize_t)st->carryLen)
+        {
+            close(st->fd);
+            st->used = false;
+            return -1;
+        }
+    }
+    return id;
+}
+
+
+int sd_async_open_at(const char* path, uint64_t offset)
+{
+    if (offset % SD_SECTOR != 0 || s_work == NULL) {
+        return -1;
+    }
+    int id = stream_claim();
+    if (id < 0) {
+        return -1;
+    }
+
+    async_stream_t* st = &s_streams[id];
+    st->pos = offset;
+    st->fd = open(path, O_RDWR);
+    if (st->fd < 0)
+    {
+        ESP_LOGE(TAG, "could not open %s", path);
+        st->used = false;
+        return -1;
+    }
+    return id;
+}
+
+
+esp_err_t sd_async_write(int stream, const void* data, size_t len, sd_async_cb_t cb, void* ctx)
+{
+    async_stream_t* st = stream_get(stream);
+    if (st == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint8_t* src = data;
+    while (len > 0)
+    {
+        if (st->cur == NULL) {
+            stream_acquire(st);
+        }
+
+        size_t n = SD_ASYNC_BUF - st->cur->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&st->cur->data[st->cur->len], src, n);
+        st->cur->len += n;
+        src += n;
+        len -= n;
+
+        if (st->cur->len == SD_ASYNC_BUF)
+        {
+            // the last byte landed in this buffer, its waiter rides along
+            if (len == 0 && cb != NULL && st->cur->ncb < SD_ASYNC_CBS)
+            {
+                st->cur->cbs[st->cur->ncb++] = (async_cb_t){ .cb = cb, .ctx = ctx };
+                cb = NULL;
+            }
+            stream_submit(st, false, false);
+        }
+    }
+
+    if (cb != NULL) {
+        stream_add_cb(st, cb, ctx);
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t sd_async_flush(int stream, sd_async_cb_t cb, void* ctx)
+{
+    async_stream_t* st = stream_get(stream);
+    if (st == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (st->cur == NULL) {
+        stream_acquire(st);
+    }
+    if (cb != NULL) {
+        st->cur->cbs[st->cur->ncb++] = (async_cb_t){ .cb = cb, .ctx = ctx };
+    }
+    stream_submit(st, true, false);
+    return ESP_OK;
+}
+
+
+esp_err_t sd_async_close(int stream, sd_async_cb_t cb, void* ctx)
+{
+    async_stream_t* st = stream_get(stream);
+    if (st == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (st->cur == NULL) {
+        stream_acquire(st);
+    }
+    if (cb != NULL) {
+        st->cur->cbs[st->cur->ncb++] = (async_cb_t){ .cb = cb, .ctx = ctx };
+    }
+    stream_submit(st, true, true);
+    return ESP_OK;
+}
+
+
+void sd_async_get_stats(sd_async_stats_t* out)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t depth = (s_work != NULL) ? (uint32_t)uxQueueMessagesWaiting(s_work) : 0;
+
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    uint64_t bytes = s_stats.bytes - s_rateBytes;
+    int64_t us = now - s_rateSince;
+    s_rateBytes = s_stats.bytes;
+    s_rateSince = now;
+    portEXIT_CRITICAL(&s_lock);
+
+    out->queue_depth = depth;
+    out->bytes_per_s = (us > 0) ? (uint32_t)(bytes * 1000000 / (uint64_t)us) : 0;
+}
+
+
+// ==== Benchmark ============================================================== //
+
+#define BENCH_RECORDS   2000
+#define BENCH_RECORD    64      // one log line
+#define BENCH_DURABLE   100     // records between durability points
+#define BENCH_STREAM    (512 * 1024)
+#define BENCH_CHUNK     1460
+#define BENCH_PATH_LEN  128
+
+#define BENCH_WAIT_MS   10000   // for the writer to answer every durability point
+
+static volatile uint32_t s_benchDone;
+static volatile uint32_t s_benchFailed;
+
+// every completion counts, a failed one too, so a card error can not leave bench_wait() spinning
+static void bench_done(void* ctx, esp_err_t err)
+{
+    (void)ctx;
+    if (err != ESP_OK) {
+        s_benchFailed++;
+    }
+    s_benchDone++;
+}
+
+
+// false if the writer has not answered target callbacks within BENCH_WAIT_MS
+static bool bench_wait(uint32_t target)
+{
+    int64_t until = esp_timer_get_time() + (int64_t)BENCH_WAIT_MS * 1000;
+    while (s_benchDone < target)
+    {
+        if (esp_timer_get_time() > until) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+
+static void bench_track(int64_t t0, int64_t* sum, uint32_t* max)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    *sum += us;
+    if (us > *max) {
+        *max = us;
+    }
+}
+
+
+void sd_async_bench(const char* dir)
+{
+    char path[BENCH_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/sda_b.bin", dir);
+
+    uint8_t* chunk = malloc(BENCH_CHUNK);
+    if (chunk == NULL)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        return;
+    }
+    for (int i = 0; i < BENCH_CHUNK; i++) {
+        chunk[i] = (uint8_t)(i * 13 + 1);
+    }
+
+    // ---- small records, durable every BENCH_DURABLE: inline ---- //
+    sd_writer_t w;
+    int64_t inlineSum = 0;
+    uint32_t inlineMax = 0;
+    sd_writer_open(&w, path, 0);
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++)
+    {
+        int64_t t0 = esp_timer_get_time();
+        sd_writer_write(&w, chunk, BENCH_RECORD);
+        if ((i + 1) % BENCH_DURABLE == 0) {
+            sd_writer_sync(&w);
+        }
+        bench_track(t0, &inlineSum, &inlineMax);
+    }
+    sd_writer_close(&w);
+
+    // ---- and through the writer task ---- //
+    sd_async_stats_t before;
+    sd_async_get_stats(&before);
+    s_benchDone = 0;
+    s_benchFailed = 0;
+    uint32_t asked = 0;
+    int64_t asyncSum = 0;
+    uint32_t asyncMax = 0;
+    int s = sd_async_open(path, false);
+    bool opened = (s >= 0);
+    for (uint32_t i = 0; s >= 0 && i < BENCH_RECORDS; i++)
+    {
+        int64_t t0 = esp_timer_get_time();
+        sd_async_write(s, chunk, BENCH_RECORD, NULL, NULL);
+        if ((i + 1) % BENCH_DURABLE == 0) {
+            asked += (sd_async_flush(s, bench_done, NULL) == ESP_OK);
+        }
+        bench_track(t0, &asyncSum, &asyncMax);
+    }
+    int64_t t0 = esp_timer_get_time();
+    if (s >= 0) {
+        asked += (sd_async_close(s, bench_done, NULL) == ESP_OK);
+    }
+    bool answered = bench_wait(asked);
+    uint32_t drainUs = (uint32_t)(esp_timer_get_time() - t0);
+
+    FILE* f = fopen(path, "r");
+    long size = -1;
+    if (f != NULL)
+    {
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fclose(f);
+    }
+
+    // ---- a stream, inline vs queued ---- //
+    int64_t seqInline = esp_timer_get_time();
+    sd_writer_open(&w, path, 0);
+    for (uint32_t off = 0; off < BENCH_STREAM; off += BENCH_CHUNK) {
+        sd_writer_write(&w, chunk, (BENCH_STREAM - off < BENCH_CHUNK) ? BENCH_STREAM - off : BENCH_CHUNK);
+    }
+    sd_writer_close(&w);
+    seqInline = esp_timer_get_time() - seqInline;
+
+    s_benchDone = 0;
+    asked = 0;
+    int64_t seqCaller = 0;
+    uint32_t seqMax = 0;
+    int64_t seqStart = esp_timer_get_time();
+    s = sd_async_open(path, false);
+    opened = opened && (s >= 0);
+    for (uint32_t off = 0; s >= 0 && off < BENCH_STREAM; off += BENCH_CHUNK)
+    {
+        int64_t c0 = esp_timer_get_time();
+        sd_async_write(s, chunk, (BENCH_STREAM - off < BENCH_CHUNK) ? BENCH_STREAM - off : BENCH_CHUNK, NULL, NULL);
+        bench_track(c0, &seqCaller, &seqMax);
+    }
+    if (s >= 0) {
+        asked += (sd_async_close(s, bench_done, NULL) == ESP_OK);
+    }
+    answered = bench_wait(asked) && answered;
+    int64_t seqAsync = esp_timer_get_time() - seqStart;
+
+    sd_async_stats_t after;
+    sd_async_get_stats(&after);
+
+    ESP_LOGI(TAG, "bench: %d records of %d bytes, durable every %d: caller inline %.1f us avg / %lu us max, "
+             "queued %.1f us avg / %lu us max, drained %lu us after the last, file %ld bytes (expect %d)",
+             BENCH_RECORDS, BENCH_RECORD, BENCH_DURABLE, (double)inlineSum / BENCH_RECORDS, (unsigned long)inlineMax,
+             (double)asyncSum / BENCH_RECORDS, (unsigned long)asyncMax, (unsigned long)drainUs, size,
+             BENCH_RECORDS * BENCH_RECORD);
+    ESP_LOGI(TAG, "bench: %d KiB stream in %d byte chunks: inline %.0f KiB/s, queued %.0f KiB/s end to end, "
+             "caller %.1f us per chunk / %lu us max",
+             BENCH_STREAM / 1024, BENCH_CHUNK, (double)BENCH_STREAM * 1e6 / 1024.0 / (double)seqInline,
+             (double)BENCH_STREAM * 1e6 / 1024.0 / (double)seqAsync,
+             (double)seqCaller / ((BENCH_STREAM + BENCH_CHUNK - 1) / BENCH_CHUNK), (unsigned long)seqMax);
+    ESP_LOGI(TAG, "bench: writer %lu writes, worst write %lu us, queue depth max %lu, %lu caller stalls "
+             "(worst %lu us), %lu errors",
+             (unsigned long)(after.writes - before.writes), (unsigned long)after.write_us_max,
+             (unsigned long)after.queue_depth_max, (unsigned long)(after.stalls - before.stalls),
+             (unsigned long)after.stall_us_max, (unsigned long)(after.errors - before.errors));
+    if (!answered || s_benchFailed > 0 || !opened)
+    {
+        ESP_LOGE(TAG, "bench: FAILED, %lu durability points failed%s, writer %s within %d ms",
+                 (unsigned long)s_benchFailed, opened ? "" : ", a stream did not open",
+                 answered ? "answered" : "did NOT answer", BENCH_WAIT_MS);
+    }
+
+    unlink(path);
+    free(chunk);
+}
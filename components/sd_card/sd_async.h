@@ -0,0 +1,87 @@
+#ifndef SD_ASYNC_H
+#define SD_ASYNC_H
+
+/*
+    - Background SD writer: callers copy their bytes into a buffer and return, one task does the
+      card writes and fsyncs, so a slow erase stalls that task and not the camera or message path
+    - A stream fills one SD_ASYNC_BUF buffer while the task writes the one before it (double
+      buffering over a shared pool of SD_ASYNC_BUFS DMA capable buffers); small appends collect
+      into whole sector writes at sector aligned offsets, a partial sector left by a flush is carried
+      into the next buffer and written again whole
+    - Durability is signalled per write: the callback runs on the writer task once the buffer
+      holding the write's last byte is on the card and fsynced. That happens when the buffer fills
+      or at the next sd_async_flush / sd_async_close, nothing is fsynced that nobody waits for.
+      Once one buffer of a stream fails every later callback on it gets the error too, until close
+    - A caller only blocks when every buffer is queued or being written; how long is in the stats
+    - The pool is static DMA capable internal RAM, counted in the SD_CARD budget; nothing is
+      allocated once the task runs
+    - sd_async_open_at() writes into an existing file from a sector boundary without truncating
+      it, for callers that lay out their own sectors (the capture archive)
+    - One task per stream: a stream is not thread safe, different streams on different tasks are
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SD_ASYNC_BUF        (4 * 1024)      // 8 sectors
+#define SD_ASYNC_BUFS       3               // one filling, one queued, one being written
+#define SD_ASYNC_STREAMS    2
+#define SD_ASYNC_CBS        8               // durability callbacks one buffer can carry
+
+// runs on the writer task, keep it short
+typedef void (*sd_async_cb_t)(void* ctx, esp_err_t err);
+
+typedef struct {
+    uint32_t queue_depth;       // buffers waiting for the writer now
+    uint32_t queue_depth_max;
+    uint64_t bytes;             // written to the card
+    uint32_t bytes_per_s;       // since the previous sd_async_get_stats
+    uint32_t writes;
+    uint32_t write_us_max;      // worst single write + fsync on the writer task
+    uint32_t stall_us_max;      // worst wait for a free buffer in a caller
+    uint32_t stalls;            // writes that had to wait at all
+    uint32_t errors;
+} sd_async_stats_t;
+
+
+// start the writer task, a second call does nothing
+esp_err_t sd_async_init(void);
+
+// the task is up, writes can go through it
+bool sd_async_is_running(void);
+
+// open path for writing through the writer, append keeps what is in the file; returns a stream
+// id >= 0, or -1
+int sd_async_open(const char* path, bool append);
+
+// open an existing path for writing from offset, a multiple of the sector size, without
+// truncating; returns a stream id >= 0, or -1
+int sd_async_open_at(const char* path, uint64_t offset);
+
+// queue len bytes, cb (may be NULL) once they are durable
+esp_err_t sd_async_write(int stream, const void* data, size_t len, sd_async_cb_t cb, void* ctx);
+
+// send what is buffered and fsync, cb once it is durable
+esp_err_t sd_async_flush(int stream, sd_async_cb_t cb, void* ctx);
+
+// flush and close, the stream id is free again once cb has run
+esp_err_t sd_async_close(int stream, sd_async_cb_t cb, void* ctx);
+
+void sd_async_get_stats(sd_async_stats_t* out);
+
+// small appends and a sequential stream through the writer vs written inline with sd_writer,
+// on scratch files in dir which are removed afterwards; needs sd_async_init first
+void sd_async_bench(const char* dir);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SD_ASYNC_H
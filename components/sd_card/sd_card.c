@@ -1,10 +1,17 @@
 # include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "sd_card.h"
+#include "sd_writer.h"
+#include "sd_async.h"
+#include "board_profile.h"
 
 // sdmmc peripheral libraries and fat file system
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
+#endif
 
 // esp-camera library in case needed
 #include "esp_camera.h"
@@ -12,8 +19,20 @@
 
 // ==== Defined Variables and Structures =================================
 
+#if !CONFIG_IDF_TARGET_LINUX
 // static card object to work with our SD card
 static sdmmc_card_t* card;
+#endif
+
+// names of pictures still on their way to the card, one per writer stream is enough
+#define SAVE_SLOTS  SD_ASYNC_STREAMS
+
+typedef struct {
+    volatile bool busy;
+    char name[64];
+} save_slot_t;
+
+static save_slot_t s_saveSlots[SAVE_SLOTS];
 
 
 // ==== Function Calls ==================================================
@@ -21,23 +40,46 @@ static sdmmc_card_t* card;
 // function to init and mount the SD card for use
 void init_sd_card()
 {
-    // defining the host peripheral for the SD card
+#if CONFIG_IDF_TARGET_LINUX
+    // no card on the host, the mount point is just a folder
+    if (host_mkdirs(SD_MOUNT_POINT) != 0)
+    {
+        printf("init_sd_card(): Failed to create %s\n", SD_MOUNT_POINT);
+    }
+#else
+    // defining the host peripheral for the SD card, high speed (40 MHz) if the card takes it
     sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-    host.max_freq_khz = SDMMC_FREQ_DEFAULT;
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
 
-    // defining parameters for the slot
+    // defining parameters for the slot, bus width and pins come from the board profile
     sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-    slot_config.width = 1;
+    slot_config.width = BOARD_SD_WIDTH;
+    slot_config.clk = BOARD_SD_CLK;
+    slot_config.cmd = BOARD_SD_CMD;
+    slot_config.d0 = BOARD_SD_D0;
+#if BOARD_SD_WIDTH == 4
+    slot_config.d1 = BOARD_SD_D1;
+    slot_config.d2 = BOARD_SD_D2;
+    slot_config.d3 = BOARD_SD_D3;
+#endif
+    slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;   // the lines still want external 10k pull ups
 
     // information regarding mounting WITH the fat file system
+    // every file slot is allocated at mount time, sd_card.h has who holds them
     esp_vfs_fat_sdmmc_mount_config_t mount_config_t = {
         .format_if_mount_failed = false,
-        .max_files = 5,
+        .max_files = SD_MAX_FILES,
         .allocation_unit_size = 16 * 1024,
     };
 
     // mount the Sd card and tech to see if it mounted properly
-    esp_err_t ret = esp_vfs_fat_sdmmc_mount("/sdcard", &host, &slot_config, &mount_config_t, &card);
+    esp_err_t ret = esp_vfs_fat_sdmmc_mount(SD_MOUNT_POINT, &host, &slot_config, &mount_config_t, &card);
+    if (ret != ESP_OK)
+    {
+        // older / long wired cards may not switch to high speed, try again at 20 MHz
+        host.max_freq_khz = SDMMC_FREQ_DEFAULT;
+        ret = esp_vfs_fat_sdmmc_mount(SD_MOUNT_POINT, &host, &slot_config, &mount_config_t, &card);
+    }
     if (ret != ESP_OK)
     {
         printf("init_sd_card(): Failed to mount the file system\n)");
@@ -46,26 +88,73 @@ void init_sd_card()
 
     // print out info to serial monitor for debugging
     sdmmc_card_print_info(stdout, card);
+#endif
 }
 
 
-// function to save a picture to the SD card
-void save_picture(const char *filename, uint8_t *image_data, size_t image_size)
+// function to save a picture to the SD card before returning
+void save_picture_inline(const char *filename, uint8_t *image_data, size_t image_size)
 {
-    // open a file on the SD card to write with
-    FILE *f = fopen(filename, "w");
-    
-    if (f == NULL)  // checking to see if we could open the file
-    {   
+    // open a file on the SD card to write with, sized for the whole image up front
+    sd_writer_t writer;
+    if (sd_writer_open(&writer, filename, image_size) != ESP_OK)
+    {
         printf("save_picture(): failed to open card for writing\n");
         return;
     }
 
-    // write the frame buffer (or any date) to the SD card
-    fwrite(image_data, 1, image_size, f);
-    fclose(f);
+    // write the frame buffer (or any date) to the SD card in whole sectors, the file is closed
+    // either way and a failed write is not reported as saved
+    esp_err_t err = sd_writer_write(&writer, image_data, image_size);
+    if (sd_writer_close(&writer) != ESP_OK || err != ESP_OK)
+    {
+        printf("save_picture(): failed writing %s\n", filename);
+        unlink(filename);       // a cut JPEG is worse than none
+        return;
+    }
 
     // debugging output
     printf("SD CARD - File saved: %s\n", filename);
 }
 
+
+// runs on the writer task once the picture is on the card, or is not
+static void save_picture_done(void* ctx, esp_err_t err)
+{
+    save_slot_t* slot = ctx;
+    if (err != ESP_OK)
+    {
+        printf("save_picture(): failed writing %s\n", slot->name);
+        unlink(slot->name);
+    }
+    else {
+        printf("SD CARD - File saved: %s\n", slot->name);
+    }
+    slot->busy = false;
+}
+
+
+// function to save a picture to the SD card, through the background writer when it runs
+void save_picture(const char *filename, uint8_t *image_data, size_t image_size)
+{
+    // a name slot for the callback, the image itself is copied into the writer's buffers
+    save_slot_t* slot = NULL;
+    for (int i = 0; i < SAVE_SLOTS && slot == NULL; i++)
+    {
+        if (!s_saveSlots[i].busy && strlen(filename) < sizeof(s_saveSlots[i].name)) {
+            slot = &s_saveSlots[i];
+        }
+    }
+
+    int stream = (slot != NULL && sd_async_is_running()) ? sd_async_open(filename, false) : -1;
+    if (stream < 0)
+    {
+        save_picture_inline(filename, image_data, image_size);
+        return;
+    }
+
+    slot->busy = true;
+    snprintf(slot->name, sizeof(slot->name), "%s", filename);
+    sd_async_write(stream, image_data, image_size, NULL, NULL);
+    sd_async_close(stream, save_picture_done, slot);
+}
@@ -1,5 +1,29 @@
 #include <stdio.h>
+#include "sdkconfig.h"
 #include "esp_camera.h"
 
+// where the card is mounted, the host build keeps the "card" in a plain folder
+#if CONFIG_IDF_TARGET_LINUX
+#include "host_fakes.h"
+#define SD_MOUNT_POINT  host_env("HOST_SD_DIR", "host_out/sdcard")
+#else
+#define SD_MOUNT_POINT  "/sdcard"
+#endif
+
+// files open on the card at once, FATFS sets aside a slot (about 560 bytes) for each at mount and
+// an open past the last one fails with EMFILE. The most held together:
+//   msg_log        1   the log
+//   cap_archive    3   the open segment, its writer stream, a sealed segment archive_read() opens
+//                      meanwhile
+//   save_picture   1   the other writer stream (SD_ASYNC_STREAMS)
+//   ward_roster    4   the live roster, the delta being merged (or the download it arrives in),
+//                      the new index and its blob
+//   spare          1   a bench
+#define SD_MAX_FILES    10
+
+// queued on the background writer when it runs (the result is printed once it is on the card),
+// written before returning otherwise
 void save_picture(const char *filename, uint8_t *image_data, size_t image_size);
+// always written before returning
+void save_picture_inline(const char *filename, uint8_t *image_data, size_t image_size);
 void init_sd_card();
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#include "esp_vfs_fat.h"
+#endif
+
+#include "sd_writer.h"
+#include "sd_card.h"
+
+
+#if SD_WRITER_BUF % SD_SECTOR != 0
+#error SD_WRITER_BUF must be a whole number of sectors
+#endif
+
+static const char* TAG = "SD_WRITER";
+
+
+// ==== Writer internals ===================================================== //
+
+static uint8_t* writer_buf_alloc(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return malloc(SD_WRITER_BUF);
+#else
+    // internal and word aligned, so the SDMMC DMA reads it in place
+    return heap_caps_malloc(SD_WRITER_BUF, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+#endif
+}
+
+
+// buf[0..n) to the file at pos, n is a full block except for the tail on a sync
+static esp_err_t writer_put(sd_writer_t* w, size_t n)
+{
+    int64_t t0 = esp_timer_get_time();
+    if (pwrite(w->fd, w->buf, n, (off_t)w->pos) != (ssize_t)n)
+    {
+        ESP_LOGE(TAG, "write of %u bytes at %llu failed", (unsigned)n, (unsigned long long)w->pos);
+        return ESP_FAIL;
+    }
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    w->stats.writes++;
+    if (us > w->stats.write_us_max) {
+        w->stats.write_us_max = us;
+    }
+    return ESP_OK;
+}
+
+
+// ==== Public functions ===================================================== //
+
+esp_err_t sd_writer_preallocate(const char* path, uint64_t bytes)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = (ftruncate(fd, (off_t)bytes) == 0) ? ESP_OK : ESP_FAIL;
+    close(fd);
+    return err;
+#else
+    // FATFS will not grow a file through ftruncate (EPERM); f_expand takes the clusters as one
+    // run and sets the size, it only works on an empty file
+    unlink(path);
+    return esp_vfs_fat_create_contiguous_file(SD_MOUNT_POINT, path, bytes, true);
+#endif
+}
+
+
+esp_err_t sd_writer_open(sd_writer_t* w, const char* path, uint64_t prealloc)
+{
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+
+    w->buf = writer_buf_alloc();
+    if (w->buf == NULL)
+    {
+        ESP_LOGE(TAG, "no DMA capable RAM for the write buffer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // reserve the clusters now, a failure only costs the speed up
+    if (prealloc > 0 && sd_writer_preallocate(path, prealloc) == ESP_OK)
+    {
+        w->prealloc = prealloc;
+        w->fd = open(path, O_WRONLY);
+    }
+    else {
+        w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (w->fd < 0)
+    {
+        ESP_LOGE(TAG, "could not open %s", path);
+        free(w->buf);
+        w->buf = NULL;
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+
+esp_err_t sd_writer_write(sd_writer_t* w, const void* data, size_t len)
+{
+    const uint8_t* src = data;
+    w->stats.bytes += len;
+
+    while (len > 0)
+    {
+        size_t n = SD_WRITER_BUF - w->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&w->buf[w->fill], src, n);
+        w->fill += n;
+        src += n;
+        len -= n;
+
+        if (w->fill == SD_WRITER_BUF)
+        {
+            if (writer_put(w, SD_WRITER_BUF) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            w->pos += SD_WRITER_BUF;
+            w->fill = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t sd_writer_sync(sd_writer_t* w)
+{
+    // the partial block stays buffered and is written again, whole, once it fills
+    if (w->fill > 0 && writer_put(w, w->fill) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    if (fsync(w->fd) != 0) {
+        return ESP_FAIL;
+    }
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    w->stats.syncs++;
+    if (us > w->stats.sync_us_max) {
+        w->stats.sync_us_max = us;
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t sd_writer_close(sd_writer_t* w)
+{
+    if (w->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = sd_writer_sync(w);
+
+    uint64_t length = w->pos + w->fill;
+    if (err == ESP_OK && w->prealloc > length && ftruncate(w->fd, (off_t)length) != 0) {
+        err = ESP_FAIL;
+    }
+    if (close(w->fd) != 0 && err == ESP_OK) {
+        err = ESP_FAIL;
+    }
+
+    free(w->buf);
+    w->buf = NULL;
+    w->fd = -1;
+    return err;
+}
+
+
+// ==== Benchmark ============================================================== //
+
+#define BENCH_CHUNK     1460    // what one TCP segment or camera callback tends to hand over
+#define BENCH_APPENDS   200
+#define BENCH_APPEND    64      // one log record
+#define BENCH_PATH_LEN  128
+
+static void bench_fill(uint8_t* chunk, uint64_t off, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        chunk[i] = (uint8_t)((off + i) * 31 + 7);
+    }
+}
+
+
+static double bench_kib_s(uint64_t bytes, int64_t us)
+{
+    return (us > 0) ? (double)bytes * 1000000.0 / 1024.0 / (double)us : 0.0;
+}
+
+
+void sd_card_bench(const char* dir, uint32_t bytes)
+{
+    char stdPath[BENCH_PATH_LEN];
+    char bufPath[BENCH_PATH_LEN];
+    char appPath[BENCH_PATH_LEN];
+    snprintf(stdPath, sizeof(stdPath), "%s/sdb_std.bin", dir);
+    snprintf(bufPath, sizeof(bufPath), "%s/sdb_buf.bin", dir);
+    snprintf(appPath, sizeof(appPath), "%s/sdb_app.bin", dir);
+
+    uint8_t* chunk = malloc(BENCH_CHUNK);
+    if (chunk == NULL || bytes == 0)
+    {
+        ESP_LOGE(TAG, "bench: out of memory");
+        free(chunk);
+        return;
+    }
+
+    // ---- the old save_picture path: stdio fwrite, default buffering ---- //
+    int64_t t0 = esp_timer_get_time();
+    FILE* f = fopen(stdPath, "w");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "bench: could not create files in %s", dir);
+        free(chunk);
+        return;
+    }
+    for (uint64_t off = 0; off < bytes; off += BENCH_CHUNK)
+    {
+        size_t n = (bytes - off < BENCH_CHUNK) ? (size_t)(bytes - off) : BENCH_CHUNK;
+        bench_fill(chunk, off, n);
+        fwrite(chunk, 1, n, f);
+    }
+    fflush(f);
+    fsync(fileno(f));   // fclose syncs on FATFS anyway, the host has to be told
+    fclose(f);
+    int64_t stdUs = esp_timer_get_time() - t0;
+
+    // ---- same data through the writer, preallocated ---- //
+    sd_writer_t w;
+    bool ok = true;
+    t0 = esp_timer_get_time();
+    ok = ok && sd_writer_open(&w, bufPath, bytes) == ESP_OK;
+    bool prealloc = ok && w.prealloc > 0;
+    for (uint64_t off = 0; ok && off < bytes; off += BENCH_CHUNK)
+    {
+        size_t n = (bytes - off < BENCH_CHUNK) ? (size_t)(bytes - off) : BENCH_CHUNK;
+        bench_fill(chunk, off, n);
+        ok = sd_writer_write(&w, chunk, n) == ESP_OK;
+    }
+    sd_writer_stats_t seq = w.stats;
+    ok = ok && sd_writer_close(&w) == ESP_OK;
+    int64_t bufUs = esp_timer_get_time() - t0;
+
+    // read it back
+    uint32_t bad = 0;
+    uint8_t* back = malloc(BENCH_CHUNK);
+    f = fopen(bufPath, "r");
+    for (uint64_t off = 0; f != NULL && back != NULL && off < bytes; off += BENCH_CHUNK)
+    {
+        size_t n = (bytes - off < BENCH_CHUNK) ? (size_t)(bytes - off) : BENCH_CHUNK;
+        bench_fill(chunk, off, n);
+        bad += (fread(back, 1, n, f) != n || memcmp(back, chunk, n) != 0);
+    }
+    bad += (f == NULL || back == NULL || fgetc(f) != EOF);
+    if (f != NULL) {
+        fclose(f);
+    }
+    free(back);
+
+    // ---- small appends, each one synced to the card ---- //
+    int64_t syncedUs = 0;
+    uint32_t syncedMax = 0;
+    ok = ok && sd_writer_open(&w, appPath, 0) == ESP_OK;
+    for (uint32_t i = 0; ok && i < BENCH_APPENDS; i++)
+    {
+        bench_fill(chunk, (uint64_t)i * BENCH_APPEND, BENCH_APPEND);
+        int64_t a0 = esp_timer_get_time();
+        ok = sd_writer_write(&w, chunk, BENCH_APPEND) == ESP_OK && sd_writer_sync(&w) == ESP_OK;
+        uint32_t us = (uint32_t)(esp_timer_get_time() - a0);
+        syncedUs += us;
+        if (us > syncedMax) {
+            syncedMax = us;
+        }
+    }
+    sd_writer_stats_t app = w.stats;
+
+    // ---- and the same appends left buffered, one sync at the end ---- //
+    t0 = esp_timer_get_time();
+    for (uint32_t i = 0; ok && i < BENCH_APPENDS; i++) {
+        ok = sd_writer_write(&w, chunk, BENCH_APPEND) == ESP_OK;
+    }
+    ok = ok && sd_writer_sync(&w) == ESP_OK;
+    int64_t bufferedUs = esp_timer_get_time() - t0;
+    ok = (sd_writer_close(&w) == ESP_OK) && ok;
+
+    ESP_LOGI(TAG, "bench: %lu bytes in %d byte chunks, stdio %.0f KiB/s, writer %.0f KiB/s (%lu writes, %lu us max), "
+             "%lu mismatches%s%s", (unsigned long)bytes, BENCH_CHUNK, bench_kib_s(bytes, stdUs), bench_kib_s(bytes, bufUs),
+             (unsigned long)seq.writes, (unsigned long)seq.write_us_max, (unsigned long)bad,
+             prealloc ? "" : ", not preallocated", ok ? "" : ", WRITES FAILED");
+    ESP_LOGI(TAG, "bench: %d appends of %d bytes, synced each %.0f us avg / %lu us max (fsync alone %lu us max), "
+             "buffered %.1f us each",
+             BENCH_APPENDS, BENCH_APPEND, (double)syncedUs / BENCH_APPENDS, (unsigned long)syncedMax,
+             (unsigned long)app.sync_us_max, (double)bufferedUs / BENCH_APPENDS);
+
+    unlink(stdPath);
+    unlink(bufPath);
+    unlink(appPath);
+    free(chunk);
+}
@@ -0,0 +1,68 @@
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+/*
+    - Buffered file writer for the SD card: data collects in one SD_WRITER_BUF block in DMA capable
+      internal RAM and reaches the card as whole, sector aligned writes at sector aligned offsets,
+      which FATFS passes straight to the SDMMC driver (no bounce copy, no read-modify-write of a
+      partial sector); only the tail of the file goes out short, on sync / close
+    - The file can be preallocated up front so FATFS is not chaining clusters while the data streams
+      in; close trims it back to what was written. On the card that takes the FAT contiguous file
+      call, FATFS refuses to grow a file through ftruncate
+    - The buffer is on the heap for as long as the writer is open, nothing static
+    - Same code on the host, where the card is a folder and the numbers are the host file system's
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SD_SECTOR       512
+#define SD_WRITER_BUF   (8 * 1024)      // 16 sectors, half of a 16 KiB FAT allocation unit
+
+typedef struct {
+    uint64_t bytes;             // handed to sd_writer_write
+    uint32_t writes;            // write() calls that reached the file system
+    uint32_t write_us_max;
+    uint32_t syncs;
+    uint32_t sync_us_max;
+} sd_writer_stats_t;
+
+typedef struct {
+    int         fd;
+    uint8_t*    buf;
+    size_t      fill;
+    uint64_t    pos;            // file offset of buf[0], always a multiple of SD_WRITER_BUF
+    uint64_t    prealloc;
+    sd_writer_stats_t stats;
+} sd_writer_t;
+
+
+// path created (or replaced) already bytes long, on the card as one contiguous run of clusters
+esp_err_t sd_writer_preallocate(const char* path, uint64_t bytes);
+
+// create / truncate path, preallocate bytes of it (0 = grow as written, or when preallocating fails)
+esp_err_t sd_writer_open(sd_writer_t* w, const char* path, uint64_t prealloc);
+
+// buffer len bytes, full blocks are written as they fill
+esp_err_t sd_writer_write(sd_writer_t* w, const void* data, size_t len);
+
+// write what is buffered and fsync, the next full block still lands aligned
+esp_err_t sd_writer_sync(sd_writer_t* w);
+
+// sync, trim the preallocation to the real length and close, the writer is unusable afterwards
+esp_err_t sd_writer_close(sd_writer_t* w);
+
+// sequential write, small appends and fsync cost on scratch files in dir, removed afterwards
+void sd_card_bench(const char* dir, uint32_t bytes);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SD_WRITER_H
@@ -4,6 +4,18 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
+#include "latency_stats.h"
+#include "msg_store.h"
+
+// longest page text, the buffer for it needs one more byte for the terminator
+#define MSG_TEXT_LEN        MSG_STORE_TEXT_MAX
+
+// item passed from the radio task to the display task through xMsgBufferQueue, the page itself
+// is in msg_store and stays there after it has been shown
+typedef struct {
+    uint32_t        seq;        // msg_store record
+    latency_tag_t   lat;
+} rf_msg_t;
 
 
 // --- declaring all the globals needed for control below... --- //
@@ -8,6 +8,8 @@
 #include "freertos/task.h"
 
 #include "u8g2_esp32_hal.h"
+#include "board_profile.h"
+#include "dlog.h"
 
 static const char *TAG = "u8g2_hal";
 static const unsigned int I2C_TIMEOUT_MS = 1000;
@@ -31,7 +33,7 @@ void u8g2_esp32_hal_init(u8g2_esp32_hal_t u8g2_esp32_hal_param) {
  * to handle SPI communications.
  */
 uint8_t u8g2_esp32_spi_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr) {
-	ESP_LOGD(TAG, "spi_byte_cb: Received a msg: %d, arg_int: %d, arg_ptr: %p", msg, arg_int, arg_ptr);
+	DLOG(U8G2_SPI_CB, msg, arg_int, arg_ptr);
 	switch(msg) {
 		case U8X8_MSG_BYTE_SET_DC:
 			if (u8g2_esp32_hal.dc != U8G2_ESP32_HAL_UNDEFINED) {
@@ -50,11 +52,11 @@ uint8_t u8g2_esp32_spi_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void
                   memset(&bus_config, 0, sizeof(spi_bus_config_t));
 		  bus_config.sclk_io_num   = u8g2_esp32_hal.clk; // CLK
 		  bus_config.mosi_io_num   = u8g2_esp32_hal.mosi; // MOSI
-		  bus_config.miso_io_num   = GPIO_NUM_37; // MISO
+		  bus_config.miso_io_num   = BOARD_SPI_MISO; // MISO, the RF69 shares the bus
 		  bus_config.quadwp_io_num = -1; // Not used
 		  bus_config.quadhd_io_num = -1; // Not used
 		  //ESP_LOGI(TAG, "... Initializing bus.");
-		  ESP_ERROR_CHECK(spi_bus_initialize(SPI3_HOST, &bus_config, SPI_DMA_CH_AUTO));
+		  ESP_ERROR_CHECK(spi_bus_initialize(BOARD_SPI_HOST, &bus_config, SPI_DMA_CH_AUTO));
 
 		  spi_device_interface_config_t dev_config;
 		  dev_config.address_bits     = 0;
@@ -71,7 +73,7 @@ uint8_t u8g2_esp32_spi_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void
 		  dev_config.pre_cb           = NULL;
 		  dev_config.post_cb          = NULL;
 		  //ESP_LOGI(TAG, "... Adding device bus.");
-		  ESP_ERROR_CHECK(spi_bus_add_device(SPI3_HOST, &dev_config, &handle_spi));
+		  ESP_ERROR_CHECK(spi_bus_add_device(BOARD_SPI_HOST, &dev_config, &handle_spi));
 
 		  break;
 		}
@@ -170,7 +172,7 @@ uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void
  * to handle callbacks for GPIO and delay functions.
  */
 uint8_t u8g2_esp32_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr) {
-	ESP_LOGD(TAG, "gpio_and_delay_cb: Received a msg: %d, arg_int: %d, arg_ptr: %p", msg, arg_int, arg_ptr);
+	DLOG(U8G2_GPIO_CB, msg, arg_int, arg_ptr);
 
 	switch(msg) {
 	// Initialize the GPIO and DELAY HAL functions.  If the pins for DC and RESET have been
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "sdkconfig.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "lwip/sockets.h"
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "udp_lookup.h"
+#include "mem_budget.h"
+
+
+#define MAGIC_0     'P'
+#define MAGIC_1     'L'
+
+typedef struct {
+    int                 sock;
+    struct sockaddr_in  server;
+    uint32_t            seq;
+    udp_lookup_stats_t  stats;
+    uint8_t             tx[UDP_LOOKUP_MAX];
+    uint8_t             rx[UDP_LOOKUP_MAX];
+} udp_lookup_t;
+
+static const char* TAG = "UDP_LOOKUP";
+
+static udp_lookup_t s_lookup = { .sock = -1 };
+
+
+// ==== Helpers ============================================================== //
+
+static inline uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+
+static void put_header(uint8_t* p, uint8_t type, uint32_t seq)
+{
+    p[0] = MAGIC_0;
+    p[1] = MAGIC_1;
+    p[2] = UDP_LOOKUP_VERSION;
+    p[3] = type;
+    put_u32(&p[4], seq);
+}
+
+
+// wait up to us for a datagram, its length, 0 on timeout, -1 on a socket error
+static int receive(udp_lookup_t* l, int64_t us)
+{
+    fd_set fds;
+    struct timeval tv = {
+        .tv_sec = (time_t)(us / 1000000),
+        .tv_usec = (suseconds_t)(us % 1000000),
+    };
+
+    FD_ZERO(&fds);
+    FD_SET(l->sock, &fds);
+    int ready = select(l->sock + 1, &fds, NULL, NULL, &tv);
+    if (ready <= 0) {
+        return (ready == 0 || errno == EINTR) ? 0 : -1;
+    }
+
+    // connected socket, nothing but the server gets through
+    int n = recv(l->sock, l->rx, sizeof(l->rx), 0);
+    return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 0 : n;
+}
+
+
+static esp_err_t send_request(udp_lookup_t* l, size_t len)
+{
+    if (send(l->sock, l->tx, len, 0) != (int)len)
+    {
+        ESP_LOGW(TAG, "send failed, errno %d", errno);
+        return ESP_FAIL;
+    }
+    l->stats.bytes_tx += (uint32_t)len;
+    l->stats.datagrams_tx++;
+    return ESP_OK;
+}
+
+
+// ==== API ================================================================== //
+
+esp_err_t udp_lookup_init(const char* ip, uint16_t port)
+{
+    udp_lookup_t* l = &s_lookup;
+
+    if (l->sock >= 0) {
+        close(l->sock);
+        l->sock = -1;
+    }
+
+    memset(&l->server, 0, sizeof(l->server));
+    l->server.sin_family = AF_INET;
+    l->server.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &l->server.sin_addr) != 1)
+    {
+        ESP_LOGE(TAG, "bad server address %s", ip);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "socket failed, errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    // connect() only fixes the peer, send() / recv() skip the address and stray senders are dropped
+    if (connect(sock, (struct sockaddr*)&l->server, sizeof(l->server)) != 0)
+    {
+        ESP_LOGE(TAG, "connect failed, errno %d", errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    l->sock = sock;
+    l->seq = (uint32_t)esp_timer_get_time();    // a reboot does not pick up answers meant for the last boot
+    l->stats.rtt_us_min = UINT32_MAX;
+    MEM_BUDGET_ADD(UDP_LOOKUP, s_lookup, MEM_REGION_DRAM);
+    ESP_LOGI(TAG, "patient lookups to %s:%u", ip, (unsigned)port);
+    return ESP_OK;
+}
+
+
+bool udp_lookup_is_ready(void)
+{
+    return s_lookup.sock >= 0;
+}
+
+
+esp_err_t udp_lookup_patient(const char* id, patient_record_t* out)
+{
+    udp_lookup_t* l = &s_lookup;
+    size_t idLen = strlen(id);
+
+    if (l->sock < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (idLen == 0 || idLen >= PATIENT_ID_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t seq = ++l->seq;
+    put_header(l->tx, UDP_LOOKUP_REQUEST, seq);
+    memcpy(&l->tx[UDP_LOOKUP_HEADER], id, idLen);
+    size_t len = UDP_LOOKUP_HEADER + idLen;
+
+    l->stats.lookups++;
+    int64_t start = esp_timer_get_time();
+    int64_t waitUs = UDP_LOOKUP_TIMEOUT_MS * 1000LL;
+
+    for (int attempt = 0; attempt < UDP_LOOKUP_TRIES; attempt++, waitUs *= 2)
+    {
+        if (attempt > 0) {
+            l->stats.retransmits++;
+        }
+        if (send_request(l, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+
+        // this send's window; anything that is not the answer to seq is dropped and the wait goes on
+        int64_t deadline = esp_timer_get_time() + waitUs;
+        for (int64_t left = waitUs; left > 0; left = deadline - esp_timer_get_time())
+        {
+            int n = receive(l, left);
+            if (n < 0) {
+                return ESP_FAIL;
+            }
+            if (n == 0) {
+                break;
+            }
+
+            l->stats.bytes_rx += (uint32_t)n;
+            l->stats.datagrams_rx++;
+            const uint8_t* rx = l->rx;
+            if (n < UDP_LOOKUP_HEADER || rx[0] != MAGIC_0 || rx[1] != MAGIC_1 ||
+                rx[2] != UDP_LOOKUP_VERSION || get_u32(&rx[4]) != seq)
+            {
+                l->stats.stale++;
+                continue;
+            }
+
+            uint32_t rtt = (uint32_t)(esp_timer_get_time() - start);
+            if (rtt < l->stats.rtt_us_min) {
+                l->stats.rtt_us_min = rtt;
+            }
+            if (rtt > l->stats.rtt_us_max) {
+                l->stats.rtt_us_max = rtt;
+            }
+            l->stats.rtt_us_sum += rtt;
+
+            switch (rx[3])
+            {
+            case UDP_LOOKUP_FOUND:
+                if (!patient_record_unpack(&rx[UDP_LOOKUP_HEADER], (size_t)n - UDP_LOOKUP_HEADER, out)) {
+                    ESP_LOGW(TAG, "malformed record for %s", id);
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+                l->stats.found++;
+                return ESP_OK;
+            case UDP_LOOKUP_NOT_FOUND:
+                l->stats.not_found++;
+                return ESP_ERR_NOT_FOUND;
+            default:
+                ESP_LOGW(TAG, "server error 0x%02x for %s", rx[3], id);
+                return ESP_FAIL;
+            }
+        }
+    }
+
+    l->stats.timeouts++;
+    ESP_LOGW(TAG, "no answer for %s after %d tries", id, UDP_LOOKUP_TRIES);
+    return ESP_ERR_TIMEOUT;
+}
+
+
+void udp_lookup_get_stats(udp_lookup_stats_t* out)
+{
+    *out = s_lookup.stats;
+}
+
+
+void udp_lookup_reset_stats(void)
+{
+    memset(&s_lookup.stats, 0, sizeof(s_lookup.stats));
+    s_lookup.stats.rtt_us_min = UINT32_MAX;
+}
@@ -0,0 +1,79 @@
+#ifndef UDP_LOOKUP_H
+#define UDP_LOOKUP_H
+
+/*
+    - Patient lookups by id in one datagram each way, for bands the device could read itself; the
+      HTTP path costs a TCP handshake and teardown plus headers several times the record per scan
+    - Every datagram starts with the same 8 byte header, little endian:
+        0-1 magic "PL", 2 version, 3 type, 4-7 sequence number
+        - request  (UDP_LOOKUP_REQUEST): the patient id, no NUL
+        - response (request type | 0x80 + status): UDP_LOOKUP_FOUND carries the record as five NUL
+          terminated strings (patient_record_pack()), UDP_LOOKUP_NOT_FOUND / UDP_LOOKUP_ERROR
+          carry nothing
+    - The server answers with the sequence number it got. A request is sent again with the same
+      number after UDP_LOOKUP_TIMEOUT_MS, doubling each time, UDP_LOOKUP_TRIES sends in all; a
+      lookup is read only, so a late answer to an earlier send is as good as the first. Answers to
+      older lookups are dropped
+    - tools/host_server.py answers it on --udp-port next to its HTTP endpoints
+    - Not thread safe: the camera task looks up, the bench runs from app_main before it starts
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "patient_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_LOOKUP_VERSION      1
+#define UDP_LOOKUP_HEADER       8
+#define UDP_LOOKUP_RECORD_MAX   255     // packed record, the same limit as on the ward roster
+#define UDP_LOOKUP_MAX          (UDP_LOOKUP_HEADER + UDP_LOOKUP_RECORD_MAX)     // largest datagram either way
+#define UDP_LOOKUP_TIMEOUT_MS   150     // first wait, a lookup over the ward AP answers in a few ms
+#define UDP_LOOKUP_TRIES        4       // 150 + 300 + 600 + 1200 ms before giving up
+#define UDP_LOOKUP_IP_OVERHEAD  28      // IPv4 + UDP header per datagram, for the bytes on air
+
+// message types
+#define UDP_LOOKUP_REQUEST      0x01
+#define UDP_LOOKUP_FOUND        0x81
+#define UDP_LOOKUP_NOT_FOUND    0x82
+#define UDP_LOOKUP_ERROR        0x83
+
+typedef struct {
+    uint32_t lookups;
+    uint32_t found;
+    uint32_t not_found;
+    uint32_t timeouts;          // no answer after every try
+    uint32_t retransmits;
+    uint32_t stale;             // answers to an older lookup or garbage, dropped
+    uint32_t rtt_us_min;        // first send to answer, answered lookups only
+    uint32_t rtt_us_max;
+    uint64_t rtt_us_sum;
+    uint32_t bytes_tx;          // UDP payload, add UDP_LOOKUP_IP_OVERHEAD per datagram for the air
+    uint32_t bytes_rx;
+    uint32_t datagrams_tx;
+    uint32_t datagrams_rx;
+} udp_lookup_stats_t;
+
+
+// socket for the server at ip:port (dotted quad), the network has to be up
+esp_err_t udp_lookup_init(const char* ip, uint16_t port);
+bool udp_lookup_is_ready(void);
+
+// record for the patient id, out->fetched is 0; ESP_ERR_NOT_FOUND when the server does not know the
+// id, ESP_ERR_TIMEOUT when it did not answer
+esp_err_t udp_lookup_patient(const char* id, patient_record_t* out);
+
+void udp_lookup_get_stats(udp_lookup_stats_t* out);
+void udp_lookup_reset_stats(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDP_LOOKUP_H
@@ -0,0 +1,1063 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+
+#include "ward_roster.h"
+#include "sd_writer.h"
+#include "mem_budget.h"
+
+
+#define FILE_MAGIC_FULL     "RSTR"
+#define FILE_MAGIC_DELTA    "RDLT"
+#define FILE_FORMAT         1
+#define ENTRY_BYTES         8
+#define ENTRIES_PER_SECTOR  (WARD_ROSTER_SECTOR / ENTRY_BYTES)
+#define FENCE_SECTORS       (WARD_ROSTER_MAX_SECTORS * 4 / WARD_ROSTER_SECTOR)
+#define ENTRY_START         (1 + FENCE_SECTORS)     // first entry sector
+#define BLOB_MAX            (1UL << 24)             // record offsets are 24 bits
+
+#define OP_UPSERT           '+'     // delta records start with one of these
+#define OP_REMOVE           '-'
+
+#define ROSTER_NEW          "roster.new"
+#define ROSTER_BLOB         "roster.blb"
+#define ROSTER_DIR_LEN      96
+#define ROSTER_PATH_LEN     (ROSTER_DIR_LEN + 16)
+
+#define FNV_OFFSET  2166136261UL
+#define FNV_PRIME   16777619UL
+
+// header sector, little endian
+//   0-3 magic, 4-5 format, 6-7 entry bytes, 8-11 version, 12-15 base version (delta only),
+//   16-19 count, 20-23 entry sectors, 24-27 blob offset, 28-31 blob bytes,
+//   32-35 CRC32 of the fence sectors, 36-39 of the entry sectors, 40-43 of the blob, 44-47 of bytes 0-43
+// entry: 0-3 hash, 4-7 blob offset << 8 | record length
+
+typedef struct {
+    bool        delta;
+    uint32_t    version;
+    uint32_t    base;
+    uint32_t    count;
+    uint32_t    entrySectors;
+    uint32_t    blobOff;
+    uint32_t    blobLen;
+    uint32_t    fenceCrc;
+    uint32_t    entryCrc;
+    uint32_t    blobCrc;
+} roster_hdr_t;
+
+typedef struct {
+    int             fd;
+    char            dir[ROSTER_DIR_LEN];
+    roster_hdr_t    hdr;
+    uint32_t        fence[WARD_ROSTER_MAX_SECTORS];     // first hash of each entry sector
+
+    // last entry sector read
+    int32_t         cacheSector;
+    uint8_t         cache[WARD_ROSTER_SECTOR];
+
+    ward_roster_stats_t stats;
+} roster_t;
+
+// builds a roster or delta file front to back; the blob goes to a side file until the entries are done
+typedef struct {
+    sd_writer_t     idx;
+    sd_writer_t     blob;
+    char            idxPath[ROSTER_PATH_LEN];
+    char            blobPath[ROSTER_PATH_LEN];
+    roster_hdr_t    hdr;
+    uint32_t        fence[WARD_ROSTER_MAX_SECTORS];
+    uint8_t         sector[WARD_ROSTER_SECTOR];
+    uint32_t        fill;       // entries in sector
+    uint32_t        lastHash;
+    esp_err_t       err;
+} roster_writer_t;
+
+// one side of a merge, walked in entry order
+typedef struct {
+    int             fd;
+    const roster_hdr_t* hdr;
+    uint32_t        index;      // next entry
+    int32_t         sector;     // entry sector in buf
+    uint8_t         buf[WARD_ROSTER_SECTOR];
+    uint32_t        hash;
+    uint32_t        offLen;
+    int32_t         recIndex;   // entry whose record is in rec
+    uint32_t        recLen;
+    uint8_t         rec[WARD_ROSTER_RECORD_MAX + 1];
+} merge_side_t;
+
+typedef struct {
+    roster_writer_t w;
+    merge_side_t    old;
+    merge_side_t    delta;
+} install_work_t;
+
+static const char* TAG = "WARD_ROSTER";
+
+static roster_t s_roster = { .fd = -1 };
+
+
+// ==== Helpers ============================================================== //
+
+static inline uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t get_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void put_u16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+
+static uint32_t id_hash(const char* id)
+{
+    uint32_t hash = FNV_OFFSET;
+    for (const char* p = id; *p != '\0'; p++)
+    {
+        hash ^= (uint8_t)*p;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+static bool read_at(int fd, void* buf, size_t len, uint32_t off)
+{
+    return pread(fd, buf, len, (off_t)off) == (ssize_t)len;
+}
+
+
+static void hdr_pack(const roster_hdr_t* h, uint8_t* s)
+{
+    memset(s, 0, WARD_ROSTER_SECTOR);
+    memcpy(s, h->delta ? FILE_MAGIC_DELTA : FILE_MAGIC_FULL, 4);
+    put_u16(&s[4], FILE_FORMAT);
+    put_u16(&s[6], ENTRY_BYTES);
+    put_u32(&s[8], h->version);
+    put_u32(&s[12], h->base);
+    put_u32(&s[16], h->count);
+    put_u32(&s[20], h->entrySectors);
+    put_u32(&s[24], h->blobOff);
+    put_u32(&s[28], h->blobLen);
+    put_u32(&s[32], h->fenceCrc);
+    put_u32(&s[36], h->entryCrc);
+    put_u32(&s[40], h->blobCrc);
+    put_u32(&s[44], esp_rom_crc32_le(0, s, 44));
+}
+
+
+// false unless the header is ours, intact and its sizes agree with each other
+static bool hdr_unpack(const uint8_t* s, roster_hdr_t* h)
+{
+    bool full = memcmp(s, FILE_MAGIC_FULL, 4) == 0;
+    if ((!full && memcmp(s, FILE_MAGIC_DELTA, 4) != 0) || get_u16(&s[4]) != FILE_FORMAT ||
+        get_u16(&s[6]) != ENTRY_BYTES || get_u32(&s[44]) != esp_rom_crc32_le(0, s, 44)) {
+        return false;
+    }
+
+    h->delta = !full;
+    h->version = get_u32(&s[8]);
+    h->base = get_u32(&s[12]);
+    h->count = get_u32(&s[16]);
+    h->entrySectors = get_u32(&s[20]);
+    h->blobOff = get_u32(&s[24]);
+    h->blobLen = get_u32(&s[28]);
+    h->fenceCrc = get_u32(&s[32]);
+    h->entryCrc = get_u32(&s[36]);
+    h->blobCrc = get_u32(&s[40]);
+
+    return h->entrySectors <= WARD_ROSTER_MAX_SECTORS &&
+           h->entrySectors == (h->count + ENTRIES_PER_SECTOR - 1) / ENTRIES_PER_SECTOR &&
+           h->blobOff == (ENTRY_START + h->entrySectors) * WARD_ROSTER_SECTOR && h->blobLen <= BLOB_MAX;
+}
+
+
+// fence sectors into fence[], buf is scratch
+static bool fence_load(int fd, const roster_hdr_t* h, uint32_t* fence, uint8_t* buf)
+{
+    uint32_t crc = 0;
+    for (uint32_t k = 0; k < FENCE_SECTORS; k++)
+    {
+        if (!read_at(fd, buf, WARD_ROSTER_SECTOR, (1 + k) * WARD_ROSTER_SECTOR)) {
+            return false;
+        }
+        crc = esp_rom_crc32_le(crc, buf, WARD_ROSTER_SECTOR);
+        for (uint32_t i = 0; i < WARD_ROSTER_SECTOR / 4; i++) {
+            fence[k * (WARD_ROSTER_SECTOR / 4) + i] = get_u32(&buf[i * 4]);
+        }
+    }
+    return crc == h->fenceCrc;
+}
+
+
+// the whole file against its CRCs, entry order and record bounds, before it is trusted
+static esp_err_t file_check(const char* path, roster_hdr_t* h, uint32_t* fence, uint8_t* buf)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_ERR_INVALID_CRC;
+    struct stat st;
+    if (!read_at(fd, buf, WARD_ROSTER_SECTOR, 0) || !hdr_unpack(buf, h) || fstat(fd, &st) != 0 ||
+        (uint64_t)st.st_size != (uint64_t)h->blobOff + h->blobLen || !fence_load(fd, h, fence, buf)) {
+        goto out;
+    }
+
+    uint32_t crc = 0;
+    uint32_t last = 0;
+    for (uint32_t s = 0; s < h->entrySectors; s++)
+    {
+        if (!read_at(fd, buf, WARD_ROSTER_SECTOR, (ENTRY_START + s) * WARD_ROSTER_SECTOR)) {
+            goto out;
+        }
+        crc = esp_rom_crc32_le(crc, buf, WARD_ROSTER_SECTOR);
+
+        uint32_t n = h->count - s * ENTRIES_PER_SECTOR;
+        n = (n > ENTRIES_PER_SECTOR) ? ENTRIES_PER_SECTOR : n;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t hash = get_u32(&buf[i * ENTRY_BYTES]);
+            uint32_t offLen = get_u32(&buf[i * ENTRY_BYTES + 4]);
+            if (hash < last || (offLen & 0xFF) == 0 || (offLen >> 8) + (offLen & 0xFF) > h->blobLen ||
+                (i == 0 && fence[s] != hash)) {
+                goto out;
+            }
+            last = hash;
+        }
+    }
+    if (crc != h->entryCrc) {
+        goto out;
+    }
+
+    crc = 0;
+    for (uint32_t off = 0; off < h->blobLen; off += WARD_ROSTER_SECTOR)
+    {
+        uint32_t n = h->blobLen - off;
+        n = (n > WARD_ROSTER_SECTOR) ? WARD_ROSTER_SECTOR : n;
+        if (!read_at(fd, buf, n, h->blobOff + off)) {
+            goto out;
+        }
+        crc = esp_rom_crc32_le(crc, buf, n);
+    }
+    if (crc == h->blobCrc) {
+        err = ESP_OK;
+    }
+
+out:
+    close(fd);
+    return err;
+}
+
+
+static void path_join(char* path, const char* dir, const char* name)
+{
+    snprintf(path, ROSTER_PATH_LEN, "%s/%s", dir, name);
+}
+
+
+// ==== Writer ================================================================ //
+
+static esp_err_t writer_begin(roster_writer_t* w, const char* dir, const char* name, bool delta,
+                              uint32_t version, uint32_t base)
+{
+    memset(w, 0, sizeof(*w));
+    w->idx.fd = -1;
+    w->blob.fd = -1;
+    w->hdr.delta = delta;
+    w->hdr.version = version;
+    w->hdr.base = base;
+    path_join(w->idxPath, dir, name);
+    path_join(w->blobPath, dir, ROSTER_BLOB);
+
+    w->err = sd_writer_open(&w->idx, w->idxPath, 0);
+    if (w->err == ESP_OK) {
+        w->err = sd_writer_open(&w->blob, w->blobPath, 0);
+    }
+
+    // header and fence are written last, in place
+    for (uint32_t s = 0; w->err == ESP_OK && s < ENTRY_START; s++) {
+        w->err = sd_writer_write(&w->idx, w->sector, WARD_ROSTER_SECTOR);
+    }
+    return w->err;
+}
+
+
+static void writer_flush_sector(roster_writer_t* w)
+{
+    memset(&w->sector[w->fill * ENTRY_BYTES], 0, WARD_ROSTER_SECTOR - w->fill * ENTRY_BYTES);
+    w->hdr.entryCrc = esp_rom_crc32_le(w->hdr.entryCrc, w->sector, WARD_ROSTER_SECTOR);
+    if (w->err == ESP_OK) {
+        w->err = sd_writer_write(&w->idx, w->sector, WARD_ROSTER_SECTOR);
+    }
+    w->hdr.entrySectors++;
+    w->fill = 0;
+}
+
+
+// records have to come in (hash, id) order
+static void writer_add(roster_writer_t* w, uint32_t hash, const uint8_t* rec, uint32_t len)
+{
+    if (w->err != ESP_OK) {
+        return;
+    }
+    if (w->hdr.count >= WARD_ROSTER_MAX_PATIENTS || len == 0 || len > WARD_ROSTER_RECORD_MAX ||
+        w->hdr.blobLen + len > BLOB_MAX)
+    {
+        w->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    if (hash < w->lastHash)
+    {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    if (w->fill == 0) {
+        w->fence[w->hdr.entrySectors] = hash;
+    }
+    put_u32(&w->sector[w->fill * ENTRY_BYTES], hash);
+    put_u32(&w->sector[w->fill * ENTRY_BYTES + 4], (w->hdr.blobLen << 8) | len);
+
+    w->err = sd_writer_write(&w->blob, rec, len);
+    w->hdr.blobCrc = esp_rom_crc32_le(w->hdr.blobCrc, rec, len);
+    w->hdr.blobLen += len;
+    w->hdr.count++;
+    w->lastHash = hash;
+
+    if (++w->fill == ENTRIES_PER_SECTOR) {
+        writer_flush_sector(w);
+    }
+}
+
+
+static void writer_abort(roster_writer_t* w)
+{
+    if (w->idx.fd >= 0) {
+        sd_writer_close(&w->idx);
+    }
+    if (w->blob.fd >= 0) {
+        sd_writer_close(&w->blob);
+    }
+    unlink(w->idxPath);
+    unlink(w->blobPath);
+}
+
+
+// blob after the entries, then fence and header over the placeholders; the file is synced
+static esp_err_t writer_finish(roster_writer_t* w)
+{
+    if (w->fill > 0) {
+        writer_flush_sector(w);
+    }
+    w->hdr.blobOff = (ENTRY_START + w->hdr.entrySectors) * WARD_ROSTER_SECTOR;
+
+    esp_err_t err = sd_writer_close(&w->blob);
+    w->blob.fd = -1;
+    if (w->err != ESP_OK || err != ESP_OK)
+    {
+        err = (w->err != ESP_OK) ? w->err : err;
+        writer_abort(w);
+        return err;
+    }
+
+    int fd = open(w->blobPath, O_RDONLY);
+    ssize_t n = 0;
+    while (fd >= 0 && err == ESP_OK && (n = read(fd, w->sector, WARD_ROSTER_SECTOR)) > 0) {
+        err = sd_writer_write(&w->idx, w->sector, (size_t)n);
+    }
+    if (fd < 0 || n < 0) {
+        err = ESP_FAIL;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(w->blobPath);
+
+    esp_err_t closeErr = sd_writer_close(&w->idx);
+    w->idx.fd = -1;
+    if (err == ESP_OK) {
+        err = closeErr;
+    }
+
+    fd = (err == ESP_OK) ? open(w->idxPath, O_WRONLY) : -1;
+    if (fd < 0)
+    {
+        unlink(w->idxPath);
+        return (err == ESP_OK) ? ESP_FAIL : err;
+    }
+
+    bool ok = true;
+    for (uint32_t k = 0; k < FENCE_SECTORS; k++)
+    {
+        for (uint32_t i = 0; i < WARD_ROSTER_SECTOR / 4; i++) {
+            put_u32(&w->sector[i * 4], w->fence[k * (WARD_ROSTER_SECTOR / 4) + i]);
+        }
+        w->hdr.fenceCrc = esp_rom_crc32_le(w->hdr.fenceCrc, w->sector, WARD_ROSTER_SECTOR);
+        ok &= pwrite(fd, w->sector, WARD_ROSTER_SECTOR, (off_t)(1 + k) * WARD_ROSTER_SECTOR) == WARD_ROSTER_SECTOR;
+    }
+
+    hdr_pack(&w->hdr, w->sector);
+    ok &= pwrite(fd, w->sector, WARD_ROSTER_SECTOR, 0) == WARD_ROSTER_SECTOR;
+    ok &= fsync(fd) == 0;
+    close(fd);
+
+    if (!ok)
+    {
+        unlink(w->idxPath);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+
+// ==== Roster internals, no locking ========================================== //
+
+static void roster_close(roster_t* r)
+{
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    r->fd = -1;
+    r->cacheSector = -1;
+    memset(&r->hdr, 0, sizeof(r->hdr));
+}
+
+
+static esp_err_t roster_open(roster_t* r, const char* dir)
+{
+    char path[ROSTER_PATH_LEN];
+    char newPath[ROSTER_PATH_LEN];
+
+    roster_close(r);
+    snprintf(r->dir, sizeof(r->dir), "%s", dir);
+    path_join(path, dir, WARD_ROSTER_FILE);
+    path_join(newPath, dir, ROSTER_NEW);
+
+    // the swap is unlink + rename, a cut in between leaves only the new file
+    struct stat st;
+    if (stat(path, &st) != 0 && file_check(newPath, &r->hdr, r->fence, r->cache) == ESP_OK && !r->hdr.delta)
+    {
+        ESP_LOGW(TAG, "finishing an interrupted roster update");
+        rename(newPath, path);
+    }
+
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (!read_at(r->fd, r->cache, WARD_ROSTER_SECTOR, 0) || !hdr_unpack(r->cache, &r->hdr) || r->hdr.delta ||
+        !fence_load(r->fd, &r->hdr, r->fence, r->cache))
+    {
+        ESP_LOGE(TAG, "%s is not a roster, ignoring it", path);
+        roster_close(r);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+
+static const uint8_t* roster_sector(roster_t* r, uint32_t sector)
+{
+    if (r->cacheSector != (int32_t)sector)
+    {
+        r->cacheSector = -1;
+        if (!read_at(r->fd, r->cache, WARD_ROSTER_SECTOR, (ENTRY_START + sector) * WARD_ROSTER_SECTOR)) {
+            return NULL;
+        }
+        r->cacheSector = (int32_t)sector;
+        r->stats.sector_reads++;
+    }
+    return r->cache;
+}
+
+
+static bool roster_lookup(roster_t* r, const char* id, patient_record_t* out)
+{
+    uint8_t rec[WARD_ROSTER_RECORD_MAX];
+    const roster_hdr_t* h = &r->hdr;
+
+    if (r->fd < 0 || h->count == 0) {
+        return false;
+    }
+    uint32_t hash = id_hash(id);
+
+    // last sector starting at or below the hash, further back while a run of equal hashes may
+    // have started in the sector before
+    uint32_t lo = 0;
+    uint32_t hi = h->entrySectors;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (r->fence[mid] <= hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    uint32_t sector = (lo > 0) ? lo - 1 : 0;
+    while (sector > 0 && r->fence[sector] == hash) {
+        sector--;
+    }
+
+    const uint8_t* s = roster_sector(r, sector);
+    if (s == NULL) {
+        return false;
+    }
+
+    // first entry of the sector with a hash >= the one looked for
+    uint32_t base = sector * ENTRIES_PER_SECTOR;
+    uint32_t n = h->count - base;
+    n = (n > ENTRIES_PER_SECTOR) ? ENTRIES_PER_SECTOR : n;
+    lo = 0;
+    hi = n;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (get_u32(&s[mid * ENTRY_BYTES]) < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (uint32_t i = base + lo; i < h->count; i++)
+    {
+        s = roster_sector(r, i / ENTRIES_PER_SECTOR);
+        if (s == NULL) {
+            return false;
+        }
+        const uint8_t* e = &s[(i % ENTRIES_PER_SECTOR) * ENTRY_BYTES];
+        if (get_u32(e) != hash) {
+            return false;
+        }
+
+        uint32_t offLen = get_u32(&e[4]);
+        uint32_t len = offLen & 0xFF;
+        if (!read_at(r->fd, rec, len, h->blobOff + (offLen >> 8))) {
+            return false;
+        }
+        if (patient_record_unpack(rec, len, out) && strcmp(out->id, id) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// ==== Merge ================================================================= //
+
+// load entry side->index, false at the end
+static bool side_entry(merge_side_t* side)
+{
+    if (side->index >= side->hdr->count) {
+        return false;
+    }
+
+    uint32_t sector = side->index / ENTRIES_PER_SECTOR;
+    if (side->sector != (int32_t)sector)
+    {
+        if (!read_at(side->fd, side->buf, WARD_ROSTER_SECTOR, (ENTRY_START + sector) * WARD_ROSTER_SECTOR)) {
+            return false;
+        }
+        side->sector = (int32_t)sector;
+    }
+
+    const uint8_t* e = &side->buf[(side->index % ENTRIES_PER_SECTOR) * ENTRY_BYTES];
+    side->hash = get_u32(e);
+    side->offLen = get_u32(&e[4]);
+    return true;
+}
+
+
+static bool side_record(merge_side_t* side)
+{
+    if (side->recIndex == (int32_t)side->index) {
+        return true;
+    }
+
+    side->recLen = side->offLen & 0xFF;
+    if (!read_at(side->fd, side->rec, side->recLen, side->hdr->blobOff + (side->offLen >> 8))) {
+        return false;
+    }
+    side->rec[side->recLen] = '\0';
+    side->recIndex = (int32_t)side->index;
+    return true;
+}
+
+
+static void side_init(merge_side_t* side, int fd, const roster_hdr_t* h)
+{
+    side->fd = fd;
+    side->hdr = h;
+    side->index = 0;
+    side->sector = -1;
+    side->recIndex = -1;
+}
+
+
+// current roster + delta -> dir/ROSTER_NEW, both walked once in (hash, id) order
+static esp_err_t roster_merge(roster_t* r, int deltaFd, const roster_hdr_t* dh, install_work_t* work)
+{
+    merge_side_t* old = &work->old;
+    merge_side_t* delta = &work->delta;
+    roster_writer_t* w = &work->w;
+
+    side_init(old, r->fd, &r->hdr);
+    side_init(delta, deltaFd, dh);
+    if (writer_begin(w, r->dir, ROSTER_NEW, false, dh->version, 0) != ESP_OK)
+    {
+        writer_abort(w);
+        return w->err;
+    }
+
+    for (;;)
+    {
+        bool haveOld = side_entry(old);
+        bool haveDelta = side_entry(delta);
+        if (!haveOld && !haveDelta) {
+            break;
+        }
+        if ((haveOld && !side_record(old)) || (haveDelta && !side_record(delta)))
+        {
+            w->err = ESP_FAIL;
+            break;
+        }
+
+        int cmp;
+        if (haveOld && haveDelta)
+        {
+            cmp = (old->hash < delta->hash) ? -1 : (old->hash > delta->hash);
+            if (cmp == 0) {
+                cmp = strcmp((const char*)old->rec, (const char*)&delta->rec[1]);
+            }
+        }
+        else {
+            cmp = haveOld ? -1 : 1;
+        }
+
+        if (cmp < 0)
+        {
+            writer_add(w, old->hash, old->rec, old->recLen);
+            old->index++;
+            continue;
+        }
+
+        // added, changed or removed; removing an id that is not there is not an error
+        if (delta->rec[0] == OP_UPSERT) {
+            writer_add(w, delta->hash, &delta->rec[1], delta->recLen - 1);
+        }
+        if (cmp == 0) {
+            old->index++;
+        }
+        delta->index++;
+    }
+
+    if (w->err != ESP_OK)
+    {
+        esp_err_t err = w->err;
+        writer_abort(w);
+        return err;
+    }
+    return writer_finish(w);
+}
+
+
+static esp_err_t roster_install(roster_t* r, const char* path)
+{
+    char live[ROSTER_PATH_LEN];
+    char newPath[ROSTER_PATH_LEN];
+    roster_hdr_t h;
+    int64_t t0 = esp_timer_get_time();
+
+    install_work_t* work = malloc(sizeof(install_work_t));
+    if (work == NULL)
+    {
+        unlink(path);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = file_check(path, &h, work->w.fence, work->w.sector);
+    if (err == ESP_OK && h.delta && (r->fd < 0 || h.base != r->hdr.version))
+    {
+        ESP_LOGW(TAG, "delta %lu -> %lu does not apply to roster %lu", (unsigned long)h.base,
+                 (unsigned long)h.version, (unsigned long)r->hdr.version);
+        err = ESP_ERR_INVALID_VERSION;
+    }
+
+    path_join(live, r->dir, WARD_ROSTER_FILE);
+    path_join(newPath, r->dir, ROSTER_NEW);
+
+    if (err == ESP_OK && h.delta)
+    {
+        int fd = open(path, O_RDONLY);
+        err = (fd >= 0) ? roster_merge(r, fd, &h, work) : ESP_FAIL;
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlink(path);
+    }
+    else if (err == ESP_OK)
+    {
+        // FAT rename does not overwrite, a roster.new left by a cut merge would fail every install
+        unlink(newPath);
+        err = (rename(path, newPath) == 0) ? ESP_OK : ESP_FAIL;
+        if (err != ESP_OK) {
+            unlink(path);
+        }
+    }
+    else {
+        unlink(path);
+    }
+    free(work);
+
+    if (err != ESP_OK)
+    {
+        r->stats.rejected++;
+        ESP_LOGE(TAG, "roster update rejected: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // the new file is complete and synced, swap it in; a cut here is finished by the next open
+    roster_close(r);
+    unlink(live);
+    if (rename(newPath, live) != 0)
+    {
+        // the next roster_open tries the rename again
+        r->stats.rejected++;
+        ESP_LOGE(TAG, "could not swap %s in", newPath);
+        return ESP_FAIL;
+    }
+
+    char dir[ROSTER_DIR_LEN];
+    snprintf(dir, sizeof(dir), "%s", r->dir);
+    err = roster_open(r, dir);
+
+    r->stats.install_us = (uint32_t)(esp_timer_get_time() - t0);
+    if (h.delta) {
+        r->stats.merges++;
+    } else {
+        r->stats.installs++;
+    }
+    ESP_LOGI(TAG, "roster %lu installed (%s), %lu patients, %lu us", (unsigned long)r->hdr.version,
+             h.delta ? "delta" : "full", (unsigned long)r->hdr.count, (unsigned long)r->stats.install_us);
+    return err;
+}
+
+
+// ==== Public API ============================================================ //
+
+esp_err_t ward_roster_open(const char* dir)
+{
+    MEM_BUDGET_ADD(WARD_ROSTER, s_roster, MEM_REGION_DRAM);
+
+    esp_err_t err = roster_open(&s_roster, dir);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "roster %lu, %lu patients, %lu entry sectors", (unsigned long)s_roster.hdr.version,
+                 (unsigned long)s_roster.hdr.count, (unsigned long)s_roster.hdr.entrySectors);
+    }
+    return err;
+}
+
+
+void ward_roster_close(void)
+{
+    roster_close(&s_roster);
+}
+
+
+bool ward_roster_is_open(void)
+{
+    return s_roster.fd >= 0;
+}
+
+
+uint32_t ward_roster_version(void)
+{
+    return s_roster.hdr.version;
+}
+
+
+uint32_t ward_roster_count(void)
+{
+    return s_roster.hdr.count;
+}
+
+
+bool ward_roster_lookup(const char* id, patient_record_t* out)
+{
+    if (id == NULL || id[0] == '\0') {
+        return false;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    bool hit = roster_lookup(&s_roster, id, out);
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+
+    s_roster.stats.lookups++;
+    s_roster.stats.hits += hit;
+    s_roster.stats.lookup_us_sum += us;
+    if (us > s_roster.stats.lookup_us_max) {
+        s_roster.stats.lookup_us_max = us;
+    }
+    return hit;
+}
+
+
+esp_err_t ward_roster_install(const char* path)
+{
+    return roster_install(&s_roster, path);
+}
+
+
+void ward_roster_get_stats(ward_roster_stats_t* out)
+{
+    *out = s_roster.stats;
+}
+
+
+// ==== Benchmark ============================================================= //
+
+#define BENCH_LOOKUPS       20000
+#define BENCH_ID_BASE       1000000
+#define BENCH_ID_STEP       3       // hits at BASE + i*3, misses at +1, delta additions at +2
+
+typedef struct {
+    uint32_t hash;
+    uint32_t num;       // patient number, ids are "MRN%07lu" so number order is id order
+    uint8_t  op;
+} bench_entry_t;
+
+static const char* const s_firstNames[] = { "John", "Mary", "Aisha", "Wei", "Olga", "Carlos", "Fatima", "Liam" };
+static const char* const s_lastNames[] = { "Doe", "Smith", "Okafor", "Zhang", "Ivanova", "Garcia", "Haddad", "Murphy" };
+
+
+static uint32_t bench_rng(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+static void bench_id(char* id, uint32_t num)
+{
+    snprintf(id, PATIENT_ID_LEN, "MRN%07lu", (unsigned long)num);
+}
+
+
+// record for num, first name "Upd" for a changed one; a removal is the id alone
+static uint32_t bench_record(uint8_t* rec, uint32_t num, uint8_t op)
+{
+    int n = 0;
+    if (op != 0) {
+        rec[n++] = op;
+    }
+    n += snprintf((char*)&rec[n], WARD_ROSTER_RECORD_MAX - n, "MRN%07lu", (unsigned long)num) + 1;
+    if (op == OP_REMOVE) {
+        return (uint32_t)n;
+    }
+    n += snprintf((char*)&rec[n], WARD_ROSTER_RECORD_MAX - n, "%s",
+                  (op == OP_UPSERT && (num - BENCH_ID_BASE) % BENCH_ID_STEP == 0) ? "Upd" : s_firstNames[num % 8]) + 1;
+    n += snprintf((char*)&rec[n], WARD_ROSTER_RECORD_MAX - n, "%s", s_lastNames[(num / 8) % 8]) + 1;
+    n += snprintf((char*)&rec[n], WARD_ROSTER_RECORD_MAX - n, "2025-%02lu-%02lu",
+                  (unsigned long)(1 + num % 12), (unsigned long)(1 + num % 28)) + 1;
+    n += snprintf((char*)&rec[n], WARD_ROSTER_RECORD_MAX - n, "%02lu:%02lu:00",
+                  (unsigned long)(num % 24), (unsigned long)(num % 60)) + 1;
+    return (uint32_t)n;
+}
+
+
+static int bench_cmp(const void* a, const void* b)
+{
+    const bench_entry_t* x = a;
+    const bench_entry_t* y = b;
+    if (x->hash != y->hash) {
+        return (x->hash < y->hash) ? -1 : 1;
+    }
+    return (x->num < y->num) ? -1 : (x->num > y->num);
+}
+
+
+static esp_err_t bench_write(roster_writer_t* w, const char* dir, bench_entry_t* list, uint32_t n,
+                             bool delta, uint32_t version, uint32_t base)
+{
+    uint8_t rec[WARD_ROSTER_RECORD_MAX + 1];
+    char id[PATIENT_ID_LEN];
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        bench_id(id, list[i].num);
+        list[i].hash = id_hash(id);
+    }
+    qsort(list, n, sizeof(bench_entry_t), bench_cmp);
+
+    if (writer_begin(w, dir, WARD_ROSTER_DOWNLOAD, delta, version, base) != ESP_OK)
+    {
+        writer_abort(w);
+        return w->err;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        writer_add(w, list[i].hash, rec, bench_record(rec, list[i].num, delta ? list[i].op : 0));
+    }
+    if (w->err != ESP_OK)
+    {
+        esp_err_t err = w->err;
+        writer_abort(w);
+        return err;
+    }
+    return writer_finish(w);
+}
+
+
+void ward_roster_bench(const char* dir, uint32_t patients)
+{
+    char sub[ROSTER_DIR_LEN];
+    char path[ROSTER_PATH_LEN];
+    char id[PATIENT_ID_LEN];
+    patient_record_t rec;
+    uint32_t rng = 0x3C6EF372;
+
+    snprintf(sub, sizeof(sub), "%s/rostbnch", dir);
+    mkdir(sub, 0755);
+    path_join(path, sub, WARD_ROSTER_DOWNLOAD);
+
+    // private roster on the heap so the live one is untouched
+    roster_t* r = malloc(sizeof(roster_t));
+    roster_writer_t* w = malloc(sizeof(roster_writer_t));
+    uint32_t changes = (patients >= 100) ? patients / 100 : 1;
+    bench_entry_t* list = malloc(patients * sizeof(bench_entry_t));
+    if (r == NULL || w == NULL || list == NULL || patients == 0 || patients > WARD_ROSTER_MAX_PATIENTS)
+    {
+        ESP_LOGE(TAG, "bench: out of memory or too many patients");
+        free(r);
+        free(w);
+        free(list);
+        return;
+    }
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    roster_open(r, sub);
+
+    // ---- server side build, then download check + install ---- //
+    for (uint32_t i = 0; i < patients; i++) {
+        list[i].num = BENCH_ID_BASE + i * BENCH_ID_STEP;
+    }
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = bench_write(w, sub, list, patients, false, 1, 0);
+    uint32_t buildUs = (uint32_t)(esp_timer_get_time() - t0);
+    if (err == ESP_OK) {
+        err = roster_install(r, path);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "bench: roster build / install failed: %s", esp_err_to_name(err));
+        goto out;
+    }
+    uint32_t installUs = r->stats.install_us;
+    uint32_t fileBytes = r->hdr.blobOff + r->hdr.blobLen;
+    uint32_t fenceBytes = r->hdr.entrySectors * 4;
+
+    // ---- random lookups, hits then misses ---- //
+    uint32_t found = 0;
+    uint32_t wrong = 0;
+    uint32_t reads = r->stats.sector_reads;
+    t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        uint32_t num = BENCH_ID_BASE + (bench_rng(&rng) % patients) * BENCH_ID_STEP;
+        bench_id(id, num);
+        if (roster_lookup(r, id, &rec))
+        {
+            found++;
+            wrong += strcmp(rec.f_name, s_firstNames[num % 8]) != 0;
+        }
+    }
+    uint32_t hitUs = (uint32_t)(esp_timer_get_time() - t0);
+    uint32_t hitReads = r->stats.sector_reads - reads;
+
+    t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        bench_id(id, BENCH_ID_BASE + (bench_rng(&rng) % patients) * BENCH_ID_STEP + 1);
+        found += roster_lookup(r, id, &rec);
+    }
+    uint32_t missUs = (uint32_t)(esp_timer_get_time() - t0);
+
+    ESP_LOGI(TAG, "bench: %lu patients, file %lu bytes (%lu per patient), RAM fence %lu bytes + %u byte sector cache; "
+             "all records in RAM would be %lu bytes", (unsigned long)patients, (unsigned long)fileBytes,
+             (unsigned long)(fileBytes / patients), (unsigned long)fenceBytes, WARD_ROSTER_SECTOR,
+             (unsigned long)(patients * sizeof(patient_record_t)));
+    ESP_LOGI(TAG, "bench: build %lu us, check + install %lu us; lookup hit %lu ns (%lu sector reads per 100), "
+             "miss %lu ns; %lu found of %u hits, %lu wrong", (unsigned long)buildUs, (unsigned long)installUs,
+             (unsigned long)((uint64_t)hitUs * 1000 / BENCH_LOOKUPS), (unsigned long)(hitReads * 100ULL / BENCH_LOOKUPS),
+             (unsigned long)((uint64_t)missUs * 1000 / BENCH_LOOKUPS), (unsigned long)found, BENCH_LOOKUPS,
+             (unsigned long)wrong);
+
+    // ---- 1% delta: half changed, a quarter removed, a quarter new ---- //
+    uint32_t first = bench_rng(&rng) % patients;
+    for (uint32_t i = 0; i < changes; i++)
+    {
+        uint32_t p = (first + i * 7) % patients;
+        switch (i % 4)
+        {
+            case 0:
+            case 1:     list[i].num = BENCH_ID_BASE + p * BENCH_ID_STEP; list[i].op = OP_UPSERT; break;
+            case 2:     list[i].num = BENCH_ID_BASE + p * BENCH_ID_STEP; list[i].op = OP_REMOVE; break;
+            default:    list[i].num = BENCH_ID_BASE + p * BENCH_ID_STEP + 2; list[i].op = OP_UPSERT; break;
+        }
+    }
+    uint32_t changed = list[0].num;
+    uint32_t removed = (changes > 2) ? list[2].num : 0;
+    uint32_t added = (changes > 3) ? list[3].num : 0;
+
+    err = bench_write(w, sub, list, changes, true, 2, 1);
+    if (err == ESP_OK) {
+        err = roster_install(r, path);
+    }
+
+    bench_id(id, changed);
+    bool okChanged = roster_lookup(r, id, &rec) && strcmp(rec.f_name, "Upd") == 0;
+    bench_id(id, removed);
+    bool okRemoved = removed == 0 || !roster_lookup(r, id, &rec);
+    bench_id(id, added);
+    bool okAdded = added == 0 || roster_lookup(r, id, &rec);
+
+    ESP_LOGI(TAG, "bench: delta of %lu changes merged in %lu us (%s), now %lu patients; changed %s, removed %s, added %s",
+             (unsigned long)changes, (unsigned long)r->stats.install_us, esp_err_to_name(err),
+             (unsigned long)r->hdr.count, okChanged ? "ok" : "WRONG", okRemoved ? "ok" : "WRONG",
+             okAdded ? "ok" : "WRONG");
+
+out:
+    roster_close(r);
+    path_join(path, sub, WARD_ROSTER_FILE);
+    unlink(path);
+    rmdir(sub);
+    free(r);
+    free(w);
+    free(list);
+}
@@ -0,0 +1,86 @@
+#ifndef WARD_ROSTER_H
+#define WARD_ROSTER_H
+
+/*
+    - The ward's patient list on the SD card, downloaded from the server in one go, so a scanned
+      band can be resolved on the device without an upload
+    - One file, WARD_ROSTER_FILE, built by the server (tools/roster_build.py) in the layout the
+      device reads, 512 byte sectors:
+        - sector 0: header (version, count, sizes, CRC32 of every region)
+        - 2 fence sectors: the first hash of every entry sector
+        - entry sectors: 8 byte entries sorted by FNV-1a hash of the patient id (then by id), 64 a
+          sector: hash + offset and length of the patient's record in the blob
+        - blob: the records, five NUL terminated strings each (id, first / last name, date and
+          time of the last check-up), in entry order
+    - Only the fence is held in RAM (4 bytes per 64 patients); a lookup is a binary search over it,
+      one entry sector read and one record read. The last entry sector read is cached
+    - Updates come as a delta file of the same layout against a base version, every record marked
+      added / changed or removed; it is merged with the current roster into a new file in one
+      sequential pass, nothing is sorted on the device. A full roster simply replaces the file
+    - A new file is checked against its CRCs before it replaces the old one, the swap is a rename;
+      a boot that finds only the new file (power cut mid swap) finishes it
+    - Scans look in the patient cache first, then here, and only upload on a miss in both
+    - Not thread safe: the camera task looks up, installs run from app_main before it starts
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "patient_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARD_ROSTER_FILE            "roster.bin"    // 8.3, the card is mounted without long names
+#define WARD_ROSTER_DOWNLOAD        "roster.dl"
+#define WARD_ROSTER_SECTOR          512
+#define WARD_ROSTER_MAX_SECTORS     256             // entry sectors
+#define WARD_ROSTER_MAX_PATIENTS    (WARD_ROSTER_MAX_SECTORS * 64)
+#define WARD_ROSTER_RECORD_MAX      255
+
+typedef struct {
+    uint32_t lookups;
+    uint32_t hits;
+    uint32_t lookup_us_max;
+    uint64_t lookup_us_sum;
+    uint32_t sector_reads;      // entry sectors that missed the one sector cache
+    uint32_t installs;          // full rosters installed
+    uint32_t merges;            // deltas merged
+    uint32_t rejected;          // downloads that failed their checks
+    uint32_t install_us;        // last install or merge, checks included
+} ward_roster_stats_t;
+
+
+// open dir/WARD_ROSTER_FILE if there is one and load its fence; dir is where installs go, so this
+// comes first even when the card has no roster yet (ESP_ERR_NOT_FOUND)
+esp_err_t ward_roster_open(const char* dir);
+void ward_roster_close(void);
+bool ward_roster_is_open(void);
+
+// version of the roster on the card, 0 when there is none
+uint32_t ward_roster_version(void);
+uint32_t ward_roster_count(void);
+
+// record for the patient id, out->fetched is 0; false when the id is not on the roster
+bool ward_roster_lookup(const char* id, patient_record_t* out);
+
+// check a downloaded roster file (in the open roster's dir) and install it: a full roster replaces
+// the current one, a delta is merged into it and needs the current version as its base; path is
+// removed either way
+esp_err_t ward_roster_install(const char* path);
+
+void ward_roster_get_stats(ward_roster_stats_t* out);
+
+// build a roster of patients, install it, time hit / miss lookups and a 1% delta merge, report the
+// file size and RAM; on a private roster in a subdir of dir, the live one is untouched
+void ward_roster_bench(const char* dir, uint32_t patients);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARD_ROSTER_H
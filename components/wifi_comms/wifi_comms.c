@@ -1,10 +1,17 @@
 // standard includes
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
 
 // esp system includes
+#include "sdkconfig.h"
 #include "esp_system.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_wifi.h"
+#include "esp_mac.h"
+#endif
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_http_client.h"
@@ -13,22 +20,37 @@
 #include "esp_camera.h"
 #include "GUI_drivers.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "cJSON.h"
 
 // C http libraries
 #include "nvs_flash.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
+#else
+#include "host_fakes.h"
+#endif
 
 // library for parsing the JSONs from HTTP
 #include "jsmn.h"
 
 // custom header file
 #include "wifi_comms.h"
+#include "board_profile.h"
+#include "mem_budget.h"
+#include "patient_cache.h"
+#include "ward_roster.h"
+#include "udp_lookup.h"
+#include "mqtt_pager.h"
+#include "cbor_lite.h"
+#include "gunzip.h"
+#include "sd_writer.h"
 
 
 // ==== Defines needed for code =============================
@@ -40,6 +62,30 @@
 #define SERVER_IP       "INSERT"
 #define SERVER_SOCKET   "INSERT"
 
+// base url of the Flask server, the host build talks to tools/host_server.py instead
+#if CONFIG_IDF_TARGET_LINUX
+#define SERVER_URL      host_env("HOST_SERVER_URL", "http://127.0.0.1:5000")
+#else
+#define SERVER_URL      "http://10.0.0.73:5000"
+#endif
+
+// the same server answers patient lookups by id over UDP (udp_lookup.h)
+#if CONFIG_IDF_TARGET_LINUX
+#define LOOKUP_IP       host_env("HOST_LOOKUP_IP", "127.0.0.1")
+#else
+#define LOOKUP_IP       "10.0.0.73"
+#endif
+#define LOOKUP_PORT     5001
+
+// pages pushed over WiFi (mqtt_pager.h), tools/mqtt_broker.py on the host
+#if CONFIG_IDF_TARGET_LINUX
+#define MQTT_BROKER_URI host_env("HOST_MQTT_URI", "mqtt://127.0.0.1:1883")
+#else
+#define MQTT_BROKER_URI "mqtt://10.0.0.73:1883"
+#endif
+#define SERVER_URL_LEN  128
+#define FILE_PATH_LEN   128
+
 // Defines for bits controlling wifi initialization
 #define WIFI_SUCCESS        1 << 0
 #define WIFI_FAILURE        1 << 1
@@ -49,15 +95,54 @@
 
 
 // define for button assignment and variables
-#define WIFI_BUTTON         33
+#define WIFI_BUTTON         BOARD_WIFI_BUTTON
 
 
 // Global Variables //
 static const char *TAG = "WIFI_COMMS";
+#if !CONFIG_IDF_TARGET_LINUX
 static EventGroupHandle_t wifi_event_group;     // group bits to contain status bits for wifi connection
 static int s_retry_num = 0;                     //retry tracker
-#define MAX_HTTP_OUTPUT_BUFFER 128
+#endif
+#define MAX_HTTP_OUTPUT_BUFFER 256     // the patient JSON with its id is ~130 bytes
 static char response_buffer[MAX_HTTP_OUTPUT_BUFFER];
+static size_t response_len;             // bytes in response_buffer, a CBOR answer can hold NULs
+static bool response_cbor;              // the server answered with Content-Type application/cbor
+
+// patient answers are asked for as CBOR, a server that only knows JSON just ignores the header
+#define PATIENT_ACCEPT      "application/cbor, application/json;q=0.5"
+#define CBOR_CONTENT_TYPE   "application/cbor"
+
+// every request takes a gzip body, inflated as it arrives (gunzip.h). An answer is inflated
+// straight into response_buffer, which is its own window, so any server window works. A download
+// keeps only DOWNLOAD_WINDOW of history: it asks for that window with gzip_window= in the query
+// (tools/host_server.py honours it), and a body that still reaches further back is fetched again
+// uncompressed
+#define ACCEPT_ENCODING         "gzip"
+#define DOWNLOAD_WINDOW_PARAM   "gzip_window"
+#define DOWNLOAD_WINDOW_BITS    12
+#define DOWNLOAD_WINDOW         (1 << DOWNLOAD_WINDOW_BITS)
+MEM_STATIC_ASSERT((MAX_HTTP_OUTPUT_BUFFER & (MAX_HTTP_OUTPUT_BUFFER - 1)) == 0, "response_buffer is a gunzip window");
+static bool response_gzip;              // the answer came with Content-Encoding gzip
+static gunzip_t response_inflate;
+static MEM_BULK_ATTR uint8_t download_window[DOWNLOAD_WINDOW];
+static gunzip_t download_inflate;       // roster and bench downloads, one at a time from app_main
+
+// cJSON allocates out of this instead of the heap, every tree is thrown away as a whole once the
+// fields are used, so a bump pointer is enough and nothing is left fragmented between requests
+// NOTE: a response can hold at most MAX_HTTP_OUTPUT_BUFFER bytes, its tree fits many times over
+#define JSON_ARENA_SIZE     4096
+#define JSON_ARENA_ALIGN    8
+static MEM_BULK_ATTR uint8_t json_arena[JSON_ARENA_SIZE];
+static size_t json_arena_used;
+static size_t json_arena_peak;
+static StaticSemaphore_t json_lock_buf;
+static SemaphoreHandle_t json_lock;     // one tree at a time, parse_json is reached from more than one task
+
+// the scan lookup_patient() is serving, parse_json files the server's answer under its id and
+// reports its latency; only the camera task scans
+static int64_t s_scanStartUs;
+static char s_scanId[PATIENT_ID_LEN];
 
 
 
@@ -70,8 +155,72 @@ const char *json_string = "{"
 "}";
 
 
+// ==== cJSON arena ======================= //
+
+static void *json_arena_malloc(size_t size)
+{
+    size_t start = (json_arena_used + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+    if (size > JSON_ARENA_SIZE - start) {
+        return NULL;    // cJSON turns this into a failed parse
+    }
+
+    json_arena_used = start + size;
+    if (json_arena_used > json_arena_peak) {
+        json_arena_peak = json_arena_used;
+    }
+    return &json_arena[start];
+}
+
+
+// single nodes are never given back, json_arena_reset() drops the whole tree
+static void json_arena_free(void *ptr)
+{
+    (void)ptr;
+}
+
+
+static void json_arena_reset(void)
+{
+    json_arena_used = 0;
+}
+
+
+// route cJSON through the arena, called before the first parse
+static void json_arena_init(void)
+{
+    if (json_lock != NULL) {
+        return;
+    }
+
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_arena_malloc,
+        .free_fn = json_arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+
+    json_lock = xSemaphoreCreateMutexStatic(&json_lock_buf);
+    MEM_BUDGET_ADD(WIFI_COMMS, json_arena, MEM_BULK_REGION);
+    MEM_BUDGET_ADD(WIFI_COMMS, response_buffer, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(WIFI_COMMS, response_inflate, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(WIFI_COMMS, download_window, MEM_BULK_REGION);
+    MEM_BUDGET_ADD(WIFI_COMMS, download_inflate, MEM_REGION_DRAM);
+}
+
+
+
 // ==== WiFi Connection Functions (Not for data processing) ======================= //
 
+#if CONFIG_IDF_TARGET_LINUX
+
+// the host already has a network, nothing to associate with
+esp_err_t connect_wifi()
+{
+    ESP_LOGI(TAG, "Host build, using the host network (server %s)", SERVER_URL);
+    return WIFI_SUCCESS;
+}
+
+#else
+
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
     // base case where we want to connect to a wifi network(sta)
@@ -214,6 +363,8 @@ esp_err_t connect_wifi()
 
 }
 
+#endif
+
 
 // ==== Function to call from wrapper to init wifi comms ============================
 
@@ -223,6 +374,8 @@ esp_err_t init_wifi_comms()
 {
     esp_err_t status = WIFI_FAILURE;
 
+    json_arena_init();
+
     // initializing flash storage - NOT SURE IF THIS IS NEEDED
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
@@ -232,6 +385,9 @@ esp_err_t init_wifi_comms()
     }
     ESP_ERROR_CHECK(ret);
 
+    // repeat scans are answered from here, it keeps its second tier in NVS across reboots
+    patient_cache_init();
+
 
     // connect to wireless AP
     status = connect_wifi();
@@ -247,19 +403,90 @@ esp_err_t init_wifi_comms()
 }
 
 
+// scans whose band was read on the device ask the server over UDP before uploading the image,
+// needs the network up (init_wifi_comms() first)
+esp_err_t enable_udp_lookup()
+{
+    return udp_lookup_init(LOOKUP_IP, LOOKUP_PORT);
+}
+
+
+// pages over MQTT next to the radio; the client id has to stay the same across boots for the broker
+// to keep the session, so it comes from the MAC
+esp_err_t enable_mqtt_pager()
+{
+#if !CONFIG_MQTT_PAGER_ENABLE
+    return ESP_ERR_NOT_SUPPORTED;     // not built in, menuconfig: MQTT pager
+#else
+    char clientId[MQTT_PAGER_ID_LEN];
+
+#if CONFIG_IDF_TARGET_LINUX
+    snprintf(clientId, sizeof(clientId), "%s", host_env("HOST_MQTT_ID", "mdv-host"));
+#else
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(clientId, sizeof(clientId), "mdv-%02x%02x%02x", mac[3], mac[4], mac[5]);
+#endif
+
+    return mqtt_pager_start(MQTT_BROKER_URI, clientId);
+#endif
+}
+
+
 
 // ==== Function calls for data processing and server interaction =======================
 
+// the inflated answer is in place already, response_buffer is the window; it has to end one short
+// of the end for the terminator, so the window never wraps
+static bool response_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    (void)data;
+
+    response_len += len;
+    if (response_len >= MAX_HTTP_OUTPUT_BUFFER) {
+        return false;
+    }
+    response_buffer[response_len] = '\0';
+    return true;
+}
+
+
 //event handler for when we make a request to a server as a client
 esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
 
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        response_len = 0;
+        response_cbor = false;
+        response_gzip = false;
+        response_buffer[0] = '\0';
+    }
+    else if (evt->event_id == HTTP_EVENT_ON_HEADER) {
+        if (strcasecmp(evt->header_key, "Content-Type") == 0) {
+            response_cbor = (strncasecmp(evt->header_value, CBOR_CONTENT_TYPE, strlen(CBOR_CONTENT_TYPE)) == 0);
+        }
+        else if (strcasecmp(evt->header_key, "Content-Encoding") == 0 && strcasecmp(evt->header_value, "gzip") == 0) {
+            response_gzip = true;
+            gunzip_init(&response_inflate, (uint8_t *)response_buffer, MAX_HTTP_OUTPUT_BUFFER, response_sink, NULL);
+        }
+    }
+    else if (evt->event_id == HTTP_EVENT_ON_DATA && response_gzip) {
 
-        // making sure out HTTP buffer isnt overflowed
-        if (evt->data_len < MAX_HTTP_OUTPUT_BUFFER) {
+        // an answer that does not inflate is dropped whole, parse_response() sees it never finished
+        if (gunzip_feed(&response_inflate, evt->data, evt->data_len) < 0) {
+            response_len = 0;
+            response_buffer[0] = '\0';
+        }
+    }
+    else if (evt->event_id == HTTP_EVENT_ON_DATA) {
+
+        // the body can come in more than one piece, append while it fits and keep a terminator
+        // behind it for the JSON parser
+        if (response_len + evt->data_len < MAX_HTTP_OUTPUT_BUFFER) {
             //printf("%s\n", (char *)evt->data);
-            strncpy(response_buffer, (char *)evt->data, evt->data_len);
-            response_buffer[evt->data_len] = '\0';  // Null-terminate the buffer
+            memcpy(&response_buffer[response_len], evt->data, evt->data_len);
+            response_len += evt->data_len;
+            response_buffer[response_len] = '\0';  // Null-terminate the buffer
         }
     }
     return ESP_OK;
@@ -267,49 +494,213 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
 
 
 
-// function to parse the JSON string we would get from the HTTP response
-void parse_json( const char * jsonString)
+// copy a JSON string field into a fixed record field, missing fields stay empty
+static void json_copy_field(cJSON *root, const char *name, char *dst, size_t cap)
+{
+    cJSON *item = cJSON_GetObjectItem(root, name);
+    if ( cJSON_IsString(item) ) {
+        snprintf(dst, cap, "%s", item->valuestring);
+    }
+}
+
+
+// the fields of a patient answer, the same names in JSON and CBOR; a CBOR answer can key them by
+// their place in this table instead (1 = patient_id...), which is what the server sends
+typedef struct {
+    const char *name;
+    size_t      offset;
+    size_t      cap;
+} patient_field_t;
+
+#define PATIENT_FIELD(key, member) { key, offsetof(patient_record_t, member), sizeof(((patient_record_t *)0)->member) }
+
+static const patient_field_t patient_fields[] = {
+    PATIENT_FIELD("patient_id", id),
+    PATIENT_FIELD("f_name", f_name),
+    PATIENT_FIELD("l_name", l_name),
+    PATIENT_FIELD("last_checkup_date", last_checkup_date),
+    PATIENT_FIELD("last_checkup_time", last_checkup_time),
+};
+#define PATIENT_FIELD_COUNT (sizeof(patient_fields) / sizeof(patient_fields[0]))
+
+
+// fill a record from a CBOR patient answer, a map of integer or text keys, straight out of the buffer
+// with nothing allocated; unknown keys and values of other types are skipped, a field that does
+// not fit is cut like the JSON path does
+static bool cbor_patient( const uint8_t *buf, size_t len, patient_record_t *rec )
+{
+    cbor_reader_t r;
+    uint32_t pairs;
+
+    memset(rec, 0, sizeof(*rec));
+    cbor_reader_init(&r, buf, len);
+    if (!cbor_read_map(&r, &pairs)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pairs; i++)
+    {
+        const char *key;
+        const char *value;
+        size_t keyLen;
+        size_t valueLen;
+        uint64_t index;
+        const patient_field_t *field = NULL;
+
+        if (cbor_peek(&r) == CBOR_UINT)
+        {
+            cbor_read_uint(&r, &index);
+            if (index >= 1 && index <= PATIENT_FIELD_COUNT) {
+                field = &patient_fields[index - 1];
+            }
+        }
+        else if (cbor_read_text(&r, &key, &keyLen))
+        {
+            for (size_t f = 0; f < PATIENT_FIELD_COUNT; f++)
+            {
+                if (strlen(patient_fields[f].name) == keyLen && memcmp(patient_fields[f].name, key, keyLen) == 0) {
+                    field = &patient_fields[f];
+                    break;
+                }
+            }
+        }
+        else {
+            return false;
+        }
+
+        if (field == NULL || cbor_peek(&r) != CBOR_TEXT)
+        {
+            cbor_skip(&r);
+            continue;
+        }
+        cbor_read_text(&r, &value, &valueLen);
+        char *dst = (char *)rec + field->offset;
+        size_t n = (valueLen < field->cap - 1) ? valueLen : field->cap - 1;
+        memcpy(dst, value, n);
+        dst[n] = '\0';
+    }
+
+    return cbor_reader_done(&r);
+}
+
+
+// draw a patient record, closing the scan in progress (if any) for the latency stats
+static void show_patient(const patient_record_t *rec, bool cached)
 {
-    // mallocing the patient message packet to pass all info at once
-    display_msg_package_t *patientInfo = (display_msg_package_t*)malloc(sizeof(display_msg_package_t));
-    patientInfo->f_name = "";
-    patientInfo->l_name = "";
-    patientInfo->last_checkup_date = "";
-    patientInfo->last_checkup_time = "";
+    // write_patient_info() only reads the strings, the package just points into the record
+    display_msg_package_t info = {
+        .f_name = (char *)rec->f_name,
+        .l_name = (char *)rec->l_name,
+        .last_checkup_date = (char *)rec->last_checkup_date,
+        .last_checkup_time = (char *)rec->last_checkup_time,
+    };
+
+    if (s_scanStartUs != 0)
+    {
+        patient_cache_note_scan(cached, (uint32_t)(esp_timer_get_time() - s_scanStartUs));
+        s_scanStartUs = 0;
+    }
+
+    write_patient_info(&info);    // passing patient info struct to the function to be displayed
+}
+
+
+// fill a record from the server's patient JSON, the fields are copied out of the tree so the arena
+// is free again before anyone holds them; false when the JSON does not parse
+static bool parse_patient( const char *jsonString, patient_record_t *rec )
+{
+    memset(rec, 0, sizeof(*rec));
+
+    json_arena_init();
+    xSemaphoreTake(json_lock, portMAX_DELAY);
+    json_arena_reset();
 
     // passinng the json to the parser and checking for any issues
     cJSON *root = cJSON_Parse(jsonString);
+    bool parsed = (root != NULL);
     if (!root)
     {
-        printf("Error before: %s\n", cJSON_GetErrorPtr());
+        printf("Error before: %s (arena %u / %u bytes)\n", cJSON_GetErrorPtr(),
+               (unsigned)json_arena_used, (unsigned)JSON_ARENA_SIZE);
     }
 
-    cJSON *first_name = cJSON_GetObjectItem(root, "f_name");
-    if ( cJSON_IsString(first_name) ) {
-        printf("first name is: %s\n", first_name->valuestring);
-        patientInfo->f_name = first_name->valuestring;
+    for (size_t f = 0; f < PATIENT_FIELD_COUNT; f++) {
+        json_copy_field(root, patient_fields[f].name, (char *)rec + patient_fields[f].offset, patient_fields[f].cap);
     }
 
-    cJSON *last_name = cJSON_GetObjectItem(root, "l_name");
-    if ( cJSON_IsString(last_name) ) {
-        patientInfo->l_name = last_name->valuestring;
+    // clearning the cJSON root used to parse before completing, then the arena behind it
+    cJSON_Delete(root);
+    ESP_LOGD(TAG, "json arena: %u bytes this tree, %u peak of %u", (unsigned)json_arena_used,
+             (unsigned)json_arena_peak, (unsigned)JSON_ARENA_SIZE);
+    json_arena_reset();
+    xSemaphoreGive(json_lock);
+
+    return parsed;
+}
+
+
+// the record a server answer carried: cached under its id and shown; an answer that did not parse
+// shows a lookup error rather than a blank patient
+static void patient_answer( patient_record_t *rec, bool parsed )
+{
+    if (!parsed)
+    {
+        printf("Could not read the server's answer for patient %s\n", s_scanId);
+        write_to_disp_temp("LOOKUP FAILED", 5);
+        s_scanStartUs = 0;      // nothing shown, the scan is not timed
+        return;
     }
 
-    cJSON *last_checkup_date = cJSON_GetObjectItem(root, "last_checkup_date");  
-    if ( cJSON_IsString(last_checkup_date) ) {
-        patientInfo->last_checkup_date = last_checkup_date->valuestring;
+    if (rec->f_name[0] != '\0') {
+        printf("first name is: %s\n", rec->f_name);
     }
 
-    cJSON *last_checkup_time = cJSON_GetObjectItem(root, "last_checkup_time");  
-    if ( cJSON_IsString(last_checkup_time) ) {
-        patientInfo->last_checkup_time = last_checkup_time->valuestring;
+    // an older server does not send the id back, file it under the one read off the band
+    if (rec->id[0] == '\0') {
+        snprintf(rec->id, sizeof(rec->id), "%s", s_scanId);
+    }
+    if (rec->id[0] != '\0') {
+        patient_cache_put(rec);
     }
 
-    write_patient_info(patientInfo);    // passing patient info struct to the function to be displayed
+    show_patient(rec, false);
+}
 
-    // clearning the cJSON root used to parse before completing
-    free(patientInfo);
-    cJSON_Delete(root);
+
+// function to parse the JSON string we would get from the HTTP response
+void parse_json( const char * jsonString)
+{
+    patient_record_t rec;
+    bool parsed = parse_patient(jsonString, &rec);
+    patient_answer(&rec, parsed);
+}
+
+
+// the patient answer in response_buffer, in whichever format the server picked
+static bool parse_response( patient_record_t *rec )
+{
+    if (response_gzip && gunzip_finish(&response_inflate) != GUNZIP_DONE)
+    {
+        ESP_LOGW(TAG, "gzip answer cut short or damaged");
+        memset(rec, 0, sizeof(*rec));
+        return false;
+    }
+    if (response_cbor) {
+        return cbor_patient((const uint8_t *)response_buffer, response_len, rec);
+    }
+    return parse_patient(response_buffer, rec);
+}
+
+
+static void handle_response(void)
+{
+    patient_record_t rec;
+
+    if (!response_cbor) {
+        printf("%s\n", response_buffer);
+    }
+    bool parsed = parse_response(&rec);
+    patient_answer(&rec, parsed);
 }
 
 
@@ -356,8 +747,11 @@ esp_err_t http_ping_server(const char* url) {
 // function to use in order to send an image to the server and get JSON patient data back
 esp_err_t send_image_to_server( camera_fb_t *fb )
 {
+    char url[SERVER_URL_LEN];
+    snprintf(url, sizeof(url), "%s/upload_image", SERVER_URL);
+
     esp_http_client_config_t config = {
-        .url = "http://10.0.0.73:5000/upload_image", // Flash server URL for image upload
+        .url = url, // Flash server URL for image upload
         .event_handler = _http_event_handler,
         .method = HTTP_METHOD_POST,
     };
@@ -366,6 +760,13 @@ esp_err_t send_image_to_server( camera_fb_t *fb )
     // filling header information for client request
     esp_http_client_set_header(client, "Content-Type", "image/jpeg");
     esp_http_client_set_header(client, "Content-Disposition", "form-data; name=\"file\"; filename=\"image.jpg\"");
+    esp_http_client_set_header(client, "Accept", PATIENT_ACCEPT);
+    esp_http_client_set_header(client, "Accept-Encoding", ACCEPT_ENCODING);
+
+    // the server can skip its own decode when the band was already read here
+    if (s_scanId[0] != '\0') {
+        esp_http_client_set_header(client, "X-Patient-Id", s_scanId);
+    }
 
     // passing the image to the client request struct via the frame buffer
     esp_http_client_set_post_field( client, (const char*)fb->buf, fb->len );
@@ -378,11 +779,10 @@ esp_err_t send_image_to_server( camera_fb_t *fb )
         int status_code = esp_http_client_get_status_code(client);
         if (status_code == 200)
         {
-            // readiong JSON - JSON information stored in the response_buffer global
+            // readiong the answer - JSON or CBOR, stored in the response_buffer global
             if (esp_http_client_get_content_length > 0)
             {   
-                printf("%s\n", response_buffer);
-                parse_json(response_buffer);
+                handle_response();
             }
         }
         else    // base case, {"error", "invalid qr code"} is status code 600 or something else
@@ -403,9 +803,592 @@ esp_err_t send_image_to_server( camera_fb_t *fb )
 
 
 
+// show the patient for one scan: straight from the cache or the ward roster when the band's id is
+// known and on either, then by id over UDP when that is enabled, otherwise the image goes to the
+// server as before; whatever the server answers is cached
+esp_err_t lookup_patient( camera_fb_t *fb, const char *qrId, int64_t scanStartUs )
+{
+    patient_record_t rec;
+    esp_err_t err;
 
+    s_scanStartUs = scanStartUs;
+    snprintf(s_scanId, sizeof(s_scanId), "%s", (qrId != NULL) ? qrId : "");
 
+    if (patient_cache_get(s_scanId, &rec) || ward_roster_lookup(s_scanId, &rec))
+    {
+        show_patient(&rec, true);
+        s_scanId[0] = '\0';
+        return ESP_OK;
+    }
 
+    if (s_scanId[0] != '\0' && udp_lookup_is_ready())
+    {
+        err = udp_lookup_patient(s_scanId, &rec);
+        if (err == ESP_OK)
+        {
+            if (rec.id[0] == '\0') {
+                snprintf(rec.id, sizeof(rec.id), "%s", s_scanId);
+            }
+            patient_cache_put(&rec);
+            show_patient(&rec, false);
+            s_scanId[0] = '\0';
+            return ESP_OK;
+        }
+        if (err == ESP_ERR_NOT_FOUND)
+        {
+            printf("Server does not know patient %s\n", s_scanId);
+            write_to_disp_temp("PATIENT NOT FOUND", 5);
+            s_scanStartUs = 0;
+            s_scanId[0] = '\0';
+            return err;
+        }
+        // no answer over UDP, the upload still gets its TCP retries
+    }
+
+    err = send_image_to_server(fb);
+    s_scanStartUs = 0;      // no answer to show, the scan is not timed
+    s_scanId[0] = '\0';
+    return err;
+}
 
 
 
+// ==== Streamed downloads ======================= //
+
+// a GET whose body is read a piece at a time, never whole, and inflated on the way when gzip
+typedef struct {
+    esp_http_client_handle_t client;
+    int status;
+    int64_t length;         // Content-Length as sent, compressed for gzip; -1 when unknown
+    bool gzip;
+    gunzip_status_t inflate;    // where inflating stopped, GUNZIP_ERR_WINDOW: ask again without gzip
+    uint64_t wire;          // body bytes read
+    int64_t inflateUs;      // time spent in gunzip_feed()
+} download_t;
+
+
+static esp_err_t download_event_handler(esp_http_client_event_t *evt)
+{
+    download_t *dl = (download_t *)evt->user_data;
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "Content-Encoding") == 0) {
+        dl->gzip = (strcasecmp(evt->header_value, "gzip") == 0);
+    }
+    return ESP_OK;
+}
+
+
+// send the request and read the headers, dl->status is 0 when the server was not reached; always
+// followed by download_close(). A gzip request names the window it can inflate
+static void download_open( download_t *dl, const char *url, bool gzip )
+{
+    char windowUrl[SERVER_URL_LEN + sizeof("&" DOWNLOAD_WINDOW_PARAM "=15")];
+    memset(dl, 0, sizeof(*dl));
+
+    if (gzip)
+    {
+        snprintf(windowUrl, sizeof(windowUrl), "%s%c%s=%d", url, (strchr(url, '?') != NULL) ? '&' : '?',
+                 DOWNLOAD_WINDOW_PARAM, DOWNLOAD_WINDOW_BITS);
+        url = windowUrl;
+    }
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .event_handler = download_event_handler,
+        .user_data = dl,
+    };
+    dl->client = esp_http_client_init(&config);
+    if (gzip) {
+        esp_http_client_set_header(dl->client, "Accept-Encoding", ACCEPT_ENCODING);
+    }
+
+    esp_err_t err = esp_http_client_open(dl->client, 0);
+    dl->length = (err == ESP_OK) ? esp_http_client_fetch_headers(dl->client) : -1;
+    dl->status = (err == ESP_OK) ? esp_http_client_get_status_code(dl->client) : 0;
+}
+
+
+// the body into sink, which sees exactly what an uncompressed answer would have carried
+static esp_err_t download_body( download_t *dl, gunzip_sink_t sink, void *ctx )
+{
+    char buf[SD_SECTOR];
+    gunzip_status_t st = GUNZIP_MORE;
+    int n;
+
+    if (dl->gzip) {
+        gunzip_init(&download_inflate, download_window, sizeof(download_window), sink, ctx);
+    }
+
+    while ((n = esp_http_client_read(dl->client, buf, sizeof(buf))) > 0)
+    {
+        dl->wire += (uint64_t)n;
+        if (!dl->gzip)
+        {
+            if (!sink(ctx, (const uint8_t *)buf, (size_t)n)) {
+                return ESP_FAIL;
+            }
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        st = gunzip_feed(&download_inflate, (const uint8_t *)buf, (size_t)n);
+        dl->inflateUs += esp_timer_get_time() - start;
+        if (st < 0) {
+            break;
+        }
+    }
+
+    if (n < 0) {
+        return ESP_FAIL;
+    }
+    if (dl->gzip && (dl->inflate = st = gunzip_finish(&download_inflate)) != GUNZIP_DONE)
+    {
+        ESP_LOGE(TAG, "gzip body does not inflate (%d)", (int)st);
+        return (st == GUNZIP_ERR_SINK) ? ESP_FAIL : ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+
+static void download_close( download_t *dl )
+{
+    esp_http_client_cleanup(dl->client);
+}
+
+
+static bool download_to_file(void *ctx, const uint8_t *data, size_t len)
+{
+    return sd_writer_write((sd_writer_t *)ctx, data, len) == ESP_OK;
+}
+
+
+
+// bring the ward roster on the card up to date: the server answers with 304, a delta from the
+// version the card has, or the whole roster; the file is streamed to dir and installed from there
+esp_err_t sync_ward_roster( const char *dir )
+{
+    char url[SERVER_URL_LEN];
+    char path[FILE_PATH_LEN];
+    sd_writer_t file;
+    download_t dl;
+
+    snprintf(url, sizeof(url), "%s/roster?have=%lu", SERVER_URL, (unsigned long)ward_roster_version());
+    snprintf(path, sizeof(path), "%s/%s", dir, WARD_ROSTER_DOWNLOAD);
+
+    esp_err_t err;
+    bool gzip = true;
+    for (;;)
+    {
+        download_open(&dl, url, gzip);
+
+        if (dl.status == 304)
+        {
+            ESP_LOGI(TAG, "ward roster %lu is current", (unsigned long)ward_roster_version());
+            download_close(&dl);
+            return ESP_OK;
+        }
+        if (dl.status != 200)
+        {
+            printf("Could not fetch the ward roster... status code was: %d\n", dl.status);
+            download_close(&dl);
+            return ESP_FAIL;
+        }
+
+        // straight to the card, the roster never has to fit in RAM; a gzip body has no size to
+        // preallocate for
+        err = sd_writer_open(&file, path, (dl.length > 0 && !dl.gzip) ? (uint64_t)dl.length : 0);
+        if (err == ESP_OK) {
+            err = download_body(&dl, download_to_file, &file);
+        }
+        if (file.fd >= 0 && sd_writer_close(&file) != ESP_OK) {
+            err = ESP_FAIL;
+        }
+        download_close(&dl);
+
+        // the server ignored the window asked for, the uncompressed body always reads
+        if (err != ESP_OK && gzip && dl.inflate == GUNZIP_ERR_WINDOW)
+        {
+            ESP_LOGW(TAG, "ward roster gzip needs more than a %d byte window, fetching it uncompressed",
+                     DOWNLOAD_WINDOW);
+            gzip = false;
+            continue;
+        }
+        break;
+    }
+    if (err == ESP_OK && dl.gzip) {
+        ESP_LOGI(TAG, "ward roster %lu bytes from %llu gzip", (unsigned long)gunzip_total_out(&download_inflate),
+                 (unsigned long long)dl.wire);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ward roster download failed");
+        unlink(path);
+        return err;
+    }
+    return ward_roster_install(path);
+}
+
+
+
+// ==== Lookup transport bench ======================= //
+
+// IPv4 + TCP header of one segment, no options
+#define TCP_IP_OVERHEAD         40
+// a connection per lookup: SYN, SYN-ACK, ACK, request, ACK, answer, ACK, FIN / ACK from each side
+#define TCP_SEGMENTS_PER_LOOKUP 10
+
+typedef struct {
+    uint32_t ok;
+    uint32_t us_min;
+    uint32_t us_max;
+    uint64_t us_sum;
+} bench_rtt_t;
+
+
+static void bench_rtt_add(bench_rtt_t *r, int64_t start)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    r->ok++;
+    r->us_sum += us;
+    r->us_min = (us < r->us_min) ? us : r->us_min;
+    r->us_max = (us > r->us_max) ? us : r->us_max;
+}
+
+
+// GET url into response_buffer, the HTTP status or -1; accept is optional
+static int http_get(const char *url, const char *accept)
+{
+    esp_http_client_config_t config = {
+        .url = url,
+        .event_handler = _http_event_handler,
+        .method = HTTP_METHOD_GET,
+    };
+
+    response_buffer[0] = '\0';
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (accept != NULL) {
+        esp_http_client_set_header(client, "Accept", accept);
+    }
+    esp_http_client_set_header(client, "Accept-Encoding", ACCEPT_ENCODING);
+    esp_err_t err = esp_http_client_perform(client);
+    int status_code = (err == ESP_OK) ? esp_http_client_get_status_code(client) : -1;
+    esp_http_client_cleanup(client);
+    return status_code;
+}
+
+
+// bytes the stand-in server counted on its HTTP lookups (GET /stats, tools/host_server.py), false
+// when the server does not count them
+static bool server_http_bytes(uint64_t *bytes)
+{
+    char url[SERVER_URL_LEN];
+    snprintf(url, sizeof(url), "%s/stats", SERVER_URL);
+    if (http_get(url, NULL) != 200) {
+        return false;
+    }
+
+    json_arena_init();
+    xSemaphoreTake(json_lock, portMAX_DELAY);
+    json_arena_reset();
+    cJSON *root = cJSON_Parse(response_buffer);
+    cJSON *rx = cJSON_GetObjectItem(root, "http_rx");
+    cJSON *tx = cJSON_GetObjectItem(root, "http_tx");
+    bool ok = cJSON_IsNumber(rx) && cJSON_IsNumber(tx);
+    if (ok) {
+        *bytes = (uint64_t)rx->valuedouble + (uint64_t)tx->valuedouble;
+    }
+    cJSON_Delete(root);
+    json_arena_reset();
+    xSemaphoreGive(json_lock);
+    return ok;
+}
+
+
+// the same patient looked up rounds times over HTTP (GET /patient?id=, a fresh connection each
+// time like the upload) and over UDP: round trip and bytes on air per lookup, headers included
+void lookup_transport_bench( const char *id, uint32_t rounds )
+{
+    char url[SERVER_URL_LEN];
+    patient_record_t rec;
+    bench_rtt_t http = { .us_min = UINT32_MAX };
+    bench_rtt_t udp = { .us_min = UINT32_MAX };
+    uint64_t before = 0;
+    uint64_t after = 0;
+
+    snprintf(url, sizeof(url), "%s/patient?id=%s", SERVER_URL, id);
+    bool counted = server_http_bytes(&before);
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        int64_t start = esp_timer_get_time();
+        if (http_get(url, PATIENT_ACCEPT) == 200 && parse_response(&rec)) {
+            bench_rtt_add(&http, start);
+        }
+    }
+    counted = counted && server_http_bytes(&after);
+
+    if (http.ok > 0)
+    {
+        uint64_t payload = counted ? (after - before) / http.ok : 0;
+        ESP_LOGI(TAG, "bench: http %lu of %lu, rtt avg %lu us (min %lu, max %lu); %lu bytes of HTTP + ~%u TCP/IP "
+                 "a lookup%s", (unsigned long)http.ok, (unsigned long)rounds,
+                 (unsigned long)(http.us_sum / http.ok), (unsigned long)http.us_min, (unsigned long)http.us_max,
+                 (unsigned long)payload, TCP_SEGMENTS_PER_LOOKUP * TCP_IP_OVERHEAD,
+                 counted ? "" : " (server does not count bytes)");
+    }
+    else {
+        ESP_LOGW(TAG, "bench: no http answers from %s", url);
+    }
+
+    if (!udp_lookup_is_ready())
+    {
+        ESP_LOGW(TAG, "bench: udp lookup not enabled");
+        return;
+    }
+
+    udp_lookup_stats_t st;
+    udp_lookup_reset_stats();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        int64_t start = esp_timer_get_time();
+        if (udp_lookup_patient(id, &rec) == ESP_OK) {
+            bench_rtt_add(&udp, start);
+        }
+    }
+    udp_lookup_get_stats(&st);
+
+    if (udp.ok > 0)
+    {
+        uint32_t datagrams = st.datagrams_tx + st.datagrams_rx;
+        ESP_LOGI(TAG, "bench: udp %lu of %lu, rtt avg %lu us (min %lu, max %lu); %lu bytes of payload + %lu IP/UDP "
+                 "a lookup, %lu retransmits, %lu timeouts", (unsigned long)udp.ok, (unsigned long)rounds,
+                 (unsigned long)(udp.us_sum / udp.ok), (unsigned long)udp.us_min, (unsigned long)udp.us_max,
+                 (unsigned long)((st.bytes_tx + st.bytes_rx) / udp.ok),
+                 (unsigned long)(datagrams * UDP_LOOKUP_IP_OVERHEAD / udp.ok),
+                 (unsigned long)st.retransmits, (unsigned long)st.timeouts);
+    }
+    else {
+        ESP_LOGW(TAG, "bench: no udp answers from %s:%u", LOOKUP_IP, LOOKUP_PORT);
+    }
+}
+
+
+
+// ==== Response format bench ======================= //
+
+#define FORMAT_BENCH_REPEATS    100     // decodes of each record, one is below the timer's resolution
+
+static const char *bench_first[] = { "John", "Maria", "Wei", "Aleksandra", "Oluwaseun", "Ana" };
+static const char *bench_last[] = { "Doe", "Garcia", "Zhang", "Kowalczyk", "Adeyemi", "Silva" };
+
+
+static void bench_patient( patient_record_t *rec, uint32_t i )
+{
+    memset(rec, 0, sizeof(*rec));
+    snprintf(rec->id, sizeof(rec->id), "MRN%06lu", (unsigned long)i);
+    snprintf(rec->f_name, sizeof(rec->f_name), "%s", bench_first[i % 6]);
+    snprintf(rec->l_name, sizeof(rec->l_name), "%s", bench_last[(i / 6) % 6]);
+    snprintf(rec->last_checkup_date, sizeof(rec->last_checkup_date), "2025-%02lu-%02lu",
+             (unsigned long)(1 + i % 12), (unsigned long)(1 + i % 28));
+    snprintf(rec->last_checkup_time, sizeof(rec->last_checkup_time), "%02lu:%02lu:00",
+             (unsigned long)(i % 24), (unsigned long)(i % 60));
+}
+
+
+// the answer as tools/host_server.py writes it (Python's json.dumps), field order included
+static size_t bench_json( const patient_record_t *rec, char *buf, size_t cap )
+{
+    int n = snprintf(buf, cap, "{\"f_name\": \"%s\", \"l_name\": \"%s\", \"last_checkup_date\": \"%s\", "
+                     "\"last_checkup_time\": \"%s\", \"patient_id\": \"%s\"}", rec->f_name, rec->l_name,
+                     rec->last_checkup_date, rec->last_checkup_time, rec->id);
+    return (n > 0 && (size_t)n < cap) ? (size_t)n : 0;
+}
+
+
+// integer keys like the server, or the field names
+static size_t bench_cbor( const patient_record_t *rec, bool named, uint8_t *buf, size_t cap )
+{
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, cap);
+    cbor_write_map(&w, PATIENT_FIELD_COUNT);
+    for (size_t f = 0; f < PATIENT_FIELD_COUNT; f++)
+    {
+        const char *value = (const char *)rec + patient_fields[f].offset;
+        if (named) {
+            cbor_write_text(&w, patient_fields[f].name, strlen(patient_fields[f].name));
+        }
+        else {
+            cbor_write_uint(&w, f + 1);
+        }
+        cbor_write_text(&w, value, strlen(value));
+    }
+    return cbor_writer_len(&w);
+}
+
+
+// the same records decoded from JSON (cJSON on its arena) and from CBOR: bytes on the wire and
+// decode time per record, every decode checked against the record it came from
+void response_format_bench( uint32_t records )
+{
+    char json[MAX_HTTP_OUTPUT_BUFFER];
+    uint8_t cbor[MAX_HTTP_OUTPUT_BUFFER];
+    patient_record_t rec;
+    patient_record_t out;
+    uint64_t jsonBytes = 0;
+    uint64_t cborBytes = 0;
+    uint64_t namedBytes = 0;
+    int64_t jsonUs = 0;
+    int64_t cborUs = 0;
+    uint32_t bad = 0;
+
+    json_arena_init();
+    json_arena_peak = 0;
+
+    for (uint32_t i = 0; i < records; i++)
+    {
+        bench_patient(&rec, i);
+        size_t jsonLen = bench_json(&rec, json, sizeof(json));
+        // named keys decode to the same record, only their size is reported
+        size_t namedLen = bench_cbor(&rec, true, cbor, sizeof(cbor));
+        namedBytes += namedLen;
+        bad += !cbor_patient(cbor, namedLen, &out) || (memcmp(&out, &rec, sizeof(rec)) != 0);
+
+        size_t cborLen = bench_cbor(&rec, false, cbor, sizeof(cbor));
+        jsonBytes += jsonLen;
+        cborBytes += cborLen;
+
+        int64_t t0 = esp_timer_get_time();
+        for (int k = 0; k < FORMAT_BENCH_REPEATS; k++) {
+            parse_patient(json, &out);
+        }
+        int64_t t1 = esp_timer_get_time();
+        bad += (memcmp(&out, &rec, sizeof(rec)) != 0);
+
+        for (int k = 0; k < FORMAT_BENCH_REPEATS; k++) {
+            cbor_patient(cbor, cborLen, &out);
+        }
+        int64_t t2 = esp_timer_get_time();
+        bad += (memcmp(&out, &rec, sizeof(rec)) != 0);
+
+        jsonUs += t1 - t0;
+        cborUs += t2 - t1;
+    }
+
+    if (records == 0 || cborUs == 0) {
+        return;
+    }
+    double decodes = (double)records * FORMAT_BENCH_REPEATS;
+    ESP_LOGI(TAG, "bench: %lu records, JSON %.1f bytes, CBOR %.1f bytes a record (%.0f%% smaller; %.1f with the "
+             "field names as keys)", (unsigned long)records, (double)jsonBytes / records,
+             (double)cborBytes / records, 100.0 - 100.0 * cborBytes / jsonBytes, (double)namedBytes / records);
+    ESP_LOGI(TAG, "bench: decode JSON %.0f ns (arena peak %u bytes), CBOR %.0f ns (nothing allocated) a record, "
+             "%.1fx; %lu mismatches", jsonUs * 1000.0 / decodes, (unsigned)json_arena_peak,
+             cborUs * 1000.0 / decodes, (double)jsonUs / cborUs, (unsigned long)bad);
+}
+
+
+
+// ==== Download encoding bench ======================= //
+
+static const uint32_t bench_payloads[] = { 10 * 1024, 100 * 1024, 1024 * 1024 };
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t hash;          // FNV-1a of everything the sink saw, the two encodings have to agree
+} bench_sink_t;
+
+
+static bool bench_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    bench_sink_t *b = (bench_sink_t *)ctx;
+    for (size_t i = 0; i < len; i++) {
+        b->hash = (b->hash ^ data[i]) * 16777619u;
+    }
+    b->bytes += len;
+    return true;
+}
+
+
+// one GET of url, encoding as the server picks when gzip is allowed; false when it did not arrive whole
+static bool bench_download(const char *url, bool gzip, download_t *dl, bench_sink_t *out, int64_t *us)
+{
+    out->bytes = 0;
+    out->hash = 2166136261u;
+
+    int64_t start = esp_timer_get_time();
+    download_open(dl, url, gzip);
+    bool ok = (dl->status == 200) && download_body(dl, bench_sink, out) == ESP_OK;
+    download_close(dl);
+    *us = esp_timer_get_time() - start;
+    return ok;
+}
+
+
+// roster-like text from the server, 10 KB to 1 MB, plain and gzip: bytes on the wire, wall time,
+// inflate throughput, and the RAM the inflater holds, which does not grow with the body
+void download_encoding_bench( uint32_t rounds )
+{
+    char url[SERVER_URL_LEN];
+    download_t dl;
+    bench_sink_t plain;
+    bench_sink_t inflated;
+    uint32_t bad = 0;
+
+    for (size_t i = 0; i < sizeof(bench_payloads) / sizeof(bench_payloads[0]); i++)
+    {
+        uint32_t bytes = bench_payloads[i];
+        uint64_t plainWire = 0;
+        uint64_t gzipWire = 0;
+        int64_t plainUs = 0;
+        int64_t gzipUs = 0;
+        int64_t inflateUs = 0;
+        uint32_t ok = 0;
+
+        snprintf(url, sizeof(url), "%s/payload?bytes=%lu", SERVER_URL, (unsigned long)bytes);
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            int64_t us;
+            int64_t gzUs;
+            uint64_t wire;
+            // the plain download is the reference the inflated one is checked against
+            if (!bench_download(url, false, &dl, &plain, &us) || plain.bytes != bytes || dl.gzip)
+            {
+                bad++;
+                continue;
+            }
+            wire = dl.wire;
+
+            // a round counts only with both legs, so the averages and the ratio share one divisor
+            if (!bench_download(url, true, &dl, &inflated, &gzUs) || !dl.gzip ||
+                inflated.bytes != plain.bytes || inflated.hash != plain.hash)
+            {
+                bad++;
+                continue;
+            }
+            plainWire += wire;
+            plainUs += us;
+            gzipWire += dl.wire;
+            gzipUs += gzUs;
+            inflateUs += dl.inflateUs;
+            ok++;
+        }
+
+        if (ok == 0)
+        {
+            ESP_LOGW(TAG, "bench: no %lu byte payloads from %s", (unsigned long)bytes, SERVER_URL);
+            continue;
+        }
+        ESP_LOGI(TAG, "bench: %7lu bytes: plain %llu on the wire in %.2f ms, gzip %llu (%.0f%%) in %.2f ms, "
+                 "inflating %.0f us (%.1f MB/s)", (unsigned long)bytes,
+                 (unsigned long long)(plainWire / ok), plainUs / 1000.0 / ok,
+                 (unsigned long long)(gzipWire / ok), 100.0 * gzipWire / plainWire, gzipUs / 1000.0 / ok,
+                 (double)inflateUs / ok, inflateUs ? (double)bytes * ok / inflateUs : 0.0);
+    }
+
+    // everything a download holds, whatever its size: holding the compressed body instead would
+    // take the largest one above on top of its output
+    ESP_LOGI(TAG, "bench: inflater RAM %u bytes (decoder %u, window %u, read buffer %u), %lu failed downloads",
+             (unsigned)(sizeof(download_inflate) + sizeof(download_window) + SD_SECTOR),
+             (unsigned)sizeof(download_inflate), (unsigned)sizeof(download_window), (unsigned)SD_SECTOR,
+             (unsigned long)bad);
+}
@@ -1,6 +1,13 @@
 
 esp_err_t init_wifi_comms();
+esp_err_t enable_udp_lookup();
+esp_err_t enable_mqtt_pager();
 //void test_http_request();
 esp_err_t send_image_to_server( camera_fb_t *fb );
+esp_err_t lookup_patient( camera_fb_t *fb, const char *qrId, int64_t scanStartUs );
+esp_err_t sync_ward_roster( const char *dir );
 esp_err_t http_ping_server(const char* url);
-void parse_json(const char *jsonString);
\ No newline at end of file
+void parse_json(const char *jsonString);
+void lookup_transport_bench( const char *id, uint32_t rounds );
+void response_format_bench( uint32_t records );
+void download_encoding_bench( uint32_t rounds );
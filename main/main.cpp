@@ -4,6 +4,7 @@
 
 // custom cpp libraries
 #include "rf_comms.h"
+#include "board_profile.h"     // C++ half has the constexpr pin checks, keep it out of extern "C"
 
 // extern c wrapper for original source code
 #ifdef __cplusplus
@@ -11,13 +12,21 @@ extern "C" {
 #endif
     #include <stdio.h>
     #include <string.h>
+    #include "sdkconfig.h"
 
     // including graphics libraries
     #include "u8g2.h"
+#if !CONFIG_IDF_TARGET_LINUX
     #include "u8g2_esp32_hal.h"
+#endif
 
     // including header files with all globals needed
     #include "sync_objects.h"
+    #include "latency_stats.h"
+    #include "dlog.h"
+    #include "mem_budget.h"
+    #include "msg_store.h"
+    #include "msg_log.h"
 
     // library used for JSON parsing
     #include "cJSON.h"
@@ -26,26 +35,46 @@ extern "C" {
     #include "esp_camera.h"
     #include "camera.h"
     #include "sd_card.h"
+    #include "sd_writer.h"
+    #include "sd_async.h"
+    #include "cap_archive.h"
+    #include "patient_cache.h"
+    #include "ward_roster.h"
+    #include "mqtt_pager.h"
 
     // custom code and wrappers
     #include "GUI_drivers.h"
+    #include "pocsag_bch.h"
+    #include "capcode_table.h"
+    #include "pulse_capture.h"
+#if !CONFIG_IDF_TARGET_LINUX
     #include "SPI_drivers.h"
+#endif
 
     // including FreeRTOS driver libraries
     #include "freertos/FreeRTOS.h"
     #include "freertos/task.h"
     #include "freertos/semphr.h"
     #include "driver/gpio.h"
+#if !CONFIG_IDF_TARGET_LINUX
     #include "driver/spi_master.h"
+#endif
     #include "esp_timer.h"
     #include "esp_log.h"
 
     // including UART libraries
+#if !CONFIG_IDF_TARGET_LINUX
     #include "driver/uart.h"
+#endif
 
     // including wifi comms code
     #include "wifi_comms.h"
 
+#if CONFIG_IDF_TARGET_LINUX
+    // synthetic pager traffic for the host build
+    #include "pager_traffic.h"
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,6 +85,47 @@ extern "C" {
 #define ENABLE_WIFI (1)
 #define ENABLE_UART (0)
 #define ENABLE_STAT (0)
+#define ENABLE_LATENCY (1)     // periodically dump the RF -> display latency histograms
+#define ENABLE_MEM_REPORT (1)  // static footprint per subsystem and heap state once every task is up
+#define ENABLE_RF_BENCH (0)    // time the codeword corrector, capcode matcher, message store and radio GPIO writes once at boot
+// page history on the SD card; off on the board while the card shares pins with display DC / camera XCLK
+#define ENABLE_MSG_LOG (CONFIG_IDF_TARGET_LINUX)
+#define ENABLE_LOG_BENCH (0)   // time SD log appends, index rebuild and page reads once at boot
+#define ENABLE_CAP_ARCHIVE (ENABLE_MSG_LOG)  // captures packed into segment files on the same card
+#define ENABLE_ARCHIVE_BENCH (0)   // archive vs one file per image, random reads, crash recovery
+#define ENABLE_ROSTER (ENABLE_MSG_LOG)   // ward roster on the card, brought up to date once wifi is up
+#define ENABLE_ROSTER_BENCH (0)    // roster index size, lookups and a delta merge for 10k patients
+#define ENABLE_SD_BENCH (0)    // SD throughput: stdio vs the sector aligned writer, synced appends, fsync cost
+#define ENABLE_ASYNC_BENCH (0) // the background SD writer vs writing inline from the caller
+#define ENABLE_SD_CARD (ENABLE_MSG_LOG || ENABLE_LOG_BENCH || ENABLE_SD_BENCH || ENABLE_CAP_ARCHIVE || \
+                        ENABLE_ARCHIVE_BENCH || ENABLE_ASYNC_BENCH || ENABLE_ROSTER || ENABLE_ROSTER_BENCH)
+#define ENABLE_CACHE_BENCH (0) // patient cache RAM / NVS / miss lookups and the hit rate of a simulated ward round
+#define ENABLE_UDP_LOOKUP (0)  // scans with a decoded band ask the server over UDP before uploading the image
+#define ENABLE_LOOKUP_BENCH (0)    // round trip and bytes on air of a lookup by id, HTTP vs UDP
+#define ENABLE_FORMAT_BENCH (0)    // patient answer size and decode time, JSON vs CBOR
+#define ENABLE_DOWNLOAD_BENCH (0)  // 10 KB - 1 MB downloads plain vs gzip: bytes, time, inflate rate and RAM
+// pages over WiFi from the MQTT broker as well, the radio's copies are deduplicated; esp-mqtt is only
+// built in with CONFIG_MQTT_PAGER_ENABLE (menuconfig: MQTT pager)
+#define ENABLE_MQTT (CONFIG_MQTT_PAGER_ENABLE)
+#define ENABLE_MQTT_BENCH (0)  // publish to delivery latency and pages/s through the broker
+#if ENABLE_MQTT_BENCH && !CONFIG_MQTT_PAGER_ENABLE
+#error "ENABLE_MQTT_BENCH needs CONFIG_MQTT_PAGER_ENABLE (menuconfig: MQTT pager)"
+#endif
+#define ENABLE_PULSE_BENCH (0) // edge-interrupt pulseIn vs the old polling loop, needs a spare pin
+#define PULSE_BENCH_PIN (BOARD_SPARE_GPIO)   // the bench drives it and reads it back
+#define ENABLE_SOAK (0)        // host build only: drive the fake radio with synthetic pages and report
+#define ENABLE_RECOVERY_CHECK (0)  // host build only: overrun / desync the receiver and time the recovery
+#define DLOG_BINARY (0)        // 1 = hot path logs leave as binary frames, decode with tools/dlog_decode.py
+
+#define STAT_PERIOD_MS (10000)
+
+#define MSG_QUEUE_LEN       (10)
+
+// stack sizes in bytes
+#define RADIO_TASK_STACK    (4096)
+#define DISPLAY_TASK_STACK  (4096)
+#define CAMERA_TASK_STACK   (6144)      // JPEG decoder and QR search on top of the HTTP upload
+#define HOST_TASK_STACK     (4096)
 
 
 static const char* TAG = "MAIN";
@@ -65,7 +135,20 @@ static const char* TAG = "MAIN";
 SemaphoreHandle_t   xMsgDisplaySem = NULL;
 QueueHandle_t       xMsgBufferQueue = NULL; 
 
+// everything that lives as long as the device is allocated here, not on the heap
+static StaticSemaphore_t    s_msgDisplaySemBuf;
+static StaticQueue_t        s_msgQueueBuf;
+static MEM_BULK_ATTR uint8_t s_msgQueueStorage[MSG_QUEUE_LEN * sizeof(rf_msg_t)];
+
+MEM_STATIC_TASK(s_radioTask, RADIO_TASK_STACK);
+MEM_STATIC_TASK(s_displayTask, DISPLAY_TASK_STACK);
+MEM_STATIC_TASK(s_cameraTask, CAMERA_TASK_STACK);
+#if CONFIG_IDF_TARGET_LINUX && (ENABLE_SOAK || ENABLE_RECOVERY_CHECK)
+MEM_STATIC_TASK(s_hostTask, HOST_TASK_STACK);
+#endif
+
 
+#if !CONFIG_IDF_TARGET_LINUX
 // ==== UART definitions ===================== //
 #define UART_PORT_NUM UART_NUM_0
 #define UART_BAUD_RATE 115200
@@ -79,9 +162,11 @@ uart_config_t uart_config = {
     .stop_bits = UART_STOP_BITS_1,
     .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
 };
+#endif
 
 
 // ==== Code for tracking the CPU load of tasks ==== // 
+#if ENABLE_STAT
 
 void calculateTaskCpuLoad(TaskHandle_t taskHandle, uint32_t totalElapsedTime) {
     TaskStatus_t taskStatus;
@@ -97,13 +182,14 @@ void printRunTimeStats() {
     vTaskGetRunTimeStats(statsBuffer);
     ESP_LOGV(TAG, "Task Run-Time Stats:\n%s", statsBuffer);
 }
+#endif
 
 
 // ==== Helper functions for the main loop ================ //
 esp_err_t init_sync_objects(void)
 {
     // init the msg buffer semaphore
-    xMsgDisplaySem = xSemaphoreCreateBinary();
+    xMsgDisplaySem = xSemaphoreCreateBinaryStatic(&s_msgDisplaySemBuf);
     if (xMsgDisplaySem == NULL)
     {
         ESP_LOGE(TAG, "Message display semaphore could not be created...\n ");
@@ -111,14 +197,20 @@ esp_err_t init_sync_objects(void)
     }
     xSemaphoreGive(xMsgDisplaySem);
 
+    // every page the radio accepts is kept here, the queue below only carries seq numbers
+    msg_store_init();
+
     // init the msg buffer queue
-    xMsgBufferQueue = xQueueCreate( 10, sizeof( char ) * 256 );
+    xMsgBufferQueue = xQueueCreateStatic( MSG_QUEUE_LEN, sizeof( rf_msg_t ), s_msgQueueStorage, &s_msgQueueBuf );
     if ( xMsgBufferQueue == NULL)
     {
         ESP_LOGE(TAG, "Message buffer queue could not be created...\n ");
         return ESP_FAIL;
     }
 
+    MEM_BUDGET_ADD(MAIN, s_msgQueueStorage, MEM_BULK_REGION);
+    MEM_BUDGET_ADD(MAIN, s_msgQueueBuf, MEM_REGION_DRAM);
+    MEM_BUDGET_ADD(MAIN, s_msgDisplaySemBuf, MEM_REGION_DRAM);
     return ESP_OK;
 }
 
@@ -128,9 +220,26 @@ extern "C" void app_main(void)
 {
     esp_log_level_set("*", ESP_LOG_VERBOSE);
 
+    // hot path logging goes through the deferred ring, started before any task can use it
+    dlog_set_level(ESP_LOG_VERBOSE);
+    dlog_init( DLOG_BINARY ? DLOG_OUTPUT_BINARY : DLOG_OUTPUT_TEXT );
+
     // needed to call for certain HALs
     gpio_install_isr_service(0);
 
+    // start every boot with empty latency histograms
+    latency_stats_reset();
+
+    #if ENABLE_RF_BENCH
+        pocsag_bch_bench(100000);
+        capcode_table_bench(100000);
+        msg_store_bench(100000);
+    #endif
+
+    #if ENABLE_PULSE_BENCH
+        pulse_capture_bench(PULSE_BENCH_PIN);
+    #endif
+
     // call fucntion to init all the synchronization objects needed
     esp_err_t initCheck = init_sync_objects();
     if ( initCheck != ESP_OK )
@@ -156,6 +265,10 @@ extern "C" void app_main(void)
     if (init_radio() == ESP_OK)
     {
         ESP_LOGI(TAG, "Radio has started!\n");
+
+        #if ENABLE_RF_BENCH
+            rf_gpio_bench(100000);
+        #endif
     }
     else {
         ESP_LOGE(TAG, "Radio couldnt start...\n");
@@ -172,16 +285,120 @@ extern "C" void app_main(void)
         abort();
     }
 
+    #if ENABLE_SD_CARD
+        // page history, the capture archive and the SD benches all live on the card
+        init_sd_card();
+
+        // card writes that should not hold up their caller go through the background writer
+        if ( sd_async_init() != ESP_OK )
+        {
+            ESP_LOGE(TAG, "SD writer task couldnt start...\n");
+        }
+
+        #if ENABLE_ASYNC_BENCH
+            sd_async_bench(SD_MOUNT_POINT);
+        #endif
+
+        #if ENABLE_SD_BENCH
+            sd_card_bench(SD_MOUNT_POINT, 1024 * 1024);
+        #endif
+
+        #if ENABLE_LOG_BENCH
+            msg_log_bench(SD_MOUNT_POINT, 5000);
+        #endif
+
+        #if ENABLE_ARCHIVE_BENCH
+            cap_archive_bench(SD_MOUNT_POINT, 200);
+        #endif
+
+        #if ENABLE_ROSTER_BENCH
+            ward_roster_bench(SD_MOUNT_POINT, 10000);
+        #endif
+
+        #if ENABLE_MSG_LOG
+            if ( msg_log_open(SD_MOUNT_POINT) == ESP_OK )
+            {
+                ESP_LOGI(TAG, "Message log is open!\n");
+            }
+            else {
+                ESP_LOGE(TAG, "Message log couldnt open, history is what is in RAM only...\n");
+            }
+        #endif
+
+        #if ENABLE_CAP_ARCHIVE
+            if ( cap_archive_open(SD_MOUNT_POINT) != ESP_OK )
+            {
+                ESP_LOGE(TAG, "Capture archive couldnt open, captures are not kept...\n");
+            }
+        #endif
+
+        #if ENABLE_ROSTER
+            // no roster yet is fine, the sync below fetches the whole thing
+            ward_roster_open(SD_MOUNT_POINT);
+        #endif
+    #endif
+
     #if ENABLE_WIFI
         // init wifi
         if ( init_wifi_comms() == ESP_OK )
         {
             ESP_LOGI(TAG, "Wifi has started!\n");
+        #if ENABLE_MEM_REPORT
+            // what is left for the camera's frames and the QR decode once the WiFi heap is taken
+            mem_budget_heap("after WiFi");
+        #endif
         }
         else {
             ESP_LOGE(TAG, "Wifi couldnt start...\n");
             abort();
         }
+
+        #if ENABLE_ROSTER
+            // before the camera task starts, it is the only one looking up
+            if ( sync_ward_roster(SD_MOUNT_POINT) != ESP_OK )
+            {
+                ESP_LOGE(TAG, "Ward roster not updated, scans use what is on the card...\n");
+            }
+        #endif
+
+        #if ENABLE_CACHE_BENCH
+            // after init_wifi_comms(), which brings up NVS; a ward of 24 beds
+            patient_cache_bench(24, 1000);
+        #endif
+
+        #if ENABLE_UDP_LOOKUP || ENABLE_LOOKUP_BENCH
+            if ( enable_udp_lookup() != ESP_OK )
+            {
+                ESP_LOGE(TAG, "UDP lookup unavailable, scans upload the image...\n");
+            }
+        #endif
+
+        #if ENABLE_LOOKUP_BENCH
+            // a patient the stand-in server knows, tools/host_server.py answers any id without --roster
+            lookup_transport_bench("MRN000001", 200);
+        #endif
+
+        #if ENABLE_FORMAT_BENCH
+            response_format_bench(1000);
+        #endif
+
+        #if ENABLE_DOWNLOAD_BENCH
+            // tools/host_server.py serves the payloads
+            download_encoding_bench(5);
+        #endif
+
+        #if ENABLE_MQTT || ENABLE_MQTT_BENCH
+            // the radio has been up since init_radio(), this is a second way in
+            if ( enable_mqtt_pager() != ESP_OK )
+            {
+                ESP_LOGE(TAG, "MQTT pages unavailable, radio only...\n");
+            }
+        #endif
+
+        #if ENABLE_MQTT_BENCH
+            // 40 characters is a typical ward page
+            mqtt_pager_bench(1000, 40);
+        #endif
     #endif
 
 
@@ -207,15 +424,36 @@ extern "C" void app_main(void)
 
 
     //--- CREATING TASKS --- //
-    xTaskCreate( poll_radio, "RadioTask", 4096, NULL, 5, NULL);
-    xTaskCreate( displayLoop, "DisplayTask", 4096, NULL, 10, NULL);
-    xTaskCreate( camera_button_poll, "CameraTask", 4096, NULL, 5, NULL);
+    // static stacks and TCBs, these can not fail once the image links
+    TaskHandle_t radioTask = xTaskCreateStatic( poll_radio, "RadioTask", MEM_STACK_DEPTH(RADIO_TASK_STACK), NULL, 5,
+                                                s_radioTask_stack, &s_radioTask_tcb);
+    TaskHandle_t displayTask = xTaskCreateStatic( displayLoop, "DisplayTask", MEM_STACK_DEPTH(DISPLAY_TASK_STACK), NULL, 10,
+                                                  s_displayTask_stack, &s_displayTask_tcb);
+    TaskHandle_t cameraTask = xTaskCreateStatic( camera_button_poll, "CameraTask", MEM_STACK_DEPTH(CAMERA_TASK_STACK), NULL, 5,
+                                                 s_cameraTask_stack, &s_cameraTask_tcb);
+    MEM_BUDGET_ADD_TASK(MAIN, s_radioTask, radioTask);
+    MEM_BUDGET_ADD_TASK(MAIN, s_displayTask, displayTask);
+    MEM_BUDGET_ADD_TASK(MAIN, s_cameraTask, cameraTask);
 
     //xTaskCreate( receive_transmission, "receive loop task", 3072, NULL, 1, NULL);
 
-    #if ENABLE_STAT
+    #if CONFIG_IDF_TARGET_LINUX && ENABLE_SOAK
+        // default ward profile, length set by HOST_SOAK_SECONDS, compress it with HOST_RF_SPEEDUP
+        xTaskCreateStatic( pager_soak_task, "PagerSoak", MEM_STACK_DEPTH(HOST_TASK_STACK), NULL, 2,
+                           s_hostTask_stack, &s_hostTask_tcb);
+    #elif CONFIG_IDF_TARGET_LINUX && ENABLE_RECOVERY_CHECK
+        xTaskCreateStatic( pager_recovery_task, "PagerRecovery", MEM_STACK_DEPTH(HOST_TASK_STACK), NULL, 2,
+                           s_hostTask_stack, &s_hostTask_tcb);
+    #endif
+
+    #if ENABLE_MEM_REPORT
+        mem_budget_report();
+    #endif
+
+    #if ENABLE_STAT || ENABLE_LATENCY
         for (;;)
         {
+        #if ENABLE_STAT
             // Calculate CPU load for each task
             uint32_t totalElapsedTime = (uint32_t)esp_timer_get_time();
             
@@ -225,7 +463,33 @@ extern "C" void app_main(void)
             // calculateTaskCpuLoad(xTaskGetHandle("CameraTask"), totalElapsedTime);
             printRunTimeStats();
             printf("\n");
-            vTaskDelay(pdMS_TO_TICKS(10000));
+        #endif
+
+        #if ENABLE_STAT && ENABLE_SD_CARD
+            sd_async_stats_t sdStats;
+            sd_async_get_stats(&sdStats);
+            ESP_LOGI(TAG, "SD writer: queue %lu (max %lu), %lu B/s, worst write %lu us, worst caller stall %lu us, "
+                     "%lu errors", (unsigned long)sdStats.queue_depth, (unsigned long)sdStats.queue_depth_max,
+                     (unsigned long)sdStats.bytes_per_s, (unsigned long)sdStats.write_us_max,
+                     (unsigned long)sdStats.stall_us_max, (unsigned long)sdStats.errors);
+        #endif
+
+        #if ENABLE_STAT && ENABLE_WIFI
+            // hit rate and scan to display latency, hits vs uploads
+            patient_cache_log_stats();
+        #endif
+
+        #if ENABLE_STAT && ENABLE_MQTT
+            mqtt_pager_log_stats();
+        #endif
+
+        #if ENABLE_LATENCY
+            // keep accumulating so the percentiles cover the whole run, call
+            // latency_stats_reset() (or dump with true) to start a fresh window
+            latency_stats_dump(false);
+            rf_stats_dump();
+        #endif
+            vTaskDelay(pdMS_TO_TICKS(STAT_PERIOD_MS));
         }
     #endif
 
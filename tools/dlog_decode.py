@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+Decode the binary frames written by the dlog drain task (DLOG_OUTPUT_BINARY).
+
+The format strings are read straight from components/dlog/dlog_fmt.h so the decoder
+always matches the firmware it was checked out with. Anything on the serial stream
+that is not a dlog frame (normal ESP_LOG output, boot messages) is passed through.
+
+usage:
+    idf.py monitor | python tools/dlog_decode.py
+    python tools/dlog_decode.py capture.bin
+    python tools/dlog_decode.py --port /dev/ttyUSB0 --baud 115200      (needs pyserial)
+"""
+
+import argparse
+import os
+import re
+import sys
+
+SYNC0 = 0xD1
+SYNC1 = 0x06
+MAX_ARGS = 4
+
+LEVEL_CHARS = {
+    "ESP_LOG_NONE": "N",
+    "ESP_LOG_ERROR": "E",
+    "ESP_LOG_WARN": "W",
+    "ESP_LOG_INFO": "I",
+    "ESP_LOG_DEBUG": "D",
+    "ESP_LOG_VERBOSE": "V",
+}
+
+ENTRY_RE = re.compile(r'X\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+CONV_RE = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t)?([diouxXc%])")
+
+DEFAULT_TABLE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "..", "components", "dlog", "dlog_fmt.h")
+
+
+def load_table(path):
+    """returns a list of (name, level char, tag, fmt) in id order"""
+    with open(path, "r") as f:
+        text = f.read()
+    table = []
+    for m in ENTRY_RE.finditer(text):
+        name, level, tag, fmt = m.groups()
+        fmt = bytes(fmt, "utf-8").decode("unicode_escape")
+        table.append((name, LEVEL_CHARS.get(level, "?"), tag, fmt))
+    return table
+
+
+def format_record(fmt, args):
+    """apply a C printf format to 32-bit raw args, the same way the drain task would"""
+    it = iter(args + [0] * MAX_ARGS)
+
+    def repl(m):
+        flags, conv = m.group(1), m.group(2)
+        if conv == "%":
+            return "%"
+        value = next(it)
+        if conv in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+        elif conv == "c":
+            return chr(value & 0xFF)
+        return ("%" + flags + conv) % value
+
+    return CONV_RE.sub(repl, fmt)
+
+
+def decode_stream(data, table, out):
+    """decode a byte string, returns the number of bytes consumed"""
+    i = 0
+    text_start = 0
+    n = len(data)
+    while i + 1 < n:
+        if data[i] != SYNC0 or data[i + 1] != SYNC1:
+            i += 1
+            continue
+
+        if i + 5 > n:
+            break
+        nargs = data[i + 2] & 0x0F
+        core = data[i + 2] >> 4
+        frame_len = 5 + 4 + 4 * nargs + 1
+        if nargs > MAX_ARGS:
+            i += 1
+            continue
+        if i + frame_len > n:
+            break
+
+        frame = data[i:i + frame_len]
+        check = 0
+        for b in frame[:-1]:
+            check ^= b
+        if check != frame[-1]:
+            i += 1
+            continue
+
+        # flush any plain text that came before this frame
+        out.write(data[text_start:i].decode("utf-8", errors="replace"))
+
+        rec_id = frame[3] | (frame[4] << 8)
+        ts = int.from_bytes(frame[5:9], "little")
+        args = [int.from_bytes(frame[9 + 4 * a:13 + 4 * a], "little") for a in range(nargs)]
+
+        if rec_id < len(table):
+            name, level, tag, fmt = table[rec_id]
+            msg = format_record(fmt, args)
+        else:
+            level, tag, msg = "?", "DLOG", "unknown id %d args %s" % (rec_id, args)
+        out.write("%s (%d.%03d) [cpu%d] %s: %s\n" % (level, ts // 1000000, (ts // 1000) % 1000, core, tag, msg))
+
+        i += frame_len
+        text_start = i
+
+    # keep a possible partial frame for the next chunk
+    if text_start < i:
+        out.write(data[text_start:i].decode("utf-8", errors="replace"))
+    return i
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?", help="binary capture file (default: stdin)")
+    parser.add_argument("--table", default=DEFAULT_TABLE, help="path to dlog_fmt.h")
+    parser.add_argument("--port", help="read directly from a serial port")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    table = load_table(args.table)
+
+    if args.port:
+        import serial
+        src = serial.Serial(args.port, args.baud, timeout=0.1)
+        read = lambda: src.read(4096)
+    elif args.capture:
+        src = open(args.capture, "rb")
+        read = lambda: src.read(4096)
+    else:
+        src = sys.stdin.buffer
+        read = lambda: src.read1(4096)
+
+    pending = b""
+    while True:
+        chunk = read()
+        if not chunk:
+            if args.port:
+                continue
+            break
+        pending += chunk
+        used = decode_stream(pending, table, sys.stdout)
+        pending = pending[used:]
+        sys.stdout.flush()
+
+    if pending:
+        sys.stdout.write(pending.decode("utf-8", errors="replace"))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,338 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the Flask server, for the linux host build (idf.py --preview set-target linux).
+
+Answers POST /upload_image the way the real server does after a good QR code: a small JSON
+object with the patient fields parse_json() reads. Every uploaded image is kept in --save-dir
+so a run can be checked afterwards. An image smaller than --min-bytes gets the error answer,
+which is how the "bad QR" path can be exercised.
+
+The answer carries "patient_id", the device caches the record under it. A device that read the
+wristband itself sends the id in an X-Patient-Id header and gets it back, otherwise --patient-id
+stands in for the decoded QR code.
+
+GET /roster?have=N serves the ward roster from --roster (CSV, see tools/roster_build.py): 304 when
+the device is on the current version, a delta when the server still has the device's version,
+the full roster otherwise. Editing the CSV while the server runs makes a new version.
+
+Patient lookups by id (components/udp_lookup) are answered on --udp-port, and the same lookup over
+HTTP on GET /patient?id=, from the roster when there is one, otherwise any id gets the stand-in
+patient. --udp-drop drops that fraction of the UDP requests to exercise the device's retransmits.
+GET /stats reports the bytes of every HTTP lookup, request and answer with their headers, so the
+device can compare the two transports.
+
+A request whose Accept names application/cbor gets its patient answers (/upload_image, /patient)
+in CBOR instead of JSON: a map keyed by the field's place in PATIENT_KEYS, the order of
+patient_fields[] in wifi_comms.c. Errors stay JSON.
+
+A request with "Accept-Encoding: gzip" gets any body of --gzip-min bytes or more gzip compressed,
+with a window of 2^--gzip-window bytes (32 KiB by default, like zlib anywhere else), or less when
+the query asks for gzip_window=N: the device inflates with a 2^N window (DOWNLOAD_WINDOW in
+wifi_comms.c) and turns down anything reaching further back. --gzip-ignore-window leaves the
+parameter unread, the way a server that does not know it would, and the device then fetches the
+roster again uncompressed. GET /payload?bytes=N is N bytes of roster-like CSV text for the
+device's download bench.
+
+usage:
+    python tools/host_server.py
+    python tools/host_server.py --port 5000 --save-dir host_out/uploads --min-bytes 1024 --patient-id MRN000042
+    python tools/host_server.py --roster host_data/ward.csv
+    python tools/host_server.py --udp-port 5001 --udp-drop 0.1
+    python tools/host_server.py --gzip-min 256 --gzip-window 15 --gzip-ignore-window
+"""
+
+import argparse
+import json
+import os
+import random
+import socket
+import struct
+import threading
+import time
+import zlib
+from http.server import BaseHTTPRequestHandler, HTTPServer
+from urllib.parse import parse_qs, urlparse
+
+import roster_build
+
+PATIENT = {
+    "f_name": "John",
+    "l_name": "Doe",
+    "last_checkup_date": "2025-01-01",
+    "last_checkup_time": "14:30:00",
+}
+
+# CBOR map keys of a patient answer, 1 = the first one; wifi_comms.c patient_fields[]
+PATIENT_KEYS = ("patient_id", "f_name", "l_name", "last_checkup_date", "last_checkup_time")
+CBOR_TYPE = "application/cbor"
+
+
+def cbor_head(major, n):
+    if n < 24:
+        return bytes([(major << 5) | n])
+    for ai, fmt in ((24, ">B"), (25, ">H"), (26, ">I"), (27, ">Q")):
+        if n < 1 << (8 * struct.calcsize(fmt)):
+            return bytes([(major << 5) | ai]) + struct.pack(fmt, n)
+    raise ValueError(n)
+
+
+def cbor_patient(patient):
+    """the CBOR answer for a patient, fields other than PATIENT_KEYS are left out"""
+    items = [(i + 1, str(patient[k]).encode()) for i, k in enumerate(PATIENT_KEYS) if k in patient]
+    out = bytearray(cbor_head(5, len(items)))
+    for key, value in items:
+        out += cbor_head(0, key) + cbor_head(3, len(value)) + value
+    return bytes(out)
+
+
+def payload(n, cache={}):
+    """n bytes of ward roster style CSV, the same bytes every time"""
+    if n not in cache:
+        rng = random.Random(n)
+        first = ("John", "Maria", "Wei", "Aleksandra", "Oluwaseun", "Ana", "Priya", "Tomasz")
+        last = ("Doe", "Garcia", "Zhang", "Kowalczyk", "Adeyemi", "Silva", "Patel", "Novak")
+        rows, size, i = [], 0, 0
+        while size < n:
+            row = "MRN%06d,%s,%s,2025-%02d-%02d,%02d:%02d:00\n" % (
+                i, rng.choice(first), rng.choice(last), rng.randint(1, 12), rng.randint(1, 28),
+                rng.randint(0, 23), rng.randint(0, 59))
+            rows.append(row)
+            size += len(row)
+            i += 1
+        cache[n] = "".join(rows).encode()[:n]
+    return cache[n]
+
+
+class Roster:
+    """every version of the CSV seen while the server runs, the newest is served"""
+
+    def __init__(self, path):
+        self.path = path
+        self.mtime = None
+        self.versions = {}
+        self.version = 0
+        self.lock = threading.Lock()    # the UDP thread reads it too
+
+    def current(self):
+        with self.lock:
+            mtime = os.path.getmtime(self.path)
+            if mtime != self.mtime:
+                self.mtime = mtime
+                self.version += 1
+                self.versions[self.version] = roster_build.load_csv(self.path)
+            return self.version
+
+    def file_for(self, have):
+        version = self.current()
+        if have == version:
+            return None
+        if have in self.versions:
+            return roster_build.delta(self.versions[have], self.versions[version], version, have)
+        return roster_build.full(self.versions[version], version)
+
+
+# UDP lookup datagrams, udp_lookup.h
+LOOKUP_HEADER = struct.Struct("<2sBBI")
+LOOKUP_MAGIC = b"PL"
+LOOKUP_VERSION = 1
+LOOKUP_REQUEST = 0x01
+LOOKUP_FOUND = 0x81
+LOOKUP_NOT_FOUND = 0x82
+LOOKUP_ERROR = 0x83
+
+
+def find_patient(roster, pid):
+    """fields of patient pid, None when the roster does not have it"""
+    if not pid:
+        return None
+    if roster is None:
+        return dict(PATIENT, patient_id=pid)
+    return roster.versions[roster.current()].get(pid)
+
+
+def serve_udp(args, roster):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.host, args.udp_port))
+    print("udp lookups on %s:%d" % (args.host, args.udp_port))
+    while True:
+        data, peer = sock.recvfrom(512)
+        if len(data) < LOOKUP_HEADER.size:
+            continue
+        magic, version, kind, seq = LOOKUP_HEADER.unpack_from(data)
+        if magic != LOOKUP_MAGIC or kind != LOOKUP_REQUEST:
+            continue
+        if random.random() < args.udp_drop:
+            continue
+
+        if version != LOOKUP_VERSION:
+            reply = LOOKUP_HEADER.pack(LOOKUP_MAGIC, LOOKUP_VERSION, LOOKUP_ERROR, seq)
+        else:
+            patient = find_patient(roster, data[LOOKUP_HEADER.size:].decode(errors="replace"))
+            if patient is None:
+                reply = LOOKUP_HEADER.pack(LOOKUP_MAGIC, version, LOOKUP_NOT_FOUND, seq)
+            else:
+                reply = LOOKUP_HEADER.pack(LOOKUP_MAGIC, version, LOOKUP_FOUND, seq) + roster_build.record_bytes(patient)
+        sock.sendto(reply, peer)
+
+
+class Counted:
+    """file wrapper counting the bytes through it"""
+
+    def __init__(self, raw):
+        self.raw = raw
+        self.bytes = 0
+
+    def read(self, *a):
+        data = self.raw.read(*a)
+        self.bytes += len(data)
+        return data
+
+    def readline(self, *a):
+        data = self.raw.readline(*a)
+        self.bytes += len(data)
+        return data
+
+    def write(self, data):
+        self.bytes += len(data)
+        return self.raw.write(data)
+
+    def __getattr__(self, name):
+        return getattr(self.raw, name)
+
+
+def make_handler(args, roster):
+    stats = {"http_lookups": 0, "http_rx": 0, "http_tx": 0}
+
+    class Handler(BaseHTTPRequestHandler):
+        uploads = 0
+
+        def setup(self):
+            super().setup()
+            self.rfile = Counted(self.rfile)
+            self.wfile = Counted(self.wfile)
+
+        def finish(self):
+            if getattr(self, "path", "").startswith("/patient"):
+                stats["http_lookups"] += 1
+                stats["http_rx"] += self.rfile.bytes
+                stats["http_tx"] += self.wfile.bytes
+            super().finish()
+
+        def do_GET(self):
+            url = urlparse(self.path)
+            if url.path == "/patient":
+                patient = find_patient(roster, parse_qs(url.query).get("id", [""])[0])
+                if patient is None:
+                    self._reply(404, {"error": "unknown patient"})
+                else:
+                    self._reply_patient(patient)
+                return
+            if url.path == "/stats":
+                self._reply(200, stats)
+                return
+            if url.path == "/payload":
+                n = int(parse_qs(url.query).get("bytes", ["0"])[0])
+                self._send(200, payload(n), "text/csv")
+                return
+            if url.path != "/roster" or roster is None:
+                self.send_error(404)
+                return
+
+            have = int(parse_qs(url.query).get("have", ["0"])[0])
+            data = roster.file_for(have)
+            if data is None:
+                self.send_response(304)
+                self.end_headers()
+                return
+
+            self._send(200, data, "application/octet-stream")
+
+        def do_POST(self):
+            if self.path != "/upload_image":
+                self.send_error(404)
+                return
+
+            length = int(self.headers.get("Content-Length", "0"))
+            body = self.rfile.read(length) if length > 0 else b""
+
+            Handler.uploads += 1
+            if args.save_dir:
+                os.makedirs(args.save_dir, exist_ok=True)
+                name = os.path.join(args.save_dir, "upload_%04d.jpg" % Handler.uploads)
+                with open(name, "wb") as f:
+                    f.write(body)
+
+            if len(body) < args.min_bytes:
+                self._reply(600, {"error": "invalid qr code"})
+            else:
+                patient = dict(PATIENT, patient_id=self.headers.get("X-Patient-Id") or args.patient_id)
+                self._reply_patient(patient)
+
+        def _reply_patient(self, patient):
+            if CBOR_TYPE in self.headers.get("Accept", ""):
+                self._reply(200, patient, cbor_patient(patient), CBOR_TYPE)
+            else:
+                self._reply(200, patient)
+
+        def _reply(self, status, obj, data=None, ctype="application/json"):
+            if data is None:
+                data = json.dumps(obj).encode()
+            self._send(status, data, ctype)
+
+        def _send(self, status, data, ctype):
+            gzip = "gzip" in self.headers.get("Accept-Encoding", "") and len(data) >= args.gzip_min
+            if gzip:
+                z = zlib.compressobj(6, zlib.DEFLATED, 16 + self._gzip_window())
+                data = z.compress(data) + z.flush()
+            self.send_response(status)
+            self.send_header("Content-Type", ctype)
+            if gzip:
+                self.send_header("Content-Encoding", "gzip")
+            self.send_header("Content-Length", str(len(data)))
+            self.end_headers()
+            self.wfile.write(data)
+
+        def _gzip_window(self):
+            wbits = args.gzip_window
+            asked = parse_qs(urlparse(self.path).query).get("gzip_window", [""])[0]
+            if asked.isdigit() and not args.gzip_ignore_window:
+                wbits = max(9, min(wbits, int(asked)))
+            return wbits
+
+        def log_message(self, fmt, *fargs):
+            print("%s %s" % (time.strftime("%H:%M:%S"), fmt % fargs))
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=5000)
+    parser.add_argument("--save-dir", default="host_out/uploads")
+    parser.add_argument("--min-bytes", type=int, default=1)
+    parser.add_argument("--patient-id", default="MRN000001")
+    parser.add_argument("--roster", help="ward roster CSV served on GET /roster")
+    parser.add_argument("--udp-port", type=int, default=5001, help="patient lookups by id, 0 turns them off")
+    parser.add_argument("--udp-drop", type=float, default=0.0, help="fraction of UDP requests dropped")
+    parser.add_argument("--gzip-min", type=int, default=256, help="smallest body sent gzip when the device takes it")
+    parser.add_argument("--gzip-window", type=int, default=15, choices=range(9, 16),
+                        help="log2 of the deflate window when the request does not ask for less")
+    parser.add_argument("--gzip-ignore-window", action="store_true",
+                        help="do not honour gzip_window=N in the query, like a server that does not know it")
+    args = parser.parse_args()
+
+    roster = Roster(args.roster) if args.roster else None
+    if args.udp_port:
+        threading.Thread(target=serve_udp, args=(args, roster), daemon=True).start()
+
+    server = HTTPServer((args.host, args.port), make_handler(args, roster))
+    print("host server on http://%s:%d" % (args.host, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Static RAM per component, read from the linker map and checked against the budgets in
+components/mem_budget/mem_budget.h.
+
+Every input section in the map is charged to the archive it came from, MEM_BUDGET_<NAME> is
+matched against lib<name>.a (case does not matter). Only internal DRAM (.dram0.data/.bss) and
+PSRAM (.ext_ram.bss) count against a budget, IRAM and flash are listed for reference.
+The build runs this after every link (see the top level CMakeLists.txt) and fails when a
+component is over its budget.
+
+usage:
+    python tools/mem_budget.py build/MD_Vision.map
+    python tools/mem_budget.py build/MD_Vision.map --all        (every archive, not only budgeted ones)
+"""
+
+import argparse
+import os
+import re
+import sys
+
+BUDGET_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "..", "components", "mem_budget", "mem_budget.h")
+
+# output section prefix -> region
+REGIONS = [
+    (".dram0.", "dram"),
+    (".ext_ram.", "psram"),
+    (".iram0.", "iram"),
+    (".flash.", "flash"),
+]
+RAM_REGIONS = ("dram", "psram")
+
+OUTPUT_SECTION = re.compile(r"^(\.[\w.]+)")
+# "<name> 0xADDR 0xSIZE path/libX.a(obj)", the name can be on the line before
+INPUT_SECTION = re.compile(r"^\s+(?:\S+\s+)?0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S+?\.a)\(")
+BUDGET_DEFINE = re.compile(r"^#define\s+MEM_BUDGET_(\w+)\s+\((\d+)\s*\*\s*1024\)|^#define\s+MEM_BUDGET_(\w+)\s+\(?(\d+)\)?")
+
+
+def load_budgets(path):
+    budgets = {}
+    with open(path) as f:
+        for line in f:
+            m = BUDGET_DEFINE.match(line)
+            if not m:
+                continue
+            if m.group(1):
+                budgets[m.group(1).lower()] = int(m.group(2)) * 1024
+            elif m.group(3) != "MAX_OBJECTS":
+                budgets[m.group(3).lower()] = int(m.group(4))
+    return budgets
+
+
+def region_of(section):
+    for prefix, region in REGIONS:
+        if section.startswith(prefix):
+            return region
+    return None
+
+
+def parse_map(path):
+    usage = {}      # archive -> region -> bytes
+    region = None
+    in_map = False
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+
+            m = OUTPUT_SECTION.match(line)
+            if m:
+                region = region_of(m.group(1))
+                continue
+            if region is None:
+                continue
+
+            m = INPUT_SECTION.match(line)
+            if not m:
+                continue
+            size = int(m.group(1), 16)
+            if size == 0:
+                continue
+            archive = os.path.basename(m.group(2))
+            name = archive[3:-2] if archive.startswith("lib") else archive[:-2]
+            per = usage.setdefault(name.lower(), {})
+            per[region] = per.get(region, 0) + size
+
+    return usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map file (build/<project>.map)")
+    parser.add_argument("--budgets", default=BUDGET_HEADER, help="header with the MEM_BUDGET_* defines")
+    parser.add_argument("--all", action="store_true", help="list every archive with RAM in use")
+    args = parser.parse_args()
+
+    budgets = load_budgets(args.budgets)
+    usage = parse_map(args.map)
+    if not usage:
+        print("mem_budget: no sections found in %s" % args.map, file=sys.stderr)
+        return 1
+
+    names = sorted(budgets)
+    if args.all:
+        names += sorted(n for n in usage if n not in budgets and any(usage[n].get(r) for r in RAM_REGIONS))
+
+    over = []
+    print("%-20s %8s %8s %8s %8s %10s" % ("component", "dram", "psram", "iram", "flash", "budget"))
+    for name in names:
+        per = usage.get(name, {})
+        ram = sum(per.get(r, 0) for r in RAM_REGIONS)
+        budget = budgets.get(name)
+
+        if budget is None:
+            verdict = ""
+        elif ram > budget:
+            verdict = "OVER"
+            over.append(name)
+        else:
+            verdict = "%d%%" % (ram * 100 // budget)
+
+        print("%-20s %8d %8d %8d %8d %10s %s" % (name, per.get("dram", 0), per.get("psram", 0),
+                                                  per.get("iram", 0), per.get("flash", 0),
+                                                  budget if budget is not None else "-", verdict))
+
+    totals = {r: sum(per.get(r, 0) for per in usage.values()) for r in ("dram", "psram", "iram", "flash")}
+    print("%-20s %8d %8d %8d %8d" % ("(whole image)", totals["dram"], totals["psram"], totals["iram"], totals["flash"]))
+
+    if over:
+        print("mem_budget: over budget: %s, see components/mem_budget/mem_budget.h" % ", ".join(over), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
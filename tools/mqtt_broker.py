@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""
+Stand-in MQTT broker for the host build (components/mqtt_pager), MQTT 3.1.1 over plain TCP.
+
+Just what the pager uses: QoS 0 and 1, persistent sessions (clean session off keeps the
+subscriptions and queues QoS 1 messages while the client is away, unacknowledged ones are sent
+again with DUP set when it comes back), + and # wildcards, keep-alive pings. No retained
+messages, wills or authentication.
+
+--page publishes a page to pager/page/<capcode> every --every seconds, the way the paging server
+would; several --page options take turns.
+
+usage:
+    python tools/mqtt_broker.py
+    python tools/mqtt_broker.py --port 1883 --page 1234567:"Bed 4 needs assistance" --every 5
+"""
+
+import argparse
+import collections
+import itertools
+import socket
+import struct
+import threading
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, UNSUBSCRIBE, UNSUBACK = 8, 9, 10, 11
+PINGREQ, PINGRESP, DISCONNECT = 12, 13, 14
+
+
+def log(text):
+    print("%s %s" % (time.strftime("%H:%M:%S"), text), flush=True)
+
+
+def encode_length(n):
+    out = bytearray()
+    while True:
+        byte = n % 128
+        n //= 128
+        out.append(byte | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def packet(kind, flags, body):
+    return bytes([(kind << 4) | flags]) + encode_length(len(body)) + body
+
+
+def string(text):
+    data = text.encode()
+    return struct.pack(">H", len(data)) + data
+
+
+def read_string(data, pos):
+    (n,) = struct.unpack_from(">H", data, pos)
+    return data[pos + 2:pos + 2 + n].decode(errors="replace"), pos + 2 + n
+
+
+def matches(pattern, topic):
+    p = pattern.split("/")
+    t = topic.split("/")
+    for i, level in enumerate(p):
+        if level == "#":
+            return True
+        if i >= len(t) or (level != "+" and level != t[i]):
+            return False
+    return len(p) == len(t)
+
+
+class Session:
+    def __init__(self, client_id, clean):
+        self.client_id = client_id
+        self.clean = clean
+        self.subs = {}                      # filter -> granted qos
+        self.queue = collections.deque()    # (topic, payload, qos) held while offline
+        self.inflight = {}                  # packet id -> (topic, payload), QoS 1 not acked yet
+        self.ids = itertools.cycle(range(1, 65536))
+        self.conn = None
+
+
+class Broker:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.sessions = {}
+        self.stats = collections.Counter()
+
+    def publish(self, topic, payload, qos):
+        with self.lock:
+            self.stats["published"] += 1
+            for s in self.sessions.values():
+                granted = [q for f, q in s.subs.items() if matches(f, topic)]
+                if not granted:
+                    continue
+                q = min(qos, max(granted))
+                if s.conn is not None:
+                    s.conn.deliver(s, topic, payload, q, dup=False)
+                elif q == 1:
+                    s.queue.append((topic, payload, q))
+                    self.stats["queued"] += 1
+
+
+class Connection(threading.Thread):
+    def __init__(self, broker, sock, peer):
+        super().__init__(daemon=True)
+        self.broker = broker
+        self.sock = sock
+        self.peer = peer
+        self.send_lock = threading.Lock()
+        self.session = None
+
+    def send(self, data):
+        with self.send_lock:
+            try:
+                self.sock.sendall(data)
+            except OSError:
+                pass
+
+    def deliver(self, session, topic, payload, qos, dup):
+        """called with the broker lock held"""
+        body = string(topic)
+        if qos:
+            pid = next(session.ids)
+            session.inflight[pid] = (topic, payload)
+            body += struct.pack(">H", pid)
+        self.send(packet(PUBLISH, (0x08 if dup else 0) | (qos << 1), body + payload))
+        self.broker.stats["delivered"] += 1
+
+    def read_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError
+            data += chunk
+        return data
+
+    def read_packet(self):
+        first = self.read_exact(1)[0]
+        length, shift = 0, 0
+        while True:
+            byte = self.read_exact(1)[0]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        return first >> 4, first & 0x0F, self.read_exact(length) if length else b""
+
+    def run(self):
+        try:
+            while True:
+                kind, flags, body = self.read_packet()
+                if kind == CONNECT:
+                    self.on_connect(body)
+                elif kind == PUBLISH:
+                    self.on_publish(flags, body)
+                elif kind == PUBACK:
+                    with self.broker.lock:
+                        self.session.inflight.pop(struct.unpack(">H", body[:2])[0], None)
+                elif kind == SUBSCRIBE:
+                    self.on_subscribe(body)
+                elif kind == UNSUBSCRIBE:
+                    self.on_unsubscribe(body)
+                elif kind == PINGREQ:
+                    self.send(packet(PINGRESP, 0, b""))
+                elif kind == DISCONNECT:
+                    break
+        except (ConnectionError, OSError, struct.error):
+            pass
+        finally:
+            self.close()
+
+    def on_connect(self, body):
+        _, pos = read_string(body, 0)
+        level, cflags, keepalive = struct.unpack_from(">BBH", body, pos)
+        client_id, pos = read_string(body, pos + 4)
+        clean = bool(cflags & 0x02)
+
+        with self.broker.lock:
+            old = self.broker.sessions.get(client_id)
+            if old is not None and old.conn is not None:
+                old.conn.sock.close()       # a client id is connected once, the newer one wins
+                old.conn = None
+            present = old is not None and not clean and not old.clean
+            session = old if present else Session(client_id, clean)
+            session.clean = clean
+            session.conn = self
+            self.broker.sessions[client_id] = session
+            self.session = session
+            self.broker.stats["connects"] += 1
+
+            self.send(packet(CONNACK, 0, bytes([1 if present else 0, 0])))
+            # what the client never acked goes again first, then what came in while it was away
+            for pid, (topic, payload) in list(session.inflight.items()):
+                del session.inflight[pid]
+                self.deliver(session, topic, payload, 1, dup=True)
+            while session.queue:
+                self.deliver(session, *session.queue.popleft(), dup=False)
+
+        log("%s connected from %s:%d, %s session, keep-alive %d s" %
+            (client_id, self.peer[0], self.peer[1], "resumed" if present else "new", keepalive))
+
+    def on_publish(self, flags, body):
+        qos = (flags >> 1) & 3
+        topic, pos = read_string(body, 0)
+        if qos:
+            pid = body[pos:pos + 2]
+            pos += 2
+            self.send(packet(PUBACK, 0, pid))
+        self.broker.publish(topic, body[pos:], min(qos, 1))
+
+    def on_subscribe(self, body):
+        pid, pos = body[:2], 2
+        granted = bytearray()
+        with self.broker.lock:
+            while pos < len(body):
+                topic, pos = read_string(body, pos)
+                qos = min(body[pos], 1)
+                pos += 1
+                self.session.subs[topic] = qos
+                granted.append(qos)
+        self.send(packet(SUBACK, 0, pid + bytes(granted)))
+
+    def on_unsubscribe(self, body):
+        pid, pos = body[:2], 2
+        with self.broker.lock:
+            while pos < len(body):
+                topic, pos = read_string(body, pos)
+                self.session.subs.pop(topic, None)
+        self.send(packet(UNSUBACK, 0, pid))
+
+    def close(self):
+        self.sock.close()
+        with self.broker.lock:
+            s = self.session
+            if s is None or s.conn is not self:
+                return
+            s.conn = None
+            if s.clean:
+                del self.broker.sessions[s.client_id]
+        log("%s gone, %d unacked, stats %s" % (s.client_id, len(s.inflight), dict(self.broker.stats)))
+
+
+def page_publisher(broker, pages, every):
+    for n, (capcode, text) in enumerate(itertools.cycle(pages)):
+        time.sleep(every)
+        broker.publish("pager/page/%d" % capcode, ("%s #%d" % (text, n)).encode(), 1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--page", action="append", default=[], help="CAPCODE:TEXT published every --every seconds")
+    parser.add_argument("--every", type=float, default=10.0)
+    args = parser.parse_args()
+
+    broker = Broker()
+    pages = [(int(p.split(":", 1)[0]), p.split(":", 1)[1]) for p in args.page]
+    if pages:
+        threading.Thread(target=page_publisher, args=(broker, pages, args.every), daemon=True).start()
+
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind((args.host, args.port))
+    server.listen()
+    log("mqtt broker on %s:%d" % (args.host, args.port))
+    try:
+        while True:
+            sock, peer = server.accept()
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            Connection(broker, sock, peer).start()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
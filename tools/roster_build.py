@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Build the ward roster files the device installs (components/ward_roster), server side.
+
+A full roster is every patient of the ward; a delta takes a device from one version to the next:
+patients added or changed are sent whole, removed ones by id only. Both use the layout
+ward_roster.c reads, so the device only checks CRCs and merges, it never sorts.
+
+The input is CSV with a header line: patient_id,f_name,l_name,last_checkup_date,last_checkup_time
+
+usage:
+    python tools/roster_build.py ward.csv roster.dl --version 7
+    python tools/roster_build.py ward.csv roster.dl --version 8 --base ward_v7.csv --base-version 7
+"""
+
+import argparse
+import csv
+import struct
+import zlib
+
+SECTOR = 512
+MAX_SECTORS = 256                       # WARD_ROSTER_MAX_SECTORS
+ENTRY_BYTES = 8
+ENTRIES_PER_SECTOR = SECTOR // ENTRY_BYTES
+FENCE_SECTORS = MAX_SECTORS * 4 // SECTOR
+ENTRY_START = 1 + FENCE_SECTORS
+RECORD_MAX = 255
+FORMAT = 1
+
+FIELDS = ("patient_id", "f_name", "l_name", "last_checkup_date", "last_checkup_time")
+
+
+def fnv1a(text):
+    h = 2166136261
+    for b in text.encode():
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def record_bytes(patient):
+    rec = b"".join(patient.get(f, "").encode() + b"\0" for f in FIELDS)
+    if len(rec) > RECORD_MAX:
+        raise ValueError("record of %s is over %d bytes" % (patient["patient_id"], RECORD_MAX))
+    return rec
+
+
+def build(records, version, base=None):
+    """records: list of (patient_id, record bytes); base set makes it a delta"""
+    records = sorted(records, key=lambda r: (fnv1a(r[0]), r[0].encode()))
+    if len(records) > MAX_SECTORS * ENTRIES_PER_SECTOR:
+        raise ValueError("%d patients, the device takes %d" % (len(records), MAX_SECTORS * ENTRIES_PER_SECTOR))
+
+    entries = bytearray()
+    blob = bytearray()
+    fence = []
+    for i, (pid, rec) in enumerate(records):
+        h = fnv1a(pid)
+        if i % ENTRIES_PER_SECTOR == 0:
+            fence.append(h)
+        entries += struct.pack("<II", h, (len(blob) << 8) | len(rec))
+        blob += rec
+    if len(blob) >= 1 << 24:
+        raise ValueError("blob over 16 MiB")
+
+    entry_sectors = (len(records) + ENTRIES_PER_SECTOR - 1) // ENTRIES_PER_SECTOR
+    entries += b"\0" * (entry_sectors * SECTOR - len(entries))
+    fence_bytes = struct.pack("<%dI" % MAX_SECTORS, *(fence + [0] * (MAX_SECTORS - len(fence))))
+    blob_off = (ENTRY_START + entry_sectors) * SECTOR
+
+    hdr = (b"RDLT" if base is not None else b"RSTR") + struct.pack(
+        "<HHIIIIIIIII", FORMAT, ENTRY_BYTES, version, base or 0, len(records), entry_sectors, blob_off, len(blob),
+        zlib.crc32(fence_bytes), zlib.crc32(entries), zlib.crc32(blob))
+    hdr += struct.pack("<I", zlib.crc32(hdr))
+    hdr += b"\0" * (SECTOR - len(hdr))
+    return hdr + fence_bytes + bytes(entries) + bytes(blob)
+
+
+def full(patients, version):
+    """patients: dict patient_id -> dict of FIELDS"""
+    return build([(pid, record_bytes(p)) for pid, p in patients.items()], version)
+
+
+def delta(old, new, version, base_version):
+    records = []
+    for pid, p in new.items():
+        if old.get(pid) != p:
+            records.append((pid, b"+" + record_bytes(p)))
+    for pid in old:
+        if pid not in new:
+            records.append((pid, b"-" + pid.encode() + b"\0"))
+    return build(records, version, base_version)
+
+
+def load_csv(path):
+    with open(path, newline="") as f:
+        return {row["patient_id"]: {k: row.get(k, "") for k in FIELDS} for row in csv.DictReader(f)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("csv")
+    parser.add_argument("out")
+    parser.add_argument("--version", type=int, required=True)
+    parser.add_argument("--base", help="CSV of the version the device has, builds a delta against it")
+    parser.add_argument("--base-version", type=int)
+    args = parser.parse_args()
+
+    new = load_csv(args.csv)
+    if args.base:
+        data = delta(load_csv(args.base), new, args.version, args.base_version)
+    else:
+        data = full(new, args.version)
+
+    with open(args.out, "wb") as f:
+        f.write(data)
+    print("%s: %d bytes, %d patients" % (args.out, len(data), len(new)))
+
+
+if __name__ == "__main__":
+    main()